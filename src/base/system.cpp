@@ -15,6 +15,7 @@
 #include <sys/socket.h>
 #endif
 
+#include <atomic>
 #include <chrono>
 
 #if defined(CONF_FAMILY_UNIX)
@@ -34,6 +35,7 @@
 	#include <arpa/inet.h>
 
 	#include <dirent.h>
+	#include <sys/mman.h>
 
 	#if defined(CONF_PLATFORM_MACOSX)
 		#include <Carbon/Carbon.h>
@@ -48,6 +50,7 @@
 	#include <fcntl.h>
 	#include <direct.h>
 	#include <errno.h>
+	#include <io.h>
 	#include <wincrypt.h>
 #else
 	#error NOT IMPLEMENTED
@@ -66,8 +69,31 @@ IOHANDLE io_stdout() { return (IOHANDLE)stdout; }
 IOHANDLE io_stderr() { return (IOHANDLE)stderr; }
 
 static DBG_LOGGER loggers[16];
+static DBG_LOGGER_FINISH logger_finishes[16];
 static int num_loggers = 0;
 
+/* asynchronous logging, a bounded multi producer ring with one writer */
+enum
+{
+	LOG_RING_SIZE = 1024, /* has to be a power of two */
+	LOG_LINE_SIZE = 1024,
+	LOG_FLUSH_INTERVAL = 20, /* ms */
+};
+
+typedef struct
+{
+	std::atomic<unsigned> sequence;
+	char line[LOG_LINE_SIZE];
+} LOG_SLOT;
+
+static LOG_SLOT *log_ring = 0;
+static std::atomic<unsigned> log_write_pos(0);
+static unsigned log_read_pos = 0;
+static std::atomic<int> log_dropped(0);
+static std::atomic<int> log_running(0);
+static void *log_thread = 0;
+static LOCK log_drain_lock = 0;
+
 static NETSTATS network_stats = {0};
 static MEMSTATS memory_stats = {0};
 
@@ -102,9 +128,11 @@ struct NETSOCKET_INTERNAL
 };
 static NETSOCKET_INTERNAL invalid_socket = {NETTYPE_INVALID, -1, -1, -1};
 
-void dbg_logger(DBG_LOGGER logger)
+void dbg_logger(DBG_LOGGER logger, DBG_LOGGER_FINISH finish)
 {
-	loggers[num_loggers++] = logger;
+	loggers[num_loggers] = logger;
+	logger_finishes[num_loggers] = finish;
+	num_loggers++;
 }
 
 void dbg_assert_imp(const char *filename, int line, int test, const char *msg)
@@ -112,6 +140,7 @@ void dbg_assert_imp(const char *filename, int line, int test, const char *msg)
 	if(!test)
 	{
 		dbg_msg("assert", "%s(%d): %s", filename, line, msg);
+		dbg_logger_flush();
 		dbg_break();
 	}
 }
@@ -119,6 +148,10 @@ void dbg_assert_imp(const char *filename, int line, int test, const char *msg)
 static void logger_stdout(const char *line)
 {
 	printf("%s\n", line);
+}
+
+static void logger_stdout_finish()
+{
 	fflush(stdout);
 }
 
@@ -135,27 +168,157 @@ void dbg_break()
 	*((volatile unsigned*)0) = 0x0;
 }
 
-void dbg_msg(const char *sys, const char *fmt, ...)
+static void dbg_msg_format(char *str, int size, const char *sys, const char *fmt, va_list args)
 {
-	va_list args;
-	char str[1024*4];
-	char *msg;
-	int i, len;
+	int len;
 
-	str_format(str, sizeof(str), "[%08x][%s]: ", (int)time(0), sys);
+	str_format(str, size, "[%08x][%s]: ", (int)time(0), sys);
 	len = strlen(str);
-	msg = (char *)str + len;
 
-	va_start(args, fmt);
 #if defined(CONF_FAMILY_WINDOWS)
-	_vsnprintf(msg, sizeof(str)-len, fmt, args);
+	_vsnprintf(str+len, size-len, fmt, args);
 #else
-	vsnprintf(msg, sizeof(str)-len, fmt, args);
+	vsnprintf(str+len, size-len, fmt, args);
 #endif
+	str[size-1] = 0;
+}
+
+/* reserves a slot of the ring, returns 0 if the ring is full */
+static LOG_SLOT *log_ring_reserve(unsigned *pos)
+{
+	unsigned cur = log_write_pos.load(std::memory_order_relaxed);
+	while(1)
+	{
+		LOG_SLOT *slot = &log_ring[cur&(LOG_RING_SIZE-1)];
+		int dif = (int)(slot->sequence.load(std::memory_order_acquire) - cur);
+		if(dif == 0)
+		{
+			if(log_write_pos.compare_exchange_weak(cur, cur+1, std::memory_order_relaxed))
+			{
+				*pos = cur;
+				return slot;
+			}
+		}
+		else if(dif < 0)
+			return 0;
+		else
+			cur = log_write_pos.load(std::memory_order_relaxed);
+	}
+}
+
+void dbg_msg(const char *sys, const char *fmt, ...)
+{
+	va_list args;
+	int i;
+
+	if(log_running.load(std::memory_order_acquire))
+	{
+		unsigned pos;
+		LOG_SLOT *slot = log_ring_reserve(&pos);
+		if(!slot)
+		{
+			/* never block the caller */
+			log_dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		va_start(args, fmt);
+		dbg_msg_format(slot->line, sizeof(slot->line), sys, fmt, args);
+		va_end(args);
+
+		slot->sequence.store(pos+1, std::memory_order_release);
+		return;
+	}
+
+	char str[1024*4];
+	va_start(args, fmt);
+	dbg_msg_format(str, sizeof(str), sys, fmt, args);
 	va_end(args);
 
 	for(i = 0; i < num_loggers; i++)
+	{
 		loggers[i](str);
+		if(logger_finishes[i])
+			logger_finishes[i]();
+	}
+}
+
+void dbg_logger_flush()
+{
+	int i, num_lines = 0, dropped;
+
+	if(!log_ring)
+		return;
+
+	lock_wait(log_drain_lock);
+	while(1)
+	{
+		LOG_SLOT *slot = &log_ring[log_read_pos&(LOG_RING_SIZE-1)];
+		if(slot->sequence.load(std::memory_order_acquire) != log_read_pos+1)
+			break;
+
+		for(i = 0; i < num_loggers; i++)
+			loggers[i](slot->line);
+		slot->sequence.store(log_read_pos+LOG_RING_SIZE, std::memory_order_release);
+		log_read_pos++;
+		num_lines++;
+	}
+
+	dropped = log_dropped.exchange(0, std::memory_order_relaxed);
+	if(dropped)
+	{
+		char str[128];
+		str_format(str, sizeof(str), "[%08x][logger]: dropped %d lines, the log ring was full", (int)time(0), dropped);
+		for(i = 0; i < num_loggers; i++)
+			loggers[i](str);
+		num_lines++;
+	}
+
+	if(num_lines)
+	{
+		for(i = 0; i < num_loggers; i++)
+			if(logger_finishes[i])
+				logger_finishes[i]();
+	}
+	lock_unlock(log_drain_lock);
+}
+
+static void log_thread_func(void *user)
+{
+	while(log_running.load(std::memory_order_acquire))
+	{
+		dbg_logger_flush();
+		thread_sleep(LOG_FLUSH_INTERVAL);
+	}
+}
+
+void dbg_logger_async(int enable)
+{
+	unsigned i;
+
+	if(enable && !log_running.load())
+	{
+		if(!log_ring)
+		{
+			log_ring = new LOG_SLOT[LOG_RING_SIZE];
+			for(i = 0; i < LOG_RING_SIZE; i++)
+				log_ring[i].sequence.store(i, std::memory_order_relaxed);
+			log_write_pos.store(0);
+			log_read_pos = 0;
+			log_drain_lock = lock_create();
+		}
+		log_running.store(1, std::memory_order_release);
+		log_thread = thread_init(log_thread_func, 0);
+	}
+	else if(!enable && log_running.load())
+	{
+		log_running.store(0, std::memory_order_release);
+		thread_wait(log_thread);
+		log_thread = 0;
+
+		/* lines that were reserved before the switch */
+		dbg_logger_flush();
+	}
 }
 
 
@@ -164,16 +327,20 @@ static void logger_file(const char *line)
 {
 	io_write(logfile, line, strlen(line));
 	io_write_newline(logfile);
+}
+
+static void logger_file_finish()
+{
 	io_flush(logfile);
 }
 
-void dbg_logger_stdout() { dbg_logger(logger_stdout); }
+void dbg_logger_stdout() { dbg_logger(logger_stdout, logger_stdout_finish); }
 void dbg_logger_debugger() { dbg_logger(logger_debugger); }
 void dbg_logger_file(const char *filename)
 {
 	logfile = io_open(filename, IOFLAG_WRITE);
 	if(logfile)
-		dbg_logger(logger_file);
+		dbg_logger(logger_file, logger_file_finish);
 	else
 		dbg_msg("dbg/logger", "failed to open '%s' for logging", filename);
 
@@ -382,6 +549,38 @@ long int io_length(IOHANDLE io)
 	return length;
 }
 
+void *io_map(IOHANDLE io, unsigned *size)
+{
+	long int length = io_length(io);
+	if(length <= 0)
+		return 0;
+#if defined(CONF_FAMILY_WINDOWS)
+	HANDLE file = (HANDLE)_get_osfhandle(_fileno((FILE*)io));
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if(!mapping)
+		return 0;
+	void *data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	CloseHandle(mapping);
+	if(!data)
+		return 0;
+#else
+	void *data = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno((FILE*)io), 0);
+	if(data == MAP_FAILED)
+		return 0;
+#endif
+	*size = length;
+	return data;
+}
+
+void io_unmap(void *data, unsigned size)
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	UnmapViewOfFile(data);
+#else
+	munmap(data, size);
+#endif
+}
+
 unsigned io_write(IOHANDLE io, const void *buffer, unsigned size)
 {
 	return fwrite(buffer, 1, size, (FILE*)io);
@@ -1607,6 +1806,44 @@ int fs_is_dir(const char *path)
 #endif
 }
 
+#if defined(CONF_FAMILY_WINDOWS)
+static time_t filetime_to_unixtime(LPFILETIME filetime)
+{
+	time_t t;
+	ULARGE_INTEGER li;
+	li.LowPart = filetime->dwLowDateTime;
+	li.HighPart = filetime->dwHighDateTime;
+
+	li.QuadPart /= 10000000; // 100ns to 1s
+	li.QuadPart -= 11644473600LL; // Windows epoch is in the past
+
+	t = li.QuadPart;
+	return t == (time_t)li.QuadPart ? t : (time_t)-1;
+}
+#endif
+
+int fs_file_time(const char *name, time_t *created, time_t *modified)
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	WIN32_FIND_DATA finddata;
+	HANDLE handle = FindFirstFileA(name, &finddata);
+	if(handle == INVALID_HANDLE_VALUE)
+		return 1;
+
+	*created = filetime_to_unixtime(&finddata.ftCreationTime);
+	*modified = filetime_to_unixtime(&finddata.ftLastWriteTime);
+	FindClose(handle);
+#else
+	struct stat sb;
+	if(stat(name, &sb))
+		return 1;
+
+	*created = sb.st_ctime;
+	*modified = sb.st_mtime;
+#endif
+	return 0;
+}
+
 int fs_chdir(const char *path)
 {
 	if(fs_is_dir(path))
@@ -10,6 +10,7 @@
 
 #include "detect.h"
 #include <stdlib.h>
+#include <time.h>
 
 #ifdef CONF_PLATFORM_LINUX
 #include <netinet/in.h>
@@ -306,6 +307,35 @@ long int io_tell(IOHANDLE io);
 */
 long int io_length(IOHANDLE io);
 
+/*
+	Function: io_map
+		Maps a whole file into memory. The pages are copy on write,
+		changes to them are private and never reach the file.
+
+	Parameters:
+		io - Handle to the file.
+		size - Pointer to the length of the mapping, set on success.
+
+	Returns:
+		Pointer to the mapped file, 0 if the file could not be mapped.
+
+	Remarks:
+		- The mapping stays valid after the file is closed, but the
+		  file must not be truncated while it is mapped. Replace it
+		  with a rename instead.
+*/
+void *io_map(IOHANDLE io, unsigned *size);
+
+/*
+	Function: io_unmap
+		Releases a mapping from io_map.
+
+	Parameters:
+		data - Pointer returned by io_map.
+		size - Length of the mapping.
+*/
+void io_unmap(void *data, unsigned size);
+
 /*
 	Function: io_close
 		Closes a file.
@@ -1233,6 +1263,23 @@ int fs_storage_path(const char *appname, char *path, int max);
 */
 int fs_is_dir(const char *path);
 
+/*
+	Function: fs_file_time
+		Gets the creation and the last modification date of a file.
+
+	Parameters:
+		name - The filename.
+		created - Pointer to time_t
+		modified - Pointer to time_t
+
+	Returns:
+		0 on success non-zero on failure
+
+	Remarks:
+		- Returned time is in seconds since UNIX Epoch
+*/
+int fs_file_time(const char *name, time_t *created, time_t *modified);
+
 /*
 	Function: fs_chdir
 		Changes current working directory
@@ -1345,12 +1392,33 @@ void swap_endian(void *data, unsigned elem_size, unsigned num);
 
 
 typedef void (*DBG_LOGGER)(const char *line);
-void dbg_logger(DBG_LOGGER logger);
+typedef void (*DBG_LOGGER_FINISH)();
+void dbg_logger(DBG_LOGGER logger, DBG_LOGGER_FINISH finish = 0);
 
 void dbg_logger_stdout();
 void dbg_logger_debugger();
 void dbg_logger_file(const char *filename);
 
+/*
+	Function: dbg_logger_async
+		Moves the loggers to a background thread. dbg_msg then only
+		formats the line into a ring buffer, the thread writes the
+		lines in batches and flushes the loggers after every batch.
+		Lines that don't fit into the ring are dropped and counted.
+
+	Parameters:
+		enable - Start (1) or stop (0) the background thread. Stopping
+			writes all pending lines before returning.
+*/
+void dbg_logger_async(int enable);
+
+/*
+	Function: dbg_logger_flush
+		Writes all pending lines of the asynchronous logger from the
+		calling thread.
+*/
+void dbg_logger_flush();
+
 typedef struct
 {
 	int allocated;
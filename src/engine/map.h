@@ -25,10 +25,15 @@ class IEngineMap : public IMap
 	MACRO_INTERFACE("enginemap", 0)
 public:
 	virtual bool Load(const char *pMapName) = 0;
+	// takes over pData, a whole map file allocated with mem_alloc
+	virtual bool LoadMemory(const char *pMapName, unsigned char *pData, unsigned Size) = 0;
 	virtual bool IsLoaded() = 0;
 	virtual void Unload() = 0;
 	virtual SHA256_DIGEST Sha256() = 0;
 	virtual unsigned Crc() = 0;
+	// the whole map file while it is loaded, 0 if it was read and not mapped
+	virtual const unsigned char *File() = 0;
+	virtual unsigned FileSize() = 0;
 };
 
 extern IEngineMap *CreateEngineMap();
@@ -58,37 +58,103 @@ public:
 	template<class T>
 	int SendPackMsg(T *pMsg, int Flags, int ClientID)
 	{
-		int result = 0;
+		if(ClientID == -1)
+			return SendPackMsgAll(pMsg, Flags);
+
 		T tmp;
-		if (ClientID == -1)
+		mem_copy(&tmp, pMsg, sizeof(T));
+		if(!TranslateMsg(&tmp, ClientID))
+			return 0;
+		return SendPackMsgOne(&tmp, Flags, ClientID);
+	}
+
+	// the payload is the same for every client, pack it once
+	template<class T>
+	int SendPackMsgAll(T *pMsg, int Flags)
+	{
+		return SendPackMsgOne(pMsg, Flags, -1);
+	}
+
+	int SendPackMsgAll(CNetMsg_Sv_Emoticon *pMsg, int Flags) { return SendPackMsgVariants(pMsg, Flags); }
+	int SendPackMsgAll(CNetMsg_Sv_KillMsg *pMsg, int Flags) { return SendPackMsgVariants(pMsg, Flags); }
+	int SendPackMsgAll(CNetMsg_Sv_Chat *pMsg, int Flags)
+	{
+		// server messages don't name a client
+		if(pMsg->m_ClientID < 0)
+			return SendPackMsgOne(pMsg, Flags, -1);
+		return SendPackMsgVariants(pMsg, Flags);
+	}
+
+	/*
+		Function: SendPackMsgVariants
+			Sends a message that gets translated to the id map of every
+			client. Clients that end up with the same translated message
+			share one packed copy, so it is only packed once per variant.
+	*/
+	template<class T>
+	int SendPackMsgVariants(T *pMsg, int Flags)
+	{
+		// record the untranslated message once
+		if(!(Flags&MSGFLAG_NORECORD))
+			SendPackMsgOne(pMsg, Flags|MSGFLAG_NOSEND, -1);
+		if(Flags&MSGFLAG_NOSEND)
+			return 0;
+
+		T aVariants[MAX_PLAYERS];
+		int aClientVariant[MAX_PLAYERS];
+		int NumVariants = 0;
+		for(int i = 0; i < MAX_PLAYERS; i++)
 		{
-			for(int i = 0; i < MAX_CLIENTS; i++)
-				if(ClientIngame(i))
-				{
-					mem_copy(&tmp, pMsg, sizeof(T));
-					result = SendPackMsgTranslate(&tmp, Flags, i);
-				}
-		} else {
+			aClientVariant[i] = -1;
+			if(!ClientIngame(i))
+				continue;
+
+			T tmp;
 			mem_copy(&tmp, pMsg, sizeof(T));
-			result = SendPackMsgTranslate(&tmp, Flags, ClientID);
+			if(!TranslateMsg(&tmp, i))
+				continue;
+
+			int Variant = 0;
+			while(Variant < NumVariants && mem_comp(&aVariants[Variant], &tmp, sizeof(T)) != 0)
+				Variant++;
+			if(Variant == NumVariants)
+				mem_copy(&aVariants[NumVariants++], &tmp, sizeof(T));
+			aClientVariant[i] = Variant;
+		}
+
+		int Result = 0;
+		for(int Variant = 0; Variant < NumVariants; Variant++)
+		{
+			CMsgPacker Packer(pMsg->MsgID());
+			if(aVariants[Variant].Pack(&Packer))
+				return -1;
+			for(int i = 0; i < MAX_PLAYERS; i++)
+				if(aClientVariant[i] == Variant)
+					Result = SendMsg(&Packer, Flags|MSGFLAG_NORECORD, i);
 		}
-		return result;
+		return Result;
 	}
 
+	/*
+		Function: TranslateMsg
+			Maps the client ids of a message to the id map of the
+			receiving client. Returns false if the client must not get
+			the message.
+	*/
 	template<class T>
-	int SendPackMsgTranslate(T *pMsg, int Flags, int ClientID)
+	bool TranslateMsg(T *pMsg, int ClientID)
 	{
-		return SendPackMsgOne(pMsg, Flags, ClientID);
+		return true;
 	}
 
-	int SendPackMsgTranslate(CNetMsg_Sv_Emoticon *pMsg, int Flags, int ClientID)
+	bool TranslateMsg(CNetMsg_Sv_Emoticon *pMsg, int ClientID)
 	{
-		return Translate(pMsg->m_ClientID, ClientID) && SendPackMsgOne(pMsg, Flags, ClientID);
+		return Translate(pMsg->m_ClientID, ClientID);
 	}
 
 	char msgbuf[1000];
 
-	int SendPackMsgTranslate(CNetMsg_Sv_Chat *pMsg, int Flags, int ClientID)
+	bool TranslateMsg(CNetMsg_Sv_Chat *pMsg, int ClientID)
 	{
 		if (pMsg->m_ClientID >= 0 && !Translate(pMsg->m_ClientID, ClientID))
 		{
@@ -96,14 +162,14 @@ public:
 			pMsg->m_pMessage = msgbuf;
 			pMsg->m_ClientID = VANILLA_MAX_CLIENTS - 1;
 		}
-		return SendPackMsgOne(pMsg, Flags, ClientID);
+		return true;
 	}
 
-	int SendPackMsgTranslate(CNetMsg_Sv_KillMsg *pMsg, int Flags, int ClientID)
+	bool TranslateMsg(CNetMsg_Sv_KillMsg *pMsg, int ClientID)
 	{
-		if (!Translate(pMsg->m_Victim, ClientID)) return 0;
+		if (!Translate(pMsg->m_Victim, ClientID)) return false;
 		if (!Translate(pMsg->m_Killer, ClientID)) pMsg->m_Killer = pMsg->m_Victim;
-		return SendPackMsgOne(pMsg, Flags, ClientID);
+		return true;
 	}
 
 	template<class T>
@@ -177,6 +243,15 @@ public:
 	virtual void RegenerateMap() = 0;
 
 	virtual bool IsActive() = 0;
+
+	enum
+	{
+		OVERLOAD_NONE=0,
+		OVERLOAD_SNAPRATE, // far clients get less snapshots
+		OVERLOAD_BOTS, // bots think every other tick
+		NUM_OVERLOAD_LEVELS
+	};
+	virtual int OverloadLevel() const = 0;
 };
 
 class IGameServer : public IInterface
@@ -187,6 +262,8 @@ public:
 	virtual void OnInit() = 0;
 	virtual void OnConsoleInit() = 0;
 	virtual void OnShutdown() = 0;
+	// the engine loaded another map, the players stay and reenter
+	virtual void OnMapChange() = 0;
 
 	virtual void OnTick() = 0;
 	virtual void OnPreSnap() = 0;
@@ -1,3 +1,4 @@
+#include <engine/engine.h>
 #include <engine/server/mapgen.h>
 #include <engine/shared/config.h>
 #include <engine/shared/linereader.h>
@@ -10,30 +11,35 @@
 
 #include <base/color.h>
 
-CMapGen::CMapGen(IStorage *pStorage, IConsole* pConsole) :
+#include <zlib.h>
+
+// the doodads of jungle_doodads, tried in this order at every position
+static const CMapGen::CDoodadStamp s_aJungleDoodads[] = {
+	{6, 9, 3},
+};
+
+std::mutex CMapGen::ms_AssetLock;
+std::map<std::string, std::shared_ptr<const CMapGen::CCachedImage>> CMapGen::ms_Images;
+std::map<std::string, std::shared_ptr<const CMapGen::CCachedRules>> CMapGen::ms_Rules;
+
+CMapGen::CMapGen(IStorage *pStorage, IConsole* pConsole, IEngine *pEngine) :
 	m_pStorage(pStorage),
 	m_pConsole(pConsole),
-	m_pBackGroundTiles(0),
-	m_pGameTiles(0),
-	m_pDoodadsTiles(0),
-	m_pHookableTiles(0),
-	m_pUnhookableTiles(0)
+	m_MemoryUsage(0),
+	m_PeakMemoryUsage(0)
 {
-	
+	// the embedded image is compressed in parallel, the tile layers as they are made
+	m_DataFile.SetCompressionJobs(pEngine);
 }
 
 CMapGen::~CMapGen()
 {
-	if(m_pBackGroundTiles)
-		delete[] m_pBackGroundTiles;
-	if(m_pGameTiles)
-		delete[] m_pGameTiles;
-	if(m_pDoodadsTiles)
-		delete[] m_pDoodadsTiles;
-	if(m_pHookableTiles)
-		delete[] m_pHookableTiles;
-	if(m_pUnhookableTiles)
-		delete[] m_pUnhookableTiles;
+}
+
+void CMapGen::UseMemory(int64 Bytes)
+{
+	m_MemoryUsage += Bytes;
+	m_PeakMemoryUsage = maximum(m_PeakMemoryUsage, m_MemoryUsage);
 }
 
 void CMapGen::InitQuad(CQuad* pQuad)
@@ -109,7 +115,7 @@ void CMapGen::AddImageQuad(const char* pName, int ImageID, int GridX, int GridY,
 	Item.m_Image = ImageID;
 	Item.m_NumQuads = aQuads.size();
 	StrToInts(Item.m_aName, sizeof(Item.m_aName)/sizeof(int), pName);
-	Item.m_Data = m_DataFile.AddDataSwapped(aQuads.size()*sizeof(CQuad), aQuads.base_ptr());
+	Item.m_Data = m_DataFile.AddDataSwapped(aQuads.size()*sizeof(CQuad), aQuads.base_ptr(), g_Config.m_SvMapgenCompression);
 	
 	m_DataFile.AddItem(MAPITEMTYPE_LAYER, m_NumLayers++, sizeof(Item), &Item);
 }
@@ -120,7 +126,10 @@ void CMapGen::InitState()
 	m_NumLayers = 0;
 	m_NumImages = 0;
 	m_NumEnvs = 0;
-	m_lConfigs.clear();
+	m_vpRules.clear();
+	m_vpConfigs.clear();
+	m_MemoryUsage = 0;
+	m_PeakMemoryUsage = 0;
 }
 
 int CMapGen::LoadPNG(CImageInfo *pImg, const char *pFilename)
@@ -177,52 +186,103 @@ void FreePNG(CImageInfo *pImg)
 	pImg->m_pData = nullptr;
 }
 
-int CMapGen::AddEmbeddedImage(const char* pImageName, int Width, int Height)
+std::shared_ptr<const CMapGen::CCachedImage> CMapGen::GetImage(const char *pImageName)
 {
-	CImageInfo img;
-	CImageInfo *pImg = &img;
+	char aPath[512];
+	str_format(aPath, sizeof(aPath), "data/mapgen/%s.png", pImageName);
+
+	char aCompleteFilename[512];
+	IOHANDLE File = m_pStorage->OpenFile(aPath, IOFLAG_READ, IStorage::TYPE_ALL, aCompleteFilename, sizeof(aCompleteFilename));
+	if(!File)
+	{
+		dbg_msg("game/png", "failed to open file. filename='%s'", aPath);
+		return nullptr;
+	}
+	io_close(File);
+
+	time_t Created;
+	time_t Modified = 0;
+	fs_file_time(aCompleteFilename, &Created, &Modified);
+
+	std::lock_guard<std::mutex> Lock(ms_AssetLock);
+	auto Entry = ms_Images.find(aPath);
+	std::shared_ptr<const CCachedImage> pOld = Entry != ms_Images.end() ? Entry->second : nullptr;
+	if(pOld && pOld->m_Modified == Modified && pOld->m_CompressionLevel == g_Config.m_SvMapgenCompression)
+		return pOld;
+
+	// entries are never changed, runs that still hold the old one keep it
+	std::shared_ptr<CCachedImage> pImage = std::make_shared<CCachedImage>();
+	pImage->m_Modified = Modified;
+	if(pOld && pOld->m_Modified == Modified)
+	{
+		// only the compression level changed
+		pImage->m_Width = pOld->m_Width;
+		pImage->m_Height = pOld->m_Height;
+		pImage->m_vRGBA = pOld->m_vRGBA;
+	}
+	else
+	{
+		CImageInfo Img;
+		if(!LoadPNG(&Img, aPath))
+			return nullptr;
+
+		pImage->m_Width = Img.m_Width;
+		pImage->m_Height = Img.m_Height;
+		pImage->m_vRGBA.resize((size_t)Img.m_Width * Img.m_Height * 4);
+		unsigned char *pDataRGBA = pImage->m_vRGBA.data();
+		unsigned char *pData = (unsigned char *)Img.m_pData;
+		if(Img.m_Format == CImageInfo::FORMAT_RGB)
+		{
+			// Convert to RGBA
+			for(int i = 0; i < Img.m_Width * Img.m_Height; i++)
+			{
+				pDataRGBA[i * 4] = pData[i * 3];
+				pDataRGBA[i * 4 + 1] = pData[i * 3 + 1];
+				pDataRGBA[i * 4 + 2] = pData[i * 3 + 2];
+				pDataRGBA[i * 4 + 3] = 255;
+			}
+		}
+		else
+			mem_copy(pDataRGBA, pData, pImage->m_vRGBA.size());
+		FreePNG(&Img);
+	}
+
+	// the same compress2 call as CDataFileWriter::AddData, the map does not change
+	pImage->m_CompressionLevel = g_Config.m_SvMapgenCompression;
+	uLongf CompressedSize = compressBound(pImage->m_vRGBA.size());
+	pImage->m_vCompressed.resize(CompressedSize);
+	int Result = compress2(pImage->m_vCompressed.data(), &CompressedSize, pImage->m_vRGBA.data(), pImage->m_vRGBA.size(), pImage->m_CompressionLevel);
+	if(Result != Z_OK)
+	{
+		dbg_msg("mapgen", "compression error %d", Result);
+		return nullptr;
+	}
+	pImage->m_vCompressed.resize(CompressedSize);
 
-	char aBuf[512];
-	str_format(aBuf, sizeof(aBuf), "data/mapgen/%s.png", pImageName);
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "loaded %s", aPath);
+	Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "mapgen", aBuf);
 
-	if (!LoadPNG(pImg, aBuf)) {
+	ms_Images[aPath] = pImage;
+	return pImage;
+}
+
+int CMapGen::AddEmbeddedImage(const char* pImageName, int Width, int Height)
+{
+	std::shared_ptr<const CCachedImage> pImage = GetImage(pImageName);
+	if(!pImage)
 		return -1;
-	}
 
 	CMapItemImage Item;
 	Item.m_Version = 1;
 
 	Item.m_External = 0;
-	Item.m_Width = Width;
-	Item.m_Height = Height;
 	Item.m_ImageName = m_DataFile.AddData(str_length((char*)pImageName)+1, (char*)pImageName);
-
-	Item.m_Width = pImg->m_Width;
-	Item.m_Height = pImg->m_Height;
-
-	if(pImg->m_Format == CImageInfo::FORMAT_RGB)
-	{
-		// Convert to RGBA
-		unsigned char *pDataRGBA = (unsigned char *)malloc((size_t)Item.m_Width * Item.m_Height * 4);
-		unsigned char *pDataRGB = (unsigned char *)pImg->m_pData;
-		for(int i = 0; i < Item.m_Width * Item.m_Height; i++)
-		{
-			pDataRGBA[i * 4] = pDataRGB[i * 3];
-			pDataRGBA[i * 4 + 1] = pDataRGB[i * 3 + 1];
-			pDataRGBA[i * 4 + 2] = pDataRGB[i * 3 + 2];
-			pDataRGBA[i * 4 + 3] = 255;
-		}
-		Item.m_ImageData = m_DataFile.AddData(Item.m_Width * Item.m_Height * 4, pDataRGBA);
-		free(pDataRGBA);
-	}
-	else
-	{
-		Item.m_ImageData = m_DataFile.AddData(Item.m_Width * Item.m_Height * 4, pImg->m_pData);
-	}
+	Item.m_Width = pImage->m_Width;
+	Item.m_Height = pImage->m_Height;
+	Item.m_ImageData = m_DataFile.AddCompressedData(pImage->m_vRGBA.size(), pImage->m_vCompressed.data(), pImage->m_vCompressed.size());
 	m_DataFile.AddItem(MAPITEMTYPE_IMAGE, m_NumImages++, sizeof(Item), &Item);
 
-	FreePNG(pImg);
-
 	return m_NumImages-1;
 }
 
@@ -261,242 +321,239 @@ void CMapGen::GenerateGameLayer()
 	StrToInts(Item.m_aName, sizeof(Item.m_aName)/sizeof(int), "Game");
 
 	// create tiles
-	m_pGameTiles = new CTile[Width*Height];
+	m_vGameTiles.assign((size_t)Width*Height, CTile());
+	UseMemory((int64)m_vGameTiles.size()*sizeof(CTile));
+	CTile *pGameTiles = m_vGameTiles.data();
 	
 	// fiil tiles to solid
-	for(int x = 0;x < Width; x ++)
-	{
-		for(int y = 0;y < Height; y ++)
-		{
-			m_pGameTiles[y*Width+x].m_Index = TILE_SOLID;
-			m_pGameTiles[y*Width+x].m_Flags = 0;
-			m_pGameTiles[y*Width+x].m_Reserved = 0;
-			m_pGameTiles[y*Width+x].m_Skip = 0;
-		}
-	}
+	for(int i = 0; i < Width*Height; i++)
+		pGameTiles[i].m_Index = TILE_SOLID;
 	
 	struct osn_context *ctx;
 
 	open_simplex_noise(random_int(40000, 55734), &ctx);
 	// noise create nohook tiles
-	for(int x = 0;x < Width; x ++)
+	for(int y = 1; y < Height-1; y++)
 	{
-		for(int y = 0;y < Height; y ++)
+		for(int x = 1; x < Width-1; x++)
 		{
-			if(x < 1 || x > Width-2 || y < 1 || y > Height-2)
-			{
-				continue;
-			}
 			double value = open_simplex_noise2(ctx, (double) x/24, (double) y/24) * 0.5 + 0.5;
-			if(value < 0.2f && m_pGameTiles[y*Width+x].m_Index == TILE_SOLID)
+			if(value < 0.2f && pGameTiles[y*Width+x].m_Index == TILE_SOLID)
 			{
-				m_pGameTiles[y*Width+x].m_Index = TILE_NOHOOK;
+				pGameTiles[y*Width+x].m_Index = TILE_NOHOOK;
 			}
 		}
 	}
+	open_simplex_noise_free(ctx);
 
 	// noise create air tiles
 	open_simplex_noise(random_int(100000, 107374), &ctx);
-	for(int x = 0;x < Width; x ++)
+	for(int y = 0; y < Height; y++)
 	{
-		for(int y = 0;y < Height; y ++)
+		for(int x = 0; x < Width; x++)
 		{
 			double value = open_simplex_noise2(ctx, (double) x/16, (double) y/16) * 0.5 + 0.5;
-			if(value < 0.5f && m_pGameTiles[y*Width+x].m_Index == TILE_SOLID)
+			if(value < 0.5f && pGameTiles[y*Width+x].m_Index == TILE_SOLID)
 			{
-				m_pGameTiles[y*Width+x].m_Index = TILE_AIR;
+				pGameTiles[y*Width+x].m_Index = TILE_AIR;
 			}
 		}
 	}
-	
+	open_simplex_noise_free(ctx);
 
 	// create border
-	for(int x = 0;x < Width; x ++)
+	for(int y = 0; y < Height; y++)
 	{
-		for(int y = 0;y < Height; y ++)
+		for(int x = 0; x < Width; x++)
 		{
 			if(x <= 3 || x >= Width-4 || y <= 3 || y >= Height-4)
 			{
-				m_pGameTiles[y*Width+x].m_Index = TILE_SOLID;
+				pGameTiles[y*Width+x].m_Index = TILE_SOLID;
 			}
 		}
 	}
 
 	// CloseMap
-	CAirTile* TileList = new CAirTile[Width*Height];
-	array<CAirTile*> AirList;
-	array<CArea*> AreaList;
+	ConnectAirAreas(pGameTiles, Width, Height);
+
+	// one part, the layer is there as a whole anyway
+	m_DataFile.BeginData(g_Config.m_SvMapgenCompression);
+	m_DataFile.AddDataPart(pGameTiles, Width*Height*sizeof(CTile));
+	AddGameTile(m_DataFile.EndData());
+	
+	m_DataFile.AddItem(MAPITEMTYPE_GROUP, m_NumGroups++, sizeof(Item), &Item);
+}
 
-	for(int y = 0;y < Height;y ++)
+// union-find root with path halving
+int CMapGen::FindRoot(std::vector<CAirRun> &vRuns, int Run)
+{
+	while(vRuns[Run].m_Area != Run)
 	{
-		for(int x = 0;x < Width;x ++)
-		{
-			TileList[y*Width+x] = *(new CAirTile(x, y));
-			if(m_pGameTiles[y*Width+x].m_Index == TILE_AIR)
-				AirList.add(new CAirTile(x, y));
-		}
+		vRuns[Run].m_Area = vRuns[vRuns[Run].m_Area].m_Area;
+		Run = vRuns[Run].m_Area;
 	}
+	return Run;
+}
 
-	while (AirList.size() > 0)
+int CMapGen::CAirRuns::AreaAt(int x, int y) const
+{
+	// the last run of the row that starts at or before x
+	int Low = m_vRowStart[y];
+	int High = m_vRowStart[y+1];
+	while(Low < High)
 	{
-		if(AirList.size() == 1)
-		{
-			CArea area;
-			area.m_Tiles.add(*AirList[0]);
-			AreaList.add(&area);
-			break;
-		}else
+		int Mid = (Low+High)/2;
+		if(m_vRuns[Mid].m_X0 <= x)
+			Low = Mid+1;
+		else
+			High = Mid;
+	}
+	if(Low == m_vRowStart[y] || m_vRuns[Low-1].m_X1 <= x)
+		return -1;
+	return m_vRuns[Low-1].m_Area;
+}
+
+void CMapGen::ConnectAirAreas(CTile *pTiles, int Width, int Height)
+{
+	// collect the air runs row by row, runs that touch one of the row
+	// above are merged. The smaller run stays root, so the roots are in
+	// scan order.
+	CAirRuns Runs;
+	std::vector<CAirRun> &vRuns = Runs.m_vRuns;
+	Runs.m_vRowStart.resize(Height+1);
+	for(int y = 0; y < Height; y++)
+	{
+		Runs.m_vRowStart[y] = vRuns.size();
+		int Above = y > 0 ? Runs.m_vRowStart[y-1] : 0;
+		int AboveEnd = Runs.m_vRowStart[y];
+		const CTile *pRow = &pTiles[y*Width];
+		for(int x = 0; x < Width; )
 		{
-			CArea *area = new CArea();
-			area->m_Tiles.add(*AirList[0]);
-			for(int i = 0; i < area->m_Tiles.size();i ++)
+			if(pRow[x].m_Index != TILE_AIR)
 			{
-				int x = area->m_Tiles[i].m_x;
-				int y = area->m_Tiles[i].m_y;
-				TileList[y*Width+x].m_IsVisited = true;
-				if(m_pGameTiles[y*Width+x+1].m_Index == TILE_AIR && TileList[y*Width+x+1].m_IsVisited == false)
-				{
-					TileList[y*Width+x+1].m_IsVisited = true;
-					area->m_Tiles.add(TileList[y*Width+x+1]);
-				}
-				if(m_pGameTiles[y*Width+x-1].m_Index == TILE_AIR && TileList[y*Width+x-1].m_IsVisited == false)
-				{
-					TileList[y*Width+x-1].m_IsVisited = true;
-					area->m_Tiles.add(TileList[y*Width+x-1]);
-				}
-				if(m_pGameTiles[(y-1)*Width+x].m_Index == TILE_AIR && TileList[(y-1)*Width+x].m_IsVisited == false)
-				{
-					TileList[(y-1)*Width+x].m_IsVisited = true;
-					area->m_Tiles.add(TileList[(y-1)*Width+x]);
-				}
-				if(m_pGameTiles[(y+1)*Width+x].m_Index == TILE_AIR && TileList[(y+1)*Width+x].m_IsVisited == false)
-				{
-					TileList[(y-1)*Width+x].m_IsVisited = true;
-					area->m_Tiles.add(TileList[(y+1)*Width+x]);
-				}
+				x++;
+				continue;
 			}
-			for(int i = 0;i < area->m_Tiles.size();i++)
+
+			CAirRun Run;
+			Run.m_X0 = x;
+			while(x < Width && pRow[x].m_Index == TILE_AIR)
+				x++;
+			Run.m_X1 = x;
+			Run.m_Area = vRuns.size();
+			vRuns.push_back(Run);
+
+			// the runs above are sorted, skip the ones left of this one
+			while(Above < AboveEnd && vRuns[Above].m_X1 <= Run.m_X0)
+				Above++;
+			for(int i = Above; i < AboveEnd && vRuns[i].m_X0 < Run.m_X1; i++)
 			{
-				CAirTile pTile = area->m_Tiles[i];
-				for(int j = 0;j < AirList.size();j++)
-				{
-					CAirTile *pAirTile = AirList[j];
-					if(pTile.m_x == pAirTile->m_x && pTile.m_y == pAirTile->m_y)
-					{
-						AirList.remove_index(j);
-						break;
-					}
-				}
-		
+				int Root = FindRoot(vRuns, vRuns.size()-1);
+				int RootAbove = FindRoot(vRuns, i);
+				vRuns[maximum(Root, RootAbove)].m_Area = minimum(Root, RootAbove);
 			}
-			AreaList.add(area);
 		}
 	}
-
-	dbg_msg("mapgen", "game tiles clear area to 1", AreaList.size());
-	while (AreaList.size() > 1)
+	Runs.m_vRowStart[Height] = vRuns.size();
+
+	// number the areas in scan order and count their tiles, parents
+	// are always smaller runs and so are numbered already
+	int NumAreas = 0;
+	for(int r = 0; r < (int)vRuns.size(); r++)
+		vRuns[r].m_Area = vRuns[r].m_Area == r ? NumAreas++ : vRuns[vRuns[r].m_Area].m_Area;
+	std::vector<int> vSample(NumAreas, 0);
+	for(const CAirRun &Run : vRuns)
+		vSample[Run.m_Area] += Run.m_X1-Run.m_X0;
+	int64 LabelMemory = (int64)vRuns.capacity()*sizeof(CAirRun) + (int64)Runs.m_vRowStart.size()*sizeof(int) + (int64)NumAreas*(sizeof(int)+1);
+	UseMemory(LabelMemory);
+
+	// a random tile of each area, counted down to in scan order
+	for(int a = 0; a < NumAreas; a++)
+		vSample[a] = random_int(0, vSample[a]-1);
+	std::vector<int> vSampleTile(NumAreas, -1);
+	for(int y = 0; y < Height; y++)
 	{
-		if(!AreaList[1])
-			break;
-
-		dbg_msg("mapgen", "%d Area left", AreaList.size());
-		int tempdis = Width;
-		CAirTile Start, End;
-		End = AreaList[1]->m_Tiles[random_int(0, AreaList[1]->m_Tiles.size()-1)];
-		for(int i = 0;i < AreaList[0]->m_Tiles.size();i ++)
-		{
-			CAirTile pTile = AreaList[0]->m_Tiles[i];
-			if(abs(pTile.m_x-End.m_x)+ abs(pTile.m_y - End.m_y) < tempdis)
-			{
-				tempdis = abs(pTile.m_x-End.m_x)+ abs(pTile.m_y - End.m_y);
-				Start = pTile;
-			}
-			if(i + 2 < AreaList[0]->m_Tiles.size())
-				i++;
-		}
-		if (Start.m_x < End.m_x)
+		for(int r = Runs.m_vRowStart[y]; r < Runs.m_vRowStart[y+1]; r++)
 		{
-			for(int x = Start.m_x; x < End.m_x; x++)
-			{
-				m_pGameTiles[Start.m_y*Width+x-1].m_Index = 0;
-				m_pGameTiles[Start.m_y*Width+x+1].m_Index = 0;
-				m_pGameTiles[Start.m_y*Width+x].m_Index = 0;
-				m_pGameTiles[(Start.m_y-1)*Width+x].m_Index = 0;
-				m_pGameTiles[(Start.m_y+1)*Width+x].m_Index = 0;
-			}
-			if(Start.m_y < End.m_y)
-			{
-				for (int y = Start.m_y; y < End.m_y; y++)
-				{
-					m_pGameTiles[y*Width+End.m_x-1].m_Index = 0;
-					m_pGameTiles[y*Width+End.m_x+1].m_Index = 0;
-					m_pGameTiles[y*Width+End.m_x].m_Index = 0;
-					m_pGameTiles[(y-1)*Width+End.m_x].m_Index = 0;
-					m_pGameTiles[(y+1)*Width+End.m_x].m_Index = 0;
-				}
-			}
-			else
-			{
-				for (int y = Start.m_y; y > End.m_y; y--)
-				{
-					m_pGameTiles[y*Width+End.m_x-1].m_Index = 0;
-					m_pGameTiles[y*Width+End.m_x+1].m_Index = 0;
-					m_pGameTiles[y*Width+End.m_x].m_Index = 0;
-					m_pGameTiles[(y-1)*Width+End.m_x].m_Index = 0;
-					m_pGameTiles[(y+1)*Width+End.m_x].m_Index = 0;
-				}
-			}
+			int &Left = vSample[vRuns[r].m_Area];
+			int Length = vRuns[r].m_X1-vRuns[r].m_X0;
+			if(Left >= 0 && Left < Length)
+				vSampleTile[vRuns[r].m_Area] = y*Width+vRuns[r].m_X0+Left;
+			Left -= Length;
 		}
-		else
+	}
+
+	// tunnels make air that was no run, it belongs to area 0
+	std::vector<unsigned char> vConnected(NumAreas, 0);
+	if(NumAreas)
+		vConnected[0] = 1;
+	for(int a = 1; a < NumAreas; a++)
+	{
+		// tunnels to earlier areas can run through later ones
+		if(vConnected[a])
+			continue;
+
+		ivec2 End(vSampleTile[a]%Width, vSampleTile[a]/Width);
+		ivec2 Start = End;
+		bool Found = false;
+		for(int d = 1; d < Width+Height && !Found; d++)
 		{
-			for (int x = Start.m_x; x > End.m_x; x--)
-			{
-				m_pGameTiles[Start.m_y*Width+x-1].m_Index = 0;
-				m_pGameTiles[Start.m_y*Width+x+1].m_Index = 0;
-				m_pGameTiles[Start.m_y*Width+x].m_Index = 0;
-				m_pGameTiles[(Start.m_y-1)*Width+x].m_Index = 0;
-				m_pGameTiles[(Start.m_y+1)*Width+x].m_Index = 0;
-			}
-			if (Start.m_y < End.m_y)
-			{
-				for (int y = Start.m_y; y < End.m_y; y++)
-				{
-					m_pGameTiles[y*Width+End.m_x-1].m_Index = 0;
-					m_pGameTiles[y*Width+End.m_x+1].m_Index = 0;
-					m_pGameTiles[y*Width+End.m_x].m_Index = 0;
-					m_pGameTiles[(y-1)*Width+End.m_x].m_Index = 0;
-					m_pGameTiles[(y+1)*Width+End.m_x].m_Index = 0;
-				}
-			}
-			else
+			for(int dy = -d; dy <= d && !Found; dy++)
 			{
-				for (int y = Start.m_y; y > End.m_y; y--)
+				int y = End.y+dy;
+				if(y < 0 || y >= Height)
+					continue;
+				int dx = d-absolute(dy);
+				for(int x = End.x-dx; x <= End.x+dx; x += maximum(2*dx, 1))
 				{
-					m_pGameTiles[y*Width+End.m_x-1].m_Index = 0;
-					m_pGameTiles[y*Width+End.m_x+1].m_Index = 0;
-					m_pGameTiles[y*Width+End.m_x].m_Index = 0;
-					m_pGameTiles[(y-1)*Width+End.m_x].m_Index = 0;
-					m_pGameTiles[(y+1)*Width+End.m_x].m_Index = 0;
+					if(x < 0 || x >= Width || pTiles[y*Width+x].m_Index != TILE_AIR)
+						continue;
+					int Area = Runs.AreaAt(x, y);
+					if(Area >= 0 && !vConnected[Area])
+						continue;
+					Start = ivec2(x, y);
+					Found = true;
+					break;
 				}
 			}
 		}
-		for(int i = 0; i < AreaList[1]->m_Tiles.size();i++)
+
+		CarveTunnel(pTiles, Runs, vConnected.data(), Width, Height, Start, End);
+		vConnected[a] = 1;
+	}
+
+	char aBuf[128];
+	str_format(aBuf, sizeof(aBuf), "connected %d air areas of %d runs", NumAreas, (int)vRuns.size());
+	Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "mapgen", aBuf);
+	UseMemory(-LabelMemory);
+}
+
+void CMapGen::CarveTunnel(CTile *pTiles, const CAirRuns &Runs, unsigned char *pConnected, int Width, int Height, ivec2 Start, ivec2 End)
+{
+	// along the row of Start to the column of End and along that to End,
+	// three tiles wide. Areas the tunnel runs into are connected with it.
+	ivec2 Pos = Start;
+	ivec2 Step(End.x > Start.x ? 1 : -1, End.y > Start.y ? 1 : -1);
+	while(!(Pos == End))
+	{
+		static const ivec2 s_aBrush[] = {ivec2(0, 0), ivec2(-1, 0), ivec2(1, 0), ivec2(0, -1), ivec2(0, 1)};
+		for(const ivec2 &Offset : s_aBrush)
 		{
-			CAirTile pTile = AreaList[1]->m_Tiles[i];
-			AreaList[0]->m_Tiles.add(pTile);
+			ivec2 Tile = Pos+Offset;
+			if(Tile.x < 0 || Tile.x >= Width || Tile.y < 0 || Tile.y >= Height)
+				continue;
+			pTiles[Tile.y*Width+Tile.x].m_Index = TILE_AIR;
+			int Area = Runs.AreaAt(Tile.x, Tile.y);
+			if(Area >= 0)
+				pConnected[Area] = 1;
 		}
-		AreaList.remove_index(1);           
-	}
-	
-	AddGameTile(m_pGameTiles);
-	
-	m_DataFile.AddItem(MAPITEMTYPE_GROUP, m_NumGroups++, sizeof(Item), &Item);
 
-	if(TileList)
-		delete[] TileList;
-	AreaList.clear();
-	AirList.clear();
-} 
+		if(Pos.x != End.x)
+			Pos.x += Step.x;
+		else
+			Pos.y += Step.y;
+	}
+}
 
 void CMapGen::GenerateBackgroundTile()
 {
@@ -521,24 +578,29 @@ void CMapGen::GenerateBackgroundTile()
 	int Image = AddExternalImage("grass_main", 1024, 1024);
 	int Rule = LoadRules("grass_main");
 
-	m_pBackGroundTiles = new CTile[Width*Height];
-	struct osn_context *ctx;
-	open_simplex_noise(random_int(90000, 97374), &ctx);
-	for(int x = 0;x < Width; x ++)
+	struct CNoiseRows
 	{
-		for(int y = 0;y < Height; y ++)
+		osn_context *m_pNoise;
+		int m_Width;
+
+		static void RawRow(int y, CTile *pRow, void *pUser)
 		{
-			double value = open_simplex_noise2(ctx, (double) x/32, (double) y/32) * 0.5 + 0.5;
-			m_pBackGroundTiles[y*Width+x].m_Flags = 0;
-			m_pBackGroundTiles[y*Width+x].m_Reserved = 0;
-			m_pBackGroundTiles[y*Width+x].m_Skip = 0;
-			if(value < 0.45f)
+			CNoiseRows *pSelf = (CNoiseRows *)pUser;
+			for(int x = 0; x < pSelf->m_Width; x++)
 			{
-				m_pBackGroundTiles[y*Width+x].m_Index = 1;
-			}else m_pBackGroundTiles[y*Width+x].m_Index = 0;
+				double value = open_simplex_noise2(pSelf->m_pNoise, (double) x/32, (double) y/32) * 0.5 + 0.5;
+				pRow[x].m_Index = value < 0.45f ? 1 : 0;
+				pRow[x].m_Flags = 0;
+				pRow[x].m_Reserved = 0;
+				pRow[x].m_Skip = 0;
+			}
 		}
-	}
-	Proceed(m_pBackGroundTiles, Rule);
+	};
+	CNoiseRows Rows;
+	Rows.m_Width = Width;
+	open_simplex_noise(random_int(90000, 97374), &Rows.m_pNoise);
+	int Data = AddAutomappedData(Rule, CNoiseRows::RawRow, &Rows);
+	open_simplex_noise_free(Rows.m_pNoise);
 	
 	CMapItemLayerTilemap LayerItem;
 	LayerItem.m_Version = LayerItem.m_Layer.m_Version = 3;
@@ -555,7 +617,7 @@ void CMapGen::GenerateBackgroundTile()
 	LayerItem.m_Flags = 0;
 	LayerItem.m_Image = Image;
 
-	LayerItem.m_Data = m_DataFile.AddData(Width*Height*sizeof(CTile), m_pBackGroundTiles);
+	LayerItem.m_Data = Data;
 	StrToInts(LayerItem.m_aName, sizeof(LayerItem.m_aName)/sizeof(int), "Background");
 	m_DataFile.AddItem(MAPITEMTYPE_LAYER, m_NumLayers++, sizeof(LayerItem), &LayerItem);
 	
@@ -616,13 +678,105 @@ void CMapGen::GenerateBackground()
 	LayerItem.m_Layer.m_Type = LAYERTYPE_QUADS;
 
 	StrToInts(LayerItem.m_aName, sizeof(LayerItem.m_aName)/sizeof(int), "Quad");
-	LayerItem.m_Data = m_DataFile.AddDataSwapped(aQuads.size()*sizeof(CQuad), aQuads.base_ptr());
+	LayerItem.m_Data = m_DataFile.AddDataSwapped(aQuads.size()*sizeof(CQuad), aQuads.base_ptr(), g_Config.m_SvMapgenCompression);
 				
 	m_DataFile.AddItem(MAPITEMTYPE_LAYER, m_NumLayers++, sizeof(LayerItem), &LayerItem);
 		
 	m_DataFile.AddItem(MAPITEMTYPE_GROUP, m_NumGroups++, sizeof(Item), &Item);
 }
 
+// sets Runs[x] to the number of tiles from x on that are air (or solid)
+static void RowRuns(const CTile *pRow, int Width, bool Air, int *pRuns)
+{
+	pRuns[Width] = 0;
+	for(int x = Width-1; x >= 0; x--)
+		pRuns[x] = ((pRow[x].m_Index == TILE_AIR) == Air) ? pRuns[x+1]+1 : 0;
+}
+
+CMapGen::CDoodadPlacer::CDoodadPlacer(const CTile *pGameTiles, int Width, int Height, const CDoodadStamp *pStamps, int NumStamps) :
+	m_pGameTiles(pGameTiles),
+	m_Width(Width),
+	m_Height(Height),
+	m_pStamps(pStamps),
+	m_NumStamps(maximum(NumStamps, 0)),
+	m_NumRows(0),
+	m_MaxHeight(0)
+{
+	if(m_NumStamps <= 0)
+		return;
+
+	int MinHeight = pStamps[0].m_Height;
+	for(int s = 0; s < m_NumStamps; s++)
+	{
+		MinHeight = minimum(MinHeight, pStamps[s].m_Height);
+		m_MaxHeight = maximum(m_MaxHeight, pStamps[s].m_Height);
+	}
+	m_NumRows = maximum(Height-MinHeight-1, 0);
+
+	// stamps always start below the current row, so a column is free
+	// for all rows from y+1 on once its last covered row is above y+1
+	m_vCoveredUntil.assign(Width, -1);
+	m_vFree.resize(Width+1);
+	m_vAirRuns.resize(Width+1);
+	m_vSolidRuns.resize(m_NumStamps * (Width+1));
+}
+
+void CMapGen::CDoodadPlacer::PlaceRow(int y, CTile *pDoodadRows, int NumDoodadRows)
+{
+	const CTile *pGameTiles = m_pGameTiles;
+	const CDoodadStamp *pStamps = m_pStamps;
+	int Width = m_Width;
+	int Height = m_Height;
+
+	RowRuns(&pGameTiles[(y+1)*Width], Width, true, m_vAirRuns.data());
+	for(int s = 0; s < m_NumStamps; s++)
+		if(y < Height-pStamps[s].m_Height-1)
+			RowRuns(&pGameTiles[(y+pStamps[s].m_Height+1)*Width], Width, false, &m_vSolidRuns[s*(Width+1)]);
+
+	m_vFree[0] = 0;
+	for(int x = 0; x < Width; x++)
+		m_vFree[x+1] = m_vFree[x] + (m_vCoveredUntil[x] < y+1);
+
+	for(int x = 0; x < Width; x++)
+	{
+		if(m_vAirRuns[x] == 0)
+			continue;
+
+		for(int s = 0; s < m_NumStamps; s++)
+		{
+			const CDoodadStamp *pStamp = &pStamps[s];
+			if(y >= Height-pStamp->m_Height-1 || x >= Width-pStamp->m_Width)
+				continue;
+			if(m_vAirRuns[x] < pStamp->m_Width || m_vSolidRuns[s*(Width+1)+x] < pStamp->m_Width)
+				continue;
+			if(m_vFree[x+pStamp->m_Width] - m_vFree[x] != pStamp->m_Width)
+				continue;
+
+			for(int i = 0; i < pStamp->m_Width; i++)
+			{
+				for(int j = 0; j < pStamp->m_Height; j++)
+				{
+					CTile *pTile = &pDoodadRows[((y+1+j)%NumDoodadRows)*Width+x+i];
+					pTile->m_Index = pStamp->m_Index+16*j+i;
+					pTile->m_Flags = 0;
+				}
+				m_vCoveredUntil[x+i] = y+pStamp->m_Height;
+			}
+
+			// the columns of this stamp are taken for the rest of the row
+			x += pStamp->m_Width-1;
+			break;
+		}
+	}
+}
+
+void CMapGen::PlaceDoodads(const CTile *pGameTiles, CTile *pDoodadsTiles, int Width, int Height, const CDoodadStamp *pStamps, int NumStamps)
+{
+	CDoodadPlacer Placer(pGameTiles, Width, Height, pStamps, NumStamps);
+	for(int y = 0; y < Placer.NumRows(); y++)
+		Placer.PlaceRow(y, pDoodadsTiles, Height);
+}
+
 void CMapGen::GenerateDoodadsLayer()
 {
 	int Width = g_Config.m_SvGeneratedMapWidth;
@@ -644,94 +798,52 @@ void CMapGen::GenerateDoodadsLayer()
 
 	int Image = AddExternalImage("jungle_doodads", 1024, 1024);
 
-	m_pDoodadsTiles = new CTile[Width*Height];
-	for(int x = 0;x < Width;x ++)
+	// a row is done once the stamps of the row of positions above it are placed
+	CDoodadPlacer Placer(m_vGameTiles.data(), Width, Height, s_aJungleDoodads, sizeof(s_aJungleDoodads)/sizeof(s_aJungleDoodads[0]));
+	int NumRows = Placer.MaxHeight()+1;
+	std::vector<CTile> vRows((size_t)Width*NumRows, CTile());
+	UseMemory((int64)vRows.size()*sizeof(CTile));
+
+	m_DataFile.BeginData(g_Config.m_SvMapgenCompression);
+	for(int y = 0; y < Height; y++)
 	{
-		for(int y = 0;y < Height;y ++)
-		{
-			m_pDoodadsTiles[y*Width+x].m_Index = 0;
-			m_pDoodadsTiles[y*Width+x].m_Flags = 0;
-			m_pDoodadsTiles[y*Width+x].m_Reserved = 0;
-			m_pDoodadsTiles[y*Width+x].m_Skip = 0;
-		}
+		if(y >= 1 && y-1 < Placer.NumRows())
+			Placer.PlaceRow(y-1, vRows.data(), NumRows);
+		CTile *pRow = &vRows[(y%NumRows)*Width];
+		m_DataFile.AddDataPart(pRow, Width*sizeof(CTile));
+		mem_zero(pRow, Width*sizeof(CTile));
 	}
+	AddTile(m_DataFile.EndData(), "Doodads", Image);
+	UseMemory(-(int64)vRows.size()*sizeof(CTile));
+	
+	m_DataFile.AddItem(MAPITEMTYPE_GROUP, m_NumGroups++, sizeof(Item), &Item);
+}
+
+// the solid tiles of the game layer, or only the unhookable ones
+struct CGameRows
+{
+	const CTile *m_pGameTiles;
+	int m_Width;
+	bool m_Hookable;
 
-	for(int y = 0;y < Height-3;y ++)
+	static void RawRow(int y, CTile *pRow, void *pUser)
 	{
-		for(int x = 0;x < Width-9;x ++)
+		CGameRows *pSelf = (CGameRows *)pUser;
+		const CTile *pGameRow = &pSelf->m_pGameTiles[y*pSelf->m_Width];
+		for(int x = 0; x < pSelf->m_Width; x++)
 		{
-			if(m_pDoodadsTiles[(y+1)*Width+x].m_Index != 0
-				|| m_pDoodadsTiles[(y+1)*Width+x+1].m_Index != 0
-				|| m_pDoodadsTiles[(y+1)*Width+x+2].m_Index != 0
-				|| m_pDoodadsTiles[(y+1)*Width+x+3].m_Index != 0
-				|| m_pDoodadsTiles[(y+1)*Width+x+4].m_Index != 0
-				|| m_pDoodadsTiles[(y+1)*Width+x+5].m_Index != 0
-				|| m_pDoodadsTiles[(y+1)*Width+x+6].m_Index != 0
-				|| m_pDoodadsTiles[(y+1)*Width+x+7].m_Index != 0
-				|| m_pDoodadsTiles[(y+1)*Width+x+8].m_Index != 0)
-				continue;
-			if(m_pDoodadsTiles[(y+2)*Width+x].m_Index != 0
-				|| m_pDoodadsTiles[(y+2)*Width+x+1].m_Index != 0
-				|| m_pDoodadsTiles[(y+2)*Width+x+2].m_Index != 0
-				|| m_pDoodadsTiles[(y+2)*Width+x+3].m_Index != 0
-				|| m_pDoodadsTiles[(y+2)*Width+x+4].m_Index != 0
-				|| m_pDoodadsTiles[(y+2)*Width+x+5].m_Index != 0
-				|| m_pDoodadsTiles[(y+2)*Width+x+6].m_Index != 0
-				|| m_pDoodadsTiles[(y+2)*Width+x+7].m_Index != 0
-				|| m_pDoodadsTiles[(y+2)*Width+x+8].m_Index != 0)
-				continue;
-			if(m_pDoodadsTiles[(y+3)*Width+x].m_Index != 0
-				|| m_pDoodadsTiles[(y+3)*Width+x+1].m_Index != 0
-				|| m_pDoodadsTiles[(y+3)*Width+x+2].m_Index != 0
-				|| m_pDoodadsTiles[(y+3)*Width+x+3].m_Index != 0
-				|| m_pDoodadsTiles[(y+3)*Width+x+4].m_Index != 0
-				|| m_pDoodadsTiles[(y+3)*Width+x+5].m_Index != 0
-				|| m_pDoodadsTiles[(y+3)*Width+x+6].m_Index != 0
-				|| m_pDoodadsTiles[(y+3)*Width+x+7].m_Index != 0
-				|| m_pDoodadsTiles[(y+3)*Width+x+8].m_Index != 0)
-				continue;
-
-			if(m_pGameTiles[(y+1)*Width+x].m_Index == TILE_AIR && 
-				m_pGameTiles[(y+1)*Width+x+1].m_Index == TILE_AIR 
-					&& m_pGameTiles[(y+1)*Width+x+2].m_Index == TILE_AIR
-					&& m_pGameTiles[(y+1)*Width+x+3].m_Index == TILE_AIR
-					&& m_pGameTiles[(y+1)*Width+x+4].m_Index == TILE_AIR
-					&& m_pGameTiles[(y+1)*Width+x+5].m_Index == TILE_AIR
-					&& m_pGameTiles[(y+1)*Width+x+6].m_Index == TILE_AIR
-					&& m_pGameTiles[(y+1)*Width+x+7].m_Index == TILE_AIR
-					&& m_pGameTiles[(y+1)*Width+x+8].m_Index == TILE_AIR)
-			{
-				if(m_pGameTiles[(y+4)*Width+x].m_Index != TILE_AIR && 
-					m_pGameTiles[(y+4)*Width+x+1].m_Index != TILE_AIR 
-						&& m_pGameTiles[(y+4)*Width+x+2].m_Index != TILE_AIR
-						&& m_pGameTiles[(y+4)*Width+x+3].m_Index != TILE_AIR
-						&& m_pGameTiles[(y+4)*Width+x+4].m_Index != TILE_AIR
-						&& m_pGameTiles[(y+4)*Width+x+5].m_Index != TILE_AIR
-						&& m_pGameTiles[(y+4)*Width+x+6].m_Index != TILE_AIR
-						&& m_pGameTiles[(y+4)*Width+x+7].m_Index != TILE_AIR
-						&& m_pGameTiles[(y+4)*Width+x+8].m_Index != TILE_AIR)
-				{
-					for(int i = 0;i < 9;i++)
-					{
-						for(int j = 0;j < 3;j++)
-						{
-							m_pDoodadsTiles[(y+1+j)*Width+x+i].m_Index = 6+16*j+i;
-							m_pDoodadsTiles[(y+1+j)*Width+x+i].m_Flags = 0;
-						}
-					}
-				}
-			}
+			int Index = pGameRow[x].m_Index;
+			pRow[x].m_Index = Index == TILE_NOHOOK || (pSelf->m_Hookable && Index == TILE_SOLID) ? 1 : 0;
+			pRow[x].m_Flags = 0;
+			pRow[x].m_Reserved = 0;
+			pRow[x].m_Skip = 0;
 		}
 	}
-	AddTile(m_pDoodadsTiles, "Doodads", Image);
-	
-	m_DataFile.AddItem(MAPITEMTYPE_GROUP, m_NumGroups++, sizeof(Item), &Item);
-}
+};
 
 void CMapGen::GenerateHookableLayer()
 {
 	int Width = g_Config.m_SvGeneratedMapWidth;
-	int Height = g_Config.m_SvGeneratedMapHeight;
 
 	CMapItemGroup Item;
 	Item.m_Version = CMapItemGroup::CURRENT_VERSION;
@@ -751,25 +863,8 @@ void CMapGen::GenerateHookableLayer()
 	int ImageHookable = AddEmbeddedImage("grass_main_0.7", 1024, 1024);
 	int RuleHookable = LoadRules("grass_main_0.7");
 
-	m_pHookableTiles = new CTile[Width*Height];
-	for(int x = 0;x < Width;x ++)
-	{
-		for(int y = 0;y < Height;y ++)
-		{
-			m_pHookableTiles[y*Width+x].m_Flags = 0;
-			m_pHookableTiles[y*Width+x].m_Reserved = 0;
-			m_pHookableTiles[y*Width+x].m_Skip = 0;
-			if(m_pGameTiles[y*Width+x].m_Index == TILE_SOLID || m_pGameTiles[y*Width+x].m_Index == TILE_NOHOOK)
-			{
-				m_pHookableTiles[y*Width+x].m_Index = 1;
-			}else 
-			{
-				m_pHookableTiles[y*Width+x].m_Index = 0;
-			}
-		}
-	}
-	Proceed(m_pHookableTiles, RuleHookable);
-	AddTile(m_pHookableTiles, "Hookable", ImageHookable);
+	CGameRows Rows = {m_vGameTiles.data(), Width, true};
+	AddTile(AddAutomappedData(RuleHookable, CGameRows::RawRow, &Rows), "Hookable", ImageHookable);
 	
 	m_DataFile.AddItem(MAPITEMTYPE_GROUP, m_NumGroups++, sizeof(Item), &Item);
 }
@@ -777,7 +872,6 @@ void CMapGen::GenerateHookableLayer()
 void CMapGen::GenerateUnhookableLayer()
 {
 	int Width = g_Config.m_SvGeneratedMapWidth;
-	int Height = g_Config.m_SvGeneratedMapHeight;
 
 	CMapItemGroup Item;
 	Item.m_Version = CMapItemGroup::CURRENT_VERSION;
@@ -797,25 +891,8 @@ void CMapGen::GenerateUnhookableLayer()
 	int ImageUnhookable = AddExternalImage("generic_unhookable", 1024, 1024);
 	int RuleUnhookable = LoadRules("generic_unhookable");
 
-	m_pUnhookableTiles = new CTile[Width*Height];
-	for(int x = 0;x < Width;x ++)
-	{
-		for(int y = 0;y < Height;y ++)
-		{
-			m_pUnhookableTiles[y*Width+x].m_Flags = 0;
-			m_pUnhookableTiles[y*Width+x].m_Reserved = 0;
-			m_pUnhookableTiles[y*Width+x].m_Skip = 0;
-			if(m_pGameTiles[y*Width+x].m_Index == TILE_NOHOOK)
-			{
-				m_pUnhookableTiles[y*Width+x].m_Index = 1;
-			}else 
-			{
-				m_pUnhookableTiles[y*Width+x].m_Index = 0;
-			}
-		}
-	}
-	Proceed(m_pUnhookableTiles, RuleUnhookable);
-	AddTile(m_pUnhookableTiles, "Unhookable", ImageUnhookable);
+	CGameRows Rows = {m_vGameTiles.data(), Width, false};
+	AddTile(AddAutomappedData(RuleUnhookable, CGameRows::RawRow, &Rows), "Unhookable", ImageUnhookable);
 	
 	m_DataFile.AddItem(MAPITEMTYPE_GROUP, m_NumGroups++, sizeof(Item), &Item);
 }
@@ -857,103 +934,141 @@ void CMapGen::GenerateMap()
 	// Generate unhookable tile
 	GenerateUnhookableLayer();
 
+	UseMemory(-(int64)m_vGameTiles.size()*sizeof(CTile));
+	std::vector<CTile>().swap(m_vGameTiles);
 }
 
-void CMapGen::Proceed(CTile *pTiles, int ConfigID)
+int CMapGen::AddAutomappedData(int ConfigID, FRawRow pfnRawRow, void *pUser)
 {
-	if(ConfigID < 0 || ConfigID >= m_lConfigs.size())
-		return;
-
-	CConfiguration *pConf = &m_lConfigs[ConfigID];
-
-	if(!pConf->m_aIndexRules.size())
-		return;
-
-	int BaseTile = 1;
+	int Width = g_Config.m_SvGeneratedMapWidth;
+	int Height = g_Config.m_SvGeneratedMapHeight;
 
-	// find base tile if there is one
-	for(int i = 0; i < pConf->m_aIndexRules.size(); ++i)
+	const CConfiguration *pConf = 0;
+	if(ConfigID >= 0 && ConfigID < (int)m_vpConfigs.size() && m_vpConfigs[ConfigID]->m_aIndexRules.size())
+		pConf = m_vpConfigs[ConfigID];
+
+	// rows further away than the farthest rule can not change a row any more
+	int Reach = 0;
+	for(int i = 0; pConf && i < pConf->m_aIndexRules.size(); i++)
+		for(int j = 0; j < pConf->m_aIndexRules[i].m_aRules.size(); j++)
+			Reach = maximum(Reach, absolute(pConf->m_aIndexRules[i].m_aRules[j].m_Y)+1);
+
+	// the rows are mapped in place like on a whole layer, so the rows
+	// above a tile are mapped and the rows below it are raw when it is
+	// checked. A row is written once the last row that can see it is done.
+	int NumRows = 2*Reach+1;
+	std::vector<CTile> vRows((size_t)Width*NumRows);
+	std::vector<CTile *> vpWindow(NumRows);
+	UseMemory((int64)vRows.size()*sizeof(CTile));
+
+	m_DataFile.BeginData(g_Config.m_SvMapgenCompression);
+	for(int y = 0; y < minimum(Reach, Height); y++)
+		pfnRawRow(y, &vRows[(y%NumRows)*Width], pUser);
+	for(int y = 0; y < Height; y++)
 	{
-		if(pConf->m_aIndexRules[i].m_BaseTile)
+		if(y+Reach < Height)
+			pfnRawRow(y+Reach, &vRows[((y+Reach)%NumRows)*Width], pUser);
+
+		if(pConf)
 		{
-			BaseTile = pConf->m_aIndexRules[i].m_ID;
-			break;
+			for(int r = 0; r < NumRows; r++)
+			{
+				int RowY = y-Reach+r;
+				vpWindow[r] = RowY >= 0 && RowY < Height ? &vRows[(RowY%NumRows)*Width] : 0;
+			}
+			ProceedRow(pConf, y, vpWindow.data(), Reach);
 		}
+
+		if(y-Reach >= 0)
+			m_DataFile.AddDataPart(&vRows[((y-Reach)%NumRows)*Width], Width*sizeof(CTile));
 	}
+	for(int y = maximum(Height-Reach, 0); y < Height; y++)
+		m_DataFile.AddDataPart(&vRows[(y%NumRows)*Width], Width*sizeof(CTile));
+	UseMemory(-(int64)vRows.size()*sizeof(CTile));
+	return m_DataFile.EndData();
+}
+
+void CMapGen::ProceedRow(const CConfiguration *pConf, int y, CTile **ppRows, int Reach)
+{
+	int BaseTile = pConf->m_BaseTile;
 	
 	int Width = g_Config.m_SvGeneratedMapWidth;
 	int Height = g_Config.m_SvGeneratedMapHeight;
 	
-	int MaxIndex = Width*Height;
-	for(int y = 0; y < Height; y++)
-		for(int x = 0; x < Width; x++)
-		{
-			CTile *pTile = &(pTiles[y*Width+x]);
-			if(pTile->m_Index == 0)
-				continue;
+	for(int x = 0; x < Width; x++)
+	{
+		CTile *pTile = &ppRows[Reach][x];
+		if(pTile->m_Index == 0)
+			continue;
 
-			pTile->m_Index = BaseTile;
+		pTile->m_Index = BaseTile;
 
-			if(y == 0 || y == Height-1 || x == 0 || x == Width-1)
+		if(y == 0 || y == Height-1 || x == 0 || x == Width-1)
+			continue;
+
+		for(int i = 0; i < pConf->m_aIndexRules.size(); ++i)
+		{
+			if(pConf->m_aIndexRules[i].m_BaseTile)
 				continue;
 
-			for(int i = 0; i < pConf->m_aIndexRules.size(); ++i)
+			bool RespectRules = true;
+			for(int j = 0; j < pConf->m_aIndexRules[i].m_aRules.size() && RespectRules; ++j)
 			{
-				if(pConf->m_aIndexRules[i].m_BaseTile)
-					continue;
+				const CPosRule *pRule = &pConf->m_aIndexRules[i].m_aRules[j];
 
-				bool RespectRules = true;
-				for(int j = 0; j < pConf->m_aIndexRules[i].m_aRules.size() && RespectRules; ++j)
+				// a check beside the map wraps into the row above or below, as on the flat layer
+				int CheckX = x+pRule->m_X;
+				int CheckY = y+pRule->m_Y;
+				if(CheckX < 0)
+				{
+					CheckX += Width;
+					CheckY--;
+				}
+				else if(CheckX >= Width)
 				{
-					CPosRule *pRule = &pConf->m_aIndexRules[i].m_aRules[j];
-					int CheckIndex = (y+pRule->m_Y)*Width+(x+pRule->m_X);
+					CheckX -= Width;
+					CheckY++;
+				}
 
-					if(CheckIndex < 0 || CheckIndex >= MaxIndex)
-						RespectRules = false;
+				if(CheckY < 0 || CheckY >= Height)
+					RespectRules = false;
+				else
+				{
+					const CTile *pCheck = &ppRows[CheckY-y+Reach][CheckX];
+					if(pRule->m_IndexValue)
+					{
+						if(pCheck->m_Index != pRule->m_Value)
+							RespectRules = false;
+					}
 					else
 					{
- 						if(pRule->m_IndexValue)
-						{
-							if(pTiles[CheckIndex].m_Index != pRule->m_Value)
-								RespectRules = false;
-						}
-						else
-						{
-							if(pTiles[CheckIndex].m_Index > 0 && pRule->m_Value == CPosRule::EMPTY)
-								RespectRules = false;
-
-							if(pTiles[CheckIndex].m_Index == 0 && pRule->m_Value == CPosRule::FULL)
-								RespectRules = false;
-						}
+						if(pCheck->m_Index > 0 && pRule->m_Value == CPosRule::EMPTY)
+							RespectRules = false;
+
+						if(pCheck->m_Index == 0 && pRule->m_Value == CPosRule::FULL)
+							RespectRules = false;
 					}
 				}
+			}
 
-				if(RespectRules &&
-					(pConf->m_aIndexRules[i].m_RandomValue <= 1 || (int)((float)rand() / ((float)RAND_MAX + 1) * pConf->m_aIndexRules[i].m_RandomValue) == 1))
-				{
-					pTile->m_Index = pConf->m_aIndexRules[i].m_ID;
-					pTile->m_Flags = pConf->m_aIndexRules[i].m_Flag;
-				}
+			if(RespectRules &&
+				(pConf->m_aIndexRules[i].m_RandomValue <= 1 || (int)((float)rand() / ((float)RAND_MAX + 1) * pConf->m_aIndexRules[i].m_RandomValue) == 1))
+			{
+				pTile->m_Index = pConf->m_aIndexRules[i].m_ID;
+				pTile->m_Flags = pConf->m_aIndexRules[i].m_Flag;
 			}
 		}
+	}
 }
 
-int CMapGen::LoadRules(const char *pImageName)
+void CMapGen::ParseRules(IOHANDLE RulesFile, CCachedRules *pRules)
 {
-	char aPath[256];
-	str_format(aPath, sizeof(aPath), "mapgen/%s.rules", pImageName);
-	IOHANDLE RulesFile = Storage()->OpenFile(aPath, IOFLAG_READ, IStorage::TYPE_ALL);
-	if(!RulesFile)
-		return -1;
-
 	CLineReader LineReader;
 	LineReader.Init(RulesFile);
 
 	CConfiguration *pCurrentConf = 0;
 	CIndexRule *pCurrentIndex = 0;
 
-	char aBuf[256];
-
 	// read each line
 	while(char *pLine = LineReader.Get())
 	{
@@ -967,8 +1082,9 @@ int CMapGen::LoadRules(const char *pImageName)
 				pLine++;
 
 				CConfiguration NewConf;
-				int ID = m_lConfigs.add(NewConf);
-				pCurrentConf = &m_lConfigs[ID];
+				NewConf.m_BaseTile = 1;
+				int ID = pRules->m_lConfigs.add(NewConf);
+				pCurrentConf = &pRules->m_lConfigs[ID];
 
 				str_copy(pCurrentConf->m_aName, pLine, str_length(pLine));
 			}
@@ -1032,15 +1148,68 @@ int CMapGen::LoadRules(const char *pImageName)
 		}
 	}
 
+	// find the base tile once instead of in every Proceed
+	for(int i = 0; i < pRules->m_lConfigs.size(); i++)
+	{
+		CConfiguration *pConf = &pRules->m_lConfigs[i];
+		for(int j = 0; j < pConf->m_aIndexRules.size(); j++)
+		{
+			if(pConf->m_aIndexRules[j].m_BaseTile)
+			{
+				pConf->m_BaseTile = pConf->m_aIndexRules[j].m_ID;
+				break;
+			}
+		}
+	}
+}
+
+std::shared_ptr<const CMapGen::CCachedRules> CMapGen::GetRules(const char *pImageName)
+{
+	char aPath[256];
+	str_format(aPath, sizeof(aPath), "mapgen/%s.rules", pImageName);
+	char aCompleteFilename[512];
+	IOHANDLE RulesFile = Storage()->OpenFile(aPath, IOFLAG_READ, IStorage::TYPE_ALL, aCompleteFilename, sizeof(aCompleteFilename));
+	if(!RulesFile)
+		return nullptr;
+
+	time_t Created;
+	time_t Modified = 0;
+	fs_file_time(aCompleteFilename, &Created, &Modified);
+
+	std::lock_guard<std::mutex> Lock(ms_AssetLock);
+	auto Entry = ms_Rules.find(aPath);
+	if(Entry != ms_Rules.end() && Entry->second->m_Modified == Modified)
+	{
+		io_close(RulesFile);
+		return Entry->second;
+	}
+
+	std::shared_ptr<CCachedRules> pRules = std::make_shared<CCachedRules>();
+	pRules->m_Modified = Modified;
+	ParseRules(RulesFile, pRules.get());
 	io_close(RulesFile);
 
+	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf),"loaded %s", aPath);
 	Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "mapgen", aBuf);
 
-	return m_lConfigs.size()-1;
+	ms_Rules[aPath] = pRules;
+	return pRules;
 }
 
-void CMapGen::AddGameTile(CTile *pTile)
+int CMapGen::LoadRules(const char *pImageName)
+{
+	std::shared_ptr<const CCachedRules> pRules = GetRules(pImageName);
+	if(!pRules)
+		return -1;
+
+	m_vpRules.push_back(pRules);
+	for(int i = 0; i < pRules->m_lConfigs.size(); i++)
+		m_vpConfigs.push_back(&pRules->m_lConfigs[i]);
+	return (int)m_vpConfigs.size()-1;
+}
+
+void CMapGen::AddGameTile(int Data)
 {
 	CMapItemLayerTilemap Item;
 	Item.m_Version = 3;
@@ -1058,13 +1227,13 @@ void CMapGen::AddGameTile(CTile *pTile)
 	Item.m_Flags = 1;
 	Item.m_Image = -1;
 
-	Item.m_Data = m_DataFile.AddData(Item.m_Width*Item.m_Height*sizeof(CTile), pTile);
+	Item.m_Data = Data;
 	StrToInts(Item.m_aName, sizeof(Item.m_aName)/sizeof(int), "Game");
 	m_DataFile.AddItem(MAPITEMTYPE_LAYER, m_NumLayers++, sizeof(Item), &Item);
 	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "mapgen", "game tiles generated");
 }
 
-void CMapGen::AddTile(CTile *pTile, const char *LayerName, int Image)
+void CMapGen::AddTile(int Data, const char *LayerName, int Image)
 {
 	CMapItemLayerTilemap Item;
 	Item.m_Version = 3;
@@ -1082,27 +1251,89 @@ void CMapGen::AddTile(CTile *pTile, const char *LayerName, int Image)
 	Item.m_Flags = 0;
 	Item.m_Image = Image;
 
-	Item.m_Data = m_DataFile.AddData(Item.m_Width*Item.m_Height*sizeof(CTile), pTile);
+	Item.m_Data = Data;
 	StrToInts(Item.m_aName, sizeof(Item.m_aName)/sizeof(int), LayerName);
 	m_DataFile.AddItem(MAPITEMTYPE_LAYER, m_NumLayers++, sizeof(CMapItemLayerTilemap), &Item);
 }
 
 bool CMapGen::CreateMap(const char* pFilename)
 {
-	char aBuf[512];
-	if(!m_DataFile.Open(Storage(), pFilename))
-	{
-		str_format(aBuf, sizeof(aBuf), "failed to open file '%s'...", pFilename);
-		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mapgen", aBuf);
+	unsigned char *pData;
+	unsigned Size;
+	if(!CreateMapInMemory(&pData, &Size))
 		return false;
-	}
+
+	bool Written = WriteMap(Storage(), pFilename, pData, Size);
+	mem_free(pData);
+	return Written;
+}
+
+bool CMapGen::CreateMapInMemory(unsigned char **ppData, unsigned *pSize)
+{
+	m_DataFile.OpenMemory();
 
 	InitState();
 	
 	GenerateMap();
 	
 	m_DataFile.Finish();
-	
-	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "mapgen", "map generated");
+
+	*ppData = m_DataFile.TakeMemory(pSize);
+	if(!*ppData)
+	{
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mapgen", "failed to write the map");
+		return false;
+	}
+
+	char aBuf[128];
+	str_format(aBuf, sizeof(aBuf), "map generated, %u bytes, %d KiB of tiles at the peak", *pSize, (int)(m_PeakMemoryUsage/1024));
+	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "mapgen", aBuf);
 	return true;
 }
+
+bool CMapGen::WriteMap(IStorage *pStorage, const char *pFilename, const unsigned char *pData, unsigned Size)
+{
+	// a loaded map may be mapped, it must be replaced and not overwritten
+	char aTmpFilename[512];
+	str_format(aTmpFilename, sizeof(aTmpFilename), "%s.tmp", pFilename);
+
+	IOHANDLE File = pStorage->OpenFile(aTmpFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+	{
+		dbg_msg("mapgen", "failed to open file '%s'...", aTmpFilename);
+		return false;
+	}
+	bool Written = io_write(File, pData, Size) == Size;
+	io_close(File);
+	if(!Written)
+	{
+		dbg_msg("mapgen", "failed to write '%s'", aTmpFilename);
+		pStorage->RemoveFile(aTmpFilename, IStorage::TYPE_SAVE);
+		return false;
+	}
+
+	if(!pStorage->RenameFile(aTmpFilename, pFilename, IStorage::TYPE_SAVE))
+	{
+		// rename does not replace files everywhere
+		pStorage->RemoveFile(pFilename, IStorage::TYPE_SAVE);
+		if(!pStorage->RenameFile(aTmpFilename, pFilename, IStorage::TYPE_SAVE))
+		{
+			dbg_msg("mapgen", "failed to replace '%s'", pFilename);
+			return false;
+		}
+	}
+	return true;
+}
+
+CMapGen::CArchiveJob::CArchiveJob(IStorage *pStorage, const char *pFilename, const unsigned char *pData, unsigned Size) :
+	m_pStorage(pStorage),
+	m_vData(pData, pData + Size)
+{
+	str_copy(m_aFilename, pFilename, sizeof(m_aFilename));
+}
+
+void CMapGen::CArchiveJob::Run()
+{
+	if(WriteMap(m_pStorage, m_aFilename, m_vData.data(), m_vData.size()))
+		dbg_msg("mapgen", "archived '%s'", m_aFilename);
+}
@@ -10,6 +10,12 @@
 #include <game/gamecore.h>
 #include <engine/shared/imageinfo.h>
 
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
 class CMapGen
 {
 protected:
@@ -17,11 +23,14 @@ protected:
 	IConsole *m_pConsole;
 	CDataFileWriter m_DataFile;
 	
-	CTile* m_pBackGroundTiles;
-	CTile* m_pGameTiles;
-	CTile* m_pHookableTiles;
-	CTile* m_pUnhookableTiles;
-	CTile* m_pDoodadsTiles;
+	// the game layer is the only one held as a whole, the others
+	// are derived from it or from noise one row band at a time
+	std::vector<CTile> m_vGameTiles;
+
+	// bytes of the tile buffers in use, the peak is logged per map
+	int64 m_MemoryUsage;
+	int64 m_PeakMemoryUsage;
+	void UseMemory(int64 Bytes);
 	
 	int m_NumGroups;
 	int m_NumLayers;
@@ -34,8 +43,8 @@ protected:
 	
 	void InitQuad(CQuad* pQuad);
 	void InitQuad(CQuad* pQuad, vec2 Pos, vec2 Size);
-	void AddTile(CTile *pTile, const char *LayerName, int Image);
-	void AddGameTile(CTile *pTile);
+	void AddTile(int Data, const char *LayerName, int Image);
+	void AddGameTile(int Data);
 
 	void GenerateBackground();
 	void GenerateBackgroundTile();
@@ -46,7 +55,6 @@ protected:
 
 	// auto map
 	int LoadRules(const char *pImageName);
-	void Proceed(CTile *pTiles, int ConfigID);
 
 	struct CPosRule
 	{
@@ -77,26 +85,83 @@ protected:
 	{
 		array<CIndexRule> m_aIndexRules;
 		char m_aName[128];
+		int m_BaseTile;
 	};
 
-	class CAirTile
+	// fills row y of a layer before it is auto mapped
+	typedef void (*FRawRow)(int y, CTile *pRow, void *pUser);
+
+	/*
+		Function: AddAutomappedData
+			Adds a tile layer as data block. The rows are made by
+			pfnRawRow top to bottom, auto mapped and compressed as
+			soon as no rule can reach them any more, so only a few
+			rows are held at a time.
+
+		Returns:
+			The index of the data block.
+	*/
+	int AddAutomappedData(int ConfigID, FRawRow pfnRawRow, void *pUser);
+
+	// auto maps row y, ppRows holds the rows y-Reach to y+Reach
+	void ProceedRow(const CConfiguration *pConf, int y, CTile **ppRows, int Reach);
+
+	// the air of the game layer as horizontal runs in scan order, each
+	// labelled with its area, so the labels cost memory per run and not
+	// per tile
+	struct CAirRun
 	{
-	public:
-		CAirTile() {};
-		CAirTile(int x, int y) { m_x = x; m_y = y; m_IsVisited = 0;}
-		int m_x;
-		int m_y;
-		bool m_IsVisited;
+		short m_X0;
+		short m_X1; // exclusive
+		int m_Area; // the union-find parent while labelling
 	};
-	
-	class CArea
+	struct CAirRuns
 	{
-	public:
-		CArea() {};
-		array<CAirTile> m_Tiles;
+		std::vector<CAirRun> m_vRuns;
+		std::vector<int> m_vRowStart; // index of the first run of each row, one more than rows
+
+		// -1 for tiles that were not air when labelling
+		int AreaAt(int x, int y) const;
 	};
 
-	array<CConfiguration> m_lConfigs;
+	/*
+		Function: ConnectAirAreas
+			Labels the air areas of the game layer and connects each
+			one to the ones before it with a tunnel from a random tile
+			of it to the closest connected tile.
+	*/
+	void ConnectAirAreas(CTile *pTiles, int Width, int Height);
+	static int FindRoot(std::vector<CAirRun> &vRuns, int Run);
+	static void CarveTunnel(CTile *pTiles, const CAirRuns &Runs, unsigned char *pConnected, int Width, int Height, ivec2 Start, ivec2 End);
+
+	// decoded assets are kept for the whole process, keyed by file name and checked against the file time
+	struct CCachedImage
+	{
+		time_t m_Modified;
+		int m_Width;
+		int m_Height;
+		std::vector<unsigned char> m_vRGBA;
+		int m_CompressionLevel;
+		std::vector<unsigned char> m_vCompressed;
+	};
+
+	struct CCachedRules
+	{
+		time_t m_Modified;
+		array<CConfiguration> m_lConfigs;
+	};
+
+	static std::mutex ms_AssetLock;
+	static std::map<std::string, std::shared_ptr<const CCachedImage>> ms_Images;
+	static std::map<std::string, std::shared_ptr<const CCachedRules>> ms_Rules;
+
+	std::shared_ptr<const CCachedImage> GetImage(const char *pImageName);
+	std::shared_ptr<const CCachedRules> GetRules(const char *pImageName);
+	void ParseRules(IOHANDLE RulesFile, CCachedRules *pRules);
+
+	// the rules of this run, the configurations point into the cached rules
+	std::vector<std::shared_ptr<const CCachedRules>> m_vpRules;
+	std::vector<const CConfiguration *> m_vpConfigs;
 
 	void InitState();
 	
@@ -109,10 +174,93 @@ protected:
 	void GenerateMap();
 
 public:
-	CMapGen(IStorage *pStorage, IConsole* pConsole);
+	// a block of Width x Height tiles of a 16 tiles wide tileset, m_Index is the top left one
+	struct CDoodadStamp
+	{
+		int m_Index;
+		int m_Width;
+		int m_Height;
+	};
+
+	// PlaceDoodads one row of positions at a time, for layers that are written in bands
+	class CDoodadPlacer
+	{
+		const CTile *m_pGameTiles;
+		int m_Width;
+		int m_Height;
+		const CDoodadStamp *m_pStamps;
+		int m_NumStamps;
+		int m_NumRows;
+		int m_MaxHeight;
+
+		std::vector<int> m_vCoveredUntil;
+		std::vector<int> m_vFree;
+		std::vector<int> m_vAirRuns;
+		std::vector<int> m_vSolidRuns;
+
+	public:
+		CDoodadPlacer(const CTile *pGameTiles, int Width, int Height, const CDoodadStamp *pStamps, int NumStamps);
+
+		// rows of positions, the stamps of row y cover the doodad rows y+1 to y+MaxHeight()
+		int NumRows() const { return m_NumRows; }
+		int MaxHeight() const { return m_MaxHeight; }
+
+		// doodad row r is row r % NumDoodadRows of pDoodadRows, the rows have to be empty
+		void PlaceRow(int y, CTile *pDoodadRows, int NumDoodadRows);
+	};
+
+	/*
+		Function: PlaceDoodads
+			Stamps doodads on air that is directly above a solid floor.
+			A stamp fits where the first row it covers is air in the
+			game layer, the row below it is solid and inside the map
+			and no other stamp is in the way. Positions are tried row by row and the first
+			fitting stamp in pStamps wins. Every position is checked in
+			constant time against run lengths of the game rows.
+
+		Parameters:
+			pGameTiles - The game layer.
+			pDoodadsTiles - The doodad layer, it has to be empty.
+			Width - Width of both layers.
+			Height - Height of both layers.
+			pStamps - The stamps in the order they are tried.
+			NumStamps - Number of stamps.
+	*/
+	static void PlaceDoodads(const CTile *pGameTiles, CTile *pDoodadsTiles, int Width, int Height, const CDoodadStamp *pStamps, int NumStamps);
+
+	// writes a copy of a generated map to disk on the job pool
+	class CArchiveJob : public IJob
+	{
+		IStorage *m_pStorage;
+		char m_aFilename[512];
+		std::vector<unsigned char> m_vData;
+		void Run() override;
+
+	public:
+		CArchiveJob(IStorage *pStorage, const char *pFilename, const unsigned char *pData, unsigned Size);
+	};
+
+	CMapGen(IStorage *pStorage, IConsole* pConsole, class IEngine *pEngine);
 	~CMapGen();
 
 	bool CreateMap(const char* pFilename);
+
+	/*
+		Function: CreateMapInMemory
+			Generates a map without writing it to disk.
+
+		Parameters:
+			ppData - Set to the map file, allocated with mem_alloc. It can
+				be handed to IEngineMap::LoadMemory.
+			pSize - Set to the size of the map file.
+
+		Returns:
+			true on success.
+	*/
+	bool CreateMapInMemory(unsigned char **ppData, unsigned *pSize);
+
+	// writes a map file through a temporary file, so a loaded map is never truncated
+	static bool WriteMap(IStorage *pStorage, const char *pFilename, const unsigned char *pData, unsigned Size);
 };
 
 #endif
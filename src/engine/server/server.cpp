@@ -23,6 +23,7 @@
 #include <engine/shared/netban.h>
 #include <engine/shared/network.h>
 #include <engine/shared/packer.h>
+#include <engine/shared/profiler.h>
 #include <engine/shared/protocol.h>
 #include <engine/shared/protocol_ex.h>
 #include <engine/shared/snapshot.h>
@@ -222,9 +223,8 @@ int CServerBan::BanExt(T *pBanPool, const typename T::CDataType *pData, int Seco
 
 		if(NetMatch(&Data, Server()->m_NetServer.ClientAddr(i)))
 		{
-			CNetHash NetHash(&Data);
 			char aBuf[256];
-			MakeBanInfo(pBanPool->Find(&Data, &NetHash), aBuf, sizeof(aBuf), MSGTYPE_PLAYER);
+			MakeBanInfo(pBanPool->Find(&Data), aBuf, sizeof(aBuf), MSGTYPE_PLAYER);
 			Server()->m_NetServer.Drop(i, aBuf);
 		}
 	}
@@ -303,10 +303,14 @@ CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
 	m_RunServer = 1;
 
 	m_pCurrentMapData = 0;
+	m_pCurrentMapBuffer = 0;
 	m_CurrentMapSize = 0;
 
 	m_MapReload = 0;
 	m_GeneratedMap = 0;
+	m_pGeneratedMapData = 0;
+	m_GeneratedMapSize = 0;
+	m_MapChangeStart = 0;
 
 	m_RconClientID = IServer::RCON_CID_SERV;
 	m_RconAuthLevel = AUTHED_ADMIN;
@@ -315,17 +319,46 @@ CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
 	m_ServerInfoNumRequests = 0;
 	m_ServerInfoHighLoad = false;
 	m_ServerInfoNeedsUpdate = false;
+	m_ServerInfoFieldsValid = false;
+	m_ServerInfoJsonFieldsSize = 0;
+	m_aServerInfoJsonFields[0] = 0;
+	for(int i = 0; i < 3; i++)
+		m_aServerInfoHeadClients[i] = -1;
+	mem_zero(m_aClientInfoFragments, sizeof(m_aClientInfoFragments));
+	m_ServerInfoUpdates = 0;
+	m_ServerInfoBytesRebuilt = 0;
+	m_ServerInfoLastBytesRebuilt = 0;
 
 	m_pRegister = nullptr;
 	m_MapLock = lock_create();
 
 	m_Active = false;
 
+	m_OverloadLevel = OVERLOAD_NONE;
+	m_LateTicksSecond = 0;
+	m_CatchupCappedSecond = false;
+	m_CalmSeconds = 0;
+	m_LateTicksMinute = 0;
+	m_SkippedTicksMinute = 0;
+	m_MaxTickLagMinute = 0;
+	m_OverloadSecondTime = 0;
+	m_OverloadMinuteTime = 0;
+
+	m_ProfileLog = 0;
+	m_DeltaDump = 0;
+	m_DeltaDumpLeft = 0;
+	m_aProfileLogName[0] = 0;
+	m_ProfileLogTime = 0;
+
 	Init();
 }
 
 CServer::~CServer()
 {
+	if(m_ProfileLog)
+		io_close(m_ProfileLog);
+	if(m_DeltaDump)
+		io_close(m_DeltaDump);
 	lock_destroy(m_MapLock);
 	delete m_pRegister;
 }
@@ -707,6 +740,13 @@ void CServer::DoSnapshot()
 		if(m_aClients[i].m_SnapRate == CClient::SNAPRATE_INIT && (Tick()%10) != 0)
 			continue;
 
+		// overloaded, far clients get every other snapshot. Without
+		// sv_high_bandwidth snapshots are only made on even ticks, so
+		// count them instead of the ticks
+		if(m_OverloadLevel >= OVERLOAD_SNAPRATE && m_aClients[i].m_Latency > g_Config.m_SvOverloadFarPing &&
+			(Tick()/(g_Config.m_SvHighBandwidth ? 1 : 2))%2 != 0)
+			continue;
+
 		{
 			char aData[CSnapshot::MAX_SIZE];
 			CSnapshot *pData = (CSnapshot*)aData;	// Fix compiler warning for strict-aliasing
@@ -716,30 +756,34 @@ void CServer::DoSnapshot()
 			int Crc;
 			static CSnapshot EmptySnap;
 			CSnapshot *pDeltashot = &EmptySnap;
+			const uint64_t *pDeltaKeys = 0;
 			int DeltashotSize;
 			int DeltaTick = -1;
 			int DeltaSize;
 
-			m_SnapshotBuilder.Init();
+			{
+				CProfileScope Scope(CProfiler::PHASE_SNAP_BUILD, true);
+				m_SnapshotBuilder.Init();
 
-			GameServer()->OnSnap(i);
+				GameServer()->OnSnap(i);
 
-			// finish snapshot
-			SnapshotSize = m_SnapshotBuilder.Finish(pData);
-			Crc = pData->Crc();
+				// finish snapshot
+				SnapshotSize = m_SnapshotBuilder.Finish(pData);
+				Crc = pData->Crc();
+			}
 
 			// remove old snapshos
 			// keep 3 seconds worth of snapshots
 			m_aClients[i].m_Snapshots.PurgeUntil(m_CurrentGameTick-SERVER_TICK_SPEED*3);
 
 			// save it the snapshot
-			m_aClients[i].m_Snapshots.Add(m_CurrentGameTick, time_get(), SnapshotSize, pData, 0, nullptr);
+			m_aClients[i].m_Snapshots.Add(m_CurrentGameTick, time_get(), SnapshotSize, pData, 0, nullptr, m_SnapshotBuilder.SortedKeys());
 
 			// find snapshot that we can preform delta against
 			EmptySnap.Clear();
 
 			{
-				DeltashotSize = m_aClients[i].m_Snapshots.Get(m_aClients[i].m_LastAckedSnapshot, 0, &pDeltashot, 0);
+				DeltashotSize = m_aClients[i].m_Snapshots.Get(m_aClients[i].m_LastAckedSnapshot, 0, &pDeltashot, 0, &pDeltaKeys);
 				if(DeltashotSize >= 0)
 					DeltaTick = m_aClients[i].m_LastAckedSnapshot;
 				else
@@ -751,16 +795,43 @@ void CServer::DoSnapshot()
 			}
 
 			// create delta
-			DeltaSize = m_SnapshotDelta.CreateDelta(pDeltashot, pData, aDeltaData);
+			int CompSize = 0;
+			{
+				CProfileScope Scope(CProfiler::PHASE_SNAP_DELTA, true);
+				DeltaSize = m_SnapshotDelta.CreateDelta(pDeltashot, pData, aDeltaData, pDeltaKeys, m_SnapshotBuilder.SortedKeys());
+				if(DeltaSize)
+					CompSize = CVariableInt::Compress(aDeltaData, DeltaSize, aCompData, sizeof(aCompData));
+			}
+
+			if(m_DeltaDump && DeltaSize)
+			{
+				// every delta is its number of ints followed by the ints
+				int NumInts = DeltaSize/(int)sizeof(int);
+				io_write(m_DeltaDump, &NumInts, sizeof(NumInts));
+				io_write(m_DeltaDump, aDeltaData, DeltaSize);
+				if(--m_DeltaDumpLeft == 0)
+				{
+					io_close(m_DeltaDump);
+					m_DeltaDump = 0;
+					Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "varint", "delta dump done");
+				}
+			}
+
+			if(m_MapChangeStart && DeltaTick < 0)
+			{
+				char aBuf[128];
+				str_format(aBuf, sizeof(aBuf), "first full snapshot %.2f ms after the map change", (time_get_impl() - m_MapChangeStart) * 1000.0 / time_freq());
+				Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+				m_MapChangeStart = 0;
+			}
 
 			if(DeltaSize)
 			{
 				// compress it
-				int SnapshotSize;
+				int SnapshotSize = CompSize;
 				const int MaxSize = MAX_SNAPSHOT_PACKSIZE;
 				int NumPackets;
 
-				SnapshotSize = CVariableInt::Compress(aDeltaData, DeltaSize, aCompData, sizeof(aCompData));
 				NumPackets = (SnapshotSize+MaxSize-1)/MaxSize;
 
 				for(int n = 0, Left = SnapshotSize; Left; n++)
@@ -801,6 +872,8 @@ void CServer::DoSnapshot()
 			}
 		}
 	}
+	g_Profiler.FlushParts(CProfiler::PHASE_SNAP_BUILD);
+	g_Profiler.FlushParts(CProfiler::PHASE_SNAP_DELTA);
 
 	GameServer()->OnPostSnap();
 }
@@ -832,6 +905,7 @@ int CServer::NewClientNoAuthCallback(int ClientID, void *pUser)
 	pThis->m_aClients[ClientID].m_Authed = AUTHED_NO;
 	pThis->m_aClients[ClientID].m_AuthTries = 0;
 	pThis->m_aClients[ClientID].m_pRconCmdToSend = 0;
+	pThis->m_aClients[ClientID].m_MapChanging = false;
 	pThis->m_aClients[ClientID].m_DDNetVersion = VERSION_NONE;
 	pThis->m_aClients[ClientID].m_GotDDNetVersionPacket = false;
 	pThis->m_aClients[ClientID].m_DDNetVersionSettled = false;
@@ -853,6 +927,7 @@ int CServer::NewClientCallback(int ClientID, void *pUser, bool Sixup)
 	pThis->m_aClients[ClientID].m_Authed = AUTHED_NO;
 	pThis->m_aClients[ClientID].m_AuthTries = 0;
 	pThis->m_aClients[ClientID].m_pRconCmdToSend = 0;
+	pThis->m_aClients[ClientID].m_MapChanging = false;
 	pThis->m_aClients[ClientID].m_DDNetVersion = VERSION_NONE;
 	pThis->m_aClients[ClientID].m_GotDDNetVersionPacket = false;
 	pThis->m_aClients[ClientID].m_DDNetVersionSettled = false;
@@ -872,10 +947,11 @@ int CServer::DelClientCallback(int ClientID, const char *pReason, void *pUser)
 	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBuf);
 
 	// notify the mod about the drop
-	if(pThis->m_aClients[ClientID].m_State >= CClient::STATE_READY)
+	if(pThis->m_aClients[ClientID].m_State >= CClient::STATE_READY || pThis->m_aClients[ClientID].m_MapChanging)
 		pThis->GameServer()->OnClientDrop(ClientID, pReason);
 
 	pThis->m_aClients[ClientID].m_State = CClient::STATE_EMPTY;
+	pThis->m_aClients[ClientID].m_MapChanging = false;
 	pThis->m_aClients[ClientID].m_aName[0] = 0;
 	pThis->m_aClients[ClientID].m_aClan[0] = 0;
 	pThis->m_aClients[ClientID].m_Country = -1;
@@ -1095,6 +1171,7 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 				str_format(aBuf, sizeof(aBuf), "player is ready. ClientID=%x addr=%s secure=%s", ClientID, aAddrStr, m_NetServer.HasSecurityToken(ClientID)?"yes":"no");
 				Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBuf);
 				m_aClients[ClientID].m_State = CClient::STATE_READY;
+				m_aClients[ClientID].m_MapChanging = false;
 				GameServer()->OnClientConnected(ClientID);
 				SendConnectionReady(ClientID);
 			}
@@ -1366,13 +1443,191 @@ void CServer::CCache::Clear()
 	m_Cache.clear();
 }
 
+// packs an int as a decimal string, like formatting it with "%d"
+static void AddIntString(CPacker *pPacker, int Value)
+{
+	char aBuf[16];
+	char *pStart = aBuf + sizeof(aBuf);
+	*--pStart = 0;
+	unsigned Abs = Value < 0 ? 0u - (unsigned)Value : (unsigned)Value;
+	do
+	{
+		*--pStart = '0' + Abs % 10;
+		Abs /= 10;
+	} while(Abs);
+	if(Value < 0)
+		*--pStart = '-';
+	pPacker->AddRaw(pStart, aBuf + sizeof(aBuf) - pStart);
+}
+
+void CServer::UpdateServerInfoFragments()
+{
+	int Rebuilt = 0;
+
+	int ClientCount = 0;
+	for(int i = 0; i < MAX_PLAYERS; i++)
+		if(m_aClients[i].m_State != CClient::STATE_EMPTY)
+			ClientCount++;
+
+	CServerInfoFields Fields;
+	mem_zero(&Fields, sizeof(Fields));
+	str_copy(Fields.m_aName, g_Config.m_SvName, sizeof(Fields.m_aName));
+	str_copy(Fields.m_aGameType, GameServer()->GameType(), sizeof(Fields.m_aGameType));
+	str_copy(Fields.m_aVersion, GameServer()->Version(), sizeof(Fields.m_aVersion));
+	Fields.m_Password = g_Config.m_Password[0];
+	Fields.m_MapCrc = m_CurrentMapCrc;
+	Fields.m_MapSize = m_CurrentMapSize;
+	Fields.m_MapSha256 = m_CurrentMapSha256;
+	bool FieldsChanged = !m_ServerInfoFieldsValid || mem_comp(&Fields, &m_ServerInfoFields, sizeof(Fields)) != 0;
+	m_ServerInfoFields = Fields;
+	m_ServerInfoFieldsValid = true;
+
+	// vanilla clients see the client count in the name on bigger servers
+	bool VanillaCountInName = m_NetServer.MaxClients() > VANILLA_MAX_CLIENTS;
+
+	CPacker p;
+	char aBuf[128];
+	for(int Type = 0; Type < 3; Type++)
+	{
+		int HeadClients = Type == SERVERINFO_VANILLA && VanillaCountInName ? ClientCount : -1;
+		if(!FieldsChanged && HeadClients == m_aServerInfoHeadClients[Type])
+			continue;
+
+		p.Reset();
+		p.AddString(Fields.m_aVersion, 32);
+		if(Type != SERVERINFO_VANILLA)
+			p.AddString(Fields.m_aName, 256);
+		else if(HeadClients < 0)
+			p.AddString(Fields.m_aName, 64);
+		else
+		{
+			const int MaxClients = max(ClientCount, m_NetServer.MaxClients());
+			str_format(aBuf, sizeof(aBuf), "%s [%d/%d]", Fields.m_aName, ClientCount, MaxClients);
+			p.AddString(aBuf, 64);
+		}
+		p.AddString("LastDay", 32);
+
+		if(Type == SERVERINFO_EXTENDED)
+		{
+			AddIntString(&p, Fields.m_MapCrc);
+			AddIntString(&p, Fields.m_MapSize);
+		}
+
+		// gametype
+		p.AddString(Fields.m_aGameType, 16);
+
+		// flags
+		AddIntString(&p, Fields.m_Password ? SERVER_FLAG_PASSWORD : 0);
+
+		m_avServerInfoHead[Type].assign(p.Data(), p.Data() + p.Size());
+		m_aServerInfoHeadClients[Type] = HeadClients;
+		Rebuilt += p.Size();
+	}
+
+	if(FieldsChanged)
+	{
+		char aName[256];
+		char aGameType[32];
+		char aMapName[64];
+		char aVersion[64];
+		char aMapSha256[SHA256_MAXSTRSIZE];
+		sha256_str(Fields.m_MapSha256, aMapSha256, sizeof(aMapSha256));
+
+		str_format(m_aServerInfoJsonFields, sizeof(m_aServerInfoJsonFields),
+			"\"passworded\":%s,"
+			"\"game_type\":\"%s\","
+			"\"name\":\"%s\","
+			"\"map\":{"
+			"\"name\":\"%s\","
+			"\"sha256\":\"%s\","
+			"\"size\":%d"
+			"},"
+			"\"version\":\"%s\",",
+			JsonBool(Fields.m_Password),
+			EscapeJson(aGameType, sizeof(aGameType), Fields.m_aGameType),
+			EscapeJson(aName, sizeof(aName), Fields.m_aName),
+			EscapeJson(aMapName, sizeof(aMapName), "LastDay"),
+			aMapSha256,
+			Fields.m_MapSize,
+			EscapeJson(aVersion, sizeof(aVersion), Fields.m_aVersion));
+		m_ServerInfoJsonFieldsSize = str_length(m_aServerInfoJsonFields);
+		Rebuilt += m_ServerInfoJsonFieldsSize;
+	}
+
+	for(int i = 0; i < MAX_PLAYERS; i++)
+	{
+		CClientInfoFragment *pFragment = &m_aClientInfoFragments[i];
+		if(m_aClients[i].m_State == CClient::STATE_EMPTY)
+		{
+			pFragment->m_Valid = false;
+			continue;
+		}
+
+		// the extra info of the game is only known by asking for it
+		char aExtra[sizeof(pFragment->m_aExtra)];
+		aExtra[0] = 0;
+		GameServer()->OnUpdatePlayerServerInfo(aExtra, sizeof(aExtra), i);
+		bool Player = GameServer()->IsClientPlayer(i);
+
+		if(pFragment->m_Valid &&
+			str_comp(pFragment->m_aName, ClientName(i)) == 0 &&
+			str_comp(pFragment->m_aClan, ClientClan(i)) == 0 &&
+			pFragment->m_Country == m_aClients[i].m_Country &&
+			pFragment->m_Score == m_aClients[i].m_Score &&
+			pFragment->m_Player == Player &&
+			str_comp(pFragment->m_aExtra, aExtra) == 0)
+			continue;
+
+		pFragment->m_Valid = true;
+		str_copy(pFragment->m_aName, ClientName(i), sizeof(pFragment->m_aName));
+		str_copy(pFragment->m_aClan, ClientClan(i), sizeof(pFragment->m_aClan));
+		pFragment->m_Country = m_aClients[i].m_Country;
+		pFragment->m_Score = m_aClients[i].m_Score;
+		pFragment->m_Player = Player;
+		str_copy(pFragment->m_aExtra, aExtra, sizeof(pFragment->m_aExtra));
+
+		p.Reset();
+		p.AddString(ClientName(i), MAX_NAME_LENGTH); // client name
+		p.AddString(ClientClan(i), MAX_CLAN_LENGTH); // client clan
+		AddIntString(&p, pFragment->m_Country); // client country
+		AddIntString(&p, pFragment->m_Score); // client score
+		AddIntString(&p, Player ? 1 : 0); // is player?
+		mem_copy(pFragment->m_aPacked, p.Data(), p.Size());
+		pFragment->m_PackedSize = p.Size();
+
+		char aCName[32];
+		char aCClan[32];
+		str_format(pFragment->m_aJson, sizeof(pFragment->m_aJson),
+			"{"
+			"\"name\":\"%s\","
+			"\"clan\":\"%s\","
+			"\"country\":%d,"
+			"\"score\":%d,"
+			"\"is_player\":%s"
+			"%s"
+			"}",
+			EscapeJson(aCName, sizeof(aCName), ClientName(i)),
+			EscapeJson(aCClan, sizeof(aCClan), ClientClan(i)),
+			pFragment->m_Country,
+			pFragment->m_Score,
+			JsonBool(Player),
+			aExtra);
+		pFragment->m_JsonSize = str_length(pFragment->m_aJson);
+
+		Rebuilt += pFragment->m_PackedSize + pFragment->m_JsonSize;
+	}
+
+	m_ServerInfoUpdates++;
+	m_ServerInfoBytesRebuilt += Rebuilt;
+	m_ServerInfoLastBytesRebuilt = Rebuilt;
+}
+
 void CServer::CacheServerInfo(CCache *pCache, int Type, bool SendClients)
 {
 	pCache->Clear();
 
 	// One chance to improve the protocol!
 	CPacker p;
-	char aBuf[128];
 
 	// count the players
 	int PlayerCount = 0, ClientCount = 0;
@@ -1380,7 +1635,7 @@ void CServer::CacheServerInfo(CCache *pCache, int Type, bool SendClients)
 	{
 		if(m_aClients[i].m_State != CClient::STATE_EMPTY)
 		{
-			if(GameServer()->IsClientPlayer(i))
+			if(m_aClientInfoFragments[i].m_Player)
 				PlayerCount++;
 
 			ClientCount++;
@@ -1389,45 +1644,8 @@ void CServer::CacheServerInfo(CCache *pCache, int Type, bool SendClients)
 
 	p.Reset();
 
-#define ADD_RAW(p, x) (p).AddRaw(x, sizeof(x))
-#define ADD_INT(p, x) \
-	do \
-	{ \
-		str_format(aBuf, sizeof(aBuf), "%d", x); \
-		(p).AddString(aBuf, 0); \
-	} while(0)
-
-	p.AddString(GameServer()->Version(), 32);
-	if(Type != SERVERINFO_VANILLA)
-	{
-		p.AddString(g_Config.m_SvName, 256);
-	}
-	else
-	{
-		if(m_NetServer.MaxClients() <= VANILLA_MAX_CLIENTS)
-		{
-			p.AddString(g_Config.m_SvName, 64);
-		}
-		else
-		{
-			const int MaxClients = max(ClientCount, m_NetServer.MaxClients());
-			str_format(aBuf, sizeof(aBuf), "%s [%d/%d]", g_Config.m_SvName, ClientCount, MaxClients);
-			p.AddString(aBuf, 64);
-		}
-	}
-	p.AddString("LastDay", 32);
-
-	if(Type == SERVERINFO_EXTENDED)
-	{
-		ADD_INT(p, m_CurrentMapCrc);
-		ADD_INT(p, m_CurrentMapSize);
-	}
-
-	// gametype
-	p.AddString(GameServer()->GameType(), 16);
-
-	// flags
-	ADD_INT(p, g_Config.m_Password[0] ? SERVER_FLAG_PASSWORD : 0);
+	// version up to the flags, packed by UpdateServerInfoFragments
+	p.AddRaw(m_avServerInfoHead[Type].data(), m_avServerInfoHead[Type].size());
 
 	int MaxClients = m_NetServer.MaxClients();
 	// How many clients the used serverinfo protocol supports, has to be tracked
@@ -1447,10 +1665,10 @@ void CServer::CacheServerInfo(CCache *pCache, int Type, bool SendClients)
 			PlayerCount = ClientCount;
 	}
 
-	ADD_INT(p, PlayerCount); // num players
-	ADD_INT(p, minimum(MaxClientsProtocol, max(MaxClients - g_Config.m_SvSpectatorSlots, PlayerCount))); // max players
-	ADD_INT(p, ClientCount); // num clients
-	ADD_INT(p, minimum(MaxClientsProtocol, max(MaxClients, ClientCount))); // max clients
+	AddIntString(&p, PlayerCount); // num players
+	AddIntString(&p, minimum(MaxClientsProtocol, max(MaxClients - g_Config.m_SvSpectatorSlots, PlayerCount))); // max players
+	AddIntString(&p, ClientCount); // num clients
+	AddIntString(&p, minimum(MaxClientsProtocol, max(MaxClients, ClientCount))); // max clients
 
 	if(Type == SERVERINFO_EXTENDED)
 		p.AddString("", 0); // extra info, reserved
@@ -1530,12 +1748,9 @@ void CServer::CacheServerInfo(CCache *pCache, int Type, bool SendClients)
 
 			int PreviousSize = q.Size();
 
-			q.AddString(ClientName(i), MAX_NAME_LENGTH); // client name
-			q.AddString(ClientClan(i), MAX_CLAN_LENGTH); // client clan
-
-			ADD_INT(q, m_aClients[i].m_Country); // client country
-			ADD_INT(q, m_aClients[i].m_Score); // client score
-			ADD_INT(q, GameServer()->IsClientPlayer(i) ? 1 : 0); // is player?
+			// name, clan, country, score and is player
+			const CClientInfoFragment *pFragment = &m_aClientInfoFragments[i];
+			q.AddRaw(pFragment->m_aPacked, pFragment->m_PackedSize);
 			if(Type == SERVERINFO_EXTENDED)
 				q.AddString("", 0); // extra info, reserved
 
@@ -1547,7 +1762,7 @@ void CServer::CacheServerInfo(CCache *pCache, int Type, bool SendClients)
 					i--;
 					SAVE(PreviousSize);
 					RESET();
-					ADD_INT(q, ChunksStored);
+					AddIntString(&q, ChunksStored);
 					q.AddString("", 0); // extra info, reserved
 					continue;
 				}
@@ -1559,25 +1774,17 @@ void CServer::CacheServerInfo(CCache *pCache, int Type, bool SendClients)
 	SAVE(q.Size());
 #undef SAVE
 #undef RESET
-#undef ADD_RAW
-#undef ADD_INT
 }
 
 void CServer::SendServerInfo(const NETADDR *pAddr, int Token, int Type, bool SendClients)
 {
 	CPacker p;
-	char aBuf[128];
 	p.Reset();
 
 	CCache *pCache = &m_aServerInfoCache[GetCacheIndex(Type, SendClients)];
 
 #define ADD_RAW(p, x) (p).AddRaw(x, sizeof(x))
-#define ADD_INT(p, x) \
-	do \
-	{ \
-		str_format(aBuf, sizeof(aBuf), "%d", x); \
-		(p).AddString(aBuf, 0); \
-	} while(0)
+#define ADD_INT(p, x) AddIntString(&(p), x)
 
 	CNetChunk Packet;
 	Packet.m_ClientID = -1;
@@ -1630,7 +1837,7 @@ void CServer::UpdateRegisterServerInfo()
 	{
 		if(m_aClients[i].m_State != CClient::STATE_EMPTY)
 		{
-			if(GameServer()->IsClientPlayer(i))
+			if(m_aClientInfoFragments[i].m_Player)
 				PlayerCount++;
 
 			ClientCount++;
@@ -1639,73 +1846,42 @@ void CServer::UpdateRegisterServerInfo()
 
 	int MaxPlayers = max(m_NetServer.MaxClients() - g_Config.m_SvSpectatorSlots, PlayerCount);
 	int MaxClients = max(m_NetServer.MaxClients(), ClientCount);
-	char aName[256];
-	char aGameType[32];
-	char aMapName[64];
-	char aVersion[64];
-	char aMapSha256[SHA256_MAXSTRSIZE];
-
-	sha256_str(m_CurrentMapSha256, aMapSha256, sizeof(aMapSha256));
 
+	// the fields and clients are copied from UpdateServerInfoFragments
 	char aInfo[16384];
 	str_format(aInfo, sizeof(aInfo),
 		"{"
 		"\"max_clients\":%d,"
-		"\"max_players\":%d,"
-		"\"passworded\":%s,"
-		"\"game_type\":\"%s\","
-		"\"name\":\"%s\","
-		"\"map\":{"
-		"\"name\":\"%s\","
-		"\"sha256\":\"%s\","
-		"\"size\":%d"
-		"},"
-		"\"version\":\"%s\","
-		"\"clients\":[",
+		"\"max_players\":%d,",
 		MaxClients,
-		MaxPlayers,
-		JsonBool(g_Config.m_Password[0]),
-		EscapeJson(aGameType, sizeof(aGameType), GameServer()->GameType()),
-		EscapeJson(aName, sizeof(aName), g_Config.m_SvName),
-		EscapeJson(aMapName, sizeof(aMapName), "LastDay"),
-		aMapSha256,
-		m_CurrentMapSize,
-		EscapeJson(aVersion, sizeof(aVersion), GameServer()->Version()));
+		MaxPlayers);
+	int Length = str_length(aInfo);
+	mem_copy(aInfo + Length, m_aServerInfoJsonFields, m_ServerInfoJsonFieldsSize);
+	Length += m_ServerInfoJsonFieldsSize;
+	str_format(aInfo + Length, sizeof(aInfo) - Length,
+		"\"overload\":%d,"
+		"\"clients\":[",
+		m_OverloadLevel);
+	Length += str_length(aInfo + Length);
 
 	bool FirstPlayer = true;
 	for(int i = 0; i < MAX_PLAYERS; i++)
 	{
 		if(m_aClients[i].m_State != CClient::STATE_EMPTY)
 		{
-			char aCName[32];
-			char aCClan[32];
-
-			char aExtraPlayerInfo[512];
-			GameServer()->OnUpdatePlayerServerInfo(aExtraPlayerInfo, sizeof(aExtraPlayerInfo), i);
-
-			char aClientInfo[256];
-			str_format(aClientInfo, sizeof(aClientInfo),
-				"%s{"
-				"\"name\":\"%s\","
-				"\"clan\":\"%s\","
-				"\"country\":%d,"
-				"\"score\":%d,"
-				"\"is_player\":%s"
-				"%s"
-				"}",
-				!FirstPlayer ? "," : "",
-				EscapeJson(aCName, sizeof(aCName), ClientName(i)),
-				EscapeJson(aCClan, sizeof(aCClan), ClientClan(i)),
-				m_aClients[i].m_Country,
-				m_aClients[i].m_Score,
-				JsonBool(GameServer()->IsClientPlayer(i)),
-				aExtraPlayerInfo);
-			str_append(aInfo, aClientInfo, sizeof(aInfo));
+			const CClientInfoFragment *pFragment = &m_aClientInfoFragments[i];
+			// room for the separator and the closing "]}"
+			if(Length + pFragment->m_JsonSize + 4 > (int)sizeof(aInfo))
+				break;
+			if(!FirstPlayer)
+				aInfo[Length++] = ',';
+			mem_copy(aInfo + Length, pFragment->m_aJson, pFragment->m_JsonSize);
+			Length += pFragment->m_JsonSize;
 			FirstPlayer = false;
 		}
 	}
 
-	str_append(aInfo, "]}", sizeof(aInfo));
+	mem_copy(aInfo + Length, "]}", 3);
 
 	m_pRegister->OnNewInfo(aInfo);
 }
@@ -1715,6 +1891,7 @@ void CServer::UpdateServerInfo(bool Resend)
 	if(!m_pRegister)
 		return;
 
+	UpdateServerInfoFragments();
 	UpdateRegisterServerInfo();
 
 	for(int i = 0; i < 3; i++)
@@ -1838,8 +2015,22 @@ int CServer::LoadMap()
 		if(!GenerateMap())
 			return 0;
 
-	if(!m_pMap->Load(aBuf))
+	// the map is handed over in memory, the file on disk is only an archive.
+	// a reload thread that is generating the next map is not waited for
+	if(lock_trylock(m_MapLock) != 0)
+		return 0;
+	unsigned char *pData = m_pGeneratedMapData;
+	unsigned Size = m_GeneratedMapSize;
+	m_pGeneratedMapData = 0;
+	m_GeneratedMapSize = 0;
+	lock_unlock(m_MapLock);
+
+	bool Loaded = pData ? m_pMap->LoadMemory(aBuf, pData, Size) : m_pMap->Load(aBuf);
+	if(!Loaded)
+	{
+		m_GeneratedMap = 0;
 		return 0;
+	}
 
 	// stop recording when we change map
 	m_DemoRecorder.Stop();
@@ -1862,15 +2053,25 @@ int CServer::LoadMap()
 	str_copy(m_aCurrentMap, "ld_generated", sizeof(m_aCurrentMap));
 	//map_set(df);
 
-	// load complete map into memory for download
+	// downloads are served from the mapped file, only read it again if it is not mapped
+	if(m_pCurrentMapBuffer)
+	{
+		mem_free(m_pCurrentMapBuffer);
+		m_pCurrentMapBuffer = 0;
+	}
+	if(m_pMap->File())
+	{
+		m_pCurrentMapData = m_pMap->File();
+		m_CurrentMapSize = m_pMap->FileSize();
+	}
+	else
 	{
 		IOHANDLE File = Storage()->OpenFile(aBuf, IOFLAG_READ, IStorage::TYPE_ALL);
 		m_CurrentMapSize = (int)io_length(File);
-		if(m_pCurrentMapData)
-			mem_free(m_pCurrentMapData);
-		m_pCurrentMapData = (unsigned char *)mem_alloc(m_CurrentMapSize, 1);
-		io_read(File, m_pCurrentMapData, m_CurrentMapSize);
+		m_pCurrentMapBuffer = (unsigned char *)mem_alloc(m_CurrentMapSize, 1);
+		io_read(File, m_pCurrentMapBuffer, m_CurrentMapSize);
 		io_close(File);
+		m_pCurrentMapData = m_pCurrentMapBuffer;
 	}
 	m_GeneratedMap = 0;
 	return 1;
@@ -1880,9 +2081,17 @@ int CServer::GenerateMap()
 {
 	char aBuf[512];
 	str_copy(aBuf, "generated_map/ld_generated.map");
-	{
-		CMapGen MapGen(Storage(), Console());
 
+	IEngine *pEngine = Kernel()->RequestInterface<IEngine>();
+	CMapGen MapGen(Storage(), Console(), pEngine);
+
+	bool Archive = g_Config.m_SvMapgenArchive;
+#if defined(CONF_ARCH_ENDIAN_BIG)
+	// datafiles can only be used in place on little endian hosts
+	Archive = true;
+#endif
+	if(Archive)
+	{
 		char aMapDir[256];
 		str_format(aMapDir, sizeof(aMapDir), "generated_map");
 
@@ -1892,10 +2101,32 @@ int CServer::GenerateMap()
 		{
 			dbg_msg("mapgen", "Can't create the directory '%s'", aMapDir);
 		}
+	}
 
-		if(!MapGen.CreateMap(aBuf))
-			return 0;
+	unsigned char *pData;
+	unsigned Size;
+	if(!MapGen.CreateMapInMemory(&pData, &Size))
+		return 0;
+
+#if defined(CONF_ARCH_ENDIAN_BIG)
+	bool Written = CMapGen::WriteMap(Storage(), aBuf, pData, Size);
+	mem_free(pData);
+	if(!Written)
+		return 0;
+#else
+	if(Archive)
+	{
+		if(pEngine)
+			pEngine->AddJob(std::make_shared<CMapGen::CArchiveJob>(Storage(), aBuf, pData, Size));
+		else
+			CMapGen::WriteMap(Storage(), aBuf, pData, Size);
 	}
+
+	// a map that was generated but never loaded is replaced
+	mem_free(m_pGeneratedMapData);
+	m_pGeneratedMapData = pData;
+	m_GeneratedMapSize = Size;
+#endif
 	m_GeneratedMap = 1;
 	return 1;
 }
@@ -1999,31 +2230,56 @@ int CServer::Run()
 			int64_t t = time_get();
 			int NewTicks = 0;
 
+			// the snapshots below are queued before the next network pump
+			CNetBase::UpdateTime(t);
+
 			// load new map
 			if(m_GeneratedMap || m_CurrentGameTick >= 0x5FFFFFFF)// force reload to make sure the ticks stay within a valid range
 			{
+				// a regenerated map only swaps the world, the ticks go on
+				bool KeepGame = g_Config.m_SvMapgenKeepGame && m_CurrentGameTick < 0x5FFFFFFF;
+				int64 ChangeStart = time_get_impl();
+
 				// load map
 				if(LoadMap())
 				{
 					// new map loaded
-					GameServer()->OnShutdown();
+					if(!KeepGame)
+						GameServer()->OnShutdown();
 
+					int NumReloading = 0;
 					for(int ClientID = 0; ClientID < MAX_PLAYERS; ClientID++)
 					{
 						if(m_aClients[ClientID].m_State <= CClient::STATE_AUTH)
 							continue;
+						NumReloading++;
 
+						// clients only get the new map by loading it, the game keeps
+						// the players of those that were past ready meanwhile
+						bool MapChanging = KeepGame && (m_aClients[ClientID].m_State >= CClient::STATE_READY || m_aClients[ClientID].m_MapChanging);
 						SendMap(ClientID);
 						m_aClients[ClientID].Reset();
 						m_aClients[ClientID].m_State = CClient::STATE_CONNECTING;
+						m_aClients[ClientID].m_MapChanging = MapChanging;
 					}
 
-					m_GameStartTime = time_get();
-					m_CurrentGameTick = 0;
 					m_ServerInfoFirstRequest = 0;
-					Kernel()->ReregisterInterface(GameServer());
-					GameServer()->OnInit();
+					if(KeepGame)
+						GameServer()->OnMapChange();
+					else
+					{
+						m_GameStartTime = time_get();
+						m_CurrentGameTick = 0;
+						Kernel()->ReregisterInterface(GameServer());
+						GameServer()->OnInit();
+					}
 					UpdateServerInfo(true);
+
+					// the first full snapshot tells how long the clients waited
+					m_MapChangeStart = NumReloading ? ChangeStart : 0;
+					char aBuf[128];
+					str_format(aBuf, sizeof(aBuf), "map changed in %.2f ms, %s", (time_get_impl() - ChangeStart) * 1000.0 / time_freq(), KeepGame ? "game kept" : "game restarted");
+					Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
 				}
 			}
 			
@@ -2034,46 +2290,88 @@ int CServer::Run()
 
 			while(t > TickStartTime(m_CurrentGameTick + 1))
 			{
+				// don't simulate too many ticks before the clients get a snapshot
+				if(NewTicks >= g_Config.m_SvMaxCatchupTicks)
+				{
+					m_CatchupCappedSecond = true;
+
+					// more than a second behind, give up on the backlog
+					int Behind = (int)((t - TickStartTime(m_CurrentGameTick)) * SERVER_TICK_SPEED / time_freq());
+					if(Behind > SERVER_TICK_SPEED)
+					{
+						m_GameStartTime += time_freq() * (Behind - 1) / SERVER_TICK_SPEED;
+						m_SkippedTicksMinute += Behind - 1;
+					}
+					break;
+				}
+
+				// the tick is late if the following one should have started already
+				int64 Lag = t - TickStartTime(m_CurrentGameTick + 1);
+				if(Lag > time_freq() / SERVER_TICK_SPEED)
+				{
+					m_LateTicksSecond++;
+					m_LateTicksMinute++;
+					m_MaxTickLagMinute = max(m_MaxTickLagMinute, Lag);
+				}
+
 				m_CurrentGameTick++;
 				NewTicks++;
 
 				// apply new input
-				for(int c = 0; c < g_Config.m_SvMaxClients; c++)
 				{
-					if(m_aClients[c].m_State != CClient::STATE_INGAME)
-						continue;
-					bool ClientHadInput = false;
-					for(auto &Input : m_aClients[c].m_aInputs)
+					CProfileScope Scope(CProfiler::PHASE_INPUT);
+					for(int c = 0; c < g_Config.m_SvMaxClients; c++)
 					{
-						if(Input.m_GameTick == Tick())
+						if(m_aClients[c].m_State != CClient::STATE_INGAME)
+							continue;
+						bool ClientHadInput = false;
+						for(auto &Input : m_aClients[c].m_aInputs)
 						{
-							GameServer()->OnClientPredictedInput(c, Input.m_aData);
-							ClientHadInput = true;
-							break;
+							if(Input.m_GameTick == Tick())
+							{
+								GameServer()->OnClientPredictedInput(c, Input.m_aData);
+								ClientHadInput = true;
+								break;
+							}
 						}
 					}
 				}
 
-				GameServer()->OnTick();
+				{
+					CProfileScope Scope(CProfiler::PHASE_GAME_TICK);
+					GameServer()->OnTick();
+				}
 			}
 
 			// snap game
 			if(NewTicks)
 			{
 				if(g_Config.m_SvHighBandwidth || (m_CurrentGameTick % 2) == 0)
+				{
+					CProfileScope Scope(CProfiler::PHASE_SNAP);
 					DoSnapshot();
+				}
 
 				UpdateClientRconCommands();
 			}
 
 			// master server stuff
-			m_pRegister->Update();
+			{
+				CProfileScope Scope(CProfiler::PHASE_REGISTER);
+				m_pRegister->Update();
+			}
 
 			if(m_ServerInfoNeedsUpdate)
 				UpdateServerInfo();
 
 			if(m_Active)
+			{
+				CProfileScope Scope(CProfiler::PHASE_NETWORK);
 				PumpNetwork(PacketWaiting);
+			}
+
+			UpdateProfiler();
+			UpdateOverload();
 
 			m_Active = false;
 
@@ -2129,8 +2427,9 @@ int CServer::Run()
 	GameServer()->OnShutdown();
 	m_pMap->Unload();
 
-	if(m_pCurrentMapData)
-		mem_free(m_pCurrentMapData);
+	if(m_pCurrentMapBuffer)
+		mem_free(m_pCurrentMapBuffer);
+	mem_free(m_pGeneratedMapData);
 
 	m_pRegister->OnShutdown();
 	return 0;
@@ -2173,6 +2472,187 @@ void CServer::ConStatus(IConsole::IResult *pResult, void *pUser)
 	}
 }
 
+void CServer::UpdateOverload()
+{
+	int64 Now = time_get();
+	char aBuf[256];
+
+	if(Now >= m_OverloadSecondTime + time_freq())
+	{
+		m_OverloadSecondTime = Now;
+
+		// raise the level fast, lower it after a few calm seconds
+		int NewLevel = m_OverloadLevel;
+		if(m_CatchupCappedSecond || m_LateTicksSecond > SERVER_TICK_SPEED / 10)
+		{
+			NewLevel = min(m_OverloadLevel + 1, (int)NUM_OVERLOAD_LEVELS - 1);
+			m_CalmSeconds = 0;
+		}
+		else if(m_LateTicksSecond == 0 && ++m_CalmSeconds >= 5)
+		{
+			NewLevel = max(m_OverloadLevel - 1, (int)OVERLOAD_NONE);
+			m_CalmSeconds = 0;
+		}
+
+		if(NewLevel != m_OverloadLevel)
+		{
+			static const char *s_apLevelNames[NUM_OVERLOAD_LEVELS] = {"none", "reduced snap rate for far clients", "reduced bot ai"};
+			str_format(aBuf, sizeof(aBuf), "overload level %d -> %d (%s), %d late ticks in the last second",
+				m_OverloadLevel, NewLevel, s_apLevelNames[NewLevel], m_LateTicksSecond);
+			Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+			m_OverloadLevel = NewLevel;
+			ExpireServerInfo();
+		}
+
+		m_LateTicksSecond = 0;
+		m_CatchupCappedSecond = false;
+	}
+
+	if(Now >= m_OverloadMinuteTime + time_freq() * 60)
+	{
+		if(m_LateTicksMinute && m_OverloadMinuteTime)
+		{
+			str_format(aBuf, sizeof(aBuf), "%d late ticks in the last minute, max lag %d ms, %d ticks skipped",
+				m_LateTicksMinute, (int)(m_MaxTickLagMinute * 1000 / time_freq()), m_SkippedTicksMinute);
+			Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+		}
+		m_OverloadMinuteTime = Now;
+		m_LateTicksMinute = 0;
+		m_SkippedTicksMinute = 0;
+		m_MaxTickLagMinute = 0;
+	}
+}
+
+void CServer::UpdateProfiler()
+{
+	g_Profiler.SetEnabled(g_Config.m_SvProfile);
+
+	// (re)open the csv log when the file name changes
+	if(str_comp(m_aProfileLogName, g_Config.m_SvProfileLog) != 0)
+	{
+		if(m_ProfileLog)
+			io_close(m_ProfileLog);
+		m_ProfileLog = 0;
+		str_copy(m_aProfileLogName, g_Config.m_SvProfileLog, sizeof(m_aProfileLogName));
+		if(m_aProfileLogName[0])
+		{
+			m_ProfileLog = Storage()->OpenFile(m_aProfileLogName, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+			if(!m_ProfileLog)
+			{
+				char aBuf[256];
+				str_format(aBuf, sizeof(aBuf), "failed to open '%s' for writing", m_aProfileLogName);
+				Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "profile", aBuf);
+				return;
+			}
+
+			char aBuf[64];
+			io_write(m_ProfileLog, "tick", 4);
+			for(int i = 0; i < CProfiler::NUM_PHASES; i++)
+			{
+				str_format(aBuf, sizeof(aBuf), ",%s_p50,%s_p99,%s_max", CProfiler::PhaseName(i), CProfiler::PhaseName(i), CProfiler::PhaseName(i));
+				io_write(m_ProfileLog, aBuf, str_length(aBuf));
+			}
+			io_write_newline(m_ProfileLog);
+			m_ProfileLogTime = time_get();
+		}
+	}
+
+	if(!m_ProfileLog || !g_Profiler.IsEnabled() || time_get() < m_ProfileLogTime+time_freq())
+		return;
+	m_ProfileLogTime = time_get();
+
+	char aBuf[128];
+	str_format(aBuf, sizeof(aBuf), "%d", Tick());
+	io_write(m_ProfileLog, aBuf, str_length(aBuf));
+	for(int i = 0; i < CProfiler::NUM_PHASES; i++)
+	{
+		CProfiler::CStats Stats;
+		g_Profiler.GetStats(i, &Stats);
+		str_format(aBuf, sizeof(aBuf), ",%lld,%lld,%lld", Stats.m_P50, Stats.m_P99, Stats.m_Max);
+		io_write(m_ProfileLog, aBuf, str_length(aBuf));
+	}
+	io_write_newline(m_ProfileLog);
+	io_flush(m_ProfileLog);
+}
+
+void CServer::ConProfileDump(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+	char aBuf[256];
+	if(!g_Profiler.IsEnabled())
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "profile", "profiler is disabled, set sv_profile 1 to record");
+
+	for(int i = 0; i < CProfiler::NUM_PHASES; i++)
+	{
+		CProfiler::CStats Stats;
+		g_Profiler.GetStats(i, &Stats);
+		str_format(aBuf, sizeof(aBuf), "%-10s samples=%d total=%lldus p50=%lldus p99=%lldus max=%lldus", CProfiler::PhaseName(i),
+			Stats.m_NumSamples, Stats.m_Total, Stats.m_P50, Stats.m_P99, Stats.m_Max);
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "profile", aBuf);
+	}
+
+	if(pResult->NumArguments() && pResult->GetInteger(0))
+		g_Profiler.Reset();
+}
+
+void CServer::ConDumpDeltas(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+	if(pThis->m_DeltaDump)
+		io_close(pThis->m_DeltaDump);
+	pThis->m_DeltaDump = pThis->Storage()->OpenFile(pResult->GetString(0), IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	pThis->m_DeltaDumpLeft = pResult->NumArguments() > 1 ? clamp(pResult->GetInteger(1), 1, 10000) : 500;
+
+	char aBuf[256];
+	if(pThis->m_DeltaDump)
+		str_format(aBuf, sizeof(aBuf), "writing the next %d snapshot deltas to '%s'", pThis->m_DeltaDumpLeft, pResult->GetString(0));
+	else
+		str_format(aBuf, sizeof(aBuf), "failed to open '%s' for writing", pResult->GetString(0));
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "varint", aBuf);
+}
+
+void CServer::ConNetCounters(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+	const CNetBase::CRecvCounters &Counters = CNetBase::RecvCounters();
+	int64 NumPackets = maximum(Counters.m_NumPackets, (int64)1);
+
+	// uncompressed payloads are parsed in the receive buffer, only huffman output is written
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "recv packets=%lld in_place=%lld decoded=%lld bytes=%lld written=%lld written_per_packet=%.1f",
+		Counters.m_NumPackets, Counters.m_NumInPlace, Counters.m_NumDecoded, Counters.m_BytesReceived, Counters.m_BytesDecoded,
+		(double)Counters.m_BytesDecoded / NumPackets);
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net", aBuf);
+
+	const CNetFloodShield::CCounters &Shield = pThis->m_NetServer.FloodShield()->Counters();
+	str_format(aBuf, sizeof(aBuf), "preauth checked=%lld dropped=%lld", Shield.m_NumChecked, Shield.m_NumDropped);
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net", aBuf);
+
+	if(pResult->NumArguments() && pResult->GetInteger(0))
+	{
+		CNetBase::ResetRecvCounters();
+		pThis->m_NetServer.FloodShield()->ResetCounters();
+	}
+}
+
+void CServer::ConServerInfoCounters(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+
+	// bytes packed or formatted again, the rest of the info is spliced from the fragments
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "server info updates=%lld rebuilt=%lld rebuilt_per_update=%.1f last=%d",
+		pThis->m_ServerInfoUpdates, pThis->m_ServerInfoBytesRebuilt,
+		(double)pThis->m_ServerInfoBytesRebuilt / maximum(pThis->m_ServerInfoUpdates, (int64)1), pThis->m_ServerInfoLastBytesRebuilt);
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+
+	if(pResult->NumArguments() && pResult->GetInteger(0))
+	{
+		pThis->m_ServerInfoUpdates = 0;
+		pThis->m_ServerInfoBytesRebuilt = 0;
+	}
+}
+
 void CServer::ConShutdown(IConsole::IResult *pResult, void *pUser)
 {
 	((CServer *)pUser)->m_RunServer = 0;
@@ -2298,6 +2778,13 @@ void CServer::ConchainConsoleOutputLevelUpdate(IConsole::IResult *pResult, void
 	}
 }
 
+void CServer::ConchainHuffmanFastUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
+{
+	pfnCallback(pResult, pCallbackUserData);
+	if(pResult->NumArguments() == 1)
+		CNetBase::SetHuffmanFastPath(pResult->GetInteger(0) != 0);
+}
+
 void CServer::RegisterCommands()
 {
 	m_pConsole = Kernel()->RequestInterface<IConsole>();
@@ -2312,6 +2799,10 @@ void CServer::RegisterCommands()
 	Console()->Register("status", "", CFGFLAG_SERVER, ConStatus, this, "List players");
 	Console()->Register("shutdown", "", CFGFLAG_SERVER, ConShutdown, this, "Shut down");
 	Console()->Register("logout", "", CFGFLAG_SERVER, ConLogout, this, "Logout of rcon");
+	Console()->Register("net_counters", "?i", CFGFLAG_SERVER, ConNetCounters, this, "Show the receive path and preauth counters (1 = reset afterwards)");
+	Console()->Register("serverinfo_counters", "?i", CFGFLAG_SERVER, ConServerInfoCounters, this, "Show how many server info bytes were packed again per update (1 = reset afterwards)");
+	Console()->Register("dump_deltas", "s?i", CFGFLAG_SERVER, ConDumpDeltas, this, "Write the next snapshot deltas to a file for the varint_bench tool");
+	Console()->Register("profile_dump", "?i", CFGFLAG_SERVER, ConProfileDump, this, "Show the tick phase timings of the profiler (1 = reset afterwards)");
 
 	Console()->Register("record", "?s", CFGFLAG_SERVER|CFGFLAG_STORE, ConRecord, this, "Record to a file");
 	Console()->Register("stoprecord", "", CFGFLAG_SERVER, ConStopRecord, this, "Stop recording");
@@ -2322,6 +2813,7 @@ void CServer::RegisterCommands()
 	Console()->Chain("sv_max_clients_per_ip", ConchainMaxclientsperipUpdate, this);
 	Console()->Chain("mod_command", ConchainModCommandUpdate, this);
 	Console()->Chain("console_output_level", ConchainConsoleOutputLevelUpdate, this);
+	Console()->Chain("net_huffman_fast", ConchainHuffmanFastUpdate, this);
 	// register console commands in sub parts
 	m_ServerBan.InitServerBan(Console(), Storage(), this);
 	m_pGameServer->OnConsoleInit();
@@ -2386,6 +2878,9 @@ int main(int argc, const char **argv) // ignore_convention
 	// create the components
 	IEngine *pEngine = CreateEngine("Teeworlds", 2);
 
+	// keep the game thread away from the log writes
+	dbg_logger_async(1);
+
 	IEngineMap *pEngineMap = CreateEngineMap();
 	IGameServer *pGameServer = CreateGameServer();
 	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER|CFGFLAG_ECON);
@@ -2405,7 +2900,10 @@ int main(int argc, const char **argv) // ignore_convention
 		RegisterFail = RegisterFail || !pKernel->RegisterInterface(pConfig);
 
 		if(RegisterFail)
+		{
+			dbg_logger_async(0);
 			return -1;
+		}
 	}
 
 	pEngine->Init();
@@ -2421,6 +2919,7 @@ int main(int argc, const char **argv) // ignore_convention
 	if(!pServer->m_pLocalization->Init())
 	{
 		dbg_msg("localization", "could not initialize localization");
+		dbg_logger_async(0);
 		return -1;
 	}
 
@@ -2445,6 +2944,8 @@ int main(int argc, const char **argv) // ignore_convention
 	delete pConsole;
 	delete pStorage;
 	delete pConfig;
+
+	dbg_logger_async(0);
 	return 0;
 	
 }
@@ -136,6 +136,9 @@ public:
 
 		const IConsole::CCommandInfo *m_pRconCmdToSend;
 
+		// sent back to load a new map while the game kept its player
+		bool m_MapChanging;
+
 		void Reset();
 
 		char m_aLanguage[16];
@@ -164,6 +167,11 @@ public:
 	int m_RunServer;
 	int m_MapReload;
 	int m_GeneratedMap;
+	// the generated map file until LoadMap hands it to m_pMap
+	unsigned char *m_pGeneratedMapData;
+	unsigned m_GeneratedMapSize;
+	// when the last map change started, until its first full snapshot went out
+	int64 m_MapChangeStart;
 	bool m_ReloadedWhenEmpty;
 	int m_RconClientID;
 	int m_RconAuthLevel;
@@ -175,7 +183,9 @@ public:
 	char m_aCurrentMap[64];
 	SHA256_DIGEST m_CurrentMapSha256;
 	unsigned m_CurrentMapCrc;
-	unsigned char *m_pCurrentMapData;
+	// the loaded map file held by m_pMap, or m_pCurrentMapBuffer if it was read
+	const unsigned char *m_pCurrentMapData;
+	unsigned char *m_pCurrentMapBuffer;
 	int m_CurrentMapSize;
 
 	bool m_ServerInfoHighLoad;
@@ -186,6 +196,25 @@ public:
 
 	bool m_Active;
 
+	// tick overrun accounting
+	int m_OverloadLevel;
+	int m_LateTicksSecond;
+	bool m_CatchupCappedSecond;
+	int m_CalmSeconds;
+	int m_LateTicksMinute;
+	int m_SkippedTicksMinute;
+	int64 m_MaxTickLagMinute;
+	int64 m_OverloadSecondTime;
+	int64 m_OverloadMinuteTime;
+
+	IOHANDLE m_ProfileLog;
+
+	// snapshot deltas dumped for the varint_bench tool
+	IOHANDLE m_DeltaDump;
+	int m_DeltaDumpLeft;
+	char m_aProfileLogName[128];
+	int64 m_ProfileLogTime;
+
 	CServer();
 	~CServer();
 
@@ -265,7 +294,53 @@ class CCache
 	CCache m_aSixupServerInfoCache[2];
 	bool m_ServerInfoNeedsUpdate;
 
+	// the inputs of the parts of the server info that only change with
+	// the config or the map, compared as a whole
+	struct CServerInfoFields
+	{
+		char m_aName[256];
+		char m_aGameType[32];
+		char m_aVersion[64];
+		bool m_Password;
+		unsigned m_MapCrc;
+		int m_MapSize;
+		SHA256_DIGEST m_MapSha256;
+	};
+
+	// one client in the server info, packed and as json. the parts are
+	// only packed again when one of the inputs changed
+	struct CClientInfoFragment
+	{
+		bool m_Valid;
+		char m_aName[MAX_NAME_LENGTH];
+		char m_aClan[MAX_CLAN_LENGTH];
+		int m_Country;
+		int m_Score;
+		bool m_Player;
+		char m_aExtra[512];
+
+		unsigned char m_aPacked[128];
+		int m_PackedSize;
+		char m_aJson[1024];
+		int m_JsonSize;
+	};
+
+	CServerInfoFields m_ServerInfoFields;
+	bool m_ServerInfoFieldsValid;
+	// version, name, map and game type up to the flags, per info type
+	std::vector<uint8_t> m_avServerInfoHead[3];
+	// the client count in the vanilla name, -1 if the name has none
+	int m_aServerInfoHeadClients[3];
+	char m_aServerInfoJsonFields[1024];
+	int m_ServerInfoJsonFieldsSize;
+	CClientInfoFragment m_aClientInfoFragments[MAX_PLAYERS];
+
+	int64 m_ServerInfoUpdates;
+	int64 m_ServerInfoBytesRebuilt;
+	int m_ServerInfoLastBytesRebuilt;
+
 	void ExpireServerInfo() override;
+	void UpdateServerInfoFragments();
 	void CacheServerInfo(CCache *pCache, int Type, bool SendClients);
 	void SendServerInfo(const NETADDR *pAddr, int Token, int Type, bool SendClients);
 	bool RateLimitServerInfoConnless();
@@ -274,6 +349,9 @@ class CCache
 	void UpdateServerInfo(bool Resend = false);
 
 	void PumpNetwork(bool PacketWaiting);
+	void UpdateProfiler();
+	void UpdateOverload();
+	int OverloadLevel() const override { return m_OverloadLevel; }
 
 	char *GetMapName();
 	int LoadMap();
@@ -289,10 +367,15 @@ class CCache
 	static void ConRecord(IConsole::IResult *pResult, void *pUser);
 	static void ConStopRecord(IConsole::IResult *pResult, void *pUser);
 	static void ConLogout(IConsole::IResult *pResult, void *pUser);
+	static void ConProfileDump(IConsole::IResult *pResult, void *pUser);
+	static void ConDumpDeltas(IConsole::IResult *pResult, void *pUser);
+	static void ConNetCounters(IConsole::IResult *pResult, void *pUser);
+	static void ConServerInfoCounters(IConsole::IResult *pResult, void *pUser);
 	static void ConchainSpecialInfoupdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConchainMaxclientsperipUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConchainModCommandUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConchainConsoleOutputLevelUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
+	static void ConchainHuffmanFastUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	
 	void RegisterCommands();
 
@@ -65,6 +65,26 @@ const unsigned char *CVariableInt::Unpack(const unsigned char *pSrc, int *pInOut
 	return pSrc;
 }
 
+// the batch coders below classify 4 ints at once and only take the
+// generic path for ints that do not fit into a single byte
+static inline unsigned Magnitude(int i)
+{
+	return (unsigned)(i ^ (i >> 31)); // ~i for negative values, like Pack
+}
+
+static inline unsigned char *PackOne(unsigned char *pDst, int i)
+{
+	// needs MAX_BYTES_PACKED bytes of room, writes all of them and returns the end of the packed int
+	unsigned u = Magnitude(i);
+	int Len = 1 + (u >= (1u << 6)) + (u >= (1u << 13)) + (u >= (1u << 20)) + (u >= (1u << 27));
+	pDst[0] = (unsigned char)(((i >> 31) & 0x40) | (u & 0x3F) | (Len > 1 ? 0x80 : 0));
+	pDst[1] = (unsigned char)(((u >> 6) & 0x7F) | (Len > 2 ? 0x80 : 0));
+	pDst[2] = (unsigned char)(((u >> 13) & 0x7F) | (Len > 3 ? 0x80 : 0));
+	pDst[3] = (unsigned char)(((u >> 20) & 0x7F) | (Len > 4 ? 0x80 : 0));
+	pDst[4] = (unsigned char)((u >> 27) & 0x7F);
+	return pDst + Len;
+}
+
 long CVariableInt::Decompress(const void *pSrc_, int SrcSize, void *pDst_, int DstSize)
 {
 	dbg_assert(DstSize % sizeof(int) == 0, "invalid bounds");
@@ -73,6 +93,24 @@ long CVariableInt::Decompress(const void *pSrc_, int SrcSize, void *pDst_, int D
 	const unsigned char *pSrcEnd = pSrc + SrcSize;
 	int *pDst = (int *)pDst_;
 	const int *pDstEnd = pDst + DstSize / sizeof(int);
+
+	// while 4 full ints fit on both sides, single byte ints are decoded 4 at a time
+	while(pSrcEnd - pSrc >= 4 * MAX_BYTES_PACKED && pDstEnd - pDst >= 4)
+	{
+		if(!((pSrc[0] | pSrc[1] | pSrc[2] | pSrc[3]) & 0x80))
+		{
+			for(int k = 0; k < 4; k++)
+				pDst[k] = (pSrc[k] & 0x3F) ^ -((pSrc[k] >> 6) & 1);
+			pSrc += 4;
+			pDst += 4;
+		}
+		else
+		{
+			pSrc = CVariableInt::Unpack(pSrc, pDst, pSrcEnd - pSrc);
+			pDst++;
+		}
+	}
+
 	while(pSrc < pSrcEnd)
 	{
 		if(pDst >= pDstEnd)
@@ -93,6 +131,25 @@ long CVariableInt::Compress(const void *pSrc_, int SrcSize, void *pDst_, int Dst
 	unsigned char *pDst = (unsigned char *)pDst_;
 	const unsigned char *pDstEnd = pDst + DstSize;
 	SrcSize /= sizeof(int);
+
+	// while 4 ints fit in any case, blocks of single byte ints (zeros included) go at once
+	while(SrcSize >= 4 && pDstEnd - pDst >= 4 * MAX_BYTES_PACKED)
+	{
+		if((Magnitude(pSrc[0]) | Magnitude(pSrc[1]) | Magnitude(pSrc[2]) | Magnitude(pSrc[3])) < 0x40)
+		{
+			for(int k = 0; k < 4; k++)
+				pDst[k] = (unsigned char)(((pSrc[k] >> 31) & 0x40) | Magnitude(pSrc[k]));
+			pDst += 4;
+		}
+		else
+		{
+			for(int k = 0; k < 4; k++)
+				pDst = PackOne(pDst, pSrc[k]);
+		}
+		SrcSize -= 4;
+		pSrc += 4;
+	}
+
 	while(SrcSize)
 	{
 		pDst = CVariableInt::Pack(pDst, *pSrc, pDstEnd - pDst);
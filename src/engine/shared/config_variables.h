@@ -9,6 +9,7 @@
 MACRO_CONFIG_STR(Password, password, 32, "", CFGFLAG_CLIENT|CFGFLAG_SERVER, "Password to the server")
 MACRO_CONFIG_STR(Logfile, logfile, 128, "", CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "Filename to log all output to")
 MACRO_CONFIG_INT(ConsoleOutputLevel, console_output_level, 0, 0, 2, CFGFLAG_SERVER, "Adjusts the amount of information in the console")
+MACRO_CONFIG_INT(StdoutOutputLevel, stdout_output_level, 2, 0, 2, CFGFLAG_SERVER, "Adjusts the amount of console information written to the log")
 
 MACRO_CONFIG_STR(SvName, sv_name, 128, "unnamed lastday server", CFGFLAG_SERVER, "Server name")
 MACRO_CONFIG_STR(SvHostname, sv_hostname, 128, "", CFGFLAG_SAVE | CFGFLAG_SERVER, "Server hostname (0.7 only)")
@@ -31,6 +32,8 @@ MACRO_CONFIG_INT(SvServerInfoPerSecond, sv_server_info_per_second, 10, 1, 1000,
 
 MACRO_CONFIG_INT(SvVanillaAntiSpoof, sv_vanilla_antispoof, 1, 0, 1, CFGFLAG_SERVER, "Enable vanilla Antispoof")
 MACRO_CONFIG_INT(SvVanConnPerSecond, sv_van_conn_per_second, 10, 1, 1000, CFGFLAG_SERVER, "Antispoof specific ratelimit")
+MACRO_CONFIG_INT(SvPreauthRate, sv_preauth_rate, 100, 0, 100000, CFGFLAG_SERVER, "Packets per second accepted from one /24 (IPv4) or /64 (IPv6) that is not connected (0 = no limit)")
+MACRO_CONFIG_INT(SvPreauthBurst, sv_preauth_burst, 200, 1, 100000, CFGFLAG_SERVER, "Packets one unconnected /24 or /64 can send at once before sv_preauth_rate applies")
 
 MACRO_CONFIG_STR(EcBindaddr, ec_bindaddr, 128, "localhost", CFGFLAG_ECON, "Address to bind the external console to. Anything but 'localhost' is dangerous")
 MACRO_CONFIG_INT(EcPort, ec_port, 0, 0, 0, CFGFLAG_ECON, "Port to use for the external console")
@@ -70,7 +73,15 @@ MACRO_CONFIG_INT(ConnTimeout, conn_timeout, 100, 5, 1000, CFGFLAG_SAVE | CFGFLAG
 MACRO_CONFIG_INT(ConnTimeoutProtection, conn_timeout_protection, 1000, 5, 10000, CFGFLAG_SERVER, "Network timeout protection")
 MACRO_CONFIG_INT(SvConnlimit, sv_connlimit, 5, 0, 100, CFGFLAG_SERVER, "Connlimit: Number of connections an IP is allowed to do in a timespan")
 MACRO_CONFIG_INT(SvConnlimitTime, sv_connlimit_time, 20, 0, 1000, CFGFLAG_SERVER, "Connlimit: Time in which IP's connections are counted")
+MACRO_CONFIG_INT(NetHuffmanFast, net_huffman_fast, 1, 0, 1, CFGFLAG_SERVER, "Use the table driven huffman coder for packets (same output as the reference coder)")
 
+MACRO_CONFIG_INT(SvMaxCatchupTicks, sv_max_catchup_ticks, 5, 1, 50, CFGFLAG_SERVER, "Maximum number of late ticks simulated back to back before a snapshot is sent")
+MACRO_CONFIG_INT(SvOverloadFarPing, sv_overload_far_ping, 150, 0, 1000, CFGFLAG_SERVER, "Clients above this ping get half the snapshots while the server is overloaded")
+MACRO_CONFIG_INT(SvProfile, sv_profile, 0, 0, 1, CFGFLAG_SERVER, "Record the time spent in the phases of a server tick (see profile_dump)")
+MACRO_CONFIG_STR(SvProfileLog, sv_profile_log, 128, "", CFGFLAG_SERVER, "File to write the profiler statistics to once per second as CSV (empty = off)")
+MACRO_CONFIG_INT(SvMapgenCompression, sv_mapgen_compression, -1, -1, 9, CFGFLAG_SERVER, "zlib level for generated maps, lower is faster and bigger (-1 = zlib default)")
+MACRO_CONFIG_INT(SvMapgenArchive, sv_mapgen_archive, 1, 0, 1, CFGFLAG_SERVER, "Write generated maps to generated_map/ld_generated.map in the background")
+MACRO_CONFIG_INT(SvMapgenKeepGame, sv_mapgen_keep_game, 1, 0, 1, CFGFLAG_SERVER, "Keep players and game state over map regenerations and only rebuild the world (0 = restart the game)")
 MACRO_CONFIG_INT(SvMapUpdateRate, sv_mapupdaterate, 5, 1, 100, CFGFLAG_SERVER, "(Tw32) real id <-> vanilla id players map update rate")
 MACRO_CONFIG_INT(Debug, debug, 0, 0, 1, CFGFLAG_CLIENT|CFGFLAG_SERVER, "Debug mode")
 MACRO_CONFIG_INT(DbgCurl, dbg_curl, 0, 0, 1, CFGFLAG_CLIENT | CFGFLAG_SERVER, "Debug curl")
@@ -200,7 +200,8 @@ void CConsole::SetPrintOutputLevel_Hard(int Index, int OutputLevel)
 
 void CConsole::Print(int Level, const char *pFrom, const char *pStr)
 {
-	dbg_msg(pFrom ,"%s", pStr);
+	if(Level == OUTPUT_LEVEL_CHAT || Level <= g_Config.m_StdoutOutputLevel)
+		dbg_msg(pFrom ,"%s", pStr);
 	for(int i = 0; i < m_NumPrintCB; ++i)
 	{
 		if(!m_aPrintCB[i].m_pfnPrintCallback)
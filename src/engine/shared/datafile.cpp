@@ -4,7 +4,9 @@
 #include "datafile.h"
 
 #include <base/hash_ctxt.h>
+#include <base/math.h>
 #include <base/system.h>
+#include <engine/engine.h>
 #include <engine/storage.h>
 
 #include "uuid_manager.h"
@@ -16,6 +18,9 @@ static const int DEBUG = 0;
 enum
 {
 	OFFSET_UUID_TYPE = 0x8000,
+
+	// smaller data blocks are not worth a job
+	COMPRESS_JOB_MIN_SIZE = 16 * 1024,
 };
 
 struct CItemEx
@@ -96,9 +101,19 @@ struct CDatafile
 	int m_DataStartOffset;
 	char **m_ppDataPtrs;
 	char *m_pData;
+
+	// set when the file is mapped or handed over in memory, the tables
+	// and items are copied out of it
+	unsigned char *m_pMapping;
+	unsigned m_MappingSize;
+	bool m_MemoryFile;
+	// data blocks are inflated or copied into one block, allocated on first use
+	char *m_pArena;
+	size_t m_ArenaSize;
+	size_t *m_pArenaOffsets;
 };
 
-bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int StorageType)
+bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int StorageType, bool MapFile)
 {
 	dbg_msg("datafile", "loading. filename='%s'", pFilename);
 
@@ -109,6 +124,18 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 		return false;
 	}
 
+#if !defined(CONF_ARCH_ENDIAN_BIG)
+	// the tables are not swapped, that needs the file byte order
+	if(MapFile)
+	{
+		unsigned MappingSize = 0;
+		unsigned char *pMapping = (unsigned char *)io_map(File, &MappingSize);
+		if(pMapping)
+			return OpenInPlace(pFilename, File, pMapping, MappingSize, false);
+		dbg_msg("datafile", "could not map '%s', reading it instead", pFilename);
+	}
+#endif
+
 	// take the CRC of the file and store it
 	unsigned Crc = 0;
 	SHA256_DIGEST Sha256;
@@ -180,6 +207,12 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	pTmpDataFile->m_File = File;
 	pTmpDataFile->m_Sha256 = Sha256;
 	pTmpDataFile->m_Crc = Crc;
+	pTmpDataFile->m_pMapping = 0;
+	pTmpDataFile->m_MappingSize = 0;
+	pTmpDataFile->m_MemoryFile = false;
+	pTmpDataFile->m_pArena = 0;
+	pTmpDataFile->m_ArenaSize = 0;
+	pTmpDataFile->m_pArenaOffsets = 0;
 
 	// clear the data pointers
 	mem_zero(pTmpDataFile->m_ppDataPtrs, Header.m_NumRawData * sizeof(void *));
@@ -210,18 +243,139 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 		dbg_msg("datafile", "item_size=%d", m_pDataFile->m_Header.m_ItemSize);
 	}
 
-	m_pDataFile->m_Info.m_pItemTypes = (CDatafileItemType *)m_pDataFile->m_pData;
-	m_pDataFile->m_Info.m_pItemOffsets = (int *)&m_pDataFile->m_Info.m_pItemTypes[m_pDataFile->m_Header.m_NumItemTypes];
-	m_pDataFile->m_Info.m_pDataOffsets = &m_pDataFile->m_Info.m_pItemOffsets[m_pDataFile->m_Header.m_NumItems];
-	m_pDataFile->m_Info.m_pDataSizes = &m_pDataFile->m_Info.m_pDataOffsets[m_pDataFile->m_Header.m_NumRawData];
+	InitInfo(m_pDataFile);
 
-	if(Header.m_Version == 4)
-		m_pDataFile->m_Info.m_pItemStart = (char *)&m_pDataFile->m_Info.m_pDataSizes[m_pDataFile->m_Header.m_NumRawData];
+	dbg_msg("datafile", "loading done. datafile='%s'", pFilename);
+
+	return true;
+}
+
+void CDataFileReader::InitInfo(CDatafile *pDataFile)
+{
+	pDataFile->m_Info.m_pItemTypes = (CDatafileItemType *)pDataFile->m_pData;
+	pDataFile->m_Info.m_pItemOffsets = (int *)&pDataFile->m_Info.m_pItemTypes[pDataFile->m_Header.m_NumItemTypes];
+	pDataFile->m_Info.m_pDataOffsets = &pDataFile->m_Info.m_pItemOffsets[pDataFile->m_Header.m_NumItems];
+	pDataFile->m_Info.m_pDataSizes = &pDataFile->m_Info.m_pDataOffsets[pDataFile->m_Header.m_NumRawData];
+
+	if(pDataFile->m_Header.m_Version == 4)
+		pDataFile->m_Info.m_pItemStart = (char *)&pDataFile->m_Info.m_pDataSizes[pDataFile->m_Header.m_NumRawData];
 	else
-		m_pDataFile->m_Info.m_pItemStart = (char *)&m_pDataFile->m_Info.m_pDataOffsets[m_pDataFile->m_Header.m_NumRawData];
-	m_pDataFile->m_Info.m_pDataStart = m_pDataFile->m_Info.m_pItemStart + m_pDataFile->m_Header.m_ItemSize;
+		pDataFile->m_Info.m_pItemStart = (char *)&pDataFile->m_Info.m_pDataOffsets[pDataFile->m_Header.m_NumRawData];
+	pDataFile->m_Info.m_pDataStart = pDataFile->m_Info.m_pItemStart + pDataFile->m_Header.m_ItemSize;
+}
 
-	dbg_msg("datafile", "loading done. datafile='%s'", pFilename);
+bool CDataFileReader::OpenMemory(const char *pName, unsigned char *pData, unsigned Size)
+{
+	dbg_msg("datafile", "loading. name='%s' size=%u", pName, Size);
+
+#if defined(CONF_ARCH_ENDIAN_BIG)
+	dbg_msg("datafile", "can't use '%s' in place on a big endian host", pName);
+	mem_free(pData);
+	return false;
+#else
+	return OpenInPlace(pName, 0, pData, Size, true);
+#endif
+}
+
+static void ReleaseInPlace(IOHANDLE File, unsigned char *pData, unsigned Size, bool MemoryFile)
+{
+	if(MemoryFile)
+		mem_free(pData);
+	else
+		io_unmap(pData, Size);
+	if(File)
+		io_close(File);
+}
+
+bool CDataFileReader::OpenInPlace(const char *pName, IOHANDLE File, unsigned char *pData, unsigned DataSize, bool MemoryFile)
+{
+	// take the CRC of the file and store it
+	SHA256_CTX Sha256Ctxt;
+	sha256_init(&Sha256Ctxt);
+	sha256_update(&Sha256Ctxt, pData, DataSize);
+	SHA256_DIGEST Sha256 = sha256_finish(&Sha256Ctxt);
+	unsigned Crc = crc32(0, pData, DataSize);
+
+	CDatafileHeader Header;
+	if(DataSize < sizeof(Header))
+	{
+		dbg_msg("datafile", "couldn't load header");
+		ReleaseInPlace(File, pData, DataSize, MemoryFile);
+		return false;
+	}
+	mem_copy(&Header, pData, sizeof(Header));
+	if((Header.m_aID[0] != 'A' || Header.m_aID[1] != 'T' || Header.m_aID[2] != 'A' || Header.m_aID[3] != 'D') &&
+		(Header.m_aID[0] != 'D' || Header.m_aID[1] != 'A' || Header.m_aID[2] != 'T' || Header.m_aID[3] != 'A'))
+	{
+		dbg_msg("datafile", "wrong signature. %x %x %x %x", Header.m_aID[0], Header.m_aID[1], Header.m_aID[2], Header.m_aID[3]);
+		ReleaseInPlace(File, pData, DataSize, MemoryFile);
+		return false;
+	}
+	if(Header.m_Version != 3 && Header.m_Version != 4)
+	{
+		dbg_msg("datafile", "wrong version. version=%x", Header.m_Version);
+		ReleaseInPlace(File, pData, DataSize, MemoryFile);
+		return false;
+	}
+
+	// everything is read in place, so it all has to be inside the file
+	uint64_t Size = 0;
+	Size += (uint64_t)Header.m_NumItemTypes * sizeof(CDatafileItemType);
+	Size += ((uint64_t)Header.m_NumItems + Header.m_NumRawData) * sizeof(int);
+	if(Header.m_Version == 4)
+		Size += (uint64_t)Header.m_NumRawData * sizeof(int); // v4 has uncompressed data sizes as well
+	Size += Header.m_ItemSize;
+	if(Header.m_NumItemTypes < 0 || Header.m_NumItems < 0 || Header.m_NumRawData < 0 || Header.m_ItemSize < 0 || Header.m_DataSize < 0 ||
+		sizeof(CDatafileHeader) + Size + Header.m_DataSize > DataSize)
+	{
+		dbg_msg("datafile", "couldn't load the whole thing, wanted=%d got=%d", (int)(sizeof(CDatafileHeader) + Size + Header.m_DataSize), DataSize);
+		ReleaseInPlace(File, pData, DataSize, MemoryFile);
+		return false;
+	}
+
+	unsigned AllocSize = sizeof(CDatafile);
+	AllocSize += Header.m_NumRawData * sizeof(void *); // data pointers
+	AllocSize += Header.m_NumRawData * sizeof(size_t); // arena offsets
+	AllocSize += Size; // tables and items
+
+	CDatafile *pTmpDataFile = (CDatafile *)malloc(AllocSize);
+	if(!pTmpDataFile)
+	{
+		dbg_msg("datafile", "couldn't allocate the tables for '%s'", pName);
+		ReleaseInPlace(File, pData, DataSize, MemoryFile);
+		return false;
+	}
+	pTmpDataFile->m_Header = Header;
+	pTmpDataFile->m_DataStartOffset = sizeof(CDatafileHeader) + Size;
+	pTmpDataFile->m_ppDataPtrs = (char **)(pTmpDataFile + 1);
+	// the users may modify items, like CLayers does with the game
+	// group, so they get a copy and the file stays as it was loaded
+	pTmpDataFile->m_pData = (char *)(pTmpDataFile->m_ppDataPtrs + Header.m_NumRawData) + Header.m_NumRawData * sizeof(size_t);
+	mem_copy(pTmpDataFile->m_pData, pData + sizeof(CDatafileHeader), Size);
+	pTmpDataFile->m_File = File;
+	pTmpDataFile->m_Sha256 = Sha256;
+	pTmpDataFile->m_Crc = Crc;
+	pTmpDataFile->m_pMapping = pData;
+	pTmpDataFile->m_MappingSize = DataSize;
+	pTmpDataFile->m_MemoryFile = MemoryFile;
+	pTmpDataFile->m_pArena = 0;
+	pTmpDataFile->m_ArenaSize = 0;
+	pTmpDataFile->m_pArenaOffsets = (size_t *)(pTmpDataFile->m_ppDataPtrs + Header.m_NumRawData);
+	mem_zero(pTmpDataFile->m_ppDataPtrs, Header.m_NumRawData * sizeof(void *));
+	InitInfo(pTmpDataFile);
+	pTmpDataFile->m_Info.m_pDataStart = (char *)pData + pTmpDataFile->m_DataStartOffset;
+
+	Close();
+	m_pDataFile = pTmpDataFile;
+
+	// every block gets a copy in the arena, the users may modify their data
+	for(int i = 0; i < Header.m_NumRawData; i++)
+	{
+		m_pDataFile->m_pArenaOffsets[i] = m_pDataFile->m_ArenaSize;
+		m_pDataFile->m_ArenaSize += maximum(GetDataSize(i), 0);
+	}
+
+	dbg_msg("datafile", "loading done. datafile='%s' %s=%u", pName, MemoryFile ? "memory" : "mapped", DataSize);
 
 	return true;
 }
@@ -272,6 +426,9 @@ void *CDataFileReader::GetDataImpl(int Index, int Swap)
 	if(Index < 0 || Index >= m_pDataFile->m_Header.m_NumRawData)
 		return 0;
 
+	if(m_pDataFile->m_pMapping)
+		return GetMappedData(Index);
+
 	// load it if needed
 	if(!m_pDataFile->m_ppDataPtrs[Index])
 	{
@@ -323,6 +480,52 @@ void *CDataFileReader::GetDataImpl(int Index, int Swap)
 	return m_pDataFile->m_ppDataPtrs[Index];
 }
 
+void *CDataFileReader::GetMappedData(int Index)
+{
+	if(m_pDataFile->m_ppDataPtrs[Index])
+		return m_pDataFile->m_ppDataPtrs[Index];
+
+	int Offset = m_pDataFile->m_Info.m_pDataOffsets[Index];
+	int DataSize = GetFileDataSize(Index);
+	if(Offset < 0 || DataSize < 0 || Offset > m_pDataFile->m_Header.m_DataSize - DataSize)
+	{
+		dbg_msg("datafile", "invalid data index=%d offset=%d size=%d", Index, Offset, DataSize);
+		return 0;
+	}
+	char *pFileData = m_pDataFile->m_Info.m_pDataStart + Offset;
+
+	if(!m_pDataFile->m_pArena)
+	{
+		// pages of blocks that are never loaded are not touched
+		m_pDataFile->m_pArena = (char *)malloc(maximum(m_pDataFile->m_ArenaSize, (size_t)1));
+		if(!m_pDataFile->m_pArena)
+			return 0;
+	}
+
+	char *pData = m_pDataFile->m_pArena + m_pDataFile->m_pArenaOffsets[Index];
+	if(m_pDataFile->m_Header.m_Version != 4)
+	{
+		// the mapping stays as it is on disk, it is what clients download
+		mem_copy(pData, pFileData, DataSize);
+		m_pDataFile->m_ppDataPtrs[Index] = pData;
+		return pData;
+	}
+
+	unsigned long ExpectedSize = maximum(m_pDataFile->m_Info.m_pDataSizes[Index], 0);
+	unsigned long UncompressedSize = ExpectedSize;
+	dbg_msg("datafile", "loading data index=%d size=%d uncompressed=%lu", Index, DataSize, UncompressedSize);
+
+	// decompress the data
+	int Result = uncompress((Bytef *)pData, &UncompressedSize, (Bytef *)pFileData, DataSize);
+	if(Result != Z_OK || UncompressedSize != ExpectedSize)
+	{
+		dbg_msg("datafile", "failed to decompress data index=%d result=%d size=%lu expected=%lu", Index, Result, UncompressedSize, ExpectedSize);
+		return 0;
+	}
+	m_pDataFile->m_ppDataPtrs[Index] = pData;
+	return pData;
+}
+
 void *CDataFileReader::GetData(int Index)
 {
 	return GetDataImpl(Index, 0);
@@ -338,8 +541,9 @@ void CDataFileReader::UnloadData(int Index)
 	if(Index < 0 || Index >= m_pDataFile->m_Header.m_NumRawData)
 		return;
 
-	//
-	free(m_pDataFile->m_ppDataPtrs[Index]);
+	// mapped data lives in the arena until Close
+	if(!m_pDataFile->m_pMapping)
+		free(m_pDataFile->m_ppDataPtrs[Index]);
 	m_pDataFile->m_ppDataPtrs[Index] = 0x0;
 }
 
@@ -480,11 +684,18 @@ bool CDataFileReader::Close()
 		return true;
 
 	// free the data that is loaded
-	int i;
-	for(i = 0; i < m_pDataFile->m_Header.m_NumRawData; i++)
-		free(m_pDataFile->m_ppDataPtrs[i]);
+	if(m_pDataFile->m_pMapping)
+	{
+		free(m_pDataFile->m_pArena);
+		ReleaseInPlace(m_pDataFile->m_File, m_pDataFile->m_pMapping, m_pDataFile->m_MappingSize, m_pDataFile->m_MemoryFile);
+	}
+	else
+	{
+		for(int i = 0; i < m_pDataFile->m_Header.m_NumRawData; i++)
+			free(m_pDataFile->m_ppDataPtrs[i]);
+		io_close(m_pDataFile->m_File);
+	}
 
-	io_close(m_pDataFile->m_File);
 	free(m_pDataFile);
 	m_pDataFile = 0;
 	return true;
@@ -518,6 +729,20 @@ int CDataFileReader::MapSize() const
 	return m_pDataFile->m_Header.m_Size + 16;
 }
 
+const unsigned char *CDataFileReader::MappedFile() const
+{
+	if(!m_pDataFile)
+		return 0;
+	return m_pDataFile->m_pMapping;
+}
+
+unsigned CDataFileReader::MappedFileSize() const
+{
+	if(!m_pDataFile)
+		return 0;
+	return m_pDataFile->m_MappingSize;
+}
+
 IOHANDLE CDataFileReader::File()
 {
 	if(!m_pDataFile)
@@ -525,9 +750,64 @@ IOHANDLE CDataFileReader::File()
 	return m_pDataFile->m_File;
 }
 
+CDataFileWriter::CCompressJob::CCompressJob(int Size, const void *pData, int CompressionLevel) :
+	m_Claimed(false),
+	m_Done(false),
+	m_CompressionLevel(CompressionLevel),
+	m_UncompressedSize(Size),
+	m_CompressedSize(0),
+	m_pCompressedData(0)
+{
+	// the caller may free or reuse its buffer right after AddData
+	m_pUncompressedData = malloc(Size);
+	mem_copy(m_pUncompressedData, pData, Size);
+	semaphore_init(&m_DoneSemaphore);
+}
+
+CDataFileWriter::CCompressJob::~CCompressJob()
+{
+	semaphore_destroy(&m_DoneSemaphore);
+	free(m_pUncompressedData);
+	free(m_pCompressedData);
+}
+
+void CDataFileWriter::CCompressJob::Compress()
+{
+	if(m_Claimed.exchange(true))
+		return;
+
+	m_CompressedSize = compressBound(m_UncompressedSize);
+	m_pCompressedData = malloc(m_CompressedSize);
+	int Result = compress2((Bytef *)m_pCompressedData, &m_CompressedSize, (Bytef *)m_pUncompressedData, m_UncompressedSize, m_CompressionLevel);
+	if(Result != Z_OK)
+	{
+		dbg_msg("datafile", "compression error %d", Result);
+		dbg_assert(0, "zlib error");
+	}
+	free(m_pUncompressedData);
+	m_pUncompressedData = 0;
+	m_Done = true;
+	semaphore_signal(&m_DoneSemaphore);
+}
+
+void CDataFileWriter::CCompressJob::Wait()
+{
+	// sleep until the pool thread is done, a later Wait sees m_Done
+	if(!m_Done)
+		semaphore_wait(&m_DoneSemaphore);
+}
+
 CDataFileWriter::CDataFileWriter()
 {
 	m_File = 0;
+	m_Memory = false;
+	m_pMemory = 0;
+	m_MemorySize = 0;
+	m_pEngine = 0;
+	m_DataStreamOpen = false;
+	m_DataStreamSize = 0;
+	m_pDataStreamOut = 0;
+	m_DataStreamOutSize = 0;
 	m_pItemTypes = static_cast<CItemTypeInfo *>(calloc(MAX_ITEM_TYPES, sizeof(CItemTypeInfo)));
 	m_pItems = static_cast<CItemInfo *>(calloc(MAX_ITEMS, sizeof(CItemInfo)));
 	m_pDatas = static_cast<CDataInfo *>(calloc(MAX_DATAS, sizeof(CDataInfo)));
@@ -541,26 +821,33 @@ CDataFileWriter::~CDataFileWriter()
 		free(m_pItems[i].m_pData);
 	for(int i = 0; i < m_NumDatas; ++i)
 		free(m_pDatas[i].m_pCompressedData);
+	// jobs still in the pool own their buffers and free them when they are released
+	m_vpCompressJobs.clear();
 	free(m_pItems);
 	m_pItems = 0;
 	free(m_pDatas);
 	m_pDatas = 0;
+	mem_free(m_pMemory);
+	if(m_DataStreamOpen)
+		deflateEnd(&m_DataStream);
+	free(m_pDataStreamOut);
 }
 
 bool CDataFileWriter::OpenFile(class IStorage *pStorage, const char *pFilename, int StorageType)
 {
-	dbg_assert(!m_File, "a file already exists");
+	dbg_assert(!m_File && !m_Memory, "a file already exists");
 	m_File = pStorage->OpenFile(pFilename, IOFLAG_WRITE, StorageType);
 	return m_File != 0;
 }
 
 void CDataFileWriter::Init()
 {
-	dbg_assert(!m_File, "a file already exists");
+	dbg_assert(!m_File && !m_Memory, "a file already exists");
 	m_NumItems = 0;
 	m_NumDatas = 0;
 	m_NumItemTypes = 0;
 	m_NumExtendedItemTypes = 0;
+	m_vpCompressJobs.clear();
 	mem_zero(m_pItemTypes, sizeof(CItemTypeInfo) * MAX_ITEM_TYPES);
 	mem_zero(m_aExtendedItemTypes, sizeof(m_aExtendedItemTypes));
 
@@ -577,6 +864,32 @@ bool CDataFileWriter::Open(class IStorage *pStorage, const char *pFilename, int
 	return OpenFile(pStorage, pFilename, StorageType);
 }
 
+void CDataFileWriter::OpenMemory()
+{
+	Init();
+	m_Memory = true;
+}
+
+unsigned char *CDataFileWriter::TakeMemory(unsigned *pSize)
+{
+	unsigned char *pMemory = m_pMemory;
+	*pSize = pMemory ? m_MemorySize : 0;
+	m_pMemory = 0;
+	m_MemorySize = 0;
+	return pMemory;
+}
+
+void CDataFileWriter::Write(const void *pData, unsigned Size)
+{
+	if(m_Memory)
+	{
+		mem_copy(m_pMemory + m_MemorySize, pData, Size);
+		m_MemorySize += Size;
+	}
+	else
+		io_write(m_File, pData, Size);
+}
+
 int CDataFileWriter::GetTypeFromIndex(int Index)
 {
 	return ITEMTYPE_EX - Index - 1;
@@ -641,11 +954,8 @@ int CDataFileWriter::AddItem(int Type, int ID, int Size, void *pData)
 	return m_NumItems - 1;
 }
 
-int CDataFileWriter::AddData(int Size, void *pData, int CompressionLevel)
+void CDataFileWriter::CompressData(CDataInfo *pInfo, int Size, const void *pData, int CompressionLevel)
 {
-	dbg_assert(m_NumDatas < 1024, "too much data");
-
-	CDataInfo *pInfo = &m_pDatas[m_NumDatas];
 	unsigned long s = compressBound(Size);
 	void *pCompData = malloc(s); // temporary buffer that we use during compression
 
@@ -656,17 +966,137 @@ int CDataFileWriter::AddData(int Size, void *pData, int CompressionLevel)
 		dbg_assert(0, "zlib error");
 	}
 
-	pInfo->m_UncompressedSize = Size;
 	pInfo->m_CompressedSize = (int)s;
 	pInfo->m_pCompressedData = malloc(pInfo->m_CompressedSize);
 	mem_copy(pInfo->m_pCompressedData, pCompData, pInfo->m_CompressedSize);
 	free(pCompData);
+}
+
+int CDataFileWriter::AddData(int Size, void *pData, int CompressionLevel)
+{
+	dbg_assert(m_NumDatas < 1024, "too much data");
+
+	CDataInfo *pInfo = &m_pDatas[m_NumDatas];
+	pInfo->m_UncompressedSize = Size;
+	pInfo->m_CompressedSize = 0;
+	pInfo->m_pCompressedData = 0;
+
+	if(m_pEngine && Size >= COMPRESS_JOB_MIN_SIZE)
+	{
+		// compressed on the pool, collected by FinishCompression
+		if((int)m_vpCompressJobs.size() <= m_NumDatas)
+			m_vpCompressJobs.resize(m_NumDatas + 1);
+		m_vpCompressJobs[m_NumDatas] = std::make_shared<CCompressJob>(Size, pData, CompressionLevel);
+		m_pEngine->AddJob(m_vpCompressJobs[m_NumDatas]);
+	}
+	else
+		CompressData(pInfo, Size, pData, CompressionLevel);
 
 	m_NumDatas++;
 	return m_NumDatas - 1;
 }
 
-int CDataFileWriter::AddDataSwapped(int Size, void *pData)
+int CDataFileWriter::AddCompressedData(int Size, const void *pCompressedData, int CompressedSize)
+{
+	dbg_assert(m_NumDatas < 1024, "too much data");
+
+	CDataInfo *pInfo = &m_pDatas[m_NumDatas];
+	pInfo->m_UncompressedSize = Size;
+	pInfo->m_CompressedSize = CompressedSize;
+	pInfo->m_pCompressedData = malloc(CompressedSize);
+	mem_copy(pInfo->m_pCompressedData, pCompressedData, CompressedSize);
+
+	m_NumDatas++;
+	return m_NumDatas - 1;
+}
+
+void CDataFileWriter::BeginData(int CompressionLevel)
+{
+	dbg_assert(!m_DataStreamOpen, "a data block is open already");
+	mem_zero(&m_DataStream, sizeof(m_DataStream));
+	if(deflateInit(&m_DataStream, CompressionLevel) != Z_OK)
+		dbg_assert(0, "zlib error");
+	m_DataStreamOpen = true;
+	m_DataStreamSize = 0;
+	m_pDataStreamOut = 0;
+	m_DataStreamOutSize = 0;
+}
+
+void CDataFileWriter::DeflateDataStream(int Flush)
+{
+	while(true)
+	{
+		// grow the output by half each time it is full
+		if(m_DataStream.total_out == m_DataStreamOutSize)
+		{
+			m_DataStreamOutSize = maximum(m_DataStreamOutSize + m_DataStreamOutSize / 2, 64u * 1024u);
+			m_pDataStreamOut = (unsigned char *)realloc(m_pDataStreamOut, m_DataStreamOutSize);
+		}
+		m_DataStream.next_out = m_pDataStreamOut + m_DataStream.total_out;
+		m_DataStream.avail_out = m_DataStreamOutSize - m_DataStream.total_out;
+
+		int Result = deflate(&m_DataStream, Flush);
+		if(Result != Z_OK && Result != Z_STREAM_END && Result != Z_BUF_ERROR)
+		{
+			dbg_msg("datafile", "compression error %d", Result);
+			dbg_assert(0, "zlib error");
+		}
+		if(Flush == Z_FINISH ? Result == Z_STREAM_END : (m_DataStream.avail_in == 0 && m_DataStream.avail_out != 0))
+			break;
+	}
+}
+
+void CDataFileWriter::AddDataPart(const void *pData, int Size)
+{
+	dbg_assert(m_DataStreamOpen, "no data block is open");
+	m_DataStream.next_in = (Bytef *)pData;
+	m_DataStream.avail_in = Size;
+	DeflateDataStream(Z_NO_FLUSH);
+	m_DataStreamSize += Size;
+}
+
+int CDataFileWriter::EndData()
+{
+	dbg_assert(m_DataStreamOpen, "no data block is open");
+	dbg_assert(m_NumDatas < 1024, "too much data");
+	m_DataStream.next_in = 0;
+	m_DataStream.avail_in = 0;
+	DeflateDataStream(Z_FINISH);
+
+	CDataInfo *pInfo = &m_pDatas[m_NumDatas];
+	pInfo->m_UncompressedSize = m_DataStreamSize;
+	pInfo->m_CompressedSize = (int)m_DataStream.total_out;
+	pInfo->m_pCompressedData = realloc(m_pDataStreamOut, maximum(pInfo->m_CompressedSize, 1));
+
+	deflateEnd(&m_DataStream);
+	m_DataStreamOpen = false;
+	m_pDataStreamOut = 0;
+	m_DataStreamOutSize = 0;
+
+	m_NumDatas++;
+	return m_NumDatas - 1;
+}
+
+void CDataFileWriter::FinishCompression()
+{
+	for(int i = 0; i < (int)m_vpCompressJobs.size(); i++)
+	{
+		CCompressJob *pJob = m_vpCompressJobs[i].get();
+		if(!pJob)
+			continue;
+
+		// jobs the pool did not start yet are compressed here
+		pJob->Compress();
+		pJob->Wait();
+
+		m_pDatas[i].m_CompressedSize = (int)pJob->m_CompressedSize;
+		m_pDatas[i].m_pCompressedData = pJob->m_pCompressedData;
+		pJob->m_pCompressedData = 0;
+	}
+	m_vpCompressJobs.clear();
+}
+
+int CDataFileWriter::AddDataSwapped(int Size, void *pData, int CompressionLevel)
 {
 	dbg_assert(Size % sizeof(int) == 0, "incorrect boundary");
 
@@ -674,19 +1104,22 @@ int CDataFileWriter::AddDataSwapped(int Size, void *pData)
 	void *pSwapped = malloc(Size); // temporary buffer that we use during compression
 	mem_copy(pSwapped, pData, Size);
 	swap_endian(pSwapped, sizeof(int), Size / sizeof(int));
-	int Index = AddData(Size, pSwapped);
+	int Index = AddData(Size, pSwapped, CompressionLevel);
 	free(pSwapped);
 	return Index;
 #else
-	return AddData(Size, pData);
+	return AddData(Size, pData, CompressionLevel);
 #endif
 }
 
 int CDataFileWriter::Finish()
 {
-	if(!m_File)
+	if(!m_File && !m_Memory)
 		return 1;
 
+	dbg_assert(!m_DataStreamOpen, "a data block is still open");
+	FinishCompression();
+
 	int ItemSize = 0;
 	int TypesSize, HeaderSize, OffsetSize, FileSize, SwapSize;
 	int DataSize = 0;
@@ -716,6 +1149,19 @@ int CDataFileWriter::Finish()
 
 	(void)SwapSize;
 
+	if(m_Memory)
+	{
+		mem_free(m_pMemory);
+		m_pMemory = (unsigned char *)mem_alloc(FileSize, 1);
+		m_MemorySize = 0;
+		if(!m_pMemory)
+		{
+			dbg_msg("datafile", "couldn't allocate %d bytes for the file", FileSize);
+			m_Memory = false;
+			return 1;
+		}
+	}
+
 	if(DEBUG)
 		dbg_msg("datafile", "num_m_aItemTypes=%d TypesSize=%d m_aItemsize=%d DataSize=%d", m_NumItemTypes, TypesSize, ItemSize, DataSize);
 
@@ -740,7 +1186,7 @@ int CDataFileWriter::Finish()
 #if defined(CONF_ARCH_ENDIAN_BIG)
 		swap_endian(&Header, sizeof(int), sizeof(Header) / sizeof(int));
 #endif
-		io_write(m_File, &Header, sizeof(Header));
+		Write(&Header, sizeof(Header));
 	}
 
 	// write types
@@ -758,7 +1204,7 @@ int CDataFileWriter::Finish()
 #if defined(CONF_ARCH_ENDIAN_BIG)
 			swap_endian(&Info, sizeof(int), sizeof(CDatafileItemType) / sizeof(int));
 #endif
-			io_write(m_File, &Info, sizeof(Info));
+			Write(&Info, sizeof(Info));
 			Count += m_pItemTypes[i].m_Num;
 		}
 	}
@@ -778,7 +1224,7 @@ int CDataFileWriter::Finish()
 #if defined(CONF_ARCH_ENDIAN_BIG)
 				swap_endian(&Temp, sizeof(int), sizeof(Temp) / sizeof(int));
 #endif
-				io_write(m_File, &Temp, sizeof(Temp));
+				Write(&Temp, sizeof(Temp));
 				Offset += m_pItems[k].m_Size + sizeof(CDatafileItem);
 
 				// next
@@ -796,7 +1242,7 @@ int CDataFileWriter::Finish()
 #if defined(CONF_ARCH_ENDIAN_BIG)
 		swap_endian(&Temp, sizeof(int), sizeof(Temp) / sizeof(int));
 #endif
-		io_write(m_File, &Temp, sizeof(Temp));
+		Write(&Temp, sizeof(Temp));
 		Offset += m_pDatas[i].m_CompressedSize;
 	}
 
@@ -809,7 +1255,7 @@ int CDataFileWriter::Finish()
 #if defined(CONF_ARCH_ENDIAN_BIG)
 		swap_endian(&UncompressedSize, sizeof(int), sizeof(UncompressedSize) / sizeof(int));
 #endif
-		io_write(m_File, &UncompressedSize, sizeof(UncompressedSize));
+		Write(&UncompressedSize, sizeof(UncompressedSize));
 	}
 
 	// write m_pItems
@@ -831,8 +1277,8 @@ int CDataFileWriter::Finish()
 				swap_endian(&Item, sizeof(int), sizeof(Item) / sizeof(int));
 				swap_endian(m_pItems[k].m_pData, sizeof(int), m_pItems[k].m_Size / sizeof(int));
 #endif
-				io_write(m_File, &Item, sizeof(Item));
-				io_write(m_File, m_pItems[k].m_pData, m_pItems[k].m_Size);
+				Write(&Item, sizeof(Item));
+				Write(m_pItems[k].m_pData, m_pItems[k].m_Size);
 
 				// next
 				k = m_pItems[k].m_Next;
@@ -845,7 +1291,7 @@ int CDataFileWriter::Finish()
 	{
 		if(DEBUG)
 			dbg_msg("datafile", "writing data id=%d size=%d", i, m_pDatas[i].m_CompressedSize);
-		io_write(m_File, m_pDatas[i].m_pCompressedData, m_pDatas[i].m_CompressedSize);
+		Write(m_pDatas[i].m_pCompressedData, m_pDatas[i].m_CompressedSize);
 	}
 
 	// free data
@@ -860,8 +1306,13 @@ int CDataFileWriter::Finish()
 		m_pDatas[i].m_pCompressedData = 0;
 	}
 
-	io_close(m_File);
-	m_File = 0;
+	if(m_Memory)
+		m_Memory = false;
+	else
+	{
+		io_close(m_File);
+		m_File = 0;
+	}
 
 	if(DEBUG)
 		dbg_msg("datafile", "done");
@@ -3,6 +3,7 @@
 #ifndef ENGINE_SHARED_DATAFILE_H
 #define ENGINE_SHARED_DATAFILE_H
 
+#include <engine/shared/jobs.h>
 #include <engine/storage.h>
 
 #include <base/hash.h>
@@ -10,6 +11,9 @@
 
 #include <zlib.h>
 
+#include <memory>
+#include <vector>
+
 enum
 {
 	ITEMTYPE_EX = 0xffff,
@@ -20,6 +24,9 @@ class CDataFileReader
 {
 	struct CDatafile *m_pDataFile;
 	void *GetDataImpl(int Index, int Swap);
+	void *GetMappedData(int Index);
+	static void InitInfo(struct CDatafile *pDataFile);
+	bool OpenInPlace(const char *pName, IOHANDLE File, unsigned char *pData, unsigned DataSize, bool MemoryFile);
 	int GetFileDataSize(int Index);
 
 	int GetExternalItemType(int InternalType);
@@ -32,7 +39,41 @@ public:
 
 	bool IsOpen() const { return m_pDataFile != nullptr; }
 
-	bool Open(class IStorage *pStorage, const char *pFilename, int StorageType);
+	/*
+		Function: Open
+			Opens a datafile and loads its item tables.
+
+		Parameters:
+			pStorage - Storage to open the file with.
+			pFilename - Name of the file.
+			StorageType - Where to look for it.
+			MapFile - Maps the file instead of reading it. The tables
+				and items are then copied out of the mapping, data
+				blocks are inflated or copied on first use into one
+				block and MappedFile returns the whole file as it is
+				on disk.
+				Falls back to reading.
+
+		Returns:
+			true on success.
+	*/
+	bool Open(class IStorage *pStorage, const char *pFilename, int StorageType, bool MapFile = false);
+
+	/*
+		Function: OpenMemory
+			Opens a datafile that is already in memory, like a mapped
+			file. Fails on big endian hosts.
+
+		Parameters:
+			pName - Name for the log.
+			pData - The whole file, allocated with mem_alloc. The reader
+				takes it over and frees it, also when opening fails.
+			Size - Size of the file.
+
+		Returns:
+			true on success.
+	*/
+	bool OpenMemory(const char *pName, unsigned char *pData, unsigned Size);
 	bool Close();
 
 	void *GetData(int Index);
@@ -51,6 +92,8 @@ public:
 	SHA256_DIGEST Sha256() const;
 	unsigned Crc() const;
 	int MapSize() const;
+	const unsigned char *MappedFile() const;
+	unsigned MappedFileSize() const;
 	IOHANDLE File();
 };
 
@@ -81,6 +124,29 @@ class CDataFileWriter
 		int m_Last;
 	};
 
+	// compresses a private copy of one data block on the job pool
+	class CCompressJob : public IJob
+	{
+		std::atomic<bool> m_Claimed;
+		std::atomic<bool> m_Done;
+		SEMAPHORE m_DoneSemaphore; // signaled once when m_Done is set
+		void Run() override { Compress(); }
+
+	public:
+		CCompressJob(int Size, const void *pData, int CompressionLevel);
+		~CCompressJob();
+
+		// whoever claims the job first compresses it, the other side returns
+		void Compress();
+		void Wait();
+
+		int m_CompressionLevel;
+		int m_UncompressedSize;
+		void *m_pUncompressedData;
+		unsigned long m_CompressedSize;
+		void *m_pCompressedData;
+	};
+
 	enum
 	{
 		MAX_ITEM_TYPES = 0x10000,
@@ -90,6 +156,9 @@ class CDataFileWriter
 	};
 
 	IOHANDLE m_File;
+	bool m_Memory;
+	unsigned char *m_pMemory;
+	unsigned m_MemorySize;
 	int m_NumItems;
 	int m_NumDatas;
 	int m_NumItemTypes;
@@ -99,8 +168,23 @@ class CDataFileWriter
 	CDataInfo *m_pDatas;
 	int m_aExtendedItemTypes[MAX_EXTENDED_ITEM_TYPES];
 
+	class IEngine *m_pEngine;
+	std::vector<std::shared_ptr<CCompressJob>> m_vpCompressJobs;
+
+	// the data block between BeginData and EndData
+	bool m_DataStreamOpen;
+	z_stream m_DataStream;
+	int m_DataStreamSize;
+	unsigned char *m_pDataStreamOut;
+	unsigned m_DataStreamOutSize;
+	void DeflateDataStream(int Flush);
+
+	void CompressData(CDataInfo *pInfo, int Size, const void *pData, int CompressionLevel);
+	void FinishCompression();
+
 	int GetExtendedItemTypeIndex(int Type);
 	int GetTypeFromIndex(int Index);
+	void Write(const void *pData, unsigned Size);
 
 public:
 	CDataFileWriter();
@@ -108,8 +192,76 @@ public:
 	void Init();
 	bool OpenFile(class IStorage *pStorage, const char *pFilename, int StorageType = IStorage::TYPE_SAVE);
 	bool Open(class IStorage *pStorage, const char *pFilename, int StorageType = IStorage::TYPE_SAVE);
+
+	/*
+		Function: OpenMemory
+			Starts a datafile that Finish writes into one buffer
+			instead of a file, see TakeMemory.
+	*/
+	void OpenMemory();
+
+	/*
+		Function: TakeMemory
+			Hands over the buffer written by Finish after OpenMemory.
+
+		Parameters:
+			pSize - Set to the size of the file.
+
+		Returns:
+			The whole file allocated with mem_alloc, or 0. The caller
+			frees it or passes it on to CDataFileReader::OpenMemory.
+	*/
+	unsigned char *TakeMemory(unsigned *pSize);
+
+	/*
+		Function: SetCompressionJobs
+			Compresses larger data blocks on the job pool of the engine
+			instead of inside AddData. Finish waits for them and writes
+			them in index order, the file does not change.
+
+		Parameters:
+			pEngine - Engine to add the jobs to, 0 compresses in AddData.
+	*/
+	void SetCompressionJobs(class IEngine *pEngine) { m_pEngine = pEngine; }
 	int AddData(int Size, void *pData, int CompressionLevel = Z_DEFAULT_COMPRESSION);
-	int AddDataSwapped(int Size, void *pData);
+	int AddDataSwapped(int Size, void *pData, int CompressionLevel = Z_DEFAULT_COMPRESSION);
+
+	/*
+		Function: AddCompressedData
+			Adds a data block that is already zlib compressed, for
+			example one kept from an earlier file.
+
+		Parameters:
+			Size - Size of the data before compression.
+			pCompressedData - The compressed data, it is copied.
+			CompressedSize - Size of the compressed data.
+
+		Returns:
+			The index of the data block.
+	*/
+	int AddCompressedData(int Size, const void *pCompressedData, int CompressedSize);
+
+	/*
+		Function: BeginData
+			Starts a data block that is handed over in parts with
+			AddDataPart and compressed as the parts come in, so the
+			block is never held uncompressed as a whole. One block can
+			be open at a time.
+
+		Parameters:
+			CompressionLevel - zlib level like for AddData.
+	*/
+	void BeginData(int CompressionLevel = Z_DEFAULT_COMPRESSION);
+	void AddDataPart(const void *pData, int Size);
+
+	/*
+		Function: EndData
+			Finishes the data block started with BeginData.
+
+		Returns:
+			The index of the data block.
+	*/
+	int EndData();
 	int AddItem(int Type, int ID, int Size, void *pData);
 	int Finish();
 };
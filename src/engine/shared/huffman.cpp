@@ -1,5 +1,6 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
 #include "huffman.h"
 
@@ -144,10 +145,120 @@ void CHuffman::Init(const unsigned *pFrequencies)
 			m_apDecodeLut[i] = pNode;
 	}
 
+	// the fast path is only exact as long as the reference code never runs out of buffered bits
+	m_MaxCodeLength = 0;
+	for(i = 0; i < HUFFMAN_MAX_SYMBOLS; i++)
+		m_MaxCodeLength = max(m_MaxCodeLength, m_aNodes[i].m_NumBits);
+
+	BuildFastLut();
+	m_FastPath = true;
+}
+
+void CHuffman::BuildFastLut()
+{
+	CNode *pEof = &m_aNodes[HUFFMAN_EOF_SYMBOL];
+
+	for(int i = 0; i < HUFFMAN_FAST_LUTSIZE; i++)
+	{
+		CFastEntry *pEntry = &m_aFastLut[i];
+		unsigned Bits = i;
+		CNode *pNode = m_pStartNode;
+
+		pEntry->m_NumSymbols = 0;
+		pEntry->m_NumBits = 0;
+		pEntry->m_Node = 0;
+
+		// decode as many complete symbols as the bits hold, but never past the eof symbol
+		for(int k = 0; k < HUFFMAN_FAST_LUTBITS; k++)
+		{
+			pNode = &m_aNodes[pNode->m_aLeafs[Bits&1]];
+			Bits >>= 1;
+
+			if(!pNode->m_NumBits)
+				continue;
+
+			pEntry->m_NumBits = k+1;
+			if(pNode == pEof)
+			{
+				pEntry->m_NumSymbols |= HUFFMAN_FAST_EOF;
+				break;
+			}
+
+			pEntry->m_aSymbols[pEntry->m_NumSymbols++] = pNode->m_Symbol;
+			if(pEntry->m_NumSymbols == HUFFMAN_FAST_MAXSYMBOLS)
+				break;
+			pNode = m_pStartNode;
+		}
+
+		// the first code is longer than the table, remember where the tree walk continues
+		if(!pEntry->m_NumSymbols)
+		{
+			pEntry->m_NumBits = HUFFMAN_FAST_LUTBITS;
+			pEntry->m_Node = (unsigned short)(pNode - m_aNodes);
+		}
+	}
 }
 
 //***************************************************************
 int CHuffman::Compress(const void *pInput, int InputSize, void *pOutput, int OutputSize)
+{
+	if(FastPath())
+		return CompressFast(pInput, InputSize, pOutput, OutputSize);
+	return CompressReference(pInput, InputSize, pOutput, OutputSize);
+}
+
+int CHuffman::CompressFast(const void *pInput, int InputSize, void *pOutput, int OutputSize)
+{
+	// setup buffer pointers
+	const unsigned char *pSrc = (const unsigned char *)pInput;
+	const unsigned char *pSrcEnd = pSrc + InputSize;
+	unsigned char *pDst = (unsigned char *)pOutput;
+	unsigned char *pDstEnd = pDst + OutputSize;
+
+	// codes are at most 24 bits long, so 64 bits always hold the pending bits plus one more code
+	unsigned long long Bits = 0;
+	unsigned Bitcount = 0;
+
+	for(; pSrc != pSrcEnd; pSrc++)
+	{
+		Bits |= (unsigned long long)m_aNodes[*pSrc].m_Bits << Bitcount;
+		Bitcount += m_aNodes[*pSrc].m_NumBits;
+
+		// write 4 bytes at once, the reference code fails as soon as the output is full
+		if(Bitcount >= 32)
+		{
+			if(pDstEnd - pDst <= 4)
+				return -1;
+			pDst[0] = (unsigned char)(Bits&0xff);
+			pDst[1] = (unsigned char)((Bits>>8)&0xff);
+			pDst[2] = (unsigned char)((Bits>>16)&0xff);
+			pDst[3] = (unsigned char)((Bits>>24)&0xff);
+			pDst += 4;
+			Bits >>= 32;
+			Bitcount -= 32;
+		}
+	}
+
+	// write EOF symbol
+	Bits |= (unsigned long long)m_aNodes[HUFFMAN_EOF_SYMBOL].m_Bits << Bitcount;
+	Bitcount += m_aNodes[HUFFMAN_EOF_SYMBOL].m_NumBits;
+	while(Bitcount >= 8)
+	{
+		*pDst++ = (unsigned char)(Bits&0xff);
+		if(pDst == pDstEnd)
+			return -1;
+		Bits >>= 8;
+		Bitcount -= 8;
+	}
+
+	// write out the last bits
+	*pDst++ = (unsigned char)(Bits&0xff);
+
+	// return the size of the output
+	return (int)(pDst - (const unsigned char *)pOutput);
+}
+
+int CHuffman::CompressReference(const void *pInput, int InputSize, void *pOutput, int OutputSize)
 {
 	// this macro loads a symbol for a byte into bits and bitcount
 #define HUFFMAN_MACRO_LOADSYMBOL(Sym) \
@@ -215,16 +326,90 @@ int CHuffman::Compress(const void *pInput, int InputSize, void *pOutput, int Out
 
 //***************************************************************
 int CHuffman::Decompress(const void *pInput, int InputSize, void *pOutput, int OutputSize)
+{
+	if(FastPath())
+		return DecompressFast(pInput, InputSize, pOutput, OutputSize);
+
+	const unsigned char *pSrc = (const unsigned char *)pInput;
+	unsigned char *pDst = (unsigned char *)pOutput;
+	return DecompressReference(pSrc, pSrc + InputSize, 0, 0, pDst, pDst + OutputSize, pDst);
+}
+
+int CHuffman::DecompressFast(const void *pInput, int InputSize, void *pOutput, int OutputSize)
 {
 	// setup buffer pointers
 	unsigned char *pDst = (unsigned char *)pOutput;
-	unsigned char *pSrc = (unsigned char *)pInput;
+	const unsigned char *pSrc = (const unsigned char *)pInput;
 	unsigned char *pDstEnd = pDst + OutputSize;
-	unsigned char *pSrcEnd = pSrc + InputSize;
+	const unsigned char *pSrcEnd = pSrc + InputSize;
 
-	unsigned Bits = 0;
+	unsigned long long Bits = 0;
 	unsigned Bitcount = 0;
 
+	CNode *pEof = &m_aNodes[HUFFMAN_EOF_SYMBOL];
+
+	while(pSrcEnd - pSrc >= 8)
+	{
+		// {A} fill the bit buffer, this reads at most 8 bytes
+		while(Bitcount <= 56)
+		{
+			Bits |= (unsigned long long)(*pSrc++) << Bitcount;
+			Bitcount += 8;
+		}
+
+		const CFastEntry *pEntry = &m_aFastLut[Bits&HUFFMAN_FAST_LUTMASK];
+		if(pEntry->m_NumSymbols)
+		{
+			// {B} output all symbols the lookup decoded, a full output is left to the reference code
+			int NumSymbols = pEntry->m_NumSymbols&~HUFFMAN_FAST_EOF;
+			if(pDstEnd - pDst < HUFFMAN_FAST_MAXSYMBOLS)
+			{
+				if(pDstEnd - pDst < NumSymbols)
+					break;
+				for(int i = 0; i < NumSymbols; i++)
+					pDst[i] = pEntry->m_aSymbols[i];
+			}
+			else
+				mem_copy(pDst, pEntry->m_aSymbols, HUFFMAN_FAST_MAXSYMBOLS);
+			pDst += NumSymbols;
+
+			Bits >>= pEntry->m_NumBits;
+			Bitcount -= pEntry->m_NumBits;
+
+			if(pEntry->m_NumSymbols&HUFFMAN_FAST_EOF)
+				return (int)(pDst - (const unsigned char *)pOutput);
+		}
+		else
+		{
+			// {C} the code is longer than the table, walk the tree for the rest of it
+			Bits >>= HUFFMAN_FAST_LUTBITS;
+			Bitcount -= HUFFMAN_FAST_LUTBITS;
+
+			CNode *pNode = &m_aNodes[pEntry->m_Node];
+			do
+			{
+				pNode = &m_aNodes[pNode->m_aLeafs[Bits&1]];
+				Bits >>= 1;
+				Bitcount--;
+			}
+			while(!pNode->m_NumBits);
+
+			if(pNode == pEof)
+				return (int)(pDst - (const unsigned char *)pOutput);
+
+			if(pDst == pDstEnd)
+				return -1;
+			*pDst++ = pNode->m_Symbol;
+		}
+	}
+
+	// the reference code decodes the tail, it defines how truncated input behaves
+	return DecompressReference(pSrc, pSrcEnd, Bits, Bitcount, pDst, pDstEnd, (unsigned char *)pOutput);
+}
+
+int CHuffman::DecompressReference(const unsigned char *pSrc, const unsigned char *pSrcEnd, unsigned long long Bits, unsigned Bitcount,
+	unsigned char *pDst, unsigned char *pDstEnd, unsigned char *pOutput)
+{
 	CNode *pEof = &m_aNodes[HUFFMAN_EOF_SYMBOL];
 	CNode *pNode = 0;
 
@@ -238,7 +423,7 @@ int CHuffman::Decompress(const void *pInput, int InputSize, void *pOutput, int O
 		// {B} fill with new bits
 		while(Bitcount < 24 && pSrc != pSrcEnd)
 		{
-			Bits |= (*pSrc++) << Bitcount;
+			Bits |= (unsigned long long)(*pSrc++) << Bitcount;
 			Bitcount += 8;
 		}
 
@@ -293,5 +478,5 @@ int CHuffman::Decompress(const void *pInput, int InputSize, void *pOutput, int O
 	}
 
 	// return the size of the decompressed buffer
-	return (int)(pDst - (const unsigned char *)pOutput);
+	return (int)(pDst - pOutput);
 }
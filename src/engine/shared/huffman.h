@@ -16,7 +16,17 @@ class CHuffman
 
 		HUFFMAN_LUTBITS = 10,
 		HUFFMAN_LUTSIZE = (1<<HUFFMAN_LUTBITS),
-		HUFFMAN_LUTMASK = (HUFFMAN_LUTSIZE-1)
+		HUFFMAN_LUTMASK = (HUFFMAN_LUTSIZE-1),
+
+		// the fast path decodes up to 4 symbols with one lookup
+		HUFFMAN_FAST_LUTBITS = 12,
+		HUFFMAN_FAST_LUTSIZE = (1<<HUFFMAN_FAST_LUTBITS),
+		HUFFMAN_FAST_LUTMASK = (HUFFMAN_FAST_LUTSIZE-1),
+		HUFFMAN_FAST_MAXSYMBOLS = 4,
+		HUFFMAN_FAST_EOF = 0x80,
+
+		// the reference code only keeps 24 bits buffered, longer codes fall back to it
+		HUFFMAN_FAST_MAXCODELEN = 24,
 	};
 
 	struct CNode
@@ -31,7 +41,15 @@ class CHuffman
 		// what the symbol represents
 		unsigned char m_Symbol;
 	};
-	
+
+	struct CFastEntry
+	{
+		unsigned char m_aSymbols[HUFFMAN_FAST_MAXSYMBOLS];
+		unsigned char m_NumSymbols; // | HUFFMAN_FAST_EOF if the bits end with the eof symbol
+		unsigned char m_NumBits;
+		unsigned short m_Node; // inner node to continue from if no symbol is complete
+	};
+
 	static const unsigned ms_aFreqTable[HUFFMAN_MAX_SYMBOLS];
 
 	CNode m_aNodes[HUFFMAN_MAX_NODES];
@@ -39,8 +57,19 @@ class CHuffman
 	CNode *m_pStartNode;
 	int m_NumNodes;
 
+	CFastEntry m_aFastLut[HUFFMAN_FAST_LUTSIZE];
+	unsigned m_MaxCodeLength;
+	bool m_FastPath;
+
 	void Setbits_r(CNode *pNode, int Bits, unsigned Depth);
 	void ConstructTree(const unsigned *pFrequencies);
+	void BuildFastLut();
+
+	int CompressFast(const void *pInput, int InputSize, void *pOutput, int OutputSize);
+	int DecompressFast(const void *pInput, int InputSize, void *pOutput, int OutputSize);
+	int CompressReference(const void *pInput, int InputSize, void *pOutput, int OutputSize);
+	int DecompressReference(const unsigned char *pSrc, const unsigned char *pSrcEnd, unsigned long long Bits, unsigned Bitcount,
+		unsigned char *pDst, unsigned char *pDstEnd, unsigned char *pOutput);
 
 public:
 	/*
@@ -89,5 +118,15 @@ public:
 	*/
 	int Decompress(const void *pInput, int InputSize, void *pOutput, int OutputSize);
 
+	/*
+		Function: SetFastPath
+			Selects between the table driven coder and the reference coder.
+			Both produce the same bytes and return the same values, the fast
+			one uses a 64 bit bit buffer and decodes several symbols per lookup.
+			It is only used if no code is longer than 24 bits, which holds for
+			the default frequency table.
+	*/
+	void SetFastPath(bool Enable) { m_FastPath = Enable; }
+	bool FastPath() const { return m_FastPath && m_MaxCodeLength <= HUFFMAN_FAST_MAXCODELEN; }
 };
 #endif // __HUFFMAN_HEADER__
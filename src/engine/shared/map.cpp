@@ -29,7 +29,12 @@ public:
 		IStorage *pStorage = Kernel()->RequestInterface<IStorage>();
 		if(!pStorage)
 			return false;
-		return m_DataFile.Open(pStorage, pMapName, IStorage::TYPE_ALL);
+		return m_DataFile.Open(pStorage, pMapName, IStorage::TYPE_ALL, true);
+	}
+
+	virtual bool LoadMemory(const char *pMapName, unsigned char *pData, unsigned Size)
+	{
+		return m_DataFile.OpenMemory(pMapName, pData, Size);
 	}
 
 	virtual bool IsLoaded()
@@ -46,6 +51,16 @@ public:
 	{
 		return m_DataFile.Sha256();
 	}
+
+	virtual const unsigned char *File()
+	{
+		return m_DataFile.MappedFile();
+	}
+
+	virtual unsigned FileSize()
+	{
+		return m_DataFile.MappedFileSize();
+	}
 };
 
 extern IEngineMap *CreateEngineMap() { return new CMap; }
@@ -2,6 +2,7 @@
 
 #include <engine/console.h>
 #include <engine/shared/config.h>
+#include <engine/shared/linereader.h>
 #include <engine/storage.h>
 
 #include "netban.h"
@@ -19,134 +20,353 @@ bool CNetBan::StrAllnum(const char *pStr)
 }
 
 
-CNetBan::CNetHash::CNetHash(const NETADDR *pAddr)
+static unsigned HashBytes(const unsigned char *pData, int Size, unsigned Hash)
 {
-	if(pAddr->type == NETTYPE_IPV4)
-		m_Hash = (pAddr->ip[0] + pAddr->ip[1] + pAddr->ip[2] + pAddr->ip[3]) & 0xFF;
-	else
-		m_Hash = (pAddr->ip[0] + pAddr->ip[1] + pAddr->ip[2] + pAddr->ip[3] + pAddr->ip[4] + pAddr->ip[5] + pAddr->ip[6] + pAddr->ip[7] +
-				 pAddr->ip[8] + pAddr->ip[9] + pAddr->ip[10] + pAddr->ip[11] + pAddr->ip[12] + pAddr->ip[13] + pAddr->ip[14] + pAddr->ip[15]) &
-			 0xFF;
-	m_HashIndex = 0;
+	// FNV-1a
+	for(int i = 0; i < Size; i++)
+		Hash = (Hash ^ pData[i]) * 16777619u;
+	return Hash;
+}
+
+unsigned CNetBan::HashData(const NETADDR *pAddr)
+{
+	return HashBytes(pAddr->ip, AddrBits(pAddr) / 8, 2166136261u);
+}
+
+unsigned CNetBan::HashData(const CNetRange *pRange)
+{
+	unsigned Hash = HashBytes(pRange->m_LB.ip, AddrBits(&pRange->m_LB) / 8, 2166136261u);
+	return HashBytes(pRange->m_UB.ip, AddrBits(&pRange->m_UB) / 8, Hash);
 }
 
-CNetBan::CNetHash::CNetHash(const CNetRange *pRange)
+// splits the range into the prefixes that lie completely inside of it
+void CNetBan::AddRangePrefixes(const unsigned char *pLB, const unsigned char *pUB, int Bytes, CPrefix *pPrefix, CPrefix *pPrefixes, int *pNumPrefixes)
 {
-	m_Hash = 0;
-	m_HashIndex = 0;
-	for(int i = 0; pRange->m_LB.ip[i] == pRange->m_UB.ip[i]; ++i)
+	const int Length = pPrefix->m_Length;
+	unsigned char aMax[16];
+	mem_copy(aMax, pPrefix->m_aIp, Bytes);
+	if(Length < Bytes * 8)
 	{
-		m_Hash += pRange->m_LB.ip[i];
-		++m_HashIndex;
+		aMax[Length / 8] |= 0xff >> (Length % 8);
+		for(int i = Length / 8 + 1; i < Bytes; i++)
+			aMax[i] = 0xff;
 	}
-	m_Hash &= 0xFF;
+
+	if(mem_comp(aMax, pLB, Bytes) < 0 || mem_comp(pPrefix->m_aIp, pUB, Bytes) > 0)
+		return;
+	if(mem_comp(pPrefix->m_aIp, pLB, Bytes) >= 0 && mem_comp(aMax, pUB, Bytes) <= 0)
+	{
+		pPrefixes[(*pNumPrefixes)++] = *pPrefix;
+		return;
+	}
+
+	// partly inside, split on the next bit
+	pPrefix->m_Length = Length + 1;
+	AddRangePrefixes(pLB, pUB, Bytes, pPrefix, pPrefixes, pNumPrefixes);
+	pPrefix->m_aIp[Length / 8] |= 0x80 >> (Length % 8);
+	AddRangePrefixes(pLB, pUB, Bytes, pPrefix, pPrefixes, pNumPrefixes);
+	pPrefix->m_aIp[Length / 8] &= ~(0x80 >> (Length % 8));
+	pPrefix->m_Length = Length;
 }
 
-int CNetBan::CNetHash::MakeHashArray(const NETADDR *pAddr, CNetHash aHash[17])
+int CNetBan::MakePrefixes(const CNetRange *pRange, CPrefix *pPrefixes)
 {
-	int Length = pAddr->type == NETTYPE_IPV4 ? 4 : 16;
-	aHash[0].m_Hash = 0;
-	aHash[0].m_HashIndex = 0;
-	for(int i = 1, Sum = 0; i <= Length; ++i)
+	CPrefix Prefix;
+	mem_zero(&Prefix, sizeof(Prefix));
+	Prefix.m_Type = pRange->m_LB.type;
+	Prefix.m_Length = 0;
+
+	int NumPrefixes = 0;
+	AddRangePrefixes(pRange->m_LB.ip, pRange->m_UB.ip, AddrBits(&pRange->m_LB) / 8, &Prefix, pPrefixes, &NumPrefixes);
+	return NumPrefixes;
+}
+
+static int PrefixBit(const unsigned char *pIp, int Bit)
+{
+	return (pIp[Bit / 8] >> (7 - Bit % 8)) & 1;
+}
+
+// number of leading bits both addresses share, at most MaxLength. the
+// first From bits are known to be equal already.
+static int CommonLength(const unsigned char *pIp1, const unsigned char *pIp2, int From, int MaxLength)
+{
+	int Length = From & ~7;
+	while(Length + 8 <= MaxLength && pIp1[Length / 8] == pIp2[Length / 8])
+		Length += 8;
+	if(Length < MaxLength)
 	{
-		Sum += pAddr->ip[i - 1];
-		aHash[i].m_Hash = Sum & 0xFF;
-		aHash[i].m_HashIndex = i % Length;
+		int Diff = pIp1[Length / 8] ^ pIp2[Length / 8];
+		int Bits = 0;
+		while(Bits < 8 && !(Diff & (0x80 >> Bits)))
+			Bits++;
+		Length = minimum(Length + Bits, MaxLength);
 	}
 	return Length;
 }
 
-template<class T, int HashCount>
-typename CNetBan::CBan<T> *CNetBan::CBanPool<T, HashCount>::Add(const T *pData, const CBanInfo *pInfo, const CNetHash *pNetHash)
+// whether the first Length bits are equal, the first From bits are known to be
+static bool PrefixMatches(const unsigned char *pIp1, const unsigned char *pIp2, int From, int Length)
 {
-	if(!m_pFirstFree)
-		return 0;
+	for(int i = From / 8; i < Length / 8; i++)
+	{
+		if(pIp1[i] != pIp2[i])
+			return false;
+	}
+	return Length % 8 == 0 || ((pIp1[Length / 8] ^ pIp2[Length / 8]) & (0xff00 >> (Length % 8))) == 0;
+}
 
-	// create new ban
-	CBan<T> *pBan = m_pFirstFree;
-	pBan->m_Data = *pData;
-	pBan->m_Info = *pInfo;
-	pBan->m_NetHash = *pNetHash;
-	if(pBan->m_pNext)
-		pBan->m_pNext->m_pPrev = pBan->m_pPrev;
-	if(pBan->m_pPrev)
-		pBan->m_pPrev->m_pNext = pBan->m_pNext;
+enum
+{
+	TREE_ROOT_IPV4 = 0,
+	TREE_ROOT_IPV6,
+	NUM_TREE_ROOTS,
+};
+
+static int TreeRoot(int Type)
+{
+	return Type == NETTYPE_IPV4 ? TREE_ROOT_IPV4 : TREE_ROOT_IPV6;
+}
+
+void CNetBan::CBanTree::Reset()
+{
+	m_aNodes.clear();
+	m_aEntries.clear();
+	m_FirstFreeNode = -1;
+	m_FirstFreeEntry = -1;
+
+	CPrefix Root;
+	mem_zero(&Root, sizeof(Root));
+	Root.m_Type = NETTYPE_IPV4;
+	AllocNode(&Root, 0, -1);
+	Root.m_Type = NETTYPE_IPV6;
+	AllocNode(&Root, 0, -1);
+}
+
+int CNetBan::CBanTree::AllocNode(const CPrefix *pPrefix, int Length, int Parent)
+{
+	int Node = m_FirstFreeNode;
+	if(Node != -1)
+		m_FirstFreeNode = m_aNodes[Node].m_aChild[0];
 	else
-		m_pFirstFree = pBan->m_pNext;
+	{
+		Node = (int)m_aNodes.size();
+		m_aNodes.emplace_back();
+	}
 
-	// add it to the hash list
-	if(m_aapHashList[pNetHash->m_HashIndex][pNetHash->m_Hash])
-		m_aapHashList[pNetHash->m_HashIndex][pNetHash->m_Hash]->m_pHashPrev = pBan;
-	pBan->m_pHashPrev = 0;
-	pBan->m_pHashNext = m_aapHashList[pNetHash->m_HashIndex][pNetHash->m_Hash];
-	m_aapHashList[pNetHash->m_HashIndex][pNetHash->m_Hash] = pBan;
+	CNode &NewNode = m_aNodes[Node];
+	NewNode.m_Prefix = *pPrefix;
+	NewNode.m_Prefix.m_Length = Length;
+	if(Length < 128)
+	{
+		NewNode.m_Prefix.m_aIp[Length / 8] &= ~(0xff >> (Length % 8));
+		for(int i = Length / 8 + 1; i < 16; i++)
+			NewNode.m_Prefix.m_aIp[i] = 0;
+	}
+	NewNode.m_Parent = Parent;
+	NewNode.m_aChild[0] = NewNode.m_aChild[1] = -1;
+	NewNode.m_FirstEntry = -1;
+	return Node;
+}
 
-	// insert it into the used list
-	if(m_pFirstUsed)
+void CNetBan::CBanTree::FreeNode(int Node)
+{
+	m_aNodes[Node].m_aChild[0] = m_FirstFreeNode;
+	m_FirstFreeNode = Node;
+}
+
+void CNetBan::CBanTree::Collapse(int Node)
+{
+	// drop nodes without values that no longer branch
+	while(Node >= NUM_TREE_ROOTS && m_aNodes[Node].m_FirstEntry == -1)
 	{
-		for(CBan<T> *p = m_pFirstUsed;; p = p->m_pNext)
+		const CNode &Current = m_aNodes[Node];
+		if(Current.m_aChild[0] != -1 && Current.m_aChild[1] != -1)
+			return;
+
+		int Parent = Current.m_Parent;
+		int Child = Current.m_aChild[0] != -1 ? Current.m_aChild[0] : Current.m_aChild[1];
+		m_aNodes[Parent].m_aChild[m_aNodes[Parent].m_aChild[0] == Node ? 0 : 1] = Child;
+		FreeNode(Node);
+		if(Child != -1)
 		{
-			if(p->m_Info.m_Expires == CBanInfo::EXPIRES_NEVER || (pInfo->m_Expires != CBanInfo::EXPIRES_NEVER && pInfo->m_Expires <= p->m_Info.m_Expires))
-			{
-				// insert before
-				pBan->m_pNext = p;
-				pBan->m_pPrev = p->m_pPrev;
-				if(p->m_pPrev)
-					p->m_pPrev->m_pNext = pBan;
-				else
-					m_pFirstUsed = pBan;
-				p->m_pPrev = pBan;
-				break;
-			}
-
-			if(!p->m_pNext)
-			{
-				// last entry
-				p->m_pNext = pBan;
-				pBan->m_pPrev = p;
-				pBan->m_pNext = 0;
-				break;
-			}
+			m_aNodes[Child].m_Parent = Parent;
+			return;
 		}
+		Node = Parent;
 	}
+}
+
+int CNetBan::CBanTree::FindNode(const CPrefix *pPrefix) const
+{
+	int Node = TreeRoot(pPrefix->m_Type);
+	int Checked = 0;
+	while(Node != -1)
+	{
+		const CNode &Current = m_aNodes[Node];
+		if(!PrefixMatches(Current.m_Prefix.m_aIp, pPrefix->m_aIp, Checked, Current.m_Prefix.m_Length))
+			return -1;
+		Checked = Current.m_Prefix.m_Length;
+		if(Current.m_Prefix.m_Length >= pPrefix->m_Length)
+			return Current.m_Prefix.m_Length == pPrefix->m_Length ? Node : -1;
+		Node = Current.m_aChild[PrefixBit(pPrefix->m_aIp, Current.m_Prefix.m_Length)];
+	}
+	return -1;
+}
+
+void CNetBan::CBanTree::Insert(const CPrefix *pPrefix, void *pValue)
+{
+	int Node = TreeRoot(pPrefix->m_Type);
+	while(m_aNodes[Node].m_Prefix.m_Length < pPrefix->m_Length)
+	{
+		int Bit = PrefixBit(pPrefix->m_aIp, m_aNodes[Node].m_Prefix.m_Length);
+		int Child = m_aNodes[Node].m_aChild[Bit];
+		if(Child == -1)
+		{
+			Child = AllocNode(pPrefix, pPrefix->m_Length, Node);
+			m_aNodes[Node].m_aChild[Bit] = Child;
+			Node = Child;
+			break;
+		}
+
+		int ChildLength = m_aNodes[Child].m_Prefix.m_Length;
+		int Common = CommonLength(m_aNodes[Child].m_Prefix.m_aIp, pPrefix->m_aIp, m_aNodes[Node].m_Prefix.m_Length, minimum(ChildLength, pPrefix->m_Length));
+		if(Common < ChildLength)
+		{
+			// the prefix leaves the edge in the middle, split it
+			int Split = AllocNode(pPrefix, Common, Node);
+			m_aNodes[Node].m_aChild[Bit] = Split;
+			m_aNodes[Split].m_aChild[PrefixBit(m_aNodes[Child].m_Prefix.m_aIp, Common)] = Child;
+			m_aNodes[Child].m_Parent = Split;
+			Child = Split;
+		}
+		Node = Child;
+	}
+
+	int Entry = m_FirstFreeEntry;
+	if(Entry != -1)
+		m_FirstFreeEntry = m_aEntries[Entry].m_Next;
 	else
 	{
-		m_pFirstUsed = pBan;
-		pBan->m_pNext = pBan->m_pPrev = 0;
+		Entry = (int)m_aEntries.size();
+		m_aEntries.emplace_back();
 	}
+	m_aEntries[Entry].m_pValue = pValue;
+	m_aEntries[Entry].m_Next = m_aNodes[Node].m_FirstEntry;
+	m_aNodes[Node].m_FirstEntry = Entry;
+}
 
-	// update ban count
+void CNetBan::CBanTree::Remove(const CPrefix *pPrefix, void *pValue)
+{
+	int Node = FindNode(pPrefix);
+	if(Node == -1)
+		return;
+
+	for(int *pEntry = &m_aNodes[Node].m_FirstEntry; *pEntry != -1; pEntry = &m_aEntries[*pEntry].m_Next)
+	{
+		if(m_aEntries[*pEntry].m_pValue == pValue)
+		{
+			int Entry = *pEntry;
+			*pEntry = m_aEntries[Entry].m_Next;
+			m_aEntries[Entry].m_Next = m_FirstFreeEntry;
+			m_FirstFreeEntry = Entry;
+			break;
+		}
+	}
+	Collapse(Node);
+}
+
+void *CNetBan::CBanTree::Match(const NETADDR *pAddr) const
+{
+	const int Bits = AddrBits(pAddr);
+	int Best = -1;
+	int Node = TreeRoot(pAddr->type);
+	int Checked = 0;
+	while(Node != -1)
+	{
+		const CNode &Current = m_aNodes[Node];
+		if(!PrefixMatches(Current.m_Prefix.m_aIp, pAddr->ip, Checked, Current.m_Prefix.m_Length))
+			break;
+		Checked = Current.m_Prefix.m_Length;
+		if(Current.m_FirstEntry != -1)
+			Best = Current.m_FirstEntry;
+		if(Checked >= Bits)
+			break;
+		Node = Current.m_aChild[PrefixBit(pAddr->ip, Checked)];
+	}
+	return Best != -1 ? m_aEntries[Best].m_pValue : 0;
+}
+
+template<class T>
+typename CNetBan::CBan<T> *CNetBan::CBanPool<T>::Add(const T *pData, const CBanInfo *pInfo)
+{
+	// reuse a free ban or grow the pool
+	CBan<T> *pBan = m_pFirstFree;
+	if(pBan)
+		m_pFirstFree = pBan->m_pNext;
+	else
+	{
+		if(m_CountUsed >= MAX_BANS)
+			return 0;
+		m_aBans.emplace_back();
+		pBan = &m_aBans.back();
+	}
+
+	// create new ban
+	pBan->m_Data = *pData;
+	pBan->m_Info = *pInfo;
+	pBan->m_HeapIndex = -1;
+	HashInsert(pBan);
+
+	// append it to the used list
+	pBan->m_pNext = 0;
+	pBan->m_pPrev = m_pLastUsed;
+	if(m_pLastUsed)
+		m_pLastUsed->m_pNext = pBan;
+	else
+		m_pFirstUsed = pBan;
+	m_pLastUsed = pBan;
+
+	CPrefix aPrefixes[MAX_PREFIXES];
+	int NumPrefixes = MakePrefixes(pData, aPrefixes);
+	for(int i = 0; i < NumPrefixes; i++)
+		m_Tree.Insert(&aPrefixes[i], pBan);
+	if(pInfo->m_Expires != CBanInfo::EXPIRES_NEVER)
+		HeapInsert(pBan);
+
+	// update ban count, keep the hash lists short
 	++m_CountUsed;
+	if(m_CountUsed > (int)m_apHashList.size())
+		Rehash((int)m_apHashList.size() * 2);
 
 	return pBan;
 }
 
-template<class T, int HashCount>
-int CNetBan::CBanPool<T, HashCount>::Remove(CBan<T> *pBan)
+template<class T>
+int CNetBan::CBanPool<T>::Remove(CBan<T> *pBan)
 {
 	if(pBan == 0)
 		return -1;
 
-	// remove from hash list
-	if(pBan->m_pHashNext)
-		pBan->m_pHashNext->m_pHashPrev = pBan->m_pHashPrev;
-	if(pBan->m_pHashPrev)
-		pBan->m_pHashPrev->m_pHashNext = pBan->m_pHashNext;
-	else
-		m_aapHashList[pBan->m_NetHash.m_HashIndex][pBan->m_NetHash.m_Hash] = pBan->m_pHashNext;
-	pBan->m_pHashNext = pBan->m_pHashPrev = 0;
+	// remove from the indices
+	HashRemove(pBan);
+	CPrefix aPrefixes[MAX_PREFIXES];
+	int NumPrefixes = MakePrefixes(&pBan->m_Data, aPrefixes);
+	for(int i = 0; i < NumPrefixes; i++)
+		m_Tree.Remove(&aPrefixes[i], pBan);
+	if(pBan->m_HeapIndex != -1)
+		HeapRemove(pBan);
 
 	// remove from used list
 	if(pBan->m_pNext)
 		pBan->m_pNext->m_pPrev = pBan->m_pPrev;
+	else
+		m_pLastUsed = pBan->m_pPrev;
 	if(pBan->m_pPrev)
 		pBan->m_pPrev->m_pNext = pBan->m_pNext;
 	else
 		m_pFirstUsed = pBan->m_pNext;
 
 	// add to recycle list
-	if(m_pFirstFree)
-		m_pFirstFree->m_pPrev = pBan;
 	pBan->m_pPrev = 0;
 	pBan->m_pNext = m_pFirstFree;
 	m_pFirstFree = pBan;
@@ -157,51 +377,122 @@ int CNetBan::CBanPool<T, HashCount>::Remove(CBan<T> *pBan)
 	return 0;
 }
 
-template<class T, int HashCount>
-void CNetBan::CBanPool<T, HashCount>::Update(CBan<CDataType> *pBan, const CBanInfo *pInfo)
+template<class T>
+void CNetBan::CBanPool<T>::Update(CBan<CDataType> *pBan, const CBanInfo *pInfo)
 {
 	pBan->m_Info = *pInfo;
 
-	// remove from used list
-	if(pBan->m_pNext)
-		pBan->m_pNext->m_pPrev = pBan->m_pPrev;
-	if(pBan->m_pPrev)
-		pBan->m_pPrev->m_pNext = pBan->m_pNext;
+	// move it in the expiry heap
+	if(pInfo->m_Expires == CBanInfo::EXPIRES_NEVER)
+	{
+		if(pBan->m_HeapIndex != -1)
+			HeapRemove(pBan);
+	}
+	else if(pBan->m_HeapIndex == -1)
+		HeapInsert(pBan);
 	else
-		m_pFirstUsed = pBan->m_pNext;
+	{
+		HeapUp(pBan->m_HeapIndex);
+		HeapDown(pBan->m_HeapIndex);
+	}
+}
+
+template<class T>
+void CNetBan::CBanPool<T>::HashInsert(CBan<T> *pBan)
+{
+	CBan<T> *&pFirst = m_apHashList[HashData(&pBan->m_Data) & (m_apHashList.size() - 1)];
+	if(pFirst)
+		pFirst->m_pHashPrev = pBan;
+	pBan->m_pHashPrev = 0;
+	pBan->m_pHashNext = pFirst;
+	pFirst = pBan;
+}
 
-	// insert it into the used list
-	if(m_pFirstUsed)
+template<class T>
+void CNetBan::CBanPool<T>::HashRemove(CBan<T> *pBan)
+{
+	if(pBan->m_pHashNext)
+		pBan->m_pHashNext->m_pHashPrev = pBan->m_pHashPrev;
+	if(pBan->m_pHashPrev)
+		pBan->m_pHashPrev->m_pHashNext = pBan->m_pHashNext;
+	else
+		m_apHashList[HashData(&pBan->m_Data) & (m_apHashList.size() - 1)] = pBan->m_pHashNext;
+	pBan->m_pHashNext = pBan->m_pHashPrev = 0;
+}
+
+template<class T>
+void CNetBan::CBanPool<T>::Rehash(int Size)
+{
+	m_apHashList.assign(Size, (CBan<T> *)0);
+	for(CBan<T> *pBan = m_pFirstUsed; pBan; pBan = pBan->m_pNext)
+		HashInsert(pBan);
+}
+
+template<class T>
+void CNetBan::CBanPool<T>::HeapSwap(int Index1, int Index2)
+{
+	CBan<T> *pBan = m_apExpiryHeap[Index1];
+	m_apExpiryHeap[Index1] = m_apExpiryHeap[Index2];
+	m_apExpiryHeap[Index2] = pBan;
+	m_apExpiryHeap[Index1]->m_HeapIndex = Index1;
+	m_apExpiryHeap[Index2]->m_HeapIndex = Index2;
+}
+
+template<class T>
+void CNetBan::CBanPool<T>::HeapUp(int Index)
+{
+	while(Index > 0)
+	{
+		int Parent = (Index - 1) / 2;
+		if(m_apExpiryHeap[Parent]->m_Info.m_Expires <= m_apExpiryHeap[Index]->m_Info.m_Expires)
+			break;
+		HeapSwap(Index, Parent);
+		Index = Parent;
+	}
+}
+
+template<class T>
+void CNetBan::CBanPool<T>::HeapDown(int Index)
+{
+	const int Size = (int)m_apExpiryHeap.size();
+	while(true)
 	{
-		for(CBan<T> *p = m_pFirstUsed;; p = p->m_pNext)
+		int Smallest = Index;
+		for(int Child = 2 * Index + 1; Child <= 2 * Index + 2 && Child < Size; Child++)
 		{
-			if(p->m_Info.m_Expires == CBanInfo::EXPIRES_NEVER || (pInfo->m_Expires != CBanInfo::EXPIRES_NEVER && pInfo->m_Expires <= p->m_Info.m_Expires))
-			{
-				// insert before
-				pBan->m_pNext = p;
-				pBan->m_pPrev = p->m_pPrev;
-				if(p->m_pPrev)
-					p->m_pPrev->m_pNext = pBan;
-				else
-					m_pFirstUsed = pBan;
-				p->m_pPrev = pBan;
-				break;
-			}
-
-			if(!p->m_pNext)
-			{
-				// last entry
-				p->m_pNext = pBan;
-				pBan->m_pPrev = p;
-				pBan->m_pNext = 0;
-				break;
-			}
+			if(m_apExpiryHeap[Child]->m_Info.m_Expires < m_apExpiryHeap[Smallest]->m_Info.m_Expires)
+				Smallest = Child;
 		}
+		if(Smallest == Index)
+			break;
+		HeapSwap(Index, Smallest);
+		Index = Smallest;
 	}
-	else
+}
+
+template<class T>
+void CNetBan::CBanPool<T>::HeapInsert(CBan<T> *pBan)
+{
+	pBan->m_HeapIndex = (int)m_apExpiryHeap.size();
+	m_apExpiryHeap.push_back(pBan);
+	HeapUp(pBan->m_HeapIndex);
+}
+
+template<class T>
+void CNetBan::CBanPool<T>::HeapRemove(CBan<T> *pBan)
+{
+	int Index = pBan->m_HeapIndex;
+	int Last = (int)m_apExpiryHeap.size() - 1;
+	if(Index != Last)
+		HeapSwap(Index, Last);
+	m_apExpiryHeap.pop_back();
+	pBan->m_HeapIndex = -1;
+
+	if(Index < Last)
 	{
-		m_pFirstUsed = pBan;
-		pBan->m_pNext = pBan->m_pPrev = 0;
+		CBan<T> *pMoved = m_apExpiryHeap[Index];
+		HeapUp(Index);
+		HeapDown(pMoved->m_HeapIndex);
 	}
 }
 
@@ -211,27 +502,21 @@ void CNetBan::UnbanAll()
 	m_BanRangePool.Reset();
 }
 
-template<class T, int HashCount>
-void CNetBan::CBanPool<T, HashCount>::Reset()
+template<class T>
+void CNetBan::CBanPool<T>::Reset()
 {
-	mem_zero(m_aapHashList, sizeof(m_aapHashList));
-	mem_zero(m_aBans, sizeof(m_aBans));
+	m_aBans.clear();
+	m_apHashList.assign(MIN_HASH_SIZE, (CBan<T> *)0);
+	m_Tree.Reset();
+	m_apExpiryHeap.clear();
+	m_pFirstFree = 0;
 	m_pFirstUsed = 0;
+	m_pLastUsed = 0;
 	m_CountUsed = 0;
-
-	for(int i = 1; i < MAX_BANS - 1; ++i)
-	{
-		m_aBans[i].m_pNext = &m_aBans[i + 1];
-		m_aBans[i].m_pPrev = &m_aBans[i - 1];
-	}
-
-	m_aBans[0].m_pNext = &m_aBans[1];
-	m_aBans[MAX_BANS - 1].m_pPrev = &m_aBans[MAX_BANS - 2];
-	m_pFirstFree = &m_aBans[0];
 }
 
-template<class T, int HashCount>
-typename CNetBan::CBan<T> *CNetBan::CBanPool<T, HashCount>::Get(int Index) const
+template<class T>
+typename CNetBan::CBan<T> *CNetBan::CBanPool<T>::Get(int Index) const
 {
 	if(Index < 0 || Index >= Num())
 		return 0;
@@ -263,8 +548,7 @@ int CNetBan::Ban(T *pBanPool, const typename T::CDataType *pData, int Seconds, c
 	str_copy(Info.m_aReason, pReason, sizeof(Info.m_aReason));
 
 	// check if it already exists
-	CNetHash NetHash(pData);
-	CBan<typename T::CDataType> *pBan = pBanPool->Find(pData, &NetHash);
+	CBan<typename T::CDataType> *pBan = pBanPool->Find(pData);
 	if(pBan)
 	{
 		// adjust the ban
@@ -276,7 +560,7 @@ int CNetBan::Ban(T *pBanPool, const typename T::CDataType *pData, int Seconds, c
 	}
 
 	// add ban and print result
-	pBan = pBanPool->Add(pData, &Info, &NetHash);
+	pBan = pBanPool->Add(pData, &Info);
 	if(pBan)
 	{
 		char aBuf[128];
@@ -292,8 +576,7 @@ int CNetBan::Ban(T *pBanPool, const typename T::CDataType *pData, int Seconds, c
 template<class T>
 int CNetBan::Unban(T *pBanPool, const typename T::CDataType *pData)
 {
-	CNetHash NetHash(pData);
-	CBan<typename T::CDataType> *pBan = pBanPool->Find(pData, &NetHash);
+	CBan<typename T::CDataType> *pBan = pBanPool->Find(pData);
 	if(pBan)
 	{
 		char aBuf[256];
@@ -307,6 +590,26 @@ int CNetBan::Unban(T *pBanPool, const typename T::CDataType *pData)
 	return -1;
 }
 
+template<class T>
+int CNetBan::LoadBan(T *pBanPool, const typename T::CDataType *pData, int Seconds, const char *pReason)
+{
+	// same as Ban, but without a message per entry
+	if(NetMatch(pData, &m_LocalhostIPV4) || NetMatch(pData, &m_LocalhostIPV6))
+		return -1;
+
+	CBanInfo Info = {0};
+	Info.m_Expires = Seconds > 0 ? time_timestamp() + Seconds : CBanInfo::EXPIRES_NEVER;
+	str_copy(Info.m_aReason, pReason, sizeof(Info.m_aReason));
+
+	CBan<typename T::CDataType> *pBan = pBanPool->Find(pData);
+	if(pBan)
+	{
+		pBanPool->Update(pBan, &Info);
+		return 1;
+	}
+	return pBanPool->Add(pData, &Info) ? 0 : -1;
+}
+
 void CNetBan::Init(IConsole *pConsole, IStorage *pStorage)
 {
 	m_pConsole = pConsole;
@@ -324,6 +627,7 @@ void CNetBan::Init(IConsole *pConsole, IStorage *pStorage)
 	Console()->Register("unban_all", "", CFGFLAG_SERVER | CFGFLAG_MASTER | CFGFLAG_STORE, ConUnbanAll, this, "Unban all entries");
 	Console()->Register("bans", "?i[page]", CFGFLAG_SERVER | CFGFLAG_MASTER, ConBans, this, "Show banlist (page 0 by default, 20 entries per page)");
 	Console()->Register("bans_save", "s[file]", CFGFLAG_SERVER | CFGFLAG_MASTER | CFGFLAG_STORE, ConBansSave, this, "Save banlist in a file");
+	Console()->Register("bans_load", "s[file]", CFGFLAG_SERVER | CFGFLAG_MASTER | CFGFLAG_STORE, ConBansLoad, this, "Load a banlist saved by bans_save");
 }
 
 void CNetBan::Update()
@@ -332,17 +636,17 @@ void CNetBan::Update()
 
 	// remove expired bans
 	char aBuf[256], aNetStr[256];
-	while(m_BanAddrPool.First() && m_BanAddrPool.First()->m_Info.m_Expires != CBanInfo::EXPIRES_NEVER && m_BanAddrPool.First()->m_Info.m_Expires < Now)
+	while(m_BanAddrPool.FirstExpiring() && m_BanAddrPool.FirstExpiring()->m_Info.m_Expires < Now)
 	{
-		str_format(aBuf, sizeof(aBuf), "ban %s expired", NetToString(&m_BanAddrPool.First()->m_Data, aNetStr, sizeof(aNetStr)));
+		str_format(aBuf, sizeof(aBuf), "ban %s expired", NetToString(&m_BanAddrPool.FirstExpiring()->m_Data, aNetStr, sizeof(aNetStr)));
 		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
-		m_BanAddrPool.Remove(m_BanAddrPool.First());
+		m_BanAddrPool.Remove(m_BanAddrPool.FirstExpiring());
 	}
-	while(m_BanRangePool.First() && m_BanRangePool.First()->m_Info.m_Expires != CBanInfo::EXPIRES_NEVER && m_BanRangePool.First()->m_Info.m_Expires < Now)
+	while(m_BanRangePool.FirstExpiring() && m_BanRangePool.FirstExpiring()->m_Info.m_Expires < Now)
 	{
-		str_format(aBuf, sizeof(aBuf), "ban %s expired", NetToString(&m_BanRangePool.First()->m_Data, aNetStr, sizeof(aNetStr)));
+		str_format(aBuf, sizeof(aBuf), "ban %s expired", NetToString(&m_BanRangePool.FirstExpiring()->m_Data, aNetStr, sizeof(aNetStr)));
 		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
-		m_BanRangePool.Remove(m_BanRangePool.First());
+		m_BanRangePool.Remove(m_BanRangePool.FirstExpiring());
 	}
 }
 
@@ -415,28 +719,20 @@ bool CNetBan::IsBanned(const NETADDR *pOrigAddr, char *pBuf, unsigned BufferSize
 		pAddr = &Addr;
 		Addr.type = NETTYPE_IPV4;
 	}
-	CNetHash aHash[17];
-	int Length = CNetHash::MakeHashArray(pAddr, aHash);
-
 	// check ban addresses
-	CBanAddr *pBan = m_BanAddrPool.Find(pAddr, &aHash[Length]);
+	CBanAddr *pBan = m_BanAddrPool.Find(pAddr);
 	if(pBan)
 	{
 		MakeBanInfo(pBan, pBuf, BufferSize, MSGTYPE_PLAYER);
 		return true;
 	}
 
-	// check ban ranges
-	for(int i = Length - 1; i >= 0; --i)
+	// check ban ranges, the most specific one is reported
+	CBanRange *pBanRange = m_BanRangePool.Match(pAddr);
+	if(pBanRange)
 	{
-		for(CBanRange *pBanRange = m_BanRangePool.First(&aHash[i]); pBanRange; pBanRange = pBanRange->m_pHashNext)
-		{
-			if(NetMatch(&pBanRange->m_Data, pAddr, i, Length))
-			{
-				MakeBanInfo(pBanRange, pBuf, BufferSize, MSGTYPE_PLAYER);
-				return true;
-			}
-		}
+		MakeBanInfo(pBanRange, pBuf, BufferSize, MSGTYPE_PLAYER);
+		return true;
 	}
 
 	return false;
@@ -584,3 +880,67 @@ void CNetBan::ConBansSave(IConsole::IResult *pResult, void *pUser)
 	str_format(aBuf, sizeof(aBuf), "saved banlist to '%s'", pResult->GetString(0));
 	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
 }
+
+void CNetBan::ConBansLoad(IConsole::IResult *pResult, void *pUser)
+{
+	CNetBan *pThis = static_cast<CNetBan *>(pUser);
+
+	char aBuf[256];
+	IOHANDLE File = pThis->Storage()->OpenFile(pResult->GetString(0), IOFLAG_READ, IStorage::TYPE_ALL);
+	if(!File)
+	{
+		str_format(aBuf, sizeof(aBuf), "failed to load banlist from '%s'", pResult->GetString(0));
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+		return;
+	}
+
+	// the lines are the ban and ban_range commands written by bans_save,
+	// they are added directly instead of being executed one by one.
+	// connected clients are not checked against the loaded bans.
+	int NumAdded = 0, NumUpdated = 0, NumFailed = 0;
+	CLineReader Reader;
+	Reader.Init(File);
+	while(char *pLine = Reader.Get())
+	{
+		char aCommand[16], aAddr1[NETADDR_MAXSTRSIZE], aAddr2[NETADDR_MAXSTRSIZE], aMinutes[16];
+		const char *pRest = str_next_token(pLine, " ", aCommand, sizeof(aCommand));
+		if(!pRest)
+			continue;
+
+		bool IsRange = str_comp(aCommand, "ban_range") == 0;
+		if(IsRange || str_comp(aCommand, "ban") == 0)
+			pRest = str_next_token(pRest, " ", aAddr1, sizeof(aAddr1));
+		else
+			pRest = 0;
+		if(pRest && IsRange)
+			pRest = str_next_token(pRest, " ", aAddr2, sizeof(aAddr2));
+		if(pRest)
+			pRest = str_next_token(pRest, " ", aMinutes, sizeof(aMinutes));
+
+		int Result = -1;
+		if(pRest)
+		{
+			int Minutes = clamp(str_toint(aMinutes), 0, 525600);
+			const char *pReason = str_utf8_skip_whitespaces(pRest);
+			if(!pReason[0])
+				pReason = "No reason given";
+
+			CNetRange Range;
+			if(!IsRange && net_addr_from_str(&Range.m_LB, aAddr1) == 0)
+				Result = pThis->LoadBan(&pThis->m_BanAddrPool, &Range.m_LB, Minutes * 60, pReason);
+			else if(IsRange && net_addr_from_str(&Range.m_LB, aAddr1) == 0 && net_addr_from_str(&Range.m_UB, aAddr2) == 0 && Range.IsValid())
+				Result = pThis->LoadBan(&pThis->m_BanRangePool, &Range, Minutes * 60, pReason);
+		}
+
+		if(Result == 0)
+			NumAdded++;
+		else if(Result == 1)
+			NumUpdated++;
+		else
+			NumFailed++;
+	}
+	io_close(File);
+
+	str_format(aBuf, sizeof(aBuf), "loaded banlist from '%s': %d added, %d updated, %d failed", pResult->GetString(0), NumAdded, NumUpdated, NumFailed);
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+}
@@ -5,6 +5,9 @@
 
 #include <base/system.h>
 
+#include <deque>
+#include <vector>
+
 inline int NetComp(const NETADDR *pAddr1, const NETADDR *pAddr2)
 {
 	return mem_comp(pAddr1, pAddr2, pAddr1->type == NETTYPE_IPV4 ? 8 : 20);
@@ -63,17 +66,68 @@ protected:
 	// todo: move?
 	static bool StrAllnum(const char *pStr);
 
-	class CNetHash
+	// an address prefix, the bits after m_Length are zero
+	struct CPrefix
 	{
-	public:
-		int m_Hash;
-		int m_HashIndex; // matching parts for ranges, 0 for addr
+		int m_Type;
+		int m_Length;
+		unsigned char m_aIp[16];
+	};
+
+	enum
+	{
+		// a range splits into at most two prefixes per bit
+		MAX_PREFIXES = 2 * 128,
+	};
 
-		CNetHash() {}
-		CNetHash(const NETADDR *pAddr);
-		CNetHash(const CNetRange *pRange);
+	static int AddrBits(const NETADDR *pAddr) { return pAddr->type == NETTYPE_IPV4 ? 32 : 128; }
+	// single addresses are only found through the hash, ranges go into the tree
+	static int MakePrefixes(const NETADDR *pAddr, CPrefix *pPrefixes) { return 0; }
+	static int MakePrefixes(const CNetRange *pRange, CPrefix *pPrefixes);
+	static unsigned HashData(const NETADDR *pAddr);
+	static unsigned HashData(const CNetRange *pRange);
+	static void AddRangePrefixes(const unsigned char *pLB, const unsigned char *pUB, int Bytes, CPrefix *pPrefix, CPrefix *pPrefixes, int *pNumPrefixes);
+
+	/*
+		Class: CBanTree
+			Compressed binary radix tree over address prefixes, one root
+			per address family. Every node can carry a list of values,
+			a lookup walks the bits of an address and visits at most one
+			node per stored prefix length.
+	*/
+	class CBanTree
+	{
+		struct CNode
+		{
+			CPrefix m_Prefix;
+			int m_Parent;
+			int m_aChild[2];
+			int m_FirstEntry;
+		};
 
-		static int MakeHashArray(const NETADDR *pAddr, CNetHash aHash[17]);
+		struct CEntry
+		{
+			void *m_pValue;
+			int m_Next;
+		};
+
+		std::vector<CNode> m_aNodes;
+		std::vector<CEntry> m_aEntries;
+		int m_FirstFreeNode;
+		int m_FirstFreeEntry;
+
+		int AllocNode(const CPrefix *pPrefix, int Length, int Parent);
+		void FreeNode(int Node);
+		void Collapse(int Node);
+		int FindNode(const CPrefix *pPrefix) const;
+
+	public:
+		void Reset();
+		void Insert(const CPrefix *pPrefix, void *pValue);
+		void Remove(const CPrefix *pPrefix, void *pValue);
+
+		// a value of the longest stored prefix that contains the address
+		void *Match(const NETADDR *pAddr) const;
 	};
 
 	struct CBanInfo
@@ -92,7 +146,9 @@ protected:
 	{
 		T m_Data;
 		CBanInfo m_Info;
-		CNetHash m_NetHash;
+
+		// index in the expiry heap, -1 for permanent bans
+		int m_HeapIndex;
 
 		// hash list
 		CBan *m_pHashNext;
@@ -103,13 +159,20 @@ protected:
 		CBan *m_pPrev;
 	};
 
-	template<class T, int HashCount>
+	/*
+		Class: CBanPool
+			Holds the bans of one kind. The bans are indexed by a hash of
+			their data, ranges also by the radix tree for address lookups,
+			and timed bans by a min-heap on the expiry time. The used list
+			keeps the order in which they were added.
+	*/
+	template<class T>
 	class CBanPool
 	{
 	public:
 		typedef T CDataType;
 
-		CBan<CDataType> *Add(const CDataType *pData, const CBanInfo *pInfo, const CNetHash *pNetHash);
+		CBan<CDataType> *Add(const CDataType *pData, const CBanInfo *pInfo);
 		int Remove(CBan<CDataType> *pBan);
 		void Update(CBan<CDataType> *pBan, const CBanInfo *pInfo);
 		void Reset();
@@ -118,10 +181,10 @@ protected:
 		bool IsFull() const { return m_CountUsed == MAX_BANS; }
 
 		CBan<CDataType> *First() const { return m_pFirstUsed; }
-		CBan<CDataType> *First(const CNetHash *pNetHash) const { return m_aapHashList[pNetHash->m_HashIndex][pNetHash->m_Hash]; }
-		CBan<CDataType> *Find(const CDataType *pData, const CNetHash *pNetHash) const
+		CBan<CDataType> *FirstExpiring() const { return m_apExpiryHeap.empty() ? 0 : m_apExpiryHeap[0]; }
+		CBan<CDataType> *Find(const CDataType *pData) const
 		{
-			for(CBan<CDataType> *pBan = m_aapHashList[pNetHash->m_HashIndex][pNetHash->m_Hash]; pBan; pBan = pBan->m_pHashNext)
+			for(CBan<CDataType> *pBan = m_apHashList[HashData(pData) & (m_apHashList.size() - 1)]; pBan; pBan = pBan->m_pHashNext)
 			{
 				if(NetComp(&pBan->m_Data, pData) == 0)
 					return pBan;
@@ -129,23 +192,38 @@ protected:
 
 			return 0;
 		}
+		CBan<CDataType> *Match(const NETADDR *pAddr) const { return (CBan<CDataType> *)m_Tree.Match(pAddr); }
 		CBan<CDataType> *Get(int Index) const;
 
 	private:
 		enum
 		{
-			MAX_BANS = 1024,
+			MAX_BANS = 0x40000,
+			MIN_HASH_SIZE = 256,
 		};
 
-		CBan<CDataType> *m_aapHashList[HashCount][256];
-		CBan<CDataType> m_aBans[MAX_BANS];
+		void HashInsert(CBan<CDataType> *pBan);
+		void HashRemove(CBan<CDataType> *pBan);
+		void Rehash(int Size);
+
+		void HeapInsert(CBan<CDataType> *pBan);
+		void HeapRemove(CBan<CDataType> *pBan);
+		void HeapSwap(int Index1, int Index2);
+		void HeapUp(int Index);
+		void HeapDown(int Index);
+
+		std::deque<CBan<CDataType>> m_aBans; // grows without moving the bans
+		std::vector<CBan<CDataType> *> m_apHashList; // power of two sized
+		CBanTree m_Tree;
+		std::vector<CBan<CDataType> *> m_apExpiryHeap;
 		CBan<CDataType> *m_pFirstFree;
 		CBan<CDataType> *m_pFirstUsed;
+		CBan<CDataType> *m_pLastUsed;
 		int m_CountUsed;
 	};
 
-	typedef CBanPool<NETADDR, 1> CBanAddrPool;
-	typedef CBanPool<CNetRange, 16> CBanRangePool;
+	typedef CBanPool<NETADDR> CBanAddrPool;
+	typedef CBanPool<CNetRange> CBanRangePool;
 	typedef CBan<NETADDR> CBanAddr;
 	typedef CBan<CNetRange> CBanRange;
 
@@ -155,6 +233,8 @@ protected:
 	int Ban(T *pBanPool, const typename T::CDataType *pData, int Seconds, const char *pReason);
 	template<class T>
 	int Unban(T *pBanPool, const typename T::CDataType *pData);
+	template<class T>
+	int LoadBan(T *pBanPool, const typename T::CDataType *pData, int Seconds, const char *pReason);
 
 	class IConsole *m_pConsole;
 	class IStorage *m_pStorage;
@@ -193,6 +273,7 @@ public:
 	static void ConUnbanAll(class IConsole::IResult *pResult, void *pUser);
 	static void ConBans(class IConsole::IResult *pResult, void *pUser);
 	static void ConBansSave(class IConsole::IResult *pResult, void *pUser);
+	static void ConBansLoad(class IConsole::IResult *pResult, void *pUser);
 };
 
 template<class T>
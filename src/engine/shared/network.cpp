@@ -19,6 +19,7 @@ void CNetRecvUnpacker::Start(const NETADDR *pAddr, CNetConnection *pConnection,
 	m_pConnection = pConnection;
 	m_ClientID = ClientID;
 	m_CurrentChunk = 0;
+	m_pCurrentChunk = m_Data.m_pChunkData;
 	m_Valid = true;
 }
 
@@ -26,12 +27,10 @@ void CNetRecvUnpacker::Start(const NETADDR *pAddr, CNetConnection *pConnection,
 int CNetRecvUnpacker::FetchChunk(CNetChunk *pChunk)
 {
 	CNetChunkHeader Header;
-	unsigned char *pEnd = m_Data.m_aChunkData + m_Data.m_DataSize;
+	unsigned char *pEnd = m_Data.m_pChunkData + m_Data.m_DataSize;
 
 	while(true)
 	{
-		unsigned char *pData = m_Data.m_aChunkData;
-
 		// check for old data to unpack
 		if(!m_Valid || m_CurrentChunk >= m_Data.m_NumChunks)
 		{
@@ -39,15 +38,10 @@ int CNetRecvUnpacker::FetchChunk(CNetChunk *pChunk)
 			return 0;
 		}
 
+		// unpack the header, the chunks are handed out in place
 		// TODO: add checking here so we don't read too far
-		for(int i = 0; i < m_CurrentChunk; i++)
-		{
-			pData = Header.Unpack(pData, (m_pConnection && m_pConnection->m_Sixup) ? 6 : 4);
-			pData += Header.m_Size;
-		}
-
-		// unpack the header
-		pData = Header.Unpack(pData, (m_pConnection && m_pConnection->m_Sixup) ? 6 : 4);
+		unsigned char *pData = Header.Unpack(m_pCurrentChunk, (m_pConnection && m_pConnection->m_Sixup) ? 6 : 4);
+		m_pCurrentChunk = pData + Header.m_Size;
 		m_CurrentChunk++;
 
 		if(pData + Header.m_Size > pEnd)
@@ -229,7 +223,7 @@ int CNetBase::UnpackPacket(unsigned char *pBuffer, int Size, CNetPacketConstruct
 		pPacket->m_Ack = 0;
 		pPacket->m_NumChunks = 0;
 		pPacket->m_DataSize = Size - Offset;
-		mem_copy(pPacket->m_aChunkData, pBuffer + Offset, pPacket->m_DataSize);
+		pPacket->m_pChunkData = pBuffer + Offset;
 
 		if(!Sixup && mem_comp(pBuffer, NET_HEADER_EXTENDED, sizeof(NET_HEADER_EXTENDED)) == 0)
 		{
@@ -271,11 +265,19 @@ int CNetBase::UnpackPacket(unsigned char *pBuffer, int Size, CNetPacketConstruct
 				return -1;
 			}
 			pPacket->m_DataSize = ms_Huffman.Decompress(&pBuffer[DataStart], pPacket->m_DataSize, pPacket->m_aChunkData, sizeof(pPacket->m_aChunkData));
+			pPacket->m_pChunkData = pPacket->m_aChunkData;
+			ms_RecvCounters.m_NumDecoded++;
+			ms_RecvCounters.m_BytesDecoded += maximum(pPacket->m_DataSize, 0);
 		}
 		else
-			mem_copy(pPacket->m_aChunkData, &pBuffer[DataStart], pPacket->m_DataSize);
+			pPacket->m_pChunkData = &pBuffer[DataStart];
 	}
 
+	ms_RecvCounters.m_NumPackets++;
+	ms_RecvCounters.m_BytesReceived += Size;
+	if(pPacket->m_pChunkData != pPacket->m_aChunkData)
+		ms_RecvCounters.m_NumInPlace++;
+
 	// check for errors
 	if(pPacket->m_DataSize < 0)
 	{
@@ -290,7 +292,7 @@ int CNetBase::UnpackPacket(unsigned char *pBuffer, int Size, CNetPacketConstruct
 		int Type = 1;
 		io_write(ms_DataLogRecv, &Type, sizeof(Type));
 		io_write(ms_DataLogRecv, &pPacket->m_DataSize, sizeof(pPacket->m_DataSize));
-		io_write(ms_DataLogRecv, pPacket->m_aChunkData, pPacket->m_DataSize);
+		io_write(ms_DataLogRecv, pPacket->m_pChunkData, pPacket->m_DataSize);
 		io_flush(ms_DataLogRecv);
 	}
 
@@ -361,6 +363,8 @@ bool CNetBase::IsSeqInBackroom(int Seq, int Ack)
 IOHANDLE CNetBase::ms_DataLogSent = 0;
 IOHANDLE CNetBase::ms_DataLogRecv = 0;
 CHuffman CNetBase::ms_Huffman;
+CNetBase::CRecvCounters CNetBase::ms_RecvCounters;
+int64_t CNetBase::ms_Time = 0;
 
 void CNetBase::OpenLog(IOHANDLE DataLogSent, IOHANDLE DataLogRecv)
 {
@@ -411,4 +415,10 @@ int CNetBase::Decompress(const void *pData, int DataSize, void *pOutput, int Out
 void CNetBase::Init()
 {
 	ms_Huffman.Init();
+	UpdateTime();
+}
+
+void CNetBase::SetHuffmanFastPath(bool Enable)
+{
+	ms_Huffman.SetFastPath(Enable);
 }
@@ -98,7 +98,7 @@ enum
 
 typedef int SECURITY_TOKEN;
 
-SECURITY_TOKEN ToSecurityToken(unsigned char *pData);
+SECURITY_TOKEN ToSecurityToken(const unsigned char *pData);
 
 extern const unsigned char SECURITY_TOKEN_MAGIC[4];
 
@@ -159,6 +159,9 @@ public:
 	int m_DataSize;
 	unsigned char m_aChunkData[NET_MAX_PAYLOAD];
 	unsigned char m_aExtraData[4];
+
+	// received packets: the payload, either in place in the receive buffer or in m_aChunkData if it was compressed
+	unsigned char *m_pChunkData;
 };
 
 enum class CONNECTIVITY
@@ -261,6 +264,13 @@ public:
 	int Update();
 	int Flush();
 
+	/*
+		Function: NextUpdateTime
+			Returns the earliest time at which Update has something to
+			do: a flush, a keepalive, a resend or a timeout.
+	*/
+	int64_t NextUpdateTime();
+
 	int Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr, SECURITY_TOKEN SecurityToken = NET_SECURITY_TOKEN_UNSUPPORTED);
 	int QueueChunk(int Flags, int DataSize, const void *pData);
 
@@ -335,9 +345,9 @@ public:
 	NETADDR m_Addr;
 	CNetConnection *m_pConnection;
 	int m_CurrentChunk;
+	unsigned char *m_pCurrentChunk;
 	int m_ClientID;
 	CNetPacketConstruct m_Data;
-	unsigned char m_aBuffer[NET_MAX_PACKETSIZE];
 
 	CNetRecvUnpacker() { Clear(); }
 	void Clear();
@@ -345,6 +355,56 @@ public:
 	int FetchChunk(CNetChunk *pChunk);
 };
 
+/*
+	Class: CNetFloodShield
+		Rate limits packets per source prefix, /24 for IPv4 and /64 for
+		IPv6. Every prefix gets a token bucket in the form of a
+		theoretical arrival time (GCRA). The buckets live in a fixed
+		size count-min sketch: memory does not grow with the number of
+		sources and prefixes sharing cells only get limited earlier.
+*/
+class CNetFloodShield
+{
+public:
+	struct CCounters
+	{
+		int64 m_NumChecked;
+		int64 m_NumDropped;
+	};
+
+private:
+	enum
+	{
+		SKETCH_DEPTH = 4,
+		SKETCH_WIDTH = 4096,
+	};
+
+	int64_t m_aaCells[SKETCH_DEPTH][SKETCH_WIDTH];
+	unsigned m_aSeed[2]; // random, so the cells of a prefix can not be predicted
+	CCounters m_Counters;
+
+public:
+	void Init();
+
+	/*
+		Function: Allow
+			Takes a token from the bucket of the source prefix.
+
+		Parameters:
+			pAddr - Source address.
+			Now - Current time.
+			Rate - Packets per second.
+			Burst - Packets that can arrive at once.
+
+		Returns:
+			False if the packet should be dropped.
+	*/
+	bool Allow(const NETADDR *pAddr, int64_t Now, int Rate, int Burst);
+
+	const CCounters &Counters() const { return m_Counters; }
+	void ResetCounters() { mem_zero(&m_Counters, sizeof(m_Counters)); }
+};
+
 // server side
 class CNetServer
 {
@@ -352,6 +412,24 @@ class CNetServer
 	{
 	public:
 		CNetConnection m_Connection;
+
+		// position in the update wheel, m_WheelTick is -1 if not scheduled
+		int64_t m_WheelTick;
+		int m_WheelPrev;
+		int m_WheelNext;
+
+		// chain in the address hash, m_HashBucket is -1 if not hashed
+		int m_HashBucket;
+		int m_HashNext;
+	};
+
+	enum
+	{
+		// 10ms buckets, the wheel wraps after 1.28 seconds
+		WHEEL_SIZE = 128,
+		WHEEL_TICKS_PER_SECOND = 100,
+
+		ADDR_HASH_SIZE = 256,
 	};
 
 	struct CSpamConn
@@ -385,6 +463,20 @@ class CNetServer
 	CSpamConn m_aSpamConns[NET_CONNLIMIT_IPS];
 
 	CNetRecvUnpacker m_RecvUnpacker;
+	CNetFloodShield m_FloodShield;
+
+	// connections by the wheel tick of their next due Update, see Update
+	int m_aWheel[WHEEL_SIZE];
+	int64_t m_WheelTick;
+	int64_t m_WheelTickTime;
+
+	// slots by the hash of the address they were given last, see GetClientSlot
+	int m_aAddrHash[ADDR_HASH_SIZE];
+
+	int64_t WheelTick(int64_t Time) const { return (Time + m_WheelTickTime - 1) / m_WheelTickTime; }
+	void Schedule(int ClientID, int64_t Time);
+	void Unschedule(int ClientID);
+	void UpdateSlot(int ClientID);
 
 	void OnTokenCtrlMsg(NETADDR &Addr, int ControlMsg, const CNetPacketConstruct &Packet);
 	int OnSixupCtrlMsg(NETADDR &Addr, CNetChunk *pChunk, int ControlMsg, const CNetPacketConstruct &Packet, SECURITY_TOKEN &ResponseToken, SECURITY_TOKEN Token);
@@ -392,6 +484,7 @@ class CNetServer
 	void OnConnCtrlMsg(NETADDR &Addr, int ClientID, int ControlMsg, const CNetPacketConstruct &Packet);
 	bool ClientExists(const NETADDR &Addr) { return GetClientSlot(Addr) != -1; }
 	int GetClientSlot(const NETADDR &Addr);
+	void HashSlot(int ClientID);
 	void SendControl(NETADDR &Addr, int ControlMsg, const void *pExtra, int ExtraSize, SECURITY_TOKEN SecurityToken);
 
 	int TryAcceptClient(NETADDR &Addr, SECURITY_TOKEN SecurityToken, bool VanillaAuth = false, bool Sixup = false, SECURITY_TOKEN Token = 0);
@@ -421,6 +514,7 @@ public:
 	NETADDR Address() const { return m_Address; }
 	NETSOCKET Socket() const { return m_Socket; }
 	CNetBan *NetBan() const { return m_pNetBan; }
+	CNetFloodShield *FloodShield() { return &m_FloodShield; }
 	int NetType() const { return net_socket_type(m_Socket); }
 	int MaxClients() const { return m_MaxClients; }
 
@@ -527,14 +621,29 @@ public:
 // TODO: both, fix these. This feels like a junk class for stuff that doesn't fit anywere
 class CNetBase
 {
+public:
+	// receive path counters for net_counters
+	struct CRecvCounters
+	{
+		int64 m_NumPackets;
+		int64 m_NumInPlace;
+		int64 m_NumDecoded;
+		int64 m_BytesReceived;
+		int64 m_BytesDecoded;
+	};
+
+private:
 	static IOHANDLE ms_DataLogSent;
 	static IOHANDLE ms_DataLogRecv;
 	static CHuffman ms_Huffman;
+	static CRecvCounters ms_RecvCounters;
+	static int64_t ms_Time;
 
 public:
 	static void OpenLog(IOHANDLE DataLogSent, IOHANDLE DataLogRecv);
 	static void CloseLog();
 	static void Init();
+	static void SetHuffmanFastPath(bool Enable);
 	static int Compress(const void *pData, int DataSize, void *pOutput, int OutputSize);
 	static int Decompress(const void *pData, int DataSize, void *pOutput, int OutputSize);
 
@@ -542,8 +651,27 @@ public:
 	static void SendPacketConnless(NETSOCKET Socket, NETADDR *pAddr, const void *pData, int DataSize, bool Extended, unsigned char aExtra[4]);
 	static void SendPacket(NETSOCKET Socket, NETADDR *pAddr, CNetPacketConstruct *pPacket, SECURITY_TOKEN SecurityToken, bool Sixup = false, bool NoCompress = false);
 
+	/*
+		Function: UnpackPacket
+			Parses a received packet. Uncompressed payloads are not copied,
+			m_pChunkData points into pBuffer then, which has to stay valid
+			until the packet is handled.
+	*/
 	static int UnpackPacket(unsigned char *pBuffer, int Size, CNetPacketConstruct *pPacket, bool &Sixup, SECURITY_TOKEN *pSecurityToken = nullptr, SECURITY_TOKEN *pResponseToken = nullptr);
 
+	/*
+		Function: UpdateTime
+			Refreshes the timestamp the connections use for their send,
+			receive and resend bookkeeping. Called once per network pump
+			instead of querying the clock for every chunk.
+	*/
+	static void UpdateTime() { ms_Time = time_get(); }
+	static void UpdateTime(int64_t Now) { ms_Time = Now; }
+	static int64_t Time() { return ms_Time; }
+
+	static const CRecvCounters &RecvCounters() { return ms_RecvCounters; }
+	static void ResetRecvCounters() { mem_zero(&ms_RecvCounters, sizeof(ms_RecvCounters)); }
+
 	// The backroom is ack-NET_MAX_SEQUENCE/2. Used for knowing if we acked a packet or not
 	static bool IsSeqInBackroom(int Seq, int Ack);
 };
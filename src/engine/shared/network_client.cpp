@@ -43,6 +43,7 @@ int CNetClient::Disconnect(const char *pReason)
 
 int CNetClient::Update()
 {
+	CNetBase::UpdateTime();
 	m_Connection.Update();
 	if(m_Connection.State() == NET_CONNSTATE_ERROR)
 		Disconnect(m_Connection.ErrorString());
@@ -52,6 +53,7 @@ int CNetClient::Update()
 
 int CNetClient::Connect(const NETADDR *pAddr, int NumAddrs)
 {
+	CNetBase::UpdateTime();
 	m_Connection.Connect(pAddr, NumAddrs);
 	return 0;
 }
@@ -93,7 +95,7 @@ int CNetClient::Recv(CNetChunk *pChunk)
 				pChunk->m_ClientID = -1;
 				pChunk->m_Address = Addr;
 				pChunk->m_DataSize = m_RecvUnpacker.m_Data.m_DataSize;
-				pChunk->m_pData = m_RecvUnpacker.m_Data.m_aChunkData;
+				pChunk->m_pData = m_RecvUnpacker.m_Data.m_pChunkData;
 				if(m_RecvUnpacker.m_Data.m_Flags & NET_PACKETFLAG_EXTENDED)
 				{
 					pChunk->m_Flags |= NETSENDFLAG_EXTENDED;
@@ -4,7 +4,7 @@
 #include "network.h"
 #include <base/system.h>
 
-SECURITY_TOKEN ToSecurityToken(unsigned char *pData)
+SECURITY_TOKEN ToSecurityToken(const unsigned char *pData)
 {
 	return (int)pData[0] | (pData[1] << 8) | (pData[2] << 16) | (pData[3] << 24);
 }
@@ -99,10 +99,14 @@ int CNetConnection::Flush()
 	CNetBase::SendPacket(m_Socket, &m_PeerAddr, &m_Construct, m_SecurityToken, m_Sixup);
 
 	// update send times
-	m_LastSendTime = time_get();
-
-	// clear construct so we can start building a new package
-	mem_zero(&m_Construct, sizeof(m_Construct));
+	m_LastSendTime = CNetBase::Time();
+
+	// clear construct so we can start building a new package, the
+	// chunk data is overwritten before it is read again
+	m_Construct.m_Flags = 0;
+	m_Construct.m_Ack = 0;
+	m_Construct.m_NumChunks = 0;
+	m_Construct.m_DataSize = 0;
 	return NumChunks;
 }
 
@@ -143,7 +147,7 @@ int CNetConnection::QueueChunkEx(int Flags, int DataSize, const void *pData, int
 			pResend->m_Flags = Flags;
 			pResend->m_DataSize = DataSize;
 			pResend->m_pData = (unsigned char *)(pResend + 1);
-			pResend->m_FirstSendTime = time_get();
+			pResend->m_FirstSendTime = CNetBase::Time();
 			pResend->m_LastSendTime = pResend->m_FirstSendTime;
 			mem_copy(pResend->m_pData, pData, DataSize);
 		}
@@ -167,7 +171,7 @@ int CNetConnection::QueueChunk(int Flags, int DataSize, const void *pData)
 void CNetConnection::SendConnect()
 {
 	// send the connect message
-	m_LastSendTime = time_get();
+	m_LastSendTime = CNetBase::Time();
 	for(int i = 0; i < m_NumConnectAddrs; i++)
 	{
 		CNetBase::SendControlMsg(m_Socket, &m_aConnectAddrs[i], m_Ack, NET_CTRLMSG_CONNECT, SECURITY_TOKEN_MAGIC, sizeof(SECURITY_TOKEN_MAGIC), m_SecurityToken, m_Sixup);
@@ -177,14 +181,14 @@ void CNetConnection::SendConnect()
 void CNetConnection::SendControl(int ControlMsg, const void *pExtra, int ExtraSize)
 {
 	// send the control message
-	m_LastSendTime = time_get();
+	m_LastSendTime = CNetBase::Time();
 	CNetBase::SendControlMsg(m_Socket, &m_PeerAddr, m_Ack, ControlMsg, pExtra, ExtraSize, m_SecurityToken, m_Sixup);
 }
 
 void CNetConnection::ResendChunk(CNetChunkResend *pResend)
 {
 	QueueChunkEx(pResend->m_Flags | NET_CHUNKFLAG_RESEND, pResend->m_DataSize, pResend->m_pData, pResend->m_Sequence);
-	pResend->m_LastSendTime = time_get();
+	pResend->m_LastSendTime = CNetBase::Time();
 }
 
 void CNetConnection::Resend()
@@ -247,7 +251,7 @@ void CNetConnection::DirectInit(NETADDR &Addr, SECURITY_TOKEN SecurityToken, SEC
 	m_PeerAddr = Addr;
 	mem_zero(m_aErrorString, sizeof(m_aErrorString));
 
-	int64_t Now = time_get();
+	int64_t Now = CNetBase::Time();
 	m_LastSendTime = Now;
 	m_LastRecvTime = Now;
 	m_LastUpdateTime = Now;
@@ -271,10 +275,10 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr, SECURITY_
 		if(pPacket->m_DataSize < (int)sizeof(m_SecurityToken))
 			return 0;
 		pPacket->m_DataSize -= sizeof(m_SecurityToken);
-		if(m_SecurityToken != ToSecurityToken(&pPacket->m_aChunkData[pPacket->m_DataSize]))
+		if(m_SecurityToken != ToSecurityToken(&pPacket->m_pChunkData[pPacket->m_DataSize]))
 		{
 			if(g_Config.m_Debug)
-				dbg_msg("security", "token mismatch, expected %d got %d", m_SecurityToken, ToSecurityToken(&pPacket->m_aChunkData[pPacket->m_DataSize]));
+				dbg_msg("security", "token mismatch, expected %d got %d", m_SecurityToken, ToSecurityToken(&pPacket->m_pChunkData[pPacket->m_DataSize]));
 			return 0;
 		}
 	}
@@ -295,7 +299,7 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr, SECURITY_
 	}
 	m_PeerAck = pPacket->m_Ack;
 
-	int64_t Now = time_get();
+	int64_t Now = CNetBase::Time();
 
 	// check if resend is requested
 	if(pPacket->m_Flags & NET_PACKETFLAG_RESEND)
@@ -304,7 +308,7 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr, SECURITY_
 	//
 	if(pPacket->m_Flags & NET_PACKETFLAG_CONTROL)
 	{
-		int CtrlMsg = pPacket->m_aChunkData[0];
+		int CtrlMsg = pPacket->m_pChunkData[0];
 
 		if(CtrlMsg == NET_CTRLMSG_CLOSE)
 		{
@@ -330,7 +334,7 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr, SECURITY_
 				if(pPacket->m_DataSize > 1)
 				{
 					// make sure to sanitize the error string form the other party
-					str_copy(aStr, (char *)&pPacket->m_aChunkData[1], minimum(pPacket->m_DataSize, (int)sizeof(aStr)));
+					str_copy(aStr, (char *)&pPacket->m_pChunkData[1], minimum(pPacket->m_DataSize, (int)sizeof(aStr)));
 					str_sanitize_cc(aStr);
 				}
 
@@ -351,7 +355,7 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr, SECURITY_
 			{
 				if(CtrlMsg == NET_CTRLMSG_CONNECT)
 				{
-					if(net_addr_comp_noport(&m_PeerAddr, pAddr) == 0 && time_get() - m_LastUpdateTime < time_freq() * 3)
+					if(net_addr_comp_noport(&m_PeerAddr, pAddr) == 0 && CNetBase::Time() - m_LastUpdateTime < time_freq() * 3)
 						return 0;
 
 					// send response and init connection
@@ -362,7 +366,7 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr, SECURITY_
 					m_LastSendTime = Now;
 					m_LastRecvTime = Now;
 					m_LastUpdateTime = Now;
-					if(m_SecurityToken == NET_SECURITY_TOKEN_UNKNOWN && pPacket->m_DataSize >= (int)(1 + sizeof(SECURITY_TOKEN_MAGIC) + sizeof(m_SecurityToken)) && !mem_comp(&pPacket->m_aChunkData[1], SECURITY_TOKEN_MAGIC, sizeof(SECURITY_TOKEN_MAGIC)))
+					if(m_SecurityToken == NET_SECURITY_TOKEN_UNKNOWN && pPacket->m_DataSize >= (int)(1 + sizeof(SECURITY_TOKEN_MAGIC) + sizeof(m_SecurityToken)) && !mem_comp(&pPacket->m_pChunkData[1], SECURITY_TOKEN_MAGIC, sizeof(SECURITY_TOKEN_MAGIC)))
 					{
 						m_SecurityToken = NET_SECURITY_TOKEN_UNSUPPORTED;
 						if(g_Config.m_Debug)
@@ -385,9 +389,9 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr, SECURITY_
 				if(CtrlMsg == NET_CTRLMSG_CONNECTACCEPT)
 				{
 					m_PeerAddr = *pAddr;
-					if(m_SecurityToken == NET_SECURITY_TOKEN_UNKNOWN && pPacket->m_DataSize >= (int)(1 + sizeof(SECURITY_TOKEN_MAGIC) + sizeof(m_SecurityToken)) && !mem_comp(&pPacket->m_aChunkData[1], SECURITY_TOKEN_MAGIC, sizeof(SECURITY_TOKEN_MAGIC)))
+					if(m_SecurityToken == NET_SECURITY_TOKEN_UNKNOWN && pPacket->m_DataSize >= (int)(1 + sizeof(SECURITY_TOKEN_MAGIC) + sizeof(m_SecurityToken)) && !mem_comp(&pPacket->m_pChunkData[1], SECURITY_TOKEN_MAGIC, sizeof(SECURITY_TOKEN_MAGIC)))
 					{
-						m_SecurityToken = ToSecurityToken(&pPacket->m_aChunkData[1 + sizeof(SECURITY_TOKEN_MAGIC)]);
+						m_SecurityToken = ToSecurityToken(&pPacket->m_pChunkData[1 + sizeof(SECURITY_TOKEN_MAGIC)]);
 						if(g_Config.m_Debug)
 							dbg_msg("security", "got token %d", m_SecurityToken);
 					}
@@ -428,7 +432,7 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr, SECURITY_
 
 int CNetConnection::Update()
 {
-	int64_t Now = time_get();
+	int64_t Now = CNetBase::Time();
 
 	if(State() == NET_CONNSTATE_ERROR && m_TimeoutSituation && (Now - m_LastRecvTime) > time_freq() * g_Config.m_ConnTimeoutProtection)
 	{
@@ -476,33 +480,58 @@ int CNetConnection::Update()
 	// send keep alives if nothing has happened for 250ms
 	if(State() == NET_CONNSTATE_ONLINE)
 	{
-		if(time_get() - m_LastSendTime > time_freq() / 2) // flush connection after 500ms if needed
+		if(Now - m_LastSendTime > time_freq() / 2) // flush connection after 500ms if needed
 		{
 			int NumFlushedChunks = Flush();
 			if(NumFlushedChunks && g_Config.m_Debug)
 				dbg_msg("connection", "flushed connection due to timeout. %d chunks.", NumFlushedChunks);
 		}
 
-		if(time_get() - m_LastSendTime > time_freq())
+		if(Now - m_LastSendTime > time_freq())
 			SendControl(NET_CTRLMSG_KEEPALIVE, 0, 0);
 	}
 	else if(State() == NET_CONNSTATE_CONNECT)
 	{
-		if(time_get() - m_LastSendTime > time_freq() / 2) // send a new connect every 500ms
+		if(Now - m_LastSendTime > time_freq() / 2) // send a new connect every 500ms
 			SendConnect();
 	}
 	else if(State() == NET_CONNSTATE_PENDING)
 	{
-		if(time_get() - m_LastSendTime > time_freq() / 2) // send a new connect/accept every 500ms
+		if(Now - m_LastSendTime > time_freq() / 2) // send a new connect/accept every 500ms
 			SendControl(NET_CTRLMSG_CONNECTACCEPT, SECURITY_TOKEN_MAGIC, sizeof(SECURITY_TOKEN_MAGIC));
 	}
 
 	return 0;
 }
 
+int64_t CNetConnection::NextUpdateTime()
+{
+	// mirrors the checks in Update, which all compare with '>'
+	const int64_t Freq = time_freq();
+	if(State() == NET_CONNSTATE_ERROR)
+		return m_LastRecvTime + Freq * g_Config.m_ConnTimeoutProtection + 1;
+
+	int64_t Next;
+	if(State() == NET_CONNSTATE_ONLINE && !m_Construct.m_NumChunks && !m_Construct.m_Flags)
+		Next = m_LastSendTime + Freq + 1; // nothing to flush, next keepalive
+	else
+		Next = m_LastSendTime + Freq / 2 + 1;
+
+	if(State() != NET_CONNSTATE_CONNECT)
+		Next = minimum(Next, m_LastRecvTime + Freq * g_Config.m_ConnTimeout + 1);
+
+	CNetChunkResend *pResend = m_Buffer.First();
+	if(pResend)
+	{
+		Next = minimum(Next, pResend->m_LastSendTime + Freq + 1);
+		Next = minimum(Next, pResend->m_FirstSendTime + Freq * g_Config.m_ConnTimeout + 1);
+	}
+	return Next;
+}
+
 void CNetConnection::SetTimedOut(const NETADDR *pAddr, int Sequence, int Ack, SECURITY_TOKEN SecurityToken, TStaticRingBuffer<CNetChunkResend, NET_CONN_BUFFERSIZE> *pResendBuffer, bool Sixup)
 {
-	int64_t Now = time_get();
+	int64_t Now = CNetBase::Time();
 
 	m_Sequence = Sequence;
 	m_Ack = Ack;
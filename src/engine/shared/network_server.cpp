@@ -38,11 +38,6 @@ unsigned char g_aDummyMapData[] = {
 	0x7c, 0x00, 0x00, 0x00, 0x78, 0x9c, 0x63, 0x64, 0x60, 0x60, 0x60, 0x44,
 	0xc2, 0x00, 0x00, 0x38, 0x00, 0x05};
 
-static SECURITY_TOKEN ToSecurityToken(const unsigned char *pData)
-{
-	return (int)pData[0] | (pData[1] << 8) | (pData[2] << 16) | (pData[3] << 24);
-}
-
 bool CNetServer::Open(NETADDR BindAddr, CNetBan *pNetBan, int MaxClients, int MaxClientsPerIP)
 {
 	// zero out the whole structure
@@ -66,9 +61,22 @@ bool CNetServer::Open(NETADDR BindAddr, CNetBan *pNetBan, int MaxClients, int Ma
 	m_VConnFirst = 0;
 
 	secure_random_fill(m_aSecurityTokenSeed, sizeof(m_aSecurityTokenSeed));
+	m_FloodShield.Init();
 
 	for(auto &Slot : m_aSlots)
+	{
 		Slot.m_Connection.Init(m_Socket, true);
+		Slot.m_WheelTick = -1;
+		Slot.m_HashBucket = -1;
+	}
+
+	for(auto &Bucket : m_aAddrHash)
+		Bucket = -1;
+
+	for(auto &Bucket : m_aWheel)
+		Bucket = -1;
+	m_WheelTickTime = time_freq() / WHEEL_TICKS_PER_SECOND;
+	m_WheelTick = time_get() / m_WheelTickTime;
 
 	return true;
 }
@@ -106,20 +114,90 @@ int CNetServer::Drop(int ClientID, const char *pReason)
 		m_pfnDelClient(ClientID, pReason, m_pUser);
 
 	m_aSlots[ClientID].m_Connection.Disconnect(pReason);
+	Unschedule(ClientID);
 
 	return 0;
 }
 
+void CNetServer::Schedule(int ClientID, int64_t Time)
+{
+	Unschedule(ClientID);
+
+	// due times beyond the wheel are rechecked after one round
+	CSlot &Slot = m_aSlots[ClientID];
+	Slot.m_WheelTick = clamp(WheelTick(Time), m_WheelTick, m_WheelTick + WHEEL_SIZE - 1);
+
+	int &Head = m_aWheel[Slot.m_WheelTick % WHEEL_SIZE];
+	Slot.m_WheelPrev = -1;
+	Slot.m_WheelNext = Head;
+	if(Head != -1)
+		m_aSlots[Head].m_WheelPrev = ClientID;
+	Head = ClientID;
+}
+
+void CNetServer::Unschedule(int ClientID)
+{
+	CSlot &Slot = m_aSlots[ClientID];
+	if(Slot.m_WheelTick == -1)
+		return;
+
+	if(Slot.m_WheelPrev != -1)
+		m_aSlots[Slot.m_WheelPrev].m_WheelNext = Slot.m_WheelNext;
+	else
+		m_aWheel[Slot.m_WheelTick % WHEEL_SIZE] = Slot.m_WheelNext;
+	if(Slot.m_WheelNext != -1)
+		m_aSlots[Slot.m_WheelNext].m_WheelPrev = Slot.m_WheelPrev;
+	Slot.m_WheelTick = -1;
+}
+
+void CNetServer::UpdateSlot(int ClientID)
+{
+	CNetConnection &Connection = m_aSlots[ClientID].m_Connection;
+	Connection.Update();
+	if(Connection.State() != NET_CONNSTATE_OFFLINE)
+		Schedule(ClientID, Connection.NextUpdateTime());
+}
+
 int CNetServer::Update()
 {
+	CNetBase::UpdateTime();
+	const int64_t NowTick = CNetBase::Time() / m_WheelTickTime;
+
+	// only connections with a due flush, keepalive, resend or timeout
+	// are updated. after a long stall every bucket is visited once.
+	const int64_t FirstTick = m_WheelTick;
+	const int64_t LastTick = minimum(NowTick, FirstTick + WHEEL_SIZE - 1);
+	m_WheelTick = NowTick + 1;
+	for(int64_t Tick = FirstTick; Tick <= LastTick; Tick++)
+	{
+		int ClientID = m_aWheel[Tick % WHEEL_SIZE];
+		while(ClientID != -1)
+		{
+			int Next = m_aSlots[ClientID].m_WheelNext;
+			if(m_aSlots[ClientID].m_WheelTick <= NowTick)
+			{
+				Unschedule(ClientID);
+				UpdateSlot(ClientID);
+			}
+			ClientID = Next;
+		}
+	}
+
 	for(int i = 0; i < MaxClients(); i++)
 	{
-		m_aSlots[i].m_Connection.Update();
-		if(m_aSlots[i].m_Connection.State() == NET_CONNSTATE_ERROR &&
-			(!m_aSlots[i].m_Connection.m_TimeoutProtected ||
-				!m_aSlots[i].m_Connection.m_TimeoutSituation))
+		CNetConnection &Connection = m_aSlots[i].m_Connection;
+		if(Connection.State() == NET_CONNSTATE_OFFLINE)
+			continue;
+
+		// new connections and the ones taken over by SetTimedOut
+		if(m_aSlots[i].m_WheelTick == -1)
+			UpdateSlot(i);
+
+		// Feed can put a connection into the error state as well
+		if(Connection.State() == NET_CONNSTATE_ERROR &&
+			(!Connection.m_TimeoutProtected || !Connection.m_TimeoutSituation))
 		{
-			Drop(i, m_aSlots[i].m_Connection.ErrorString());
+			Drop(i, Connection.ErrorString());
 		}
 	}
 
@@ -248,6 +326,7 @@ int CNetServer::TryAcceptClient(NETADDR &Addr, SECURITY_TOKEN SecurityToken, boo
 
 	// init connection slot
 	m_aSlots[Slot].m_Connection.DirectInit(Addr, SecurityToken, Token, Sixup);
+	HashSlot(Slot);
 
 	if(VanillaAuth)
 	{
@@ -303,7 +382,7 @@ void CNetServer::SendMsgs(NETADDR &Addr, const CMsgPacker *apMsgs[], int Num)
 void CNetServer::OnPreConnMsg(NETADDR &Addr, CNetPacketConstruct &Packet)
 {
 	bool IsCtrl = Packet.m_Flags & NET_PACKETFLAG_CONTROL;
-	int CtrlMsg = m_RecvUnpacker.m_Data.m_aChunkData[0];
+	int CtrlMsg = m_RecvUnpacker.m_Data.m_pChunkData[0];
 
 	// log flooding
 	//TODO: remove
@@ -434,7 +513,7 @@ void CNetServer::OnPreConnMsg(NETADDR &Addr, CNetPacketConstruct &Packet)
 	{
 		CNetChunkHeader h;
 
-		unsigned char *pData = Packet.m_aChunkData;
+		unsigned char *pData = Packet.m_pChunkData;
 		pData = h.Unpack(pData);
 		CUnpacker Unpacker;
 		Unpacker.Reset(pData, h.m_Size);
@@ -471,7 +550,7 @@ void CNetServer::OnConnCtrlMsg(NETADDR &Addr, int ClientID, int ControlMsg, cons
 		// the client probably wants to reconnect
 		bool SupportsToken = Packet.m_DataSize >=
 					     (int)(1 + sizeof(SECURITY_TOKEN_MAGIC) + sizeof(SECURITY_TOKEN)) &&
-				     !mem_comp(&Packet.m_aChunkData[1], SECURITY_TOKEN_MAGIC, sizeof(SECURITY_TOKEN_MAGIC));
+				     !mem_comp(&Packet.m_pChunkData[1], SECURITY_TOKEN_MAGIC, sizeof(SECURITY_TOKEN_MAGIC));
 
 		if(SupportsToken)
 		{
@@ -485,7 +564,7 @@ void CNetServer::OnConnCtrlMsg(NETADDR &Addr, int ClientID, int ControlMsg, cons
 	}
 	else if(ControlMsg == NET_CTRLMSG_ACCEPT && Packet.m_DataSize == 1 + sizeof(SECURITY_TOKEN))
 	{
-		SECURITY_TOKEN Token = ToSecurityToken(&Packet.m_aChunkData[1]);
+		SECURITY_TOKEN Token = ToSecurityToken(&Packet.m_pChunkData[1]);
 		if(Token == GetToken(Addr))
 		{
 			// correct token
@@ -520,7 +599,7 @@ void CNetServer::OnTokenCtrlMsg(NETADDR &Addr, int ControlMsg, const CNetPacketC
 	}
 	else if(ControlMsg == NET_CTRLMSG_ACCEPT)
 	{
-		SECURITY_TOKEN Token = ToSecurityToken(&Packet.m_aChunkData[1]);
+		SECURITY_TOKEN Token = ToSecurityToken(&Packet.m_pChunkData[1]);
 		if(Token == GetToken(Addr))
 		{
 			// correct token
@@ -543,7 +622,7 @@ int CNetServer::OnSixupCtrlMsg(NETADDR &Addr, CNetChunk *pChunk, int ControlMsg,
 	if(m_RecvUnpacker.m_Data.m_DataSize < 5 || ClientExists(Addr))
 		return 0; // silently ignore
 
-	mem_copy(&ResponseToken, Packet.m_aChunkData + 1, 4);
+	mem_copy(&ResponseToken, Packet.m_pChunkData + 1, 4);
 
 	if(ControlMsg == 5)
 	{
@@ -574,22 +653,48 @@ int CNetServer::OnSixupCtrlMsg(NETADDR &Addr, CNetChunk *pChunk, int ControlMsg,
 	return 0;
 }
 
-int CNetServer::GetClientSlot(const NETADDR &Addr)
+static unsigned AddrHash(const NETADDR &Addr)
 {
-	int Slot = -1;
+	// FNV-1a over the address and the port
+	const int Size = Addr.type == NETTYPE_IPV4 ? 4 : 16;
+	unsigned Hash = 2166136261u;
+	for(int i = 0; i < Size; i++)
+		Hash = (Hash ^ Addr.ip[i]) * 16777619u;
+	Hash = (Hash ^ (Addr.port & 0xff)) * 16777619u;
+	Hash = (Hash ^ (Addr.port >> 8)) * 16777619u;
+	return Hash;
+}
 
-	for(int i = 0; i < MaxClients(); i++)
+void CNetServer::HashSlot(int ClientID)
+{
+	CSlot *pSlot = &m_aSlots[ClientID];
+
+	// unlink it from the chain of its old address
+	if(pSlot->m_HashBucket != -1)
+	{
+		int *pLink = &m_aAddrHash[pSlot->m_HashBucket];
+		while(*pLink != ClientID)
+			pLink = &m_aSlots[*pLink].m_HashNext;
+		*pLink = pSlot->m_HashNext;
+	}
+
+	pSlot->m_HashBucket = AddrHash(*pSlot->m_Connection.PeerAddress()) % ADDR_HASH_SIZE;
+	pSlot->m_HashNext = m_aAddrHash[pSlot->m_HashBucket];
+	m_aAddrHash[pSlot->m_HashBucket] = ClientID;
+}
+
+int CNetServer::GetClientSlot(const NETADDR &Addr)
+{
+	// the chain also holds slots that went offline since, check them
+	for(int i = m_aAddrHash[AddrHash(Addr) % ADDR_HASH_SIZE]; i != -1; i = m_aSlots[i].m_HashNext)
 	{
 		if(m_aSlots[i].m_Connection.State() != NET_CONNSTATE_OFFLINE &&
 			m_aSlots[i].m_Connection.State() != NET_CONNSTATE_ERROR &&
 			net_addr_comp(m_aSlots[i].m_Connection.PeerAddress(), &Addr) == 0)
-
-		{
-			Slot = i;
-		}
+			return i;
 	}
 
-	return Slot;
+	return -1;
 }
 
 static bool IsDDNetControlMsg(const CNetPacketConstruct *pPacket)
@@ -598,12 +703,12 @@ static bool IsDDNetControlMsg(const CNetPacketConstruct *pPacket)
 	{
 		return false;
 	}
-	if(pPacket->m_aChunkData[0] == NET_CTRLMSG_CONNECT && pPacket->m_DataSize >= (int)(1 + sizeof(SECURITY_TOKEN_MAGIC) + sizeof(SECURITY_TOKEN)) && mem_comp(&pPacket->m_aChunkData[1], SECURITY_TOKEN_MAGIC, sizeof(SECURITY_TOKEN_MAGIC)) == 0)
+	if(pPacket->m_pChunkData[0] == NET_CTRLMSG_CONNECT && pPacket->m_DataSize >= (int)(1 + sizeof(SECURITY_TOKEN_MAGIC) + sizeof(SECURITY_TOKEN)) && mem_comp(&pPacket->m_pChunkData[1], SECURITY_TOKEN_MAGIC, sizeof(SECURITY_TOKEN_MAGIC)) == 0)
 	{
 		// DDNet CONNECT
 		return true;
 	}
-	if(pPacket->m_aChunkData[0] == NET_CTRLMSG_ACCEPT && pPacket->m_DataSize >= 1 + (int)sizeof(SECURITY_TOKEN))
+	if(pPacket->m_pChunkData[0] == NET_CTRLMSG_ACCEPT && pPacket->m_DataSize >= 1 + (int)sizeof(SECURITY_TOKEN))
 	{
 		// DDNet ACCEPT
 		return true;
@@ -632,6 +737,12 @@ int CNetServer::Recv(CNetChunk *pChunk, SECURITY_TOKEN *pResponseToken)
 		if(Bytes <= 0)
 			break;
 
+		// limit unconnected sources before anything is parsed or answered
+		int Slot = GetClientSlot(Addr);
+		if(Slot == -1 && g_Config.m_SvPreauthRate > 0 &&
+			!m_FloodShield.Allow(&Addr, CNetBase::Time(), g_Config.m_SvPreauthRate, g_Config.m_SvPreauthBurst))
+			continue;
+
 		// check if we just should drop the packet
 		char aBuf[128];
 		if(NetBan() && NetBan()->IsBanned(&Addr, aBuf, sizeof(aBuf)))
@@ -655,7 +766,7 @@ int CNetServer::Recv(CNetChunk *pChunk, SECURITY_TOKEN *pResponseToken)
 				pChunk->m_ClientID = -1;
 				pChunk->m_Address = Addr;
 				pChunk->m_DataSize = m_RecvUnpacker.m_Data.m_DataSize;
-				pChunk->m_pData = m_RecvUnpacker.m_Data.m_aChunkData;
+				pChunk->m_pData = m_RecvUnpacker.m_Data.m_pChunkData;
 				if(m_RecvUnpacker.m_Data.m_Flags & NET_PACKETFLAG_EXTENDED)
 				{
 					pChunk->m_Flags |= NETSENDFLAG_EXTENDED;
@@ -670,9 +781,6 @@ int CNetServer::Recv(CNetChunk *pChunk, SECURITY_TOKEN *pResponseToken)
 					m_RecvUnpacker.m_Data.m_DataSize == 0)
 					continue;
 
-				// normal packet, find matching slot
-				int Slot = GetClientSlot(Addr);
-
 				if(!Sixup && Slot != -1 && m_aSlots[Slot].m_Connection.m_Sixup)
 				{
 					Sixup = true;
@@ -686,7 +794,7 @@ int CNetServer::Recv(CNetChunk *pChunk, SECURITY_TOKEN *pResponseToken)
 
 					// control
 					if(m_RecvUnpacker.m_Data.m_Flags & NET_PACKETFLAG_CONTROL)
-						OnConnCtrlMsg(Addr, Slot, m_RecvUnpacker.m_Data.m_aChunkData[0], m_RecvUnpacker.m_Data);
+						OnConnCtrlMsg(Addr, Slot, m_RecvUnpacker.m_Data.m_pChunkData[0], m_RecvUnpacker.m_Data);
 
 					if(m_aSlots[Slot].m_Connection.Feed(&m_RecvUnpacker.m_Data, &Addr, Token))
 					{
@@ -701,12 +809,12 @@ int CNetServer::Recv(CNetChunk *pChunk, SECURITY_TOKEN *pResponseToken)
 					if(Sixup)
 					{
 						// got 0.7 control msg
-						if(OnSixupCtrlMsg(Addr, pChunk, m_RecvUnpacker.m_Data.m_aChunkData[0], m_RecvUnpacker.m_Data, *pResponseToken, Token) == 1)
+						if(OnSixupCtrlMsg(Addr, pChunk, m_RecvUnpacker.m_Data.m_pChunkData[0], m_RecvUnpacker.m_Data, *pResponseToken, Token) == 1)
 							return 1;
 					}
 					else if(IsDDNetControlMsg(&m_RecvUnpacker.m_Data))
 						// got ddnet control msg
-						OnTokenCtrlMsg(Addr, m_RecvUnpacker.m_Data.m_aChunkData[0], m_RecvUnpacker.m_Data);
+						OnTokenCtrlMsg(Addr, m_RecvUnpacker.m_Data.m_pChunkData[0], m_RecvUnpacker.m_Data);
 					else
 						// got connection-less ctrl or sys msg
 						OnPreConnMsg(Addr, m_RecvUnpacker.m_Data);
@@ -717,6 +825,52 @@ int CNetServer::Recv(CNetChunk *pChunk, SECURITY_TOKEN *pResponseToken)
 	return 0;
 }
 
+void CNetFloodShield::Init()
+{
+	mem_zero(m_aaCells, sizeof(m_aaCells));
+	secure_random_fill(m_aSeed, sizeof(m_aSeed));
+	ResetCounters();
+}
+
+bool CNetFloodShield::Allow(const NETADDR *pAddr, int64_t Now, int Rate, int Burst)
+{
+	m_Counters.m_NumChecked++;
+
+	// two seeded FNV-1a hashes over the prefix, combined for the rows
+	const int PrefixSize = pAddr->type == NETTYPE_IPV4 ? 3 : 8;
+	unsigned Hash1 = 2166136261u ^ m_aSeed[0];
+	unsigned Hash2 = 2166136261u ^ m_aSeed[1];
+	for(int i = 0; i < PrefixSize; i++)
+	{
+		Hash1 = (Hash1 ^ pAddr->ip[i]) * 16777619u;
+		Hash2 = (Hash2 ^ pAddr->ip[i]) * 16777619u;
+	}
+	Hash2 |= 1;
+
+	// the cell with the earliest arrival time is the one least shared
+	int64_t *apCells[SKETCH_DEPTH];
+	int64_t Tat = -1;
+	for(int i = 0; i < SKETCH_DEPTH; i++)
+	{
+		apCells[i] = &m_aaCells[i][(Hash1 + i * Hash2) % SKETCH_WIDTH];
+		int64_t CellTat = maximum(*apCells[i], Now);
+		if(Tat == -1 || CellTat < Tat)
+			Tat = CellTat;
+	}
+
+	const int64_t Interval = maximum(time_freq() / Rate, (int64_t)1);
+	if(Tat - Now > (Burst - 1) * Interval)
+	{
+		m_Counters.m_NumDropped++;
+		return false;
+	}
+
+	Tat += Interval;
+	for(auto *pCell : apCells)
+		*pCell = maximum(*pCell, Tat);
+	return true;
+}
+
 int CNetServer::Send(CNetChunk *pChunk)
 {
 	if(pChunk->m_DataSize >= NET_MAX_PAYLOAD)
@@ -740,10 +894,18 @@ int CNetServer::Send(CNetChunk *pChunk)
 		if(pChunk->m_Flags & NETSENDFLAG_VITAL)
 			Flags = NET_CHUNKFLAG_VITAL;
 
-		if(m_aSlots[pChunk->m_ClientID].m_Connection.QueueChunk(Flags, pChunk->m_DataSize, pChunk->m_pData) == 0)
+		CSlot &Slot = m_aSlots[pChunk->m_ClientID];
+		if(Slot.m_Connection.QueueChunk(Flags, pChunk->m_DataSize, pChunk->m_pData) == 0)
 		{
 			if(pChunk->m_Flags & NETSENDFLAG_FLUSH)
-				m_aSlots[pChunk->m_ClientID].m_Connection.Flush();
+				Slot.m_Connection.Flush();
+			else if(Slot.m_WheelTick != -1)
+			{
+				// the queued chunk may need a flush before the next keepalive
+				int64_t Next = Slot.m_Connection.NextUpdateTime();
+				if(WheelTick(Next) < Slot.m_WheelTick)
+					Schedule(pChunk->m_ClientID, Next);
+			}
 		}
 		else
 		{
@@ -796,6 +958,9 @@ bool CNetServer::SetTimedOut(int ClientID, int OrigID)
 
 	m_aSlots[ClientID].m_Connection.SetTimedOut(ClientAddr(OrigID), m_aSlots[OrigID].m_Connection.SeqSequence(), m_aSlots[OrigID].m_Connection.AckSequence(), m_aSlots[OrigID].m_Connection.SecurityToken(), m_aSlots[OrigID].m_Connection.ResendBuffer(), m_aSlots[OrigID].m_Connection.m_Sixup);
 	m_aSlots[OrigID].m_Connection.Reset();
+	HashSlot(ClientID);
+	Unschedule(ClientID);
+	Unschedule(OrigID);
 	return true;
 }
 
@@ -0,0 +1,89 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <algorithm>
+
+#include <base/math.h>
+
+#include "profiler.h"
+
+CProfiler g_Profiler;
+
+static const char *s_apPhaseNames[CProfiler::NUM_PHASES] = {
+	"input",
+	"game_tick",
+	"world_tick",
+	"bot_ai",
+	"snap",
+	"snap_build",
+	"snap_delta",
+	"network",
+	"register",
+};
+
+CProfiler::CProfiler()
+{
+	m_Enabled = false;
+	Reset();
+}
+
+void CProfiler::Reset()
+{
+	for(int i = 0; i < NUM_PHASES; i++)
+	{
+		m_aRings[i].m_Count = 0;
+		m_aRings[i].m_Total = 0;
+		m_aRings[i].m_Parts = 0;
+		m_aRings[i].m_HasParts = false;
+	}
+}
+
+void CProfiler::Add(int Phase, int64 Time)
+{
+	CRing *pRing = &m_aRings[Phase];
+	unsigned Count = pRing->m_Count.load(std::memory_order_relaxed);
+	pRing->m_aSamples[Count%HISTORY_SIZE] = Time;
+	pRing->m_Total += Time;
+	// publish the sample after it is written
+	pRing->m_Count.store(Count+1, std::memory_order_release);
+}
+
+void CProfiler::AddPart(int Phase, int64 Time)
+{
+	m_aRings[Phase].m_Parts += Time;
+	m_aRings[Phase].m_HasParts = true;
+}
+
+void CProfiler::FlushParts(int Phase)
+{
+	CRing *pRing = &m_aRings[Phase];
+	if(!pRing->m_HasParts)
+		return;
+	Add(Phase, pRing->m_Parts);
+	pRing->m_Parts = 0;
+	pRing->m_HasParts = false;
+}
+
+void CProfiler::GetStats(int Phase, CStats *pStats) const
+{
+	const CRing *pRing = &m_aRings[Phase];
+	unsigned Count = pRing->m_Count.load(std::memory_order_acquire);
+	int Num = (int)minimum(Count, (unsigned)HISTORY_SIZE);
+
+	int64 aSorted[HISTORY_SIZE];
+	for(int i = 0; i < Num; i++)
+		aSorted[i] = pRing->m_aSamples[i];
+	std::sort(aSorted, aSorted+Num);
+
+	// through double, the total times a million overflows int64 after a few hours
+	double Scale = 1000000.0/time_freq();
+	pStats->m_NumSamples = Count;
+	pStats->m_Total = (int64)(pRing->m_Total*Scale);
+	pStats->m_P50 = Num ? (int64)(aSorted[Num/2]*Scale) : 0;
+	pStats->m_P99 = Num ? (int64)(aSorted[minimum(Num-1, Num*99/100)]*Scale) : 0;
+	pStats->m_Max = Num ? (int64)(aSorted[Num-1]*Scale) : 0;
+}
+
+const char *CProfiler::PhaseName(int Phase)
+{
+	return s_apPhaseNames[Phase];
+}
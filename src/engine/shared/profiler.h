@@ -0,0 +1,103 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_PROFILER_H
+#define ENGINE_SHARED_PROFILER_H
+
+#include <base/system.h>
+
+#include <atomic>
+
+/*
+	Class: Profiler
+		Records how long the phases of a server tick take. Every phase
+		keeps the durations of its last samples in a ring that is only
+		written by the main thread, readers get a rolling view of the
+		p50, p99 and maximum. Recording is always compiled in and
+		switched on and off at runtime, a disabled scope costs a branch.
+*/
+class CProfiler
+{
+public:
+	enum
+	{
+		PHASE_INPUT = 0,
+		PHASE_GAME_TICK,
+		PHASE_WORLD_TICK,
+		PHASE_BOT_AI,
+		PHASE_SNAP,
+		PHASE_SNAP_BUILD,
+		PHASE_SNAP_DELTA,
+		PHASE_NETWORK,
+		PHASE_REGISTER,
+		NUM_PHASES,
+
+		HISTORY_SIZE = 1024,
+	};
+
+	struct CStats
+	{
+		int m_NumSamples;
+		int64 m_Total; // of all samples since the last reset
+		int64 m_P50;
+		int64 m_P99;
+		int64 m_Max;
+	};
+
+	CProfiler();
+
+	void SetEnabled(bool Enabled) { m_Enabled = Enabled; }
+	bool IsEnabled() const { return m_Enabled; }
+
+	void Add(int Phase, int64 Time);
+	void Reset();
+
+	// phases that run in pieces, like once per bot or per client, sum
+	// their parts and add them as one sample per tick
+	void AddPart(int Phase, int64 Time);
+	void FlushParts(int Phase);
+
+	// durations are returned in microseconds
+	void GetStats(int Phase, CStats *pStats) const;
+	static const char *PhaseName(int Phase);
+
+private:
+	struct CRing
+	{
+		int64 m_aSamples[HISTORY_SIZE];
+		std::atomic<unsigned> m_Count;
+		int64 m_Total;
+		int64 m_Parts;
+		bool m_HasParts;
+	};
+
+	CRing m_aRings[NUM_PHASES];
+	bool m_Enabled;
+};
+
+extern CProfiler g_Profiler;
+
+/*
+	Class: Profile scope
+		Adds the time between construction and destruction to a phase
+		of the profiler, or to the parts of its current sample.
+*/
+class CProfileScope
+{
+	int m_Phase;
+	bool m_Part;
+	int64 m_Start;
+
+public:
+	CProfileScope(int Phase, bool Part = false) : m_Phase(Phase), m_Part(Part), m_Start(g_Profiler.IsEnabled() ? time_get_impl() : 0) {}
+	~CProfileScope()
+	{
+		if(!m_Start)
+			return;
+		if(m_Part)
+			g_Profiler.AddPart(m_Phase, time_get_impl()-m_Start);
+		else
+			g_Profiler.Add(m_Phase, time_get_impl()-m_Start);
+	}
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include "compression.h"
 #include "uuid_manager.h"
 
+#include <algorithm>
 #include <climits>
 #include <cstdlib>
 
@@ -121,6 +122,23 @@ void CSnapshot::DebugDump()
 	}
 }
 
+void CSnapshot::BuildSortedKeys(uint64_t *pKeys) const
+{
+	// keys are never negative, the type is at most MAX_TYPE
+	for(int i = 0; i < m_NumItems; i++)
+		pKeys[i] = ((uint64_t)(unsigned)GetItem(i)->Key() << 32) | (unsigned)i;
+	std::sort(pKeys, pKeys + m_NumItems);
+}
+
+int CSnapshot::FindSortedKey(const uint64_t *pKeys, int NumKeys, int Key)
+{
+	// the first entry of a key has the lowest item index, like GetItemIndex
+	const uint64_t *pFound = std::lower_bound(pKeys, pKeys + NumKeys, (uint64_t)(unsigned)Key << 32);
+	if(pFound == pKeys + NumKeys || (int)(*pFound >> 32) != Key)
+		return -1;
+	return (int)(*pFound & 0xffffffff);
+}
+
 bool CSnapshot::IsValid(size_t ActualSize) const
 {
 	// validate total size
@@ -143,58 +161,6 @@ bool CSnapshot::IsValid(size_t ActualSize) const
 
 // CSnapshotDelta
 
-enum
-{
-	HASHLIST_SIZE = 256,
-	HASHLIST_BUCKET_SIZE = 64,
-};
-
-struct CItemList
-{
-	int m_Num;
-	int m_aKeys[HASHLIST_BUCKET_SIZE];
-	int m_aIndex[HASHLIST_BUCKET_SIZE];
-};
-
-inline size_t CalcHashID(int Key)
-{
-	// djb2 (http://www.cse.yorku.ca/~oz/hash.html)
-	unsigned Hash = 5381;
-	for(unsigned Shift = 0; Shift < sizeof(int); Shift++)
-		Hash = ((Hash << 5) + Hash) + ((Key >> (Shift * 8)) & 0xFF);
-	return Hash % HASHLIST_SIZE;
-}
-
-static void GenerateHash(CItemList *pHashlist, CSnapshot *pSnapshot)
-{
-	for(int i = 0; i < HASHLIST_SIZE; i++)
-		pHashlist[i].m_Num = 0;
-
-	for(int i = 0; i < pSnapshot->NumItems(); i++)
-	{
-		int Key = pSnapshot->GetItem(i)->Key();
-		size_t HashID = CalcHashID(Key);
-		if(pHashlist[HashID].m_Num < HASHLIST_BUCKET_SIZE)
-		{
-			pHashlist[HashID].m_aIndex[pHashlist[HashID].m_Num] = i;
-			pHashlist[HashID].m_aKeys[pHashlist[HashID].m_Num] = Key;
-			pHashlist[HashID].m_Num++;
-		}
-	}
-}
-
-static int GetItemIndexHashed(int Key, const CItemList *pHashlist)
-{
-	size_t HashID = CalcHashID(Key);
-	for(int i = 0; i < pHashlist[HashID].m_Num; i++)
-	{
-		if(pHashlist[HashID].m_aKeys[i] == Key)
-			return pHashlist[HashID].m_aIndex[i];
-	}
-
-	return -1;
-}
-
 int CSnapshotDelta::DiffItem(int *pPast, int *pCurrent, int *pOut, int Size)
 {
 	int Needed = 0;
@@ -261,8 +227,7 @@ const CSnapshotDelta::CData *CSnapshotDelta::EmptyDelta() const
 	return &m_Empty;
 }
 
-// TODO: OPT: this should be made much faster
-int CSnapshotDelta::CreateDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData)
+int CSnapshotDelta::CreateDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData, const uint64_t *pFromKeys, const uint64_t *pToKeys)
 {
 	CData *pDelta = (CData *)pDstData;
 	int *pData = (int *)pDelta->m_aData;
@@ -271,32 +236,53 @@ int CSnapshotDelta::CreateDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData
 	pDelta->m_NumUpdateItems = 0;
 	pDelta->m_NumTempItems = 0;
 
-	CItemList aHashlist[HASHLIST_SIZE];
-	GenerateHash(aHashlist, pTo);
+	uint64_t aFromKeys[CSnapshot::MAX_ITEMS];
+	uint64_t aToKeys[CSnapshot::MAX_ITEMS];
+	if(!pFromKeys)
+	{
+		pFrom->BuildSortedKeys(aFromKeys);
+		pFromKeys = aFromKeys;
+	}
+	if(!pToKeys)
+	{
+		pTo->BuildSortedKeys(aToKeys);
+		pToKeys = aToKeys;
+	}
 
-	// pack deleted stuff
-	for(int i = 0; i < pFrom->NumItems(); i++)
+	// merge-join the sorted keys, every new item gets the lowest index of
+	// its key in the old snapshot and old items without a new one are deleted
+	bool aDeleted[CSnapshot::MAX_ITEMS];
+	int aPastIndices[CSnapshot::MAX_ITEMS];
+	const int NumFromItems = pFrom->NumItems();
+	const int NumItems = pTo->NumItems();
+	int f = 0, t = 0;
+	while(f < NumFromItems || t < NumItems)
 	{
-		const CSnapshotItem *pFromItem = pFrom->GetItem(i);
-		if(GetItemIndexHashed(pFromItem->Key(), aHashlist) == -1)
+		unsigned FromKey = f < NumFromItems ? (unsigned)(pFromKeys[f] >> 32) : UINT_MAX;
+		unsigned ToKey = t < NumItems ? (unsigned)(pToKeys[t] >> 32) : UINT_MAX;
+		if(FromKey < ToKey)
+			aDeleted[pFromKeys[f++] & 0xffffffff] = true;
+		else if(ToKey < FromKey)
+			aPastIndices[pToKeys[t++] & 0xffffffff] = -1;
+		else
 		{
-			// deleted
-			pDelta->m_NumDeletedItems++;
-			*pData = pFromItem->Key();
-			pData++;
+			int PastIndex = (int)(pFromKeys[f] & 0xffffffff);
+			for(; f < NumFromItems && (unsigned)(pFromKeys[f] >> 32) == FromKey; f++)
+				aDeleted[pFromKeys[f] & 0xffffffff] = false;
+			for(; t < NumItems && (unsigned)(pToKeys[t] >> 32) == ToKey; t++)
+				aPastIndices[pToKeys[t] & 0xffffffff] = PastIndex;
 		}
 	}
 
-	GenerateHash(aHashlist, pFrom);
-
-	// fetch previous indices
-	// we do this as a separate pass because it helps the cache
-	int aPastIndices[CSnapshot::MAX_ITEMS];
-	const int NumItems = pTo->NumItems();
-	for(int i = 0; i < NumItems; i++)
+	// pack deleted stuff, in item order
+	for(int i = 0; i < NumFromItems; i++)
 	{
-		const CSnapshotItem *pCurItem = pTo->GetItem(i); // O(1) .. O(n)
-		aPastIndices[i] = GetItemIndexHashed(pCurItem->Key(), aHashlist); // O(n) .. O(n^n)
+		if(aDeleted[i])
+		{
+			pDelta->m_NumDeletedItems++;
+			*pData = pFrom->GetItem(i)->Key();
+			pData++;
+		}
 	}
 
 	for(int i = 0; i < NumItems; i++)
@@ -361,6 +347,9 @@ int CSnapshotDelta::UnpackDelta(CSnapshot *pFrom, CSnapshot *pTo, const void *pS
 	CSnapshotBuilder Builder;
 	Builder.Init();
 
+	uint64_t aFromKeys[CSnapshot::MAX_ITEMS];
+	pFrom->BuildSortedKeys(aFromKeys);
+
 	// unpack deleted stuff
 	int *pDeleted = pData;
 	if(pDelta->m_NumDeletedItems < 0)
@@ -434,7 +423,7 @@ int CSnapshotDelta::UnpackDelta(CSnapshot *pFrom, CSnapshot *pTo, const void *pS
 		if(!pNewData)
 			return -4;
 
-		const int FromIndex = pFrom->GetItemIndex(Key);
+		const int FromIndex = CSnapshot::FindSortedKey(aFromKeys, pFrom->NumItems(), Key);
 		if(FromIndex != -1)
 		{
 			// we got an update so we need to apply the diff
@@ -504,10 +493,11 @@ void CSnapshotStorage::PurgeUntil(int Tick)
 	m_pLast = 0;
 }
 
-void CSnapshotStorage::Add(int Tick, int64 Tagtime, int DataSize, void *pData, int AltDataSize, void *pAltData)
+void CSnapshotStorage::Add(int Tick, int64 Tagtime, int DataSize, void *pData, int AltDataSize, void *pAltData, const uint64_t *pKeys)
 {
-	// allocate memory for holder + snapshot_data
-	int TotalSize = sizeof(CHolder) + DataSize;
+	// allocate memory for holder + keys + snapshot_data, the keys go first for their alignment
+	int KeysSize = pKeys ? ((CSnapshot *)pData)->NumItems() * (int)sizeof(uint64_t) : 0;
+	int TotalSize = sizeof(CHolder) + KeysSize + DataSize;
 
 	if(AltDataSize > 0)
 	{
@@ -520,7 +510,14 @@ void CSnapshotStorage::Add(int Tick, int64 Tagtime, int DataSize, void *pData, i
 	pHolder->m_Tick = Tick;
 	pHolder->m_Tagtime = Tagtime;
 	pHolder->m_SnapSize = DataSize;
-	pHolder->m_pSnap = (CSnapshot *)(pHolder + 1);
+	if(pKeys)
+	{
+		pHolder->m_pKeys = (uint64_t *)(pHolder + 1);
+		mem_copy(pHolder->m_pKeys, pKeys, KeysSize);
+	}
+	else
+		pHolder->m_pKeys = 0;
+	pHolder->m_pSnap = (CSnapshot *)((char *)(pHolder + 1) + KeysSize);
 	mem_copy(pHolder->m_pSnap, pData, DataSize);
 
 	if(AltDataSize > 0) // create alternative if wanted
@@ -545,7 +542,7 @@ void CSnapshotStorage::Add(int Tick, int64 Tagtime, int DataSize, void *pData, i
 	m_pLast = pHolder;
 }
 
-int CSnapshotStorage::Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapshot **ppAltData)
+int CSnapshotStorage::Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapshot **ppAltData, const uint64_t **ppKeys)
 {
 	CHolder *pHolder = m_pFirst;
 
@@ -559,6 +556,8 @@ int CSnapshotStorage::Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapsh
 				*ppData = pHolder->m_pSnap;
 			if(ppAltData)
 				*ppAltData = pHolder->m_pAltSnap;
+			if(ppKeys)
+				*ppKeys = pHolder->m_pKeys;
 			return pHolder->m_SnapSize;
 		}
 
@@ -608,6 +607,9 @@ int CSnapshotBuilder::Finish(void *pSnapData)
 	pSnap->m_NumItems = m_NumItems;
 	mem_copy(pSnap->Offsets(), m_aOffsets, pSnap->OffsetSize());
 	mem_copy(pSnap->DataStart(), m_aData, m_DataSize);
+
+	// the server keeps these next to the snapshot as the base for later deltas
+	pSnap->BuildSortedKeys(m_aSortedKeys);
 	return pSnap->TotalSize();
 }
 
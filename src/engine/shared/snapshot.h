@@ -59,6 +59,15 @@ public:
 	unsigned Crc();
 	void DebugDump();
 	bool IsValid(size_t ActualSize) const;
+
+	/*
+		Function: BuildSortedKeys
+			Fills pKeys with one (Key << 32) | Index entry per item, sorted
+			ascending, so equal keys are ordered by their item index.
+			pKeys needs room for NumItems() entries.
+	*/
+	void BuildSortedKeys(uint64_t *pKeys) const;
+	static int FindSortedKey(const uint64_t *pKeys, int NumKeys, int Key);
 };
 
 // CSnapshotDelta
@@ -95,7 +104,17 @@ public:
 	int GetDataUpdates(int Index) const { return m_aSnapshotDataUpdates[Index]; }
 	void SetStaticsize(int ItemType, int Size);
 	const CData *EmptyDelta() const;
-	int CreateDelta(class CSnapshot *pFrom, class CSnapshot *pTo, void *pDstData);
+
+	/*
+		Function: CreateDelta
+			Writes the delta from pFrom to pTo. The sorted keys of both
+			snapshots (see CSnapshot::BuildSortedKeys) are optional and
+			built on the stack if missing.
+
+		Returns:
+			The size of the delta, 0 if nothing changed.
+	*/
+	int CreateDelta(class CSnapshot *pFrom, class CSnapshot *pTo, void *pDstData, const uint64_t *pFromKeys = 0, const uint64_t *pToKeys = 0);
 	int UnpackDelta(class CSnapshot *pFrom, class CSnapshot *pTo, const void *pSrcData, int DataSize);
 };
 
@@ -118,6 +137,9 @@ public:
 
 		CSnapshot *m_pSnap;
 		CSnapshot *m_pAltSnap;
+
+		// sorted keys of m_pSnap, 0 if none were added
+		uint64_t *m_pKeys;
 	};
 
 	CHolder *m_pFirst;
@@ -128,8 +150,8 @@ public:
 	void Init();
 	void PurgeAll();
 	void PurgeUntil(int Tick);
-	void Add(int Tick, int64 Tagtime, int DataSize, void *pData, int AltDataSize, void *pAltData);
-	int Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapshot **ppAltData);
+	void Add(int Tick, int64 Tagtime, int DataSize, void *pData, int AltDataSize, void *pAltData, const uint64_t *pKeys = 0);
+	int Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapshot **ppAltData, const uint64_t **ppKeys = 0);
 };
 
 class CSnapshotBuilder
@@ -145,6 +167,8 @@ class CSnapshotBuilder
 	int m_aOffsets[CSnapshot::MAX_ITEMS];
 	int m_NumItems;
 
+	uint64_t m_aSortedKeys[CSnapshot::MAX_ITEMS];
+
 	int m_aExtendedItemTypes[MAX_EXTENDED_ITEM_TYPES];
 	int m_NumExtendedItemTypes;
 
@@ -163,6 +187,9 @@ public:
 	int *GetItemData(int Key);
 
 	int Finish(void *pSnapdata);
+
+	// sorted keys of the snapshot written by the last Finish
+	const uint64_t *SortedKeys() const { return m_aSortedKeys; }
 };
 
 #endif // ENGINE_SNAPSHOT_H
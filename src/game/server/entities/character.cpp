@@ -2,6 +2,7 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <new>
 #include <engine/shared/config.h>
+#include <engine/shared/profiler.h>
 #include <game/server/gamecontext.h>
 #include <game/mapitems.h>
 #include <game/server/gameworld.h>
@@ -945,6 +946,12 @@ void CCharacter::DoBotActions()
 	if(!m_Alive)
 		return;
 
+	// overloaded, keep the last input every other tick
+	if(Server()->OverloadLevel() >= IServer::OVERLOAD_BOTS && (Server()->Tick() + GetCID()) % 2)
+		return;
+
+	CProfileScope Scope(CProfiler::PHASE_BOT_AI, true);
+
 	CCharacter *pOldTarget = GameServer()->GetPlayerChar(m_Botinfo.m_Target);
 
 	// Refind target
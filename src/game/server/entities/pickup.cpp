@@ -4,6 +4,8 @@
 #include <game/server/gamecontext.h>
 #include "pickup.h"
 
+MACRO_ALLOC_SLAB_IMPL(CPickup, 256)
+
 CPickup::CPickup(CGameWorld *pGameWorld, vec2 Pos, vec2 Dir, const char *Name, int Num)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_PICKUP)
 {
@@ -14,6 +16,8 @@ CPickup::CPickup(CGameWorld *pGameWorld, vec2 Pos, vec2 Dir, const char *Name, i
 	m_Num = Num;
 	m_ProximityRadius = PickupPhysSize;
 	m_StartTick = Server()->Tick();
+	m_RestPos = Pos;
+	m_RestTicks = 0;
 
 	GameWorld()->InsertEntity(this);
 }
@@ -82,7 +86,7 @@ void CPickup::Tick()
 	}
 
 	// Check if a player intersected us
-	CCharacter *pChr = GameServer()->m_World.ClosestCharacter(m_Pos, 32.0f, 0);
+	CCharacter *pChr = GameServer()->m_World.ClosestCharacter(m_Pos, PickupRange, 0);
 	if(pChr && pChr->IsAlive() && pChr->GetPlayer() && !pChr->GetPlayer()->m_IsBot)
 	{
 		GameServer()->SendChatTarget_Locazition(pChr->GetCID(), "You got %d %s",
@@ -95,6 +99,16 @@ void CPickup::Tick()
 
 	if((Server()->Tick() - m_StartTick)/Server()->TickSpeed() >= 60)
 		GameServer()->m_World.DestroyEntity(this);
+
+	// a pickup on the floor only bounces in place, until a character
+	// comes close enough to take it there is nothing left to do
+	if(distance(m_Pos, m_RestPos) > PickupRestDistance)
+	{
+		m_RestPos = m_Pos;
+		m_RestTicks = 0;
+	}
+	else if(++m_RestTicks >= Server()->TickSpeed()/2 && !m_MarkedForDestroy)
+		GameWorld()->SleepEntity(this, PickupRange+PickupRestDistance);
 }
 
 void CPickup::TickPaused()
@@ -102,6 +116,13 @@ void CPickup::TickPaused()
 	m_StartTick++;
 }
 
+void CPickup::OnWake(int SleptTicks)
+{
+	// the time stood still, as when paused
+	m_StartTick += SleptTicks;
+	m_RestTicks = 0;
+}
+
 void CPickup::Snap(int SnappingClient)
 {
 	if(NetworkClipped(SnappingClient))
@@ -6,9 +6,13 @@
 #include <game/server/entity.h>
 
 const int PickupPhysSize = 16;
+const float PickupRange = 32.0f;
+const float PickupRestDistance = 2.0f;
 
 class CPickup : public CEntity
 {
+	MACRO_ALLOC_SLAB()
+
 public:
 	CPickup(CGameWorld *pGameWorld, vec2 Pos, vec2 Dir, const char *Name, int Num = 1);
 
@@ -16,6 +20,7 @@ public:
 
 	void Tick() override;
 	void TickPaused() override;
+	void OnWake(int SleptTicks) override;
 	void Snap(int SnappingClient) override;
 
 private:
@@ -24,6 +29,10 @@ private:
 	char m_aName[128];
 	int m_Num;
 	int m_StartTick;
+
+	// where it lies on the floor and for how many ticks
+	vec2 m_RestPos;
+	int m_RestTicks;
 };
 
 #endif
@@ -18,8 +18,11 @@ CEntity::CEntity(CGameWorld *pGameWorld, int ObjType)
 	m_MarkedForDestroy = false;
 	m_ID = Server()->SnapNewID();
 
-	m_pPrevTypeEntity = 0;
-	m_pNextTypeEntity = 0;
+	m_ListIndex = -1;
+
+	m_SleepIndex = -1;
+	m_SleepTick = 0;
+	m_WakeRadius = 0;
 }
 
 CEntity::~CEntity()
@@ -30,7 +33,11 @@ CEntity::~CEntity()
 
 int CEntity::NetworkClipped(int SnappingClient)
 {
-	return NetworkClipped(SnappingClient, m_Pos);
+	// the visibility pass of the world did the check already
+	if(GameWorld()->IsSnapPreClipped())
+		return 0;
+
+	return NetworkClipped(SnappingClient, GetSnapPos());
 }
 
 int CEntity::NetworkClipped(int SnappingClient, vec2 CheckPos)
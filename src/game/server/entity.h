@@ -5,6 +5,7 @@
 
 #include <new>
 #include <base/vmath.h>
+#include <game/server/entitypool.h>
 #include <game/server/gameworld.h>
 
 #define MACRO_ALLOC_HEAP() \
@@ -50,6 +51,24 @@
 		mem_zero(ms_PoolData##POOLTYPE[id], sizeof(POOLTYPE)); \
 	}
 
+#define MACRO_ALLOC_SLAB() \
+	public: \
+	void *operator new(size_t Size); \
+	void operator delete(void *p); \
+	private:
+
+#define MACRO_ALLOC_SLAB_IMPL(POOLTYPE, SlabSize) \
+	static CSlabPool ms_SlabPool##POOLTYPE(sizeof(POOLTYPE), SlabSize); \
+	void *POOLTYPE::operator new(size_t Size) \
+	{ \
+		dbg_assert(sizeof(POOLTYPE) == Size, "size error"); \
+		return ms_SlabPool##POOLTYPE.Alloc(); \
+	} \
+	void POOLTYPE::operator delete(void *p) \
+	{ \
+		ms_SlabPool##POOLTYPE.Free(p); \
+	}
+
 /*
 	Class: Entity
 		Basic entity class.
@@ -59,8 +78,13 @@ class CEntity
 	MACRO_ALLOC_HEAP()
 
 	friend class CGameWorld;	// entity list handling
-	CEntity *m_pPrevTypeEntity;
-	CEntity *m_pNextTypeEntity;
+	friend class CDenseList<CEntity>;
+	int m_ListIndex; // in the list of its type, -1 while not in the world
+
+	// place in the sleeping set of the world, -1 while awake
+	int m_SleepIndex;
+	int m_SleepTick;
+	float m_WakeRadius;
 
 	class CGameWorld *m_pGameWorld;
 protected:
@@ -76,8 +100,9 @@ public:
 	class IServer *Server() { return GameWorld()->Server(); }
 
 
-	CEntity *TypeNext() { return m_pNextTypeEntity; }
-	CEntity *TypePrev() { return m_pPrevTypeEntity; }
+	CEntity *TypeNext() { return GameWorld()->NextOfType(this); }
+
+	bool IsSleeping() const { return m_SleepIndex >= 0; }
 
 	/*
 		Function: destroy
@@ -111,6 +136,15 @@ public:
 	*/
 	virtual void TickPaused() {}
 
+	/*
+		Function: OnWake
+			Called when a sleeping entity is woken, before its next tick.
+
+		Arguments:
+			SleptTicks - Number of ticks the entity was not ticked.
+	*/
+	virtual void OnWake(int SleptTicks) {}
+
 	/*
 		Function: snap
 			Called when a new snapshot is being generated for a specific
@@ -124,6 +158,13 @@ public:
 	*/
 	virtual void Snap(int SnappingClient) {}
 
+	/*
+		Function: GetSnapPos
+			Returns the position the entity is clipped against when
+			snapping. Used once per snap by the visibility pass.
+	*/
+	virtual vec2 GetSnapPos() { return m_Pos; }
+
 	/*
 		Function: networkclipped(int snapping_client)
 			Performs a series of test to see if a client can see the
@@ -0,0 +1,50 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+
+#include "entitypool.h"
+
+CSlabPool::CSlabPool(int BlockSize, int SlabSize)
+{
+	// a free block has to hold the link to the next one
+	m_BlockSize = (BlockSize + (int)sizeof(void *) - 1) / (int)sizeof(void *) * (int)sizeof(void *);
+	m_SlabSize = SlabSize;
+	m_pFirstFree = 0;
+	m_NumUsed = 0;
+}
+
+CSlabPool::~CSlabPool()
+{
+	for(unsigned i = 0; i < m_vpSlabs.size(); i++)
+		mem_free(m_vpSlabs[i]);
+}
+
+void *CSlabPool::Alloc()
+{
+	if(!m_pFirstFree)
+	{
+		// link the blocks of a new slab so the first one is used first
+		char *pSlab = (char *)mem_alloc(m_BlockSize * m_SlabSize, sizeof(void *));
+		m_vpSlabs.push_back(pSlab);
+		for(int i = m_SlabSize - 1; i >= 0; i--)
+		{
+			*(void **)(pSlab + i * m_BlockSize) = m_pFirstFree;
+			m_pFirstFree = pSlab + i * m_BlockSize;
+		}
+	}
+
+	void *pBlock = m_pFirstFree;
+	m_pFirstFree = *(void **)pBlock;
+	mem_zero(pBlock, m_BlockSize);
+	m_NumUsed++;
+	return pBlock;
+}
+
+void CSlabPool::Free(void *pBlock)
+{
+	if(!pBlock)
+		return;
+	*(void **)pBlock = m_pFirstFree;
+	m_pFirstFree = pBlock;
+	m_NumUsed--;
+}
@@ -0,0 +1,123 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef GAME_SERVER_ENTITYPOOL_H
+#define GAME_SERVER_ENTITYPOOL_H
+
+#include <base/system.h>
+
+#include <vector>
+
+/*
+	Class: Slab pool
+		Hands out zeroed blocks of one size from slabs of SlabSize
+		blocks. Freed blocks are reused first. Slabs are never moved or
+		given back while the pool lives, so a block keeps its address
+		and the blocks of a type stay close to each other.
+*/
+class CSlabPool
+{
+	int m_BlockSize;
+	int m_SlabSize;
+	std::vector<char *> m_vpSlabs;
+	void *m_pFirstFree; // the free blocks are linked through their first bytes
+	int m_NumUsed;
+
+public:
+	CSlabPool(int BlockSize, int SlabSize);
+	~CSlabPool();
+
+	void *Alloc();
+	void Free(void *pBlock);
+
+	int NumUsed() const { return m_NumUsed; }
+	int NumSlabs() const { return (int)m_vpSlabs.size(); }
+};
+
+/*
+	Class: Dense list
+		Unordered array of pointers that is iterated by index. An item
+		keeps its place in m_ListIndex, removing it moves the last item
+		into the gap. While the list is traversed a removal only leaves
+		a hole, Get returns 0 there, and the holes are closed when the
+		outermost traversal ends. Items added during a traversal are
+		appended behind the size it started with.
+*/
+template<class T>
+class CDenseList
+{
+	// a plain array instead of a vector, so Get and the traversals
+	// stay cheap in unoptimized builds too
+	T **m_ppItems;
+	int m_Size;
+	int m_Capacity;
+	int m_NumHoles;
+	int m_Traversing;
+
+	void Compact()
+	{
+		// fill each hole from the back in one pass
+		int Size = m_Size;
+		for(int i = 0; i < Size; i++)
+		{
+			if(m_ppItems[i])
+				continue;
+			while(Size > i && !m_ppItems[Size-1])
+				Size--;
+			if(Size <= i)
+				break;
+			m_ppItems[i] = m_ppItems[--Size];
+			m_ppItems[i]->m_ListIndex = i;
+		}
+		m_Size = Size;
+		m_NumHoles = 0;
+	}
+
+public:
+	CDenseList() : m_ppItems(0), m_Size(0), m_Capacity(0), m_NumHoles(0), m_Traversing(0) {}
+	~CDenseList() { mem_free(m_ppItems); }
+
+	int Size() const { return m_Size; }
+	T *Get(int Index) const { return m_ppItems[Index]; }
+	int NumItems() const { return m_Size-m_NumHoles; }
+
+	void Add(T *pItem)
+	{
+		if(m_Size == m_Capacity)
+		{
+			m_Capacity = m_Capacity ? m_Capacity*2 : 64;
+			T **ppItems = (T **)mem_alloc(m_Capacity*sizeof(T *), 1);
+			if(m_Size)
+				mem_copy(ppItems, m_ppItems, m_Size*sizeof(T *));
+			mem_free(m_ppItems);
+			m_ppItems = ppItems;
+		}
+		pItem->m_ListIndex = m_Size;
+		m_ppItems[m_Size++] = pItem;
+	}
+
+	void Remove(T *pItem)
+	{
+		int Index = pItem->m_ListIndex;
+		pItem->m_ListIndex = -1;
+		if(m_Traversing)
+		{
+			m_ppItems[Index] = 0;
+			m_NumHoles++;
+			return;
+		}
+
+		if(Index == --m_Size)
+			return;
+		m_ppItems[Index] = m_ppItems[m_Size];
+		m_ppItems[Index]->m_ListIndex = Index;
+	}
+
+	void BeginTraverse() { m_Traversing++; }
+	void EndTraverse()
+	{
+		if(--m_Traversing == 0 && m_NumHoles)
+			Compact();
+	}
+};
+
+#endif
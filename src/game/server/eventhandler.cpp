@@ -1,5 +1,7 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <algorithm>
+
 #include "eventhandler.h"
 #include "gamecontext.h"
 
@@ -9,6 +11,9 @@
 CEventHandler::CEventHandler()
 {
 	m_pGameServer = 0;
+	m_aEvents.reserve(INIT_EVENTS);
+	m_aData.resize(INIT_DATASIZE);
+	m_NumDropped = 0;
 	Clear();
 }
 
@@ -19,45 +24,114 @@ void CEventHandler::SetGameServer(CGameContext *pGameServer)
 
 void *CEventHandler::Create(int Type, int Size)
 {
-	Create(Type, Size, CmaskAll());
+	return Create(Type, Size, CmaskAll());
 }
 
 void *CEventHandler::Create(int Type, int Size, std::bitset<MAX_CLIENTS> const& Mask)
 {
-	if(m_NumEvents == MAX_EVENTS)
-		return 0;
-	if(m_CurrentOffset+Size >= MAX_DATASIZE)
+	if((int)m_aEvents.size() >= MAX_EVENTS || m_CurrentOffset+Size > MAX_DATASIZE)
+	{
+		m_NumDropped++;
 		return 0;
+	}
+
+	// grow the arena, pointers handed out earlier are not kept by the callers
+	if(m_CurrentOffset+Size > (int)m_aData.size())
+		m_aData.resize(minimum((int)MAX_DATASIZE, maximum((int)m_aData.size()*2, m_CurrentOffset+Size)));
+
+	CEvent Event;
+	Event.m_Type = Type;
+	Event.m_Offset = m_CurrentOffset;
+	Event.m_Size = Size;
+	Event.m_Mask = Mask;
+	m_aEvents.push_back(Event);
 
 	void *p = &m_aData[m_CurrentOffset];
-	m_aOffsets[m_NumEvents] = m_CurrentOffset;
-	m_aTypes[m_NumEvents] = Type;
-	m_aSizes[m_NumEvents] = Size;
-	m_aClientMasks[m_NumEvents] = Mask;
+	mem_zero(p, Size);
 	m_CurrentOffset += Size;
-	m_NumEvents++;
+	m_Prepared = false;
 	return p;
 }
 
 void CEventHandler::Clear()
 {
-	m_NumEvents = 0;
+	m_aEvents.clear();
 	m_CurrentOffset = 0;
+	m_Prepared = false;
 }
 
-void CEventHandler::Snap(int SnappingClient)
+void CEventHandler::PrepareSnap()
 {
-	for(int i = 0; i < m_NumEvents; i++)
+	for(int i = 0; i < MAX_CLIENTS; i++)
+		m_aClientEvents[i].clear();
+
+	// bucket the events by position, the cells are as large as the view distance
+	m_aBuckets.clear();
+	for(int i = 0; i < (int)m_aEvents.size(); i++)
 	{
-		if(SnappingClient == -1 || CmaskIsSet(m_aClientMasks[i], SnappingClient))
-		{
-			CNetEvent_Common *ev = (CNetEvent_Common *)&m_aData[m_aOffsets[i]];
-			if(SnappingClient == -1 || distance(GameServer()->m_apPlayers[SnappingClient]->m_ViewPos, vec2(ev->m_X, ev->m_Y)) < 1500.0f)
+		const CNetEvent_Common *pEvent = (const CNetEvent_Common *)&m_aData[m_aEvents[i].m_Offset];
+		int CellX = (int)floorf(pEvent->m_X/(float)VIEW_DISTANCE);
+		int CellY = (int)floorf(pEvent->m_Y/(float)VIEW_DISTANCE);
+		m_aBuckets.push_back((CellKey(CellX, CellY)<<32) | (uint64_t)i);
+	}
+	std::sort(m_aBuckets.begin(), m_aBuckets.end());
+
+	// only clients that receive snapshots need a list
+	for(int c = 0; c < MAX_PLAYERS; c++)
+	{
+		if(!GameServer()->m_apPlayers[c] || !GameServer()->Server()->ClientIngame(c))
+			continue;
+
+		std::vector<int> &ClientEvents = m_aClientEvents[c];
+		vec2 ViewPos = GameServer()->m_apPlayers[c]->m_ViewPos;
+		int ViewCellX = (int)floorf(ViewPos.x/(float)VIEW_DISTANCE);
+		int ViewCellY = (int)floorf(ViewPos.y/(float)VIEW_DISTANCE);
+
+		for(int y = ViewCellY-1; y <= ViewCellY+1; y++)
+			for(int x = ViewCellX-1; x <= ViewCellX+1; x++)
 			{
-				void *d = GameServer()->Server()->SnapNewItem(m_aTypes[i], i, m_aSizes[i]);
-				if(d)
-					mem_copy(d, &m_aData[m_aOffsets[i]], m_aSizes[i]);
+				uint64_t Key = CellKey(x, y);
+				std::vector<uint64_t>::const_iterator It = std::lower_bound(m_aBuckets.begin(), m_aBuckets.end(), Key<<32);
+				for(; It != m_aBuckets.end() && (*It>>32) == Key; ++It)
+				{
+					int Index = (int)(*It&0xffffffff);
+					if(!CmaskIsSet(m_aEvents[Index].m_Mask, c))
+						continue;
+					const CNetEvent_Common *pEvent = (const CNetEvent_Common *)&m_aData[m_aEvents[Index].m_Offset];
+					if(distance(ViewPos, vec2(pEvent->m_X, pEvent->m_Y)) < (float)VIEW_DISTANCE)
+						ClientEvents.push_back(Index);
+				}
 			}
+
+		// keep the creation order, the snapshot delta likes stable item orders
+		std::sort(ClientEvents.begin(), ClientEvents.end());
+	}
+
+	m_Prepared = true;
+}
+
+void CEventHandler::Snap(int SnappingClient)
+{
+	if(SnappingClient == -1)
+	{
+		for(int i = 0; i < (int)m_aEvents.size(); i++)
+		{
+			void *d = GameServer()->Server()->SnapNewItem(m_aEvents[i].m_Type, i, m_aEvents[i].m_Size);
+			if(d)
+				mem_copy(d, &m_aData[m_aEvents[i].m_Offset], m_aEvents[i].m_Size);
 		}
+		return;
+	}
+
+	if(!m_Prepared)
+		PrepareSnap();
+
+	const std::vector<int> &ClientEvents = m_aClientEvents[SnappingClient];
+	for(int j = 0; j < (int)ClientEvents.size(); j++)
+	{
+		const CEvent &Event = m_aEvents[ClientEvents[j]];
+		void *d = GameServer()->Server()->SnapNewItem(Event.m_Type, ClientEvents[j], Event.m_Size);
+		if(d)
+			mem_copy(d, &m_aData[Event.m_Offset], Event.m_Size);
 	}
 }
@@ -13,25 +13,55 @@ typedef unsigned __int64 uint64_t;
 #endif
 
 #include <bitset>
+#include <vector>
 
 #include <engine/shared/protocol.h>
 
-//
+/*
+	Class: Event handler
+		Collects the events of a snap period. The event storage is an
+		arena that grows on demand and keeps its capacity between ticks.
+		Before the snapshots are built, the events are bucketed by
+		position once and every snapping client gets its own list of
+		visible event indices, so the per-client snap only copies.
+*/
 class CEventHandler
 {
-	static const int MAX_EVENTS = 128;
-	static const int MAX_DATASIZE = 128*64;
+	enum
+	{
+		// events are snapped with their index as id, which has to fit into 16 bits
+		MAX_EVENTS = 0x10000,
+		MAX_DATASIZE = MAX_EVENTS*64,
 
-	int m_aTypes[MAX_EVENTS]; // TODO: remove some of these arrays
-	int m_aOffsets[MAX_EVENTS];
-	int m_aSizes[MAX_EVENTS];
-	std::bitset<MAX_CLIENTS>  m_aClientMasks[MAX_EVENTS];
-	char m_aData[MAX_DATASIZE];
+		INIT_EVENTS = 128,
+		INIT_DATASIZE = INIT_EVENTS*64,
+
+		// also the edge length of the buckets used by the visibility pass
+		VIEW_DISTANCE = 1500,
+	};
+
+	struct CEvent
+	{
+		int m_Type;
+		int m_Offset;
+		int m_Size;
+		std::bitset<MAX_CLIENTS> m_Mask;
+	};
+
+	std::vector<CEvent> m_aEvents;
+	std::vector<char> m_aData;
+	std::vector<uint64_t> m_aBuckets; // (cell key << 32) | event index, sorted
+
+	std::vector<int> m_aClientEvents[MAX_CLIENTS];
+	bool m_Prepared;
 
 	class CGameContext *m_pGameServer;
 
 	int m_CurrentOffset;
-	int m_NumEvents;
+	int m_NumDropped;
+
+	static uint64_t CellKey(int CellX, int CellY) { return ((uint64_t)(CellY & 0xffff) << 16) | (uint64_t)(CellX & 0xffff); }
+
 public:
 	CGameContext *GameServer() const { return m_pGameServer; }
 	void SetGameServer(CGameContext *pGameServer);
@@ -40,7 +70,17 @@ public:
 	void *Create(int Type, int Size);
 	void *Create(int Type, int Size, std::bitset<MAX_CLIENTS> const& Mask);
 	void Clear();
+
+	/*
+		Function: PrepareSnap
+			Builds the per-client event lists for the upcoming snapshots.
+			Has to be called after all events of the snap period are created.
+	*/
+	void PrepareSnap();
 	void Snap(int SnappingClient);
+
+	int NumEvents() const { return (int)m_aEvents.size(); }
+	int NumDropped() const { return m_NumDropped; }
 };
 
 #endif
@@ -246,28 +246,52 @@ void CGameContext::SendMenuChat(int To, const char* pText)
 	else m_pMenu->AddMenuChat(To, pText);
 }
 
+int CGameContext::GroupPlayersByLanguage(int Start, int End, const char **ppLanguages, int *pGroups)
+{
+	int NumGroups = 0;
+	for(int i = Start; i < End; i++)
+	{
+		pGroups[i] = -1;
+		if(!m_apPlayers[i])
+			continue;
+
+		const char *pLanguage = m_apPlayers[i]->GetLanguage();
+		int Group = 0;
+		while(Group < NumGroups && str_comp(ppLanguages[Group], pLanguage) != 0)
+			Group++;
+		if(Group == NumGroups)
+			ppLanguages[NumGroups++] = pLanguage;
+		pGroups[i] = Group;
+	}
+	return NumGroups;
+}
+
 void CGameContext::SendMenuChat_Locazition(int To, const char* pText, ...)
 {
 	int Start = (To < 0 ? 0 : To);
 	int End = (To < 0 ? MAX_CLIENTS : To+1);
-	
-	CNetMsg_Sv_Chat Msg;
-	Msg.m_Team = 0;
-	Msg.m_ClientID = -1;
-	
+
+	if(To >= MAX_CLIENTS)
+		return;
+
+	const char *apLanguages[MAX_CLIENTS];
+	int aGroups[MAX_CLIENTS];
+	int NumGroups = GroupPlayersByLanguage(Start, End, apLanguages, aGroups);
+
 	dynamic_string Buffer;
 	
 	va_list VarArgs;
 	va_start(VarArgs, pText);
 	
-	for(int i = Start; i < End; i++)
+	for(int Group = 0; Group < NumGroups; Group++)
 	{
-		if(m_apPlayers[i])
+		Buffer.clear();
+		Server()->Localization()->Format_VL(Buffer, apLanguages[Group], pText, VarArgs);
+
+		for(int i = Start; i < End; i++)
 		{
-			Buffer.clear();
-			Server()->Localization()->Format_VL(Buffer, m_apPlayers[i]->GetLanguage(), pText, VarArgs);
-			
-			m_pMenu->AddMenuChat(i, Buffer.buffer());
+			if(aGroups[i] == Group)
+				m_pMenu->AddMenuChat(i, Buffer.buffer());
 		}
 	}
 	
@@ -301,28 +325,38 @@ void CGameContext::SendChatTarget(int To, const char* pText)
 void CGameContext::SendChatTarget_Locazition(int To, const char *pText, ...)
 {
 	int Start = (To < 0 ? 0 : To);
-	int End = (To < 0 ? MAX_CLIENTS : To+1);
+	int End = (To < 0 ? MAX_PLAYERS : To+1);
 
 	if(To >= MAX_CLIENTS)
 		return;
 	CNetMsg_Sv_Chat Msg;
 	Msg.m_Team = 0;
 	Msg.m_ClientID = -1;
+
+	const char *apLanguages[MAX_CLIENTS];
+	int aGroups[MAX_CLIENTS];
+	int NumGroups = GroupPlayersByLanguage(Start, End, apLanguages, aGroups);
 	
 	dynamic_string Buffer;
 	
 	va_list VarArgs;
 	va_start(VarArgs, pText);
 	
-	for(int i = Start; i < End; i++)
+	// format and pack once per language
+	for(int Group = 0; Group < NumGroups; Group++)
 	{
-		if(m_apPlayers[i])
+		Buffer.clear();
+		Server()->Localization()->Format_VL(Buffer, apLanguages[Group], pText, VarArgs);
+
+		Msg.m_pMessage = Buffer.buffer();
+		CMsgPacker Packer(Msg.MsgID());
+		if(Msg.Pack(&Packer))
+			continue;
+
+		for(int i = Start; i < End; i++)
 		{
-			Buffer.clear();
-			Server()->Localization()->Format_VL(Buffer, m_apPlayers[i]->GetLanguage(), pText, VarArgs);
-			
-			Msg.m_pMessage = Buffer.buffer();
-			Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, i);
+			if(aGroups[i] == Group)
+				Server()->SendMsg(&Packer, MSGFLAG_VITAL, i);
 		}
 	}
 	
@@ -392,10 +426,14 @@ void CGameContext::SendBroadcast_VL(const char *pText, int ClientID, ...)
 {
 	CNetMsg_Sv_Broadcast Msg;
 	int Start = (ClientID < 0 ? 0 : ClientID);
-	int End = (ClientID < 0 ? MAX_CLIENTS : ClientID+1);
+	int End = (ClientID < 0 ? MAX_PLAYERS : ClientID+1);
 
 	if(ClientID >= MAX_CLIENTS)
 		return;
+
+	const char *apLanguages[MAX_CLIENTS];
+	int aGroups[MAX_CLIENTS];
+	int NumGroups = GroupPlayersByLanguage(Start, End, apLanguages, aGroups);
 	
 	dynamic_string Buffer;
 	
@@ -410,16 +448,21 @@ void CGameContext::SendBroadcast_VL(const char *pText, int ClientID, ...)
 		Server()->SendPackMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NOSEND, -1);
 	}
 
-	for(int i = Start; i < End; i++)
+	// format and pack once per language
+	for(int Group = 0; Group < NumGroups; Group++)
 	{
-		if(m_apPlayers[i])
+		Buffer.clear();
+		Server()->Localization()->Format_VL(Buffer, apLanguages[Group], _(pText), VarArgs);
+
+		Msg.m_pMessage = Buffer.buffer();
+		CMsgPacker Packer(Msg.MsgID());
+		if(Msg.Pack(&Packer))
+			continue;
+
+		for(int i = Start; i < End; i++)
 		{
-			Buffer.clear();
-			Server()->Localization()->Format_VL(Buffer, m_apPlayers[i]->GetLanguage(), _(pText), VarArgs);
-			
-			Msg.m_pMessage = Buffer.buffer();
-			Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, i);
-			
+			if(aGroups[i] == Group)
+				Server()->SendMsg(&Packer, MSGFLAG_VITAL, i);
 		}
 	}
 	
@@ -635,6 +678,12 @@ void CGameContext::OnClientEnter(int ClientID)
 {
 	//world.insert_entity(&players[client_id]);
 	m_apPlayers[ClientID]->Respawn();
+	if(m_apPlayers[ClientID]->m_MapChanged)
+	{
+		// back from loading the new map, everyone knows this one already
+		m_apPlayers[ClientID]->m_MapChanged = false;
+		return;
+	}
 	char aBuf[512];
 	str_format(aBuf, sizeof(aBuf), "team_join player='%d:%s' team=%d", ClientID, Server()->ClientName(ClientID), m_apPlayers[ClientID]->GetTeam());
 	Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBuf);
@@ -654,7 +703,9 @@ void CGameContext::OnClientEnter(int ClientID)
 
 void CGameContext::OnClientConnected(int ClientID)
 {
-	m_apPlayers[ClientID] = new(ClientID) CPlayer(this, ClientID);
+	// players that were kept over a map change are still there
+	if(!m_apPlayers[ClientID])
+		m_apPlayers[ClientID] = new(ClientID) CPlayer(this, ClientID);
 	//players[client_id].init(client_id);
 	//players[client_id].client_id = client_id;
 
@@ -1483,6 +1534,25 @@ void CGameContext::ConMapRegenerate(IConsole::IResult *pResult, void *pUserData)
 	pSelf->SendChatTarget_Locazition(-1, "Map will regenerate!");
 }
 
+void CGameContext::ConSnapCounters(IConsole::IResult *pResult, void *pUserData)
+{
+	CGameContext *pSelf = (CGameContext *)pUserData;
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "entities=%d events=%d dropped_events=%d", pSelf->m_World.NumEntities(), pSelf->m_Events.NumEvents(), pSelf->m_Events.NumDropped());
+	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "snap", aBuf);
+	const CGameWorld::CTickCounters *pTick = pSelf->m_World.TickCounters();
+	str_format(aBuf, sizeof(aBuf), "awake=%d sleeping=%d woken=%d", pTick->m_Awake, pTick->m_Sleeping, pTick->m_Woken);
+	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "tick", aBuf);
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(!pSelf->m_apPlayers[i] || !pSelf->Server()->ClientIngame(i))
+			continue;
+		const CGameWorld::CSnapCounters *pCounters = pSelf->m_World.SnapCounters(i);
+		str_format(aBuf, sizeof(aBuf), "id=%d considered=%d emitted=%d", i, pCounters->m_Considered, pCounters->m_Emitted);
+		pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "snap", aBuf);
+	}
+}
+
 void CGameContext::ConchainSpecialMotdupdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
 {
 	pfnCallback(pResult, pCallbackUserData);
@@ -1781,6 +1851,7 @@ void CGameContext::OnConsoleInit()
 	Console()->Register("clear_votes", "", CFGFLAG_SERVER, ConClearVotes, this, "Clears the voting options");
 	Console()->Register("vote", "r", CFGFLAG_SERVER, ConVote, this, "Force a vote to yes/no");
 	Console()->Register("regenerate_map", "", CFGFLAG_SERVER, ConMapRegenerate, this, "regenerate map");
+	Console()->Register("snap_counters", "", CFGFLAG_SERVER, ConSnapCounters, this, "Show the entities considered and emitted per client in the last snap and the awake and sleeping ones of the last tick");
 	
 	Console()->Register("about", "", CFGFLAG_CHAT, ConAbout, this, "Show information about the mod");
 	Console()->Register("language", "?s", CFGFLAG_CHAT, ConLanguage, this, "change language");
@@ -1808,9 +1879,6 @@ void CGameContext::OnInit(/*class IKernel *pKernel*/)
 	for(int i = 0; i < NUM_NETOBJTYPES; i++)
 		Server()->SnapSetStaticsize(i, m_NetObjHandler.GetObjSize(i));
 
-	m_Layers.Init(Kernel());
-	m_Collision.Init(&m_Layers);
-
 	m_pPostgresql = new CPostgresql(this);
 	Postgresql()->Init();
 
@@ -1825,6 +1893,16 @@ void CGameContext::OnInit(/*class IKernel *pKernel*/)
 	//for(int i = 0; i < MAX_CLIENTS; i++)
 	//	game.players[i].core.world = &game.world.core;
 
+	InitWorld();
+
+	OnMenuOptionsInit();
+}
+
+void CGameContext::InitWorld()
+{
+	m_Layers.Init(Kernel());
+	m_Collision.Init(&m_Layers);
+
 	// create all entities from the game layer
 	CMapItemLayerTilemap *pTileMap = m_Layers.GameLayer();
 	m_pTiles = (CTile *)Kernel()->RequestInterface<IMap>()->GetData(pTileMap->m_Data);
@@ -1853,8 +1931,6 @@ void CGameContext::OnInit(/*class IKernel *pKernel*/)
 	}
 
 	m_pController->InitSpawnPos();
-
-	OnMenuOptionsInit();
 }
 
 void CGameContext::OnShutdown()
@@ -1864,6 +1940,24 @@ void CGameContext::OnShutdown()
 	Clear();
 }
 
+void CGameContext::OnMapChange()
+{
+	// the bots come back through the controller, the players keep
+	// everything but their character and reenter on the new map
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(!m_apPlayers[i])
+			continue;
+		m_apPlayers[i]->OnMapChange();
+		if(m_apPlayers[i]->m_IsBot)
+			OnBotDead(i);
+	}
+	m_World.DestroyAllEntities();
+	m_Events.Clear();
+
+	InitWorld();
+}
+
 void CGameContext::OnSnap(int ClientID)
 {
 	// add tuning to demo
@@ -1887,7 +1981,11 @@ void CGameContext::OnSnap(int ClientID)
 			m_apPlayers[i]->Snap(ClientID);
 	}
 }
-void CGameContext::OnPreSnap() {}
+void CGameContext::OnPreSnap()
+{
+	m_World.UpdateSnapVisibility();
+	m_Events.PrepareSnap();
+}
 void CGameContext::OnPostSnap()
 {
 	m_Events.Clear();
@@ -92,6 +92,7 @@ class CGameContext : public IGameServer
 	static void ConClearVotes(IConsole::IResult *pResult, void *pUserData);
 	static void ConVote(IConsole::IResult *pResult, void *pUserData);
 	static void ConMapRegenerate(IConsole::IResult *pResult, void *pUserData);
+	static void ConSnapCounters(IConsole::IResult *pResult, void *pUserData);
 
 	static void ConchainSpecialMotdupdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 
@@ -188,6 +189,9 @@ public:
 		CHAT_BLUE=1
 	};
 
+	// players that share a language get the same localized text
+	int GroupPlayersByLanguage(int Start, int End, const char **ppLanguages, int *pGroups);
+
 	void SendMenuChat(int To, const char *pText);
 	void SendMenuChat_Locazition(int To, const char *pText, ...);
 	// network
@@ -210,11 +214,14 @@ public:
 	void SendTuningParams(int ClientID);
 
 	void OnMenuOptionsInit();
+	// layers, collision, spawn points and entities of the loaded map
+	void InitWorld();
 
 	// engine events
 	void OnInit() override;
 	void OnConsoleInit() override;
 	void OnShutdown() override;
+	void OnMapChange() override;
 
 	void OnTick() override;
 	void OnPreSnap() override;
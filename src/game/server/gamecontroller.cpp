@@ -67,6 +67,9 @@ vec2 CGameController::GetSpawnPos()
 
 void CGameController::InitSpawnPos()
 {
+	// the spawn points of the previous map are gone
+	m_SpawnPoints.clear();
+
 	// create all entities from the game layer
 	CMapItemLayerTilemap *pTileMap = GameServer()->Layers()->GameLayer();
 	CTile *pTiles = GameServer()->m_pTiles;
@@ -600,7 +603,8 @@ void CGameController::CreatePickup(vec2 Pos, vec2 Dir, CBotData BotData)
 		{
 			int PickupNum = random_int(BotData.m_Drops[i].m_MinNum, BotData.m_Drops[i].m_MaxNum);
 			const char *pName = BotData.m_Drops[i].m_ItemName;
-			dbg_msg(pName, "%d:%d", i, PickupNum);
+			if(g_Config.m_Debug)
+				dbg_msg(pName, "%d:%d", i, PickupNum);
 			new CPickup(&GameServer()->m_World, Pos, Dir, pName, PickupNum);
 		}
 	}
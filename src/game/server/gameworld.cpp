@@ -8,6 +8,7 @@
 #include <algorithm>
 #include <utility>
 #include <engine/shared/config.h>
+#include <engine/shared/profiler.h>
 
 //////////////////////////////////////////////////
 // game world
@@ -19,16 +20,22 @@ CGameWorld::CGameWorld()
 
 	m_Paused = false;
 	m_ResetRequested = false;
-	for(int i = 0; i < NUM_ENTTYPES; i++)
-		m_apFirstEntityTypes[i] = 0;
+
+	m_SnapPreClipped = false;
+	InvalidateSnapVisibility();
+	mem_zero(m_aSnapCounters, sizeof(m_aSnapCounters));
+
+	m_MaxWakeRadius = 0;
+	m_SleepGridValid = false;
+	mem_zero(&m_TickCounters, sizeof(m_TickCounters));
 }
 
 CGameWorld::~CGameWorld()
 {
 	// delete all entities
 	for(int i = 0; i < NUM_ENTTYPES; i++)
-		while(m_apFirstEntityTypes[i])
-			delete m_apFirstEntityTypes[i];
+		while(m_aEntities[i].Size())
+			delete m_aEntities[i].Get(m_aEntities[i].Size()-1);
 }
 
 void CGameWorld::SetGameServer(CGameContext *pGameServer)
@@ -39,7 +46,39 @@ void CGameWorld::SetGameServer(CGameContext *pGameServer)
 
 CEntity *CGameWorld::FindFirst(int Type)
 {
-	return Type < 0 || Type >= NUM_ENTTYPES ? 0 : m_apFirstEntityTypes[Type];
+	if(Type < 0 || Type >= NUM_ENTTYPES)
+		return 0;
+
+	const CDenseList<CEntity> &List = m_aEntities[Type];
+	for(int i = 0; i < List.Size(); i++)
+		if(List.Get(i))
+			return List.Get(i);
+	return 0;
+}
+
+CEntity *CGameWorld::NextOfType(CEntity *pEnt)
+{
+	// removed while it was looked at
+	if(pEnt->m_ListIndex < 0)
+		return 0;
+
+	const CDenseList<CEntity> &List = m_aEntities[pEnt->m_ObjType];
+	for(int i = pEnt->m_ListIndex+1; i < List.Size(); i++)
+		if(List.Get(i))
+			return List.Get(i);
+	return 0;
+}
+
+void CGameWorld::BeginTraverse()
+{
+	for(int i = 0; i < NUM_ENTTYPES; i++)
+		m_aEntities[i].BeginTraverse();
+}
+
+void CGameWorld::EndTraverse()
+{
+	for(int i = 0; i < NUM_ENTTYPES; i++)
+		m_aEntities[i].EndTraverse();
 }
 
 int CGameWorld::FindEntities(vec2 Pos, float Radius, CEntity **ppEnts, int Max, int Type)
@@ -48,9 +87,11 @@ int CGameWorld::FindEntities(vec2 Pos, float Radius, CEntity **ppEnts, int Max,
 		return 0;
 
 	int Num = 0;
-	for(CEntity *pEnt = m_apFirstEntityTypes[Type];	pEnt; pEnt = pEnt->m_pNextTypeEntity)
+	const CDenseList<CEntity> &List = m_aEntities[Type];
+	for(int i = 0; i < List.Size(); i++)
 	{
-		if(distance(pEnt->m_Pos, Pos) < Radius+pEnt->m_ProximityRadius)
+		CEntity *pEnt = List.Get(i);
+		if(pEnt && distance(pEnt->m_Pos, Pos) < Radius+pEnt->m_ProximityRadius)
 		{
 			if(ppEnts)
 				ppEnts[Num] = pEnt;
@@ -65,17 +106,12 @@ int CGameWorld::FindEntities(vec2 Pos, float Radius, CEntity **ppEnts, int Max,
 
 void CGameWorld::InsertEntity(CEntity *pEnt)
 {
-#ifdef CONF_DEBUG
-	for(CEntity *pCur = m_apFirstEntityTypes[pEnt->m_ObjType]; pCur; pCur = pCur->m_pNextTypeEntity)
-		dbg_assert(pCur != pEnt, "err");
-#endif
+	dbg_assert(pEnt->m_ListIndex < 0, "entity is in the world already");
 
 	// insert it
-	if(m_apFirstEntityTypes[pEnt->m_ObjType])
-		m_apFirstEntityTypes[pEnt->m_ObjType]->m_pPrevTypeEntity = pEnt;
-	pEnt->m_pNextTypeEntity = m_apFirstEntityTypes[pEnt->m_ObjType];
-	pEnt->m_pPrevTypeEntity = 0x0;
-	m_apFirstEntityTypes[pEnt->m_ObjType] = pEnt;
+	m_aEntities[pEnt->m_ObjType].Add(pEnt);
+
+	InvalidateSnapVisibility();
 }
 
 void CGameWorld::DestroyEntity(CEntity *pEnt)
@@ -86,47 +122,233 @@ void CGameWorld::DestroyEntity(CEntity *pEnt)
 void CGameWorld::RemoveEntity(CEntity *pEnt)
 {
 	// not in the list
-	if(!pEnt->m_pNextTypeEntity && !pEnt->m_pPrevTypeEntity && m_apFirstEntityTypes[pEnt->m_ObjType] != pEnt)
+	if(pEnt->m_ListIndex < 0)
 		return;
 
-	// remove
-	if(pEnt->m_pPrevTypeEntity)
-		pEnt->m_pPrevTypeEntity->m_pNextTypeEntity = pEnt->m_pNextTypeEntity;
-	else
-		m_apFirstEntityTypes[pEnt->m_ObjType] = pEnt->m_pNextTypeEntity;
-	if(pEnt->m_pNextTypeEntity)
-		pEnt->m_pNextTypeEntity->m_pPrevTypeEntity = pEnt->m_pPrevTypeEntity;
+	// remove, a running traversal keeps a hole
+	m_aEntities[pEnt->m_ObjType].Remove(pEnt);
 
-	// keep list traversing valid
-	if(m_pNextTraverseEntity == pEnt)
-		m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
+	if(pEnt->IsSleeping())
+		UnlinkSleeping(pEnt);
 
-	pEnt->m_pNextTypeEntity = 0;
-	pEnt->m_pPrevTypeEntity = 0;
+	InvalidateSnapVisibility();
 }
 
-//
-void CGameWorld::Snap(int SnappingClient)
+void CGameWorld::InvalidateSnapVisibility()
+{
+	for(int i = 0; i < MAX_CLIENTS; i++)
+		m_aVisibilityValid[i] = false;
+}
+
+void CGameWorld::UpdateSnapVisibility()
 {
+	// bucket all entities by their snap position, the index keeps the
+	// traversal order of the type lists
+	m_apSnapEntities.clear();
+	m_aSnapPos.clear();
+	m_aGrid.clear();
 	for(int i = 0; i < NUM_ENTTYPES; i++)
-		for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
+		for(int j = 0; j < m_aEntities[i].Size(); j++)
 		{
-			m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
-			pEnt->Snap(SnappingClient);
-			pEnt = m_pNextTraverseEntity;
+			// the sleeping ones are in the sleep grid already
+			CEntity *pEnt = m_aEntities[i].Get(j);
+			if(!pEnt || pEnt->IsSleeping())
+				continue;
+
+			vec2 Pos = pEnt->GetSnapPos();
+			int CellX = (int)floorf(Pos.x/(float)GRID_CELL_SIZE);
+			int CellY = (int)floorf(Pos.y/(float)GRID_CELL_SIZE);
+			m_aGrid.push_back((GridKey(CellX, CellY)<<32) | (uint64_t)m_apSnapEntities.size());
+			m_apSnapEntities.push_back(pEnt);
+			m_aSnapPos.push_back(Pos);
 		}
+	std::sort(m_aGrid.begin(), m_aGrid.end());
+	UpdateSleepGrid();
+
+	for(int c = 0; c < MAX_CLIENTS; c++)
+	{
+		m_aVisibilityValid[c] = false;
+		m_aapVisibleEntities[c].clear();
+		m_aSnapCounters[c].m_Considered = 0;
+		m_aSnapCounters[c].m_Emitted = 0;
+
+		if(!GameServer()->m_apPlayers[c] || !Server()->ClientIngame(c))
+			continue;
+
+		// same test as CEntity::NetworkClipped
+		vec2 ViewPos = GameServer()->m_apPlayers[c]->m_ViewPos;
+		m_aVisible.clear();
+		m_aVisibleSleeping.clear();
+		m_aSnapCounters[c].m_Considered += QueryGrid(m_aGrid, m_aSnapPos, ViewPos, vec2(1000.0f, 800.0f), 1100.0f, &m_aVisible);
+		m_aSnapCounters[c].m_Considered += QueryGrid(m_aSleepGrid, m_aSleepPos, ViewPos, vec2(1000.0f, 800.0f), 1100.0f, &m_aVisibleSleeping);
+
+		// snap the awake ones in the same order as the full traversal
+		// would, the sleeping ones after them
+		std::sort(m_aVisible.begin(), m_aVisible.end());
+		for(unsigned i = 0; i < m_aVisible.size(); i++)
+			m_aapVisibleEntities[c].push_back(m_apSnapEntities[m_aVisible[i]]);
+		std::sort(m_aVisibleSleeping.begin(), m_aVisibleSleeping.end());
+		for(unsigned i = 0; i < m_aVisibleSleeping.size(); i++)
+			m_aapVisibleEntities[c].push_back(m_apSleepingEntities[m_aVisibleSleeping[i]]);
+
+		m_aSnapCounters[c].m_Emitted = (int)m_aapVisibleEntities[c].size();
+		m_aVisibilityValid[c] = true;
+	}
+}
+
+int CGameWorld::QueryGrid(const std::vector<uint64_t> &aGrid, const std::vector<vec2> &aPos, vec2 Center, vec2 Extent, float Radius, std::vector<int> *paIndices)
+{
+	int MinX = (int)floorf((Center.x-Extent.x)/(float)GRID_CELL_SIZE);
+	int MaxX = (int)floorf((Center.x+Extent.x)/(float)GRID_CELL_SIZE);
+	int MinY = (int)floorf((Center.y-Extent.y)/(float)GRID_CELL_SIZE);
+	int MaxY = (int)floorf((Center.y+Extent.y)/(float)GRID_CELL_SIZE);
+
+	int Considered = 0;
+	for(int y = MinY; y <= MaxY; y++)
+		for(int x = MinX; x <= MaxX; x++)
+		{
+			uint64_t Key = GridKey(x, y);
+			std::vector<uint64_t>::const_iterator It = std::lower_bound(aGrid.begin(), aGrid.end(), Key<<32);
+			for(; It != aGrid.end() && (*It>>32) == Key; ++It)
+			{
+				int Index = (int)(*It&0xffffffff);
+				vec2 Pos = aPos[Index];
+				Considered++;
+				if(absolute(Center.x-Pos.x) > Extent.x || absolute(Center.y-Pos.y) > Extent.y)
+					continue;
+				if(distance(Center, Pos) > Radius)
+					continue;
+				paIndices->push_back(Index);
+			}
+		}
+	return Considered;
+}
+
+void CGameWorld::SleepEntity(CEntity *pEnt, float WakeRadius)
+{
+	if(pEnt->IsSleeping())
+		return;
+
+	pEnt->m_SleepIndex = (int)m_apSleepingEntities.size();
+	pEnt->m_SleepTick = Server()->Tick();
+	pEnt->m_WakeRadius = WakeRadius;
+	m_apSleepingEntities.push_back(pEnt);
+	m_SleepGridValid = false;
+	InvalidateSnapVisibility();
+}
+
+void CGameWorld::UnlinkSleeping(CEntity *pEnt)
+{
+	// the last one takes the place
+	CEntity *pLast = m_apSleepingEntities.back();
+	m_apSleepingEntities[pEnt->m_SleepIndex] = pLast;
+	pLast->m_SleepIndex = pEnt->m_SleepIndex;
+	m_apSleepingEntities.pop_back();
+	pEnt->m_SleepIndex = -1;
+	m_SleepGridValid = false;
+	InvalidateSnapVisibility();
+}
+
+void CGameWorld::WakeEntity(CEntity *pEnt)
+{
+	if(!pEnt->IsSleeping())
+		return;
+
+	UnlinkSleeping(pEnt);
+
+	// ticks after the one it went to sleep in up to this one were skipped
+	pEnt->OnWake(Server()->Tick()-pEnt->m_SleepTick-1);
+}
+
+void CGameWorld::UpdateSleepGrid()
+{
+	if(m_SleepGridValid)
+		return;
+
+	m_aSleepPos.clear();
+	m_aSleepGrid.clear();
+	m_MaxWakeRadius = 0;
+	for(unsigned i = 0; i < m_apSleepingEntities.size(); i++)
+	{
+		CEntity *pEnt = m_apSleepingEntities[i];
+		vec2 Pos = pEnt->GetSnapPos();
+		int CellX = (int)floorf(Pos.x/(float)GRID_CELL_SIZE);
+		int CellY = (int)floorf(Pos.y/(float)GRID_CELL_SIZE);
+		m_aSleepGrid.push_back((GridKey(CellX, CellY)<<32) | (uint64_t)i);
+		m_aSleepPos.push_back(Pos);
+		m_MaxWakeRadius = maximum(m_MaxWakeRadius, pEnt->m_WakeRadius);
+	}
+	std::sort(m_aSleepGrid.begin(), m_aSleepGrid.end());
+	m_SleepGridValid = true;
+}
+
+void CGameWorld::WakeEntities()
+{
+	if(m_apSleepingEntities.empty())
+		return;
+
+	UpdateSleepGrid();
+
+	// the grid indices change while waking, so collect first
+	m_apWake.clear();
+	const CDenseList<CEntity> &Characters = m_aEntities[ENTTYPE_CHARACTER];
+	for(int c = 0; c < Characters.Size(); c++)
+	{
+		CEntity *pChr = Characters.Get(c);
+		if(!pChr)
+			continue;
+
+		float Reach = m_MaxWakeRadius+pChr->m_ProximityRadius;
+		m_aVisible.clear();
+		QueryGrid(m_aSleepGrid, m_aSleepPos, pChr->m_Pos, vec2(Reach, Reach), Reach, &m_aVisible);
+		for(unsigned i = 0; i < m_aVisible.size(); i++)
+		{
+			CEntity *pEnt = m_apSleepingEntities[m_aVisible[i]];
+			if(distance(pChr->m_Pos, m_aSleepPos[m_aVisible[i]]) < pEnt->m_WakeRadius+pChr->m_ProximityRadius)
+				m_apWake.push_back(pEnt);
+		}
+	}
+
+	for(unsigned i = 0; i < m_apWake.size(); i++)
+	{
+		if(!m_apWake[i]->IsSleeping())
+			continue;
+		WakeEntity(m_apWake[i]);
+		m_TickCounters.m_Woken++;
+	}
+}
+
+//
+void CGameWorld::Snap(int SnappingClient)
+{
+	if(SnappingClient >= 0 && m_aVisibilityValid[SnappingClient])
+	{
+		// entities don't insert or remove others while snapping
+		m_SnapPreClipped = true;
+		const std::vector<CEntity *> &Visible = m_aapVisibleEntities[SnappingClient];
+		for(unsigned i = 0; i < Visible.size(); i++)
+			Visible[i]->Snap(SnappingClient);
+		m_SnapPreClipped = false;
+		return;
+	}
+
+	BeginTraverse();
+	for(int i = 0; i < NUM_ENTTYPES; i++)
+		for(int j = 0, Num = m_aEntities[i].Size(); j < Num; j++)
+			if(CEntity *pEnt = m_aEntities[i].Get(j))
+				pEnt->Snap(SnappingClient);
+	EndTraverse();
 }
 
 void CGameWorld::Reset()
 {
 	// reset all entities
+	BeginTraverse();
 	for(int i = 0; i < NUM_ENTTYPES; i++)
-		for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
-		{
-			m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
-			pEnt->Reset();
-			pEnt = m_pNextTraverseEntity;
-		}
+		for(int j = 0, Num = m_aEntities[i].Size(); j < Num; j++)
+			if(CEntity *pEnt = m_aEntities[i].Get(j))
+				pEnt->Reset();
+	EndTraverse();
 	RemoveEntities();
 
 	GameServer()->m_pController->PostReset();
@@ -138,58 +360,92 @@ void CGameWorld::Reset()
 void CGameWorld::RemoveEntities()
 {
 	// destroy objects marked for destruction
+	BeginTraverse();
 	for(int i = 0; i < NUM_ENTTYPES; i++)
-		for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
+		for(int j = 0, Num = m_aEntities[i].Size(); j < Num; j++)
 		{
-			m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
-			if(pEnt->m_MarkedForDestroy)
+			CEntity *pEnt = m_aEntities[i].Get(j);
+			if(pEnt && pEnt->m_MarkedForDestroy)
 			{
 				RemoveEntity(pEnt);
 				pEnt->Destroy();
 			}
-			pEnt = m_pNextTraverseEntity;
 		}
+	EndTraverse();
+}
+
+void CGameWorld::DestroyAllEntities()
+{
+	for(int i = 0; i < NUM_ENTTYPES; i++)
+		for(int j = 0; j < m_aEntities[i].Size(); j++)
+			if(CEntity *pEnt = m_aEntities[i].Get(j))
+				pEnt->m_MarkedForDestroy = true;
+	RemoveEntities();
+	InvalidateSnapVisibility();
 }
 
 void CGameWorld::Tick()
 {
+	CProfileScope Scope(CProfiler::PHASE_WORLD_TICK);
+
 	if(m_ResetRequested)
 		Reset();
 
+	m_TickCounters.m_Awake = 0;
+	m_TickCounters.m_Woken = 0;
 	if(!m_Paused)
 	{
 		if(GameServer()->m_pController->IsForceBalanced())
 			GameServer()->SendChat(-1, CGameContext::CHAT_ALL, "Teams have been balanced");
-		// update all objects
+
+		// characters that came close to sleeping entities wake them
+		WakeEntities();
+
+		// update all objects, the ones spawned meanwhile wait for the next tick
+		BeginTraverse();
 		for(int i = 0; i < NUM_ENTTYPES; i++)
-			for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
+			for(int j = 0, Num = m_aEntities[i].Size(); j < Num; j++)
 			{
-				m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
-				pEnt->Tick();
-				pEnt = m_pNextTraverseEntity;
+				CEntity *pEnt = m_aEntities[i].Get(j);
+				if(pEnt && !pEnt->IsSleeping())
+				{
+					pEnt->Tick();
+					m_TickCounters.m_Awake++;
+				}
 			}
 
 		for(int i = 0; i < NUM_ENTTYPES; i++)
-			for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
+			for(int j = 0, Num = m_aEntities[i].Size(); j < Num; j++)
 			{
-				m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
-				pEnt->TickDefered();
-				pEnt = m_pNextTraverseEntity;
+				CEntity *pEnt = m_aEntities[i].Get(j);
+				if(pEnt && !pEnt->IsSleeping())
+					pEnt->TickDefered();
 			}
+		EndTraverse();
+
+		// the bots think in their character ticks, one sample for all of them
+		g_Profiler.FlushParts(CProfiler::PHASE_BOT_AI);
 	}
 	else
 	{
-		// update all objects
+		// update all objects, the sleeping ones catch up when they wake
+		BeginTraverse();
 		for(int i = 0; i < NUM_ENTTYPES; i++)
-			for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
+			for(int j = 0, Num = m_aEntities[i].Size(); j < Num; j++)
 			{
-				m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
-				pEnt->TickPaused();
-				pEnt = m_pNextTraverseEntity;
+				CEntity *pEnt = m_aEntities[i].Get(j);
+				if(pEnt && !pEnt->IsSleeping())
+				{
+					pEnt->TickPaused();
+					m_TickCounters.m_Awake++;
+				}
 			}
+		EndTraverse();
 	}
+	m_TickCounters.m_Sleeping = (int)m_apSleepingEntities.size();
 
 	RemoveEntities();
+	InvalidateSnapVisibility();
 
 	UpdatePlayerMaps();
 }
@@ -4,6 +4,9 @@
 #define GAME_SERVER_GAMEWORLD_H
 
 #include <game/gamecore.h>
+#include <game/server/entitypool.h>
+
+#include <vector>
 
 class CEntity;
 class CCharacter;
@@ -26,12 +29,65 @@ public:
 		NUM_ENTTYPES
 	};
 
+	enum
+	{
+		// edge length of the cells the visibility pass buckets the entities into
+		GRID_CELL_SIZE = 512,
+	};
+
+	struct CSnapCounters
+	{
+		int m_Considered;
+		int m_Emitted;
+	};
+
+	struct CTickCounters
+	{
+		int m_Awake;
+		int m_Sleeping;
+		int m_Woken;
+	};
+
 private:
 	void Reset();
 	void RemoveEntities();
-
-	CEntity *m_pNextTraverseEntity;
-	CEntity *m_apFirstEntityTypes[NUM_ENTTYPES];
+	void InvalidateSnapVisibility();
+
+	// dense per type, removals during a traversal are closed after it
+	CDenseList<CEntity> m_aEntities[NUM_ENTTYPES];
+	void BeginTraverse();
+	void EndTraverse();
+
+	// visibility pass
+	std::vector<CEntity *> m_apSnapEntities; // in traversal order
+	std::vector<vec2> m_aSnapPos;
+	std::vector<uint64_t> m_aGrid; // (cell key << 32) | traversal order, sorted
+	std::vector<int> m_aVisible;
+	std::vector<CEntity *> m_aapVisibleEntities[MAX_CLIENTS];
+	CSnapCounters m_aSnapCounters[MAX_CLIENTS];
+	bool m_aVisibilityValid[MAX_CLIENTS];
+	bool m_SnapPreClipped;
+
+	// sleeping entities, bucketed once whenever the set changes
+	std::vector<CEntity *> m_apSleepingEntities;
+	std::vector<vec2> m_aSleepPos;
+	std::vector<uint64_t> m_aSleepGrid;
+	std::vector<int> m_aVisibleSleeping;
+	std::vector<CEntity *> m_apWake;
+	float m_MaxWakeRadius;
+	bool m_SleepGridValid;
+	CTickCounters m_TickCounters;
+
+	void UnlinkSleeping(CEntity *pEnt);
+	void UpdateSleepGrid();
+	void WakeEntities();
+
+	static uint64_t GridKey(int CellX, int CellY) { return ((uint64_t)(CellY & 0xffff) << 16) | (uint64_t)(CellX & 0xffff); }
+
+	// adds the index of every position in aGrid that is within the
+	// rectangle Center +- Extent and within Radius of Center, returns
+	// the number of positions checked
+	static int QueryGrid(const std::vector<uint64_t> &aGrid, const std::vector<vec2> &aPos, vec2 Center, vec2 Extent, float Radius, std::vector<int> *paIndices);
 
 	class CGameContext *m_pGameServer;
 	class IServer *m_pServer;
@@ -52,6 +108,7 @@ public:
 	void SetGameServer(CGameContext *pGameServer);
 
 	CEntity *FindFirst(int Type);
+	CEntity *NextOfType(CEntity *pEnt);
 
 	/*
 		Function: find_entities
@@ -127,6 +184,34 @@ public:
 	*/
 	void DestroyEntity(CEntity *pEntity);
 
+	/*
+		Function: DestroyAllEntities
+			Destroys every entity in the world right away. The characters
+			have to be taken from their players before, they are owned
+			there.
+	*/
+	void DestroyAllEntities();
+
+	/*
+		Function: SleepEntity
+			Takes an entity that came to rest out of the tick. It is
+			still snapped and found in the type lists, and is woken
+			when a character gets within WakeRadius of it.
+
+		Arguments:
+			pEnt - Entity to put to sleep.
+			WakeRadius - Distance to the edge of a character that
+				wakes the entity.
+	*/
+	void SleepEntity(CEntity *pEnt, float WakeRadius);
+
+	/*
+		Function: WakeEntity
+			Puts a sleeping entity back into the tick and calls its
+			OnWake.
+	*/
+	void WakeEntity(CEntity *pEnt);
+
 	/*
 		Function: snap
 			Calls snap on all the entities in the world to create
@@ -138,6 +223,26 @@ public:
 	*/
 	void Snap(int SnappingClient);
 
+	/*
+		Function: UpdateSnapVisibility
+			Buckets all entities by their snap position and builds the
+			list of entities inside the view rectangle of every snapping
+			client. Snap then only visits the entities of that list.
+			Has to be called once per snapshot tick, before the first Snap.
+	*/
+	void UpdateSnapVisibility();
+
+	/*
+		Function: IsSnapPreClipped
+			Returns true while the entities are snapped from the list of
+			the visibility pass, i.e. they are known to be visible.
+	*/
+	bool IsSnapPreClipped() const { return m_SnapPreClipped; }
+
+	const CSnapCounters *SnapCounters(int ClientID) const { return &m_aSnapCounters[ClientID]; }
+	int NumEntities() const { return (int)(m_apSnapEntities.size()+m_apSleepingEntities.size()); }
+	const CTickCounters *TickCounters() const { return &m_TickCounters; }
+
 	/*
 		Function: tick
 			Calls tick on all the entities in the world to progress
@@ -2,6 +2,8 @@
 #include <game/server/gamecontext.h>
 #include "projectile.h"
 
+MACRO_ALLOC_SLAB_IMPL(CProjectile, 256)
+
 CProjectile::CProjectile(CGameWorld *pGameWorld, int Type, int Owner, vec2 Pos, vec2 Dir, int Span,
 		int Damage, bool Explosive, float Force, int SoundImpact, int Weapon, bool Freeze)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_PROJECTILE)
@@ -101,11 +103,15 @@ void CProjectile::FillInfo(CNetObj_Projectile *pProj)
 	pProj->m_Type = m_Type;
 }
 
-void CProjectile::Snap(int SnappingClient)
+vec2 CProjectile::GetSnapPos()
 {
 	float Ct = (Server()->Tick()-m_StartTick)/(float)Server()->TickSpeed();
+	return GetPos(Ct);
+}
 
-	if(NetworkClipped(SnappingClient, GetPos(Ct)))
+void CProjectile::Snap(int SnappingClient)
+{
+	if(NetworkClipped(SnappingClient))
 		return;
 
 	CNetObj_Projectile *pProj = static_cast<CNetObj_Projectile *>(Server()->SnapNewItem(NETOBJTYPE_PROJECTILE, m_ID, sizeof(CNetObj_Projectile)));
@@ -3,6 +3,8 @@
 
 class CProjectile : public CEntity
 {
+	MACRO_ALLOC_SLAB()
+
 public:
 	CProjectile(CGameWorld *pGameWorld, int Type, int Owner, vec2 Pos, vec2 Dir, int Span,
 		int Damage, bool Explosive, float Force, int SoundImpact, int Weapon, bool Freeze);
@@ -14,6 +16,7 @@ public:
 	void Tick() override;
 	void TickPaused() override;
 	void Snap(int SnappingClient) override;
+	vec2 GetSnapPos() override;
 
 private:
 	vec2 m_Direction;
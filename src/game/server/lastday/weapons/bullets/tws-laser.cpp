@@ -2,6 +2,8 @@
 #include <game/server/gamecontext.h>
 #include "tws-laser.h"
 
+MACRO_ALLOC_SLAB_IMPL(CTWSLaser, 256)
+
 CTWSLaser::CTWSLaser(CGameWorld *pGameWorld, vec2 Pos, vec2 Direction, float StartEnergy, int Owner, int Damage, int Weapon, bool Freeze)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_LASER)
 {
@@ -5,6 +5,8 @@
 
 class CTWSLaser : public CEntity
 {
+	MACRO_ALLOC_SLAB()
+
 public:
 	CTWSLaser(CGameWorld *pGameWorld, vec2 Pos, vec2 Direction, float StartEnergy, int Owner, int Damage, int Weapon, bool Freeze = false);
 
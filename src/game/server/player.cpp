@@ -47,6 +47,7 @@ CPlayer::CPlayer(CGameContext *pGameServer, int ClientID, bool Bot, CBotData *Bo
 	idMap[0] = ClientID;
 
 	m_UserID = 0;
+	m_MapChanged = false;
 }
 
 CPlayer::~CPlayer()
@@ -368,6 +369,21 @@ void CPlayer::KillCharacter(int Weapon)
 	}
 }
 
+void CPlayer::OnMapChange()
+{
+	if(m_pCharacter)
+	{
+		m_pCharacter->Destroy();
+		delete m_pCharacter;
+		m_pCharacter = 0;
+	}
+	m_Spawning = false;
+
+	// the client sends its start info again once it has the map
+	m_IsReady = false;
+	m_MapChanged = true;
+}
+
 void CPlayer::Respawn()
 {
 	if(m_Team != TEAM_SPECTATORS)
@@ -33,6 +33,8 @@ public:
 	void OnDisconnect(const char *pReason);
 
 	void KillCharacter(int Weapon = WEAPON_GAME);
+	// drops the character without a death, the client loads the new map
+	void OnMapChange();
 	CCharacter *GetCharacter();
 
 	const char* GetLanguage();
@@ -52,6 +54,8 @@ public:
 	int m_SpectatorID;
 
 	bool m_IsReady;
+	// kept over a map change, the next enter is a reenter
+	bool m_MapChanged;
 
 	//
 	int m_Vote;
@@ -0,0 +1,303 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+#include <base/vmath.h>
+
+#include <game/server/entitypool.h>
+
+/*
+	Runs a projectile storm through two entity worlds and measures the
+	ticks. The old world allocates every entity on the heap and keeps
+	them in a linked list with new ones in front, the new one takes
+	them from a slab pool and keeps them in a dense list. Both see the
+	same spawns, so they have to end with the same entities.
+
+	Usage: entity_bench [entities] [ticks]
+
+	Every projectile lives a random time of up to three seconds and is
+	replaced by a new one when it dies.
+*/
+
+static unsigned s_Seed = 1;
+
+static unsigned Random()
+{
+	s_Seed = s_Seed * 1103515245 + 12345;
+	return (s_Seed >> 16) & 0x7fff;
+}
+
+enum
+{
+	TICK_SPEED = 50,
+	MAX_LIFESPAN = TICK_SPEED * 3,
+	PAYLOAD_SIZE = 96, // roughly what a game entity carries besides its position
+};
+
+class CBenchEntity
+{
+public:
+	// heap world
+	CBenchEntity *m_pPrev;
+	CBenchEntity *m_pNext;
+	// slab world
+	int m_ListIndex;
+
+	bool m_MarkedForDestroy;
+	int m_StartTick;
+	int m_LifeSpan;
+	vec2 m_StartPos;
+	vec2 m_Direction;
+	vec2 m_Pos;
+	char m_aPayload[PAYLOAD_SIZE];
+
+	CBenchEntity(int Tick)
+	{
+		m_pPrev = 0;
+		m_pNext = 0;
+		m_ListIndex = -1;
+		m_MarkedForDestroy = false;
+		m_StartTick = Tick;
+		m_LifeSpan = 1 + Random() % MAX_LIFESPAN;
+		m_StartPos = vec2(Random() % 4000, Random() % 4000);
+		m_Direction = normalize(vec2((int)(Random() % 200) - 100, (int)(Random() % 200) - 100) + vec2(0.5f, 0.5f));
+		m_Pos = m_StartPos;
+	}
+	virtual ~CBenchEntity() {}
+
+	virtual void Tick(int Tick)
+	{
+		// what CalcPos does for a grenade
+		float Time = (Tick - m_StartTick) / (float)TICK_SPEED;
+		m_Pos.x = m_StartPos.x + m_Direction.x * 1000.0f * Time;
+		m_Pos.y = m_StartPos.y + m_Direction.y * 1000.0f * Time + 500.0f * Time * Time;
+		m_aPayload[Tick % PAYLOAD_SIZE]++;
+		if(Tick - m_StartTick >= m_LifeSpan)
+			m_MarkedForDestroy = true;
+	}
+};
+
+class CHeapEntity : public CBenchEntity
+{
+public:
+	CHeapEntity(int Tick) : CBenchEntity(Tick) {}
+
+	void *operator new(size_t Size)
+	{
+		void *p = mem_alloc(Size, 1);
+		mem_zero(p, Size);
+		return p;
+	}
+	void operator delete(void *pPtr) { mem_free(pPtr); }
+};
+
+class CSlabEntity : public CBenchEntity
+{
+public:
+	CSlabEntity(int Tick) : CBenchEntity(Tick) {}
+
+	void *operator new(size_t Size);
+	void operator delete(void *pPtr);
+};
+
+static CSlabPool s_SlabPool(sizeof(CSlabEntity), 256);
+
+void *CSlabEntity::operator new(size_t Size) { return s_SlabPool.Alloc(); }
+void CSlabEntity::operator delete(void *pPtr) { s_SlabPool.Free(pPtr); }
+
+class CHeapWorld
+{
+	CBenchEntity *m_pFirst;
+	CBenchEntity *m_pNextTraverse;
+	int m_Num;
+
+	void Remove(CBenchEntity *pEnt)
+	{
+		if(pEnt->m_pPrev)
+			pEnt->m_pPrev->m_pNext = pEnt->m_pNext;
+		else
+			m_pFirst = pEnt->m_pNext;
+		if(pEnt->m_pNext)
+			pEnt->m_pNext->m_pPrev = pEnt->m_pPrev;
+		if(m_pNextTraverse == pEnt)
+			m_pNextTraverse = pEnt->m_pNext;
+		m_Num--;
+	}
+
+public:
+	CHeapWorld() : m_pFirst(0), m_pNextTraverse(0), m_Num(0) {}
+	~CHeapWorld()
+	{
+		while(m_pFirst)
+		{
+			CBenchEntity *pEnt = m_pFirst;
+			Remove(pEnt);
+			delete pEnt;
+		}
+	}
+
+	int Num() const { return m_Num; }
+
+	void Spawn(int Tick)
+	{
+		CBenchEntity *pEnt = new CHeapEntity(Tick);
+		if(m_pFirst)
+			m_pFirst->m_pPrev = pEnt;
+		pEnt->m_pNext = m_pFirst;
+		m_pFirst = pEnt;
+		m_Num++;
+	}
+
+	void Tick(int Tick, double *pChecksum)
+	{
+		for(CBenchEntity *pEnt = m_pFirst; pEnt; )
+		{
+			m_pNextTraverse = pEnt->m_pNext;
+			pEnt->Tick(Tick);
+			pEnt = m_pNextTraverse;
+		}
+
+		for(CBenchEntity *pEnt = m_pFirst; pEnt; )
+		{
+			m_pNextTraverse = pEnt->m_pNext;
+			if(pEnt->m_MarkedForDestroy)
+			{
+				*pChecksum += pEnt->m_Pos.x + pEnt->m_Pos.y;
+				Remove(pEnt);
+				delete pEnt;
+			}
+			pEnt = m_pNextTraverse;
+		}
+	}
+};
+
+class CSlabWorld
+{
+	CDenseList<CBenchEntity> m_List;
+
+public:
+	~CSlabWorld()
+	{
+		while(m_List.Size())
+		{
+			CBenchEntity *pEnt = m_List.Get(m_List.Size() - 1);
+			m_List.Remove(pEnt);
+			delete pEnt;
+		}
+	}
+
+	int Num() const { return m_List.NumItems(); }
+
+	void Spawn(int Tick)
+	{
+		m_List.Add(new CSlabEntity(Tick));
+	}
+
+	void Tick(int Tick, double *pChecksum)
+	{
+		m_List.BeginTraverse();
+		for(int i = 0, Num = m_List.Size(); i < Num; i++)
+			if(CBenchEntity *pEnt = m_List.Get(i))
+				pEnt->Tick(Tick);
+
+		for(int i = 0, Num = m_List.Size(); i < Num; i++)
+		{
+			CBenchEntity *pEnt = m_List.Get(i);
+			if(pEnt && pEnt->m_MarkedForDestroy)
+			{
+				*pChecksum += pEnt->m_Pos.x + pEnt->m_Pos.y;
+				m_List.Remove(pEnt);
+				delete pEnt;
+			}
+		}
+		m_List.EndTraverse();
+	}
+};
+
+/*
+	Removing the last item outside a traversal has to leave it out of
+	the list. CCharacter::Die removes the character and its destructor
+	removes it again, the second call has to be a no-op like it is in
+	CGameWorld::RemoveEntity.
+*/
+static bool CheckRemoveLast()
+{
+	CDenseList<CBenchEntity> List;
+	CBenchEntity a(0), b(0), c(0);
+	List.Add(&a);
+	List.Add(&b);
+	List.Add(&c);
+	for(int i = 0; i < 2; i++)
+		if(c.m_ListIndex >= 0)
+			List.Remove(&c);
+
+	if(List.Size() != 2 || List.Get(0) != &a || List.Get(1) != &b || a.m_ListIndex != 0 || b.m_ListIndex != 1 || c.m_ListIndex != -1)
+	{
+		dbg_msg("entity", "removing the last item twice broke the list: size %d, indices %d %d %d",
+			List.Size(), a.m_ListIndex, b.m_ListIndex, c.m_ListIndex);
+		return false;
+	}
+
+	// the first item is filled from the back
+	List.Remove(&a);
+	if(List.Size() != 1 || List.Get(0) != &b || b.m_ListIndex != 0 || a.m_ListIndex != -1)
+	{
+		dbg_msg("entity", "removing the first item broke the list: size %d, index %d", List.Size(), b.m_ListIndex);
+		return false;
+	}
+	List.Remove(&b);
+	return List.Size() == 0;
+}
+
+template<class TWorld>
+static int64 Run(int NumEntities, int Ticks, int *pNumSpawned, double *pChecksum)
+{
+	s_Seed = 1;
+	TWorld World;
+	for(int i = 0; i < NumEntities; i++)
+		World.Spawn(0);
+
+	*pNumSpawned = NumEntities;
+	*pChecksum = 0.0;
+	int64 Start = time_get();
+	for(int t = 1; t <= Ticks; t++)
+	{
+		World.Tick(t, pChecksum);
+		// refill the storm
+		for(int i = World.Num(); i < NumEntities; i++)
+		{
+			World.Spawn(t);
+			(*pNumSpawned)++;
+		}
+	}
+	return time_get() - Start;
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+
+	int NumEntities = maximum(argc > 1 ? str_toint(argv[1]) : 2000, 1); // ignore_convention
+	int Ticks = maximum(argc > 2 ? str_toint(argv[2]) : 50000, 1); // ignore_convention
+
+	if(!CheckRemoveLast())
+		return 1;
+
+	int HeapSpawned, SlabSpawned;
+	double HeapChecksum, SlabChecksum;
+	int64 HeapTime = Run<CHeapWorld>(NumEntities, Ticks, &HeapSpawned, &HeapChecksum);
+	int64 SlabTime = Run<CSlabWorld>(NumEntities, Ticks, &SlabSpawned, &SlabChecksum);
+
+	// the removal order differs, so the sums only agree roughly
+	if(HeapSpawned != SlabSpawned || absolute(HeapChecksum - SlabChecksum) > absolute(HeapChecksum) * 0.000001)
+	{
+		dbg_msg("entity", "mismatch: heap spawned %d sum %f, slab spawned %d sum %f", HeapSpawned, HeapChecksum, SlabSpawned, SlabChecksum);
+		return 1;
+	}
+
+	double Freq = (double)time_freq();
+	dbg_msg("entity", "%d entities, %d ticks, %d spawned", NumEntities, Ticks, HeapSpawned);
+	dbg_msg("entity", "heap + linked list: %8.2f us/tick", HeapTime * 1000000.0 / Freq / Ticks);
+	dbg_msg("entity", "slab + dense list:  %8.2f us/tick, %d slabs", SlabTime * 1000000.0 / Freq / Ticks, s_SlabPool.NumSlabs());
+	return 0;
+}
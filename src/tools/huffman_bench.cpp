@@ -0,0 +1,166 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+
+#include <engine/shared/huffman.h>
+#include <engine/shared/network.h>
+
+/*
+	Checks the table driven huffman coder against the reference coder
+	and measures both in packets per second.
+
+	Usage: huffman_bench [rounds]
+
+	Every round compresses a random packet with both coders, then feeds
+	the compressed data, a truncated copy and a corrupted copy to both
+	decoders. Sizes, return values and output bytes have to match.
+*/
+
+static unsigned s_Seed = 1;
+
+static unsigned Random()
+{
+	s_Seed = s_Seed*1103515245+12345;
+	return (s_Seed>>16)&0x7fff;
+}
+
+// mostly zeros like snapshot deltas, small values, or plain noise
+static int RandomPacket(unsigned char *pData)
+{
+	int Size = Random()%(NET_MAX_PAYLOAD+1);
+	int Kind = Random()%3;
+	for(int i = 0; i < Size; i++)
+	{
+		if(Kind == 0)
+			pData[i] = Random()%4 ? 0 : Random();
+		else if(Kind == 1)
+			pData[i] = Random()%8;
+		else
+			pData[i] = Random();
+	}
+	return Size;
+}
+
+static CHuffman s_Fast;
+static CHuffman s_Reference;
+
+static bool CompareDecompress(const unsigned char *pData, int Size, int OutputSize)
+{
+	unsigned char aFast[NET_MAX_PAYLOAD*2];
+	unsigned char aReference[NET_MAX_PAYLOAD*2];
+	int FastSize = s_Fast.Decompress(pData, Size, aFast, OutputSize);
+	int ReferenceSize = s_Reference.Decompress(pData, Size, aReference, OutputSize);
+	return FastSize == ReferenceSize && (FastSize <= 0 || mem_comp(aFast, aReference, FastSize) == 0);
+}
+
+static bool Fuzz(int Rounds)
+{
+	unsigned char aPacket[NET_MAX_PAYLOAD];
+	unsigned char aFast[NET_MAX_PACKETSIZE*2];
+	unsigned char aReference[NET_MAX_PACKETSIZE*2];
+
+	for(int r = 0; r < Rounds; r++)
+	{
+		int Size = RandomPacket(aPacket);
+
+		// sometimes with a too small output buffer, both have to fail the same way
+		int OutputSize = Random()%4 ? (int)sizeof(aReference) : 1+Random()%NET_MAX_PACKETSIZE;
+		int FastSize = s_Fast.Compress(aPacket, Size, aFast, OutputSize);
+		int ReferenceSize = s_Reference.Compress(aPacket, Size, aReference, OutputSize);
+		if(FastSize != ReferenceSize || (FastSize > 0 && mem_comp(aFast, aReference, FastSize) != 0))
+		{
+			dbg_msg("huffman", "compress mismatch in round %d, size=%d fast=%d reference=%d", r, Size, FastSize, ReferenceSize);
+			return false;
+		}
+
+		int Compressed = s_Reference.Compress(aPacket, Size, aReference, sizeof(aReference));
+		if(Compressed < 0)
+			continue;
+
+		OutputSize = Random()%4 ? NET_MAX_PAYLOAD*2 : Random()%(NET_MAX_PAYLOAD+1);
+		bool Match = CompareDecompress(aReference, Compressed, OutputSize);
+
+		if(Match && Compressed > 0)
+			Match = CompareDecompress(aReference, Random()%Compressed, OutputSize);
+
+		if(Match && Compressed > 0)
+		{
+			for(int i = 0; i < 3; i++)
+				aReference[Random()%Compressed] ^= 1<<(Random()%8);
+			Match = CompareDecompress(aReference, Compressed, OutputSize);
+		}
+
+		if(!Match)
+		{
+			dbg_msg("huffman", "decompress mismatch in round %d, size=%d", r, Size);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void Benchmark(CHuffman *pHuffman, const char *pName)
+{
+	enum
+	{
+		NUM_PACKETS = 64,
+		NUM_ROUNDS = 2000,
+	};
+
+	static unsigned char s_aaPackets[NUM_PACKETS][NET_MAX_PAYLOAD];
+	static unsigned char s_aaCompressed[NUM_PACKETS][NET_MAX_PACKETSIZE*2];
+	int aSizes[NUM_PACKETS];
+	int aCompressedSizes[NUM_PACKETS];
+	unsigned char aBuffer[NET_MAX_PACKETSIZE*2];
+
+	s_Seed = 1;
+	for(int i = 0; i < NUM_PACKETS; i++)
+	{
+		aSizes[i] = RandomPacket(s_aaPackets[i]);
+		aCompressedSizes[i] = pHuffman->Compress(s_aaPackets[i], aSizes[i], s_aaCompressed[i], sizeof(s_aaCompressed[i]));
+	}
+
+	int Check = 0;
+	int64 Start = time_get();
+	for(int r = 0; r < NUM_ROUNDS; r++)
+		for(int i = 0; i < NUM_PACKETS; i++)
+			Check += pHuffman->Compress(s_aaPackets[i], aSizes[i], aBuffer, sizeof(aBuffer));
+	int64 CompressTime = time_get()-Start;
+
+	Start = time_get();
+	for(int r = 0; r < NUM_ROUNDS; r++)
+		for(int i = 0; i < NUM_PACKETS; i++)
+			Check += pHuffman->Decompress(s_aaCompressed[i], aCompressedSizes[i], aBuffer, sizeof(aBuffer));
+	int64 DecompressTime = time_get()-Start;
+
+	double NumPackets = (double)NUM_PACKETS*NUM_ROUNDS;
+	dbg_msg("huffman", "%-9s compress %9.0f packets/s, decompress %9.0f packets/s (check %d)", pName,
+		NumPackets/((double)CompressTime/time_freq()), NumPackets/((double)DecompressTime/time_freq()), Check);
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+
+	int Rounds = 200000;
+	if(argc > 1) // ignore_convention
+		Rounds = str_toint(argv[1]); // ignore_convention
+
+	s_Fast.Init();
+	s_Reference.Init();
+	s_Reference.SetFastPath(false);
+
+	if(!s_Fast.FastPath())
+	{
+		dbg_msg("huffman", "fast path not available for the default frequency table");
+		return 1;
+	}
+
+	if(!Fuzz(Rounds))
+		return 1;
+	dbg_msg("huffman", "%d rounds, fast and reference coder match", Rounds);
+
+	Benchmark(&s_Reference, "reference");
+	Benchmark(&s_Fast, "fast");
+	return 0;
+}
@@ -0,0 +1,452 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/config.h>
+#include <engine/message.h>
+#include <engine/shared/network.h>
+#include <engine/shared/packer.h>
+#include <engine/shared/protocol.h>
+
+#include <game/generated/protocol.h>
+#include <game/version.h>
+
+#include <algorithm>
+#include <vector>
+
+/*
+	Headless load generator. Connects a number of synthetic clients to a
+	server, walks them through the connect and map download handshake,
+	sends scripted input, acks snapshots and reports what it measured.
+
+	Usage: loadgen <address:port> [clients] [seconds]
+
+	All clients come from the same address, so the server usually needs
+	sv_max_clients_per_ip and sv_connlimit raised for the test.
+*/
+
+enum
+{
+	MAP_CHUNK_SIZE = 1024-128,
+	MAP_REQUEST_WINDOW = 8,
+	REPORT_INTERVAL = 5,
+};
+
+class CLoadClient
+{
+public:
+	enum
+	{
+		STATE_OFFLINE = 0,
+		STATE_CONNECTING,
+		STATE_LOADING,
+		STATE_READY,
+		STATE_ENTERING,
+		STATE_INGAME,
+	};
+
+	CNetClient m_Net;
+	int m_ID;
+	int m_State;
+
+	int m_MapChunks;
+	int m_MapRequested;
+	int m_MapReceived;
+
+	int m_AckTick;
+	int m_SnapTick;
+	unsigned m_SnapParts;
+	int m_SnapSize;
+	int64 m_LastSnapTime;
+	int64 m_LastInputTime;
+	int64 m_PingTime;
+	int64 m_LastPingTime;
+};
+
+class CLoadStats
+{
+public:
+	std::vector<int64> m_aSnapSizes;
+	std::vector<int64> m_aSnapIntervals; // microseconds
+	std::vector<int64> m_aPings; // microseconds
+	int64 m_BytesRecv;
+	int64 m_BytesSent;
+	int m_FirstTick;
+	int m_LastTick;
+	int64 m_FirstTickTime;
+	int64 m_LastTickTime;
+
+	void Reset()
+	{
+		m_aSnapSizes.clear();
+		m_aSnapIntervals.clear();
+		m_aPings.clear();
+		m_BytesRecv = 0;
+		m_BytesSent = 0;
+		m_FirstTick = -1;
+		m_LastTick = -1;
+		m_FirstTickTime = 0;
+		m_LastTickTime = 0;
+	}
+};
+
+static CLoadStats s_Stats;
+
+static int64 Percentile(std::vector<int64> &aValues, int Percent)
+{
+	if(aValues.empty())
+		return 0;
+	std::sort(aValues.begin(), aValues.end());
+	return aValues[minimum((int)aValues.size()-1, (int)aValues.size()*Percent/100)];
+}
+
+static void SendMsg(CLoadClient *pClient, CMsgPacker *pMsg, int Flags)
+{
+	CPacker Packer;
+	Packer.Reset();
+	Packer.AddInt((pMsg->m_MsgID<<1) | (pMsg->m_System ? 1 : 0));
+	Packer.AddRaw(pMsg->Data(), pMsg->Size());
+
+	CNetChunk Packet;
+	mem_zero(&Packet, sizeof(Packet));
+	Packet.m_ClientID = 0;
+	Packet.m_pData = Packer.Data();
+	Packet.m_DataSize = Packer.Size();
+	Packet.m_Flags = Flags;
+	pClient->m_Net.Send(&Packet);
+	s_Stats.m_BytesSent += Packet.m_DataSize;
+}
+
+static void RequestMapChunk(CLoadClient *pClient)
+{
+	CMsgPacker Msg(NETMSG_REQUEST_MAP_DATA, true);
+	Msg.AddInt(pClient->m_MapRequested++);
+	SendMsg(pClient, &Msg, NETSENDFLAG_VITAL|NETSENDFLAG_FLUSH);
+}
+
+static void SendReady(CLoadClient *pClient)
+{
+	CMsgPacker Msg(NETMSG_READY, true);
+	SendMsg(pClient, &Msg, NETSENDFLAG_VITAL|NETSENDFLAG_FLUSH);
+	pClient->m_State = CLoadClient::STATE_READY;
+}
+
+static void SendInput(CLoadClient *pClient, int64 Now)
+{
+	// walk back and forth, jump and shoot now and then, aim in a circle
+	int64 Seconds = Now/time_freq();
+	float Angle = (float)(Now%(time_freq()*2))/(float)(time_freq()*2)*2*pi;
+	CNetObj_PlayerInput Input;
+	mem_zero(&Input, sizeof(Input));
+	Input.m_Direction = (Seconds+pClient->m_ID)%4 < 2 ? -1 : 1;
+	Input.m_TargetX = (int)(cosf(Angle)*100.0f);
+	Input.m_TargetY = (int)(sinf(Angle)*100.0f);
+	Input.m_Jump = (Seconds+pClient->m_ID)%3 == 0;
+	Input.m_Fire = (int)((Now/(time_freq()/4))&0xff);
+	Input.m_WantedWeapon = 0;
+
+	CMsgPacker Msg(NETMSG_INPUT, true);
+	Msg.AddInt(pClient->m_AckTick);
+	Msg.AddInt(pClient->m_AckTick+4);
+	Msg.AddInt(sizeof(Input));
+	const int *pData = (const int *)&Input;
+	for(unsigned i = 0; i < sizeof(Input)/sizeof(int); i++)
+		Msg.AddInt(pData[i]);
+	SendMsg(pClient, &Msg, NETSENDFLAG_FLUSH);
+}
+
+static void OnSnapshot(CLoadClient *pClient, int Tick, int Size, int64 Now)
+{
+	pClient->m_AckTick = Tick;
+	s_Stats.m_aSnapSizes.push_back(Size);
+	if(pClient->m_LastSnapTime)
+		s_Stats.m_aSnapIntervals.push_back((Now-pClient->m_LastSnapTime)*1000000/time_freq());
+	pClient->m_LastSnapTime = Now;
+
+	if(s_Stats.m_FirstTick < 0)
+	{
+		s_Stats.m_FirstTick = Tick;
+		s_Stats.m_FirstTickTime = Now;
+	}
+	if(Tick > s_Stats.m_LastTick)
+	{
+		s_Stats.m_LastTick = Tick;
+		s_Stats.m_LastTickTime = Now;
+	}
+}
+
+static void ProcessChunk(CLoadClient *pClient, CNetChunk *pChunk, int64 Now)
+{
+	s_Stats.m_BytesRecv += pChunk->m_DataSize;
+
+	CUnpacker Unpacker;
+	Unpacker.Reset(pChunk->m_pData, pChunk->m_DataSize);
+	int Msg = Unpacker.GetInt();
+	int Sys = Msg&1;
+	Msg >>= 1;
+	if(Unpacker.Error())
+		return;
+
+	if(!Sys)
+	{
+		if(Msg == NETMSGTYPE_SV_READYTOENTER && pClient->m_State == CLoadClient::STATE_ENTERING)
+		{
+			CMsgPacker Packer(NETMSG_ENTERGAME, true);
+			SendMsg(pClient, &Packer, NETSENDFLAG_VITAL|NETSENDFLAG_FLUSH);
+			pClient->m_State = CLoadClient::STATE_INGAME;
+		}
+		return;
+	}
+
+	if(Msg == NETMSG_MAP_CHANGE)
+	{
+		Unpacker.GetString(CUnpacker::SANITIZE_CC);
+		Unpacker.GetInt(); // crc
+		int MapSize = Unpacker.GetInt();
+		if(Unpacker.Error())
+			return;
+
+		pClient->m_State = CLoadClient::STATE_LOADING;
+		pClient->m_MapChunks = (MapSize+MAP_CHUNK_SIZE-1)/MAP_CHUNK_SIZE;
+		pClient->m_MapRequested = 0;
+		pClient->m_MapReceived = 0;
+		if(pClient->m_MapChunks == 0)
+			SendReady(pClient);
+		while(pClient->m_MapRequested < minimum((int)MAP_REQUEST_WINDOW, pClient->m_MapChunks))
+			RequestMapChunk(pClient);
+	}
+	else if(Msg == NETMSG_MAP_DATA && pClient->m_State == CLoadClient::STATE_LOADING)
+	{
+		pClient->m_MapReceived++;
+		if(pClient->m_MapReceived >= pClient->m_MapChunks)
+			SendReady(pClient);
+		else if(pClient->m_MapRequested < pClient->m_MapChunks)
+			RequestMapChunk(pClient);
+	}
+	else if(Msg == NETMSG_CON_READY && pClient->m_State == CLoadClient::STATE_READY)
+	{
+		char aName[16];
+		str_format(aName, sizeof(aName), "loadgen%d", pClient->m_ID);
+		CNetMsg_Cl_StartInfo StartInfo;
+		StartInfo.m_pName = aName;
+		StartInfo.m_pClan = "";
+		StartInfo.m_Country = -1;
+		StartInfo.m_pSkin = "default";
+		StartInfo.m_UseCustomColor = 0;
+		StartInfo.m_ColorBody = 0;
+		StartInfo.m_ColorFeet = 0;
+		CMsgPacker Packer(StartInfo.MsgID());
+		StartInfo.Pack(&Packer);
+		SendMsg(pClient, &Packer, NETSENDFLAG_VITAL|NETSENDFLAG_FLUSH);
+		pClient->m_State = CLoadClient::STATE_ENTERING;
+	}
+	else if(Msg == NETMSG_SNAP || Msg == NETMSG_SNAPSINGLE || Msg == NETMSG_SNAPEMPTY)
+	{
+		int Tick = Unpacker.GetInt();
+		Unpacker.GetInt(); // delta tick
+		int NumParts = 1;
+		int Part = 0;
+		int PartSize = 0;
+		if(Msg == NETMSG_SNAP)
+		{
+			NumParts = Unpacker.GetInt();
+			Part = Unpacker.GetInt();
+		}
+		if(Msg != NETMSG_SNAPEMPTY)
+		{
+			Unpacker.GetInt(); // crc
+			PartSize = Unpacker.GetInt();
+		}
+		if(Unpacker.Error() || NumParts < 1 || NumParts > 32 || Part < 0 || Part >= NumParts)
+			return;
+
+		if(Tick != pClient->m_SnapTick)
+		{
+			pClient->m_SnapTick = Tick;
+			pClient->m_SnapParts = 0;
+			pClient->m_SnapSize = 0;
+		}
+		pClient->m_SnapParts |= 1u<<Part;
+		pClient->m_SnapSize += PartSize;
+
+		// only ack complete snapshots
+		if(pClient->m_SnapParts == (NumParts == 32 ? ~0u : (1u<<NumParts)-1))
+			OnSnapshot(pClient, Tick, pClient->m_SnapSize, Now);
+	}
+	else if(Msg == NETMSG_PING_REPLY && pClient->m_PingTime)
+	{
+		s_Stats.m_aPings.push_back((Now-pClient->m_PingTime)*1000000/time_freq());
+		pClient->m_PingTime = 0;
+	}
+}
+
+static void Report(CLoadClient *pClients, int NumClients, int64 Elapsed)
+{
+	int aNumStates[CLoadClient::STATE_INGAME+1] = {0};
+	for(int i = 0; i < NumClients; i++)
+		aNumStates[pClients[i].m_State]++;
+
+	float Seconds = maximum(Elapsed/(float)time_freq(), 0.001f);
+	float TickRate = 0.0f;
+	if(s_Stats.m_LastTickTime > s_Stats.m_FirstTickTime)
+		TickRate = (s_Stats.m_LastTick-s_Stats.m_FirstTick)/((s_Stats.m_LastTickTime-s_Stats.m_FirstTickTime)/(float)time_freq());
+
+	dbg_msg("loadgen", "clients: %d ingame, %d loading, %d connecting, %d offline",
+		aNumStates[CLoadClient::STATE_INGAME], aNumStates[CLoadClient::STATE_LOADING]+aNumStates[CLoadClient::STATE_READY]+aNumStates[CLoadClient::STATE_ENTERING],
+		aNumStates[CLoadClient::STATE_CONNECTING], aNumStates[CLoadClient::STATE_OFFLINE]);
+	dbg_msg("loadgen", "server ticks: %.1f/s", TickRate);
+	dbg_msg("loadgen", "snapshots: %d, size p50=%d p99=%d max=%d bytes", (int)s_Stats.m_aSnapSizes.size(),
+		(int)Percentile(s_Stats.m_aSnapSizes, 50), (int)Percentile(s_Stats.m_aSnapSizes, 99), (int)Percentile(s_Stats.m_aSnapSizes, 100));
+	dbg_msg("loadgen", "snapshot interval p50=%.2f p99=%.2f max=%.2f ms",
+		Percentile(s_Stats.m_aSnapIntervals, 50)/1000.0f, Percentile(s_Stats.m_aSnapIntervals, 99)/1000.0f, Percentile(s_Stats.m_aSnapIntervals, 100)/1000.0f);
+	dbg_msg("loadgen", "bandwidth: recv %.1f kB/s, sent %.1f kB/s (payload)", s_Stats.m_BytesRecv/1024.0f/Seconds, s_Stats.m_BytesSent/1024.0f/Seconds);
+	dbg_msg("loadgen", "latency: %d pings, p50=%.2f p99=%.2f max=%.2f ms", (int)s_Stats.m_aPings.size(),
+		Percentile(s_Stats.m_aPings, 50)/1000.0f, Percentile(s_Stats.m_aPings, 99)/1000.0f, Percentile(s_Stats.m_aPings, 100)/1000.0f);
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+	if(argc < 2) // ignore_convention
+	{
+		dbg_msg("usage", "%s <address:port> [clients] [seconds]", argv[0]); // ignore_convention
+		return -1;
+	}
+
+	if(secure_random_init() != 0)
+	{
+		dbg_msg("secure", "could not initialize secure RNG");
+		return -1;
+	}
+	net_init();
+	CNetBase::Init();
+
+	// the network code reads a few settings
+	IConfig *pConfig = CreateConfig();
+	pConfig->Reset();
+
+	NETADDR ServerAddr;
+	if(net_host_lookup(argv[1], &ServerAddr, NETTYPE_ALL) != 0) // ignore_convention
+	{
+		dbg_msg("loadgen", "could not resolve '%s'", argv[1]); // ignore_convention
+		return -1;
+	}
+	if(!ServerAddr.port)
+		ServerAddr.port = 8303;
+
+	int NumClients = clamp(argc > 2 ? str_toint(argv[2]) : 16, 1, (int)MAX_CLIENTS); // ignore_convention
+	int Duration = maximum(argc > 3 ? str_toint(argv[3]) : 30, 1); // ignore_convention
+
+	CLoadClient *pClients = new CLoadClient[NumClients];
+	for(int i = 0; i < NumClients; i++)
+	{
+		NETADDR BindAddr;
+		mem_zero(&BindAddr, sizeof(BindAddr));
+		BindAddr.type = ServerAddr.type;
+		if(!pClients[i].m_Net.Open(BindAddr))
+		{
+			dbg_msg("loadgen", "could not open socket for client %d", i);
+			return -1;
+		}
+		pClients[i].m_ID = i;
+		pClients[i].m_State = CLoadClient::STATE_OFFLINE;
+		pClients[i].m_AckTick = -1;
+		pClients[i].m_SnapTick = -1;
+		pClients[i].m_SnapParts = 0;
+		pClients[i].m_SnapSize = 0;
+		pClients[i].m_LastSnapTime = 0;
+		pClients[i].m_LastInputTime = 0;
+		pClients[i].m_PingTime = 0;
+		pClients[i].m_LastPingTime = 0;
+	}
+
+	dbg_msg("loadgen", "connecting %d clients for %d seconds", NumClients, Duration);
+	s_Stats.Reset();
+
+	int64 StartTime = time_get();
+	int64 ReportTime = StartTime;
+	int64 ConnectTime = 0;
+	int NumConnecting = 0;
+	while(time_get() < StartTime+time_freq()*Duration)
+	{
+		int64 Now = time_get();
+
+		// stagger the connects a little
+		if(NumConnecting < NumClients && Now >= ConnectTime+time_freq()/50)
+		{
+			pClients[NumConnecting].m_Net.Connect(&ServerAddr, 1);
+			pClients[NumConnecting].m_State = CLoadClient::STATE_CONNECTING;
+			NumConnecting++;
+			ConnectTime = Now;
+		}
+
+		for(int i = 0; i < NumClients; i++)
+		{
+			CLoadClient *pClient = &pClients[i];
+			if(pClient->m_State == CLoadClient::STATE_OFFLINE)
+				continue;
+
+			pClient->m_Net.Update();
+			if(pClient->m_Net.State() == NETSTATE_OFFLINE)
+			{
+				dbg_msg("loadgen", "client %d lost the connection: %s", i, pClient->m_Net.ErrorString());
+				pClient->m_State = CLoadClient::STATE_OFFLINE;
+				continue;
+			}
+
+			if(pClient->m_State == CLoadClient::STATE_CONNECTING && pClient->m_Net.State() == NETSTATE_ONLINE)
+			{
+				CMsgPacker Msg(NETMSG_INFO, true);
+				Msg.AddString(GAME_NETVERSION, 128);
+				Msg.AddString("", 128); // password
+				SendMsg(pClient, &Msg, NETSENDFLAG_VITAL|NETSENDFLAG_FLUSH);
+				pClient->m_State = CLoadClient::STATE_LOADING;
+			}
+
+			CNetChunk Chunk;
+			while(pClient->m_Net.Recv(&Chunk))
+				ProcessChunk(pClient, &Chunk, Now);
+
+			if(pClient->m_State != CLoadClient::STATE_INGAME)
+				continue;
+
+			// input at the client tick rate
+			if(Now >= pClient->m_LastInputTime+time_freq()/SERVER_TICK_SPEED)
+			{
+				SendInput(pClient, Now);
+				pClient->m_LastInputTime = Now;
+			}
+
+			// measure the round trip once a second
+			if(!pClient->m_PingTime && Now >= pClient->m_LastPingTime+time_freq())
+			{
+				CMsgPacker Msg(NETMSG_PING, true);
+				SendMsg(pClient, &Msg, NETSENDFLAG_FLUSH);
+				pClient->m_PingTime = Now;
+				pClient->m_LastPingTime = Now;
+			}
+		}
+
+		if(Now >= ReportTime+time_freq()*REPORT_INTERVAL)
+		{
+			Report(pClients, NumClients, Now-StartTime);
+			ReportTime = Now;
+		}
+
+		thread_sleep(1);
+	}
+
+	dbg_msg("loadgen", "done, totals:");
+	Report(pClients, NumClients, time_get()-StartTime);
+
+	for(int i = 0; i < NumClients; i++)
+	{
+		pClients[i].m_Net.Disconnect("loadgen done");
+		pClients[i].m_Net.Update();
+		pClients[i].m_Net.Close();
+	}
+	delete[] pClients;
+	delete pConfig;
+	return 0;
+}
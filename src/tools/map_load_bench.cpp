@@ -0,0 +1,113 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+
+#include <engine/shared/datafile.h>
+#include <engine/storage.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+/*
+	Loads a map like the server does, once with a plain read and once
+	mapped, and reports the load time and the peak memory of each.
+
+	Usage: map_load_bench <map> [read|map]
+
+	Without a mode both are run, each in its own process so that the
+	peak memory of one does not hide the other. The server load is the
+	item tables, all data blocks and a buffer of the whole file for
+	downloads, which the mapped reader gets from the mapping.
+*/
+
+// peak resident set in KiB, 0 where it is not known
+static int PeakMemory()
+{
+#if defined(CONF_PLATFORM_LINUX)
+	FILE *pFile = fopen("/proc/self/status", "r");
+	if(!pFile)
+		return 0;
+	char aLine[256];
+	int Peak = 0;
+	while(fgets(aLine, sizeof(aLine), pFile))
+		if(str_comp_num(aLine, "VmHWM:", 6) == 0)
+			Peak = str_toint(aLine + 6);
+	fclose(pFile);
+	return Peak;
+#else
+	return 0;
+#endif
+}
+
+static bool Load(IStorage *pStorage, const char *pMap, bool MapFile)
+{
+	int PeakBefore = PeakMemory();
+	int64 Start = time_get();
+
+	CDataFileReader Reader;
+	if(!Reader.Open(pStorage, pMap, IStorage::TYPE_ALL, MapFile))
+		return false;
+
+	int Check = 0;
+	for(int i = 0; i < Reader.NumData(); i++)
+	{
+		const unsigned char *pData = (const unsigned char *)Reader.GetData(i);
+		int Size = Reader.GetDataSize(i);
+		for(int k = 0; pData && k < Size; k += 4096)
+			Check += pData[k];
+	}
+	for(int i = 0; i < Reader.NumItems(); i++)
+		Check += Reader.GetItemSize(i);
+
+	// the download buffer
+	const unsigned char *pFile = Reader.MappedFile();
+	unsigned char *pBuffer = 0;
+	if(!pFile)
+	{
+		IOHANDLE File = pStorage->OpenFile(pMap, IOFLAG_READ, IStorage::TYPE_ALL);
+		int Size = (int)io_length(File);
+		pBuffer = (unsigned char *)mem_alloc(Size, 1);
+		io_read(File, pBuffer, Size);
+		io_close(File);
+		pFile = pBuffer;
+	}
+	Check += pFile[0];
+
+	int64 LoadTime = time_get() - Start;
+	dbg_msg("map_load", "%-4s load %8.2f ms, peak memory +%d KiB (check %d, sha256 of %d bytes)", MapFile ? "map" : "read",
+		LoadTime * 1000.0 / time_freq(), PeakMemory() - PeakBefore, Check, Reader.MapSize());
+
+	if(pBuffer)
+		mem_free(pBuffer);
+	return true;
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+	if(argc < 2) // ignore_convention
+	{
+		dbg_msg("usage", "%s <map> [read|map]", argv[0]); // ignore_convention
+		return -1;
+	}
+
+	IStorage *pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_BASIC, argc, argv); // ignore_convention
+	if(!pStorage)
+		return -1;
+
+	const char *pMap = argv[1]; // ignore_convention
+	if(argc > 2) // ignore_convention
+		return Load(pStorage, pMap, str_comp(argv[2], "map") == 0) ? 0 : -1; // ignore_convention
+
+	for(const char *pMode : {"read", "map"})
+	{
+		char aCmd[1024];
+		str_format(aCmd, sizeof(aCmd), "\"%s\" \"%s\" %s", argv[0], pMap, pMode); // ignore_convention
+		if(system(aCmd) != 0)
+		{
+			dbg_msg("map_load", "loading '%s' failed", pMap);
+			return -1;
+		}
+	}
+	return 0;
+}
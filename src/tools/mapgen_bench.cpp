@@ -0,0 +1,141 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/server/mapgen.h>
+
+#include <vector>
+
+/*
+	Checks CMapGen::PlaceDoodads against a plain scan that tests every
+	tile of every stamp at every position, and measures both.
+
+	Usage: mapgen_bench [width] [height] [rounds]
+
+	The game layer is random platforms and blocks in air, the stamps
+	are the jungle bush and a few made up sizes.
+*/
+
+static unsigned s_Seed = 1;
+
+static unsigned Random()
+{
+	s_Seed = s_Seed * 1103515245 + 12345;
+	return (s_Seed >> 16) & 0x7fff;
+}
+
+static void GenerateGameTiles(CTile *pTiles, int Width, int Height)
+{
+	mem_zero(pTiles, sizeof(CTile) * Width * Height);
+	int NumPlatforms = Width * Height / 200;
+	for(int i = 0; i < NumPlatforms; i++)
+	{
+		int x = Random() * 32768 % Width;
+		int y = Random() * 32768 % Height;
+		int Length = 4 + Random() % 40;
+		int Thickness = 1 + Random() % 3;
+		for(int yy = y; yy < minimum(y + Thickness, Height); yy++)
+			for(int xx = x; xx < minimum(x + Length, Width); xx++)
+				pTiles[yy * Width + xx].m_Index = TILE_SOLID;
+	}
+}
+
+static bool Fits(const CTile *pGameTiles, const CTile *pDoodadsTiles, int Width, int x, int y, const CMapGen::CDoodadStamp *pStamp)
+{
+	for(int j = 0; j < pStamp->m_Height; j++)
+		for(int i = 0; i < pStamp->m_Width; i++)
+			if(pDoodadsTiles[(y + 1 + j) * Width + x + i].m_Index != 0)
+				return false;
+	for(int i = 0; i < pStamp->m_Width; i++)
+		if(pGameTiles[(y + 1) * Width + x + i].m_Index != TILE_AIR ||
+			pGameTiles[(y + pStamp->m_Height + 1) * Width + x + i].m_Index == TILE_AIR)
+			return false;
+	return true;
+}
+
+static void PlaceDoodadsScan(const CTile *pGameTiles, CTile *pDoodadsTiles, int Width, int Height, const CMapGen::CDoodadStamp *pStamps, int NumStamps)
+{
+	for(int y = 0; y < Height; y++)
+	{
+		for(int x = 0; x < Width; x++)
+		{
+			for(int s = 0; s < NumStamps; s++)
+			{
+				const CMapGen::CDoodadStamp *pStamp = &pStamps[s];
+				if(y >= Height - pStamp->m_Height - 1 || x >= Width - pStamp->m_Width)
+					continue;
+				if(!Fits(pGameTiles, pDoodadsTiles, Width, x, y, pStamp))
+					continue;
+				for(int i = 0; i < pStamp->m_Width; i++)
+					for(int j = 0; j < pStamp->m_Height; j++)
+						pDoodadsTiles[(y + 1 + j) * Width + x + i].m_Index = pStamp->m_Index + 16 * j + i;
+				break;
+			}
+		}
+	}
+}
+
+static bool Run(const CTile *pGameTiles, int Width, int Height, int Rounds, const CMapGen::CDoodadStamp *pStamps, int NumStamps, const char *pName)
+{
+	std::vector<CTile> vScan(Width * Height);
+	std::vector<CTile> vFast(Width * Height);
+
+	int64 ScanTime = 0;
+	int64 FastTime = 0;
+	for(int r = 0; r < Rounds; r++)
+	{
+		mem_zero(vScan.data(), sizeof(CTile) * vScan.size());
+		mem_zero(vFast.data(), sizeof(CTile) * vFast.size());
+
+		int64 Start = time_get();
+		PlaceDoodadsScan(pGameTiles, vScan.data(), Width, Height, pStamps, NumStamps);
+		int64 Scanned = time_get();
+		CMapGen::PlaceDoodads(pGameTiles, vFast.data(), Width, Height, pStamps, NumStamps);
+		FastTime += time_get() - Scanned;
+		ScanTime += Scanned - Start;
+	}
+
+	int NumPlaced = 0;
+	for(int i = 0; i < Width * Height; i++)
+	{
+		if(vScan[i].m_Index != vFast[i].m_Index)
+		{
+			dbg_msg("mapgen", "%s: mismatch at %d,%d", pName, i % Width, i / Width);
+			return false;
+		}
+		NumPlaced += vScan[i].m_Index != 0;
+	}
+
+	double Freq = (double)time_freq();
+	dbg_msg("mapgen", "%-7s %dx%d, %d doodad tiles: scan %8.2f ms, runs %8.2f ms", pName, Width, Height, NumPlaced,
+		ScanTime * 1000.0 / Freq / Rounds, FastTime * 1000.0 / Freq / Rounds);
+	return true;
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+
+	int Width = clamp(argc > 1 ? str_toint(argv[1]) : 2000, 16, 2000); // ignore_convention
+	int Height = clamp(argc > 2 ? str_toint(argv[2]) : 2000, 16, 2000); // ignore_convention
+	int Rounds = maximum(argc > 3 ? str_toint(argv[3]) : 5, 1); // ignore_convention
+
+	std::vector<CTile> vGameTiles(Width * Height);
+	GenerateGameTiles(vGameTiles.data(), Width, Height);
+
+	static const CMapGen::CDoodadStamp s_aJungle[] = {
+		{6, 9, 3},
+	};
+	static const CMapGen::CDoodadStamp s_aMixed[] = {
+		{0, 12, 4},
+		{6, 9, 3},
+		{64, 3, 2},
+		{128, 1, 1},
+	};
+
+	if(!Run(vGameTiles.data(), Width, Height, Rounds, s_aJungle, sizeof(s_aJungle) / sizeof(s_aJungle[0]), "jungle") ||
+		!Run(vGameTiles.data(), Width, Height, Rounds, s_aMixed, sizeof(s_aMixed) / sizeof(s_aMixed[0]), "mixed"))
+		return 1;
+	return 0;
+}
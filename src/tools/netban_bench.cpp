@@ -0,0 +1,208 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/config.h>
+#include <engine/console.h>
+#include <engine/shared/config.h>
+#include <engine/shared/netban.h>
+
+#include <vector>
+
+/*
+	Fills a ban list with synthetic address and range bans, checks
+	IsBanned against a plain scan over all bans and measures the adds,
+	lookups, unbans and the expiry of timed bans.
+
+	Usage: netban_bench [bans] [lookups]
+*/
+
+static unsigned s_Seed = 1;
+
+static unsigned Random()
+{
+	s_Seed = s_Seed * 1103515245 + 12345;
+	return (s_Seed >> 16) & 0x7fff;
+}
+
+static void RandomAddr(NETADDR *pAddr)
+{
+	mem_zero(pAddr, sizeof(*pAddr));
+	pAddr->type = Random() % 8 ? NETTYPE_IPV4 : NETTYPE_IPV6;
+	for(int i = 0; i < (pAddr->type == NETTYPE_IPV4 ? 4 : 16); i++)
+		pAddr->ip[i] = Random();
+	// stay away from localhost, it can not be banned
+	if(pAddr->type == NETTYPE_IPV4 && pAddr->ip[0] == 127)
+		pAddr->ip[0] = 128;
+}
+
+// random ranges between a single /24 and a few /16s
+static void RandomRange(CNetRange *pRange)
+{
+	RandomAddr(&pRange->m_LB);
+	pRange->m_UB = pRange->m_LB;
+	int Bytes = pRange->m_LB.type == NETTYPE_IPV4 ? 4 : 16;
+	if(Random() % 2)
+	{
+		pRange->m_LB.ip[Bytes - 1] = 0;
+		pRange->m_UB.ip[Bytes - 1] = 255;
+	}
+	else
+	{
+		pRange->m_LB.ip[Bytes - 1] = Random() % 128;
+		pRange->m_UB.ip[Bytes - 1] = 128 + Random() % 128;
+		pRange->m_UB.ip[Bytes - 2] = minimum(255, pRange->m_LB.ip[Bytes - 2] + (int)(Random() % 4));
+	}
+}
+
+class CBenchBan : public CNetBan
+{
+public:
+	std::vector<NETADDR> m_aAddrs;
+	std::vector<CNetRange> m_aRanges;
+
+	bool ScanBanned(const NETADDR *pAddr) const
+	{
+		for(const auto &Addr : m_aAddrs)
+			if(NetMatch(&Addr, pAddr))
+				return true;
+		for(const auto &Range : m_aRanges)
+			if(NetMatch(&Range, pAddr))
+				return true;
+		return false;
+	}
+};
+
+// half of the lookups go to banned addresses
+static void LookupAddr(const CBenchBan *pBan, NETADDR *pAddr)
+{
+	int Kind = Random() % 4;
+	if(Kind == 0 && !pBan->m_aAddrs.empty())
+		*pAddr = pBan->m_aAddrs[Random() * 32768 % pBan->m_aAddrs.size()];
+	else if(Kind == 1 && !pBan->m_aRanges.empty())
+	{
+		*pAddr = pBan->m_aRanges[(Random() * 32768 + Random()) % pBan->m_aRanges.size()].m_LB;
+		pAddr->ip[pAddr->type == NETTYPE_IPV4 ? 3 : 15] += Random() % 128;
+	}
+	else
+		RandomAddr(pAddr);
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+
+	int NumBans = maximum(argc > 1 ? str_toint(argv[1]) : 100000, 2); // ignore_convention
+	int NumLookups = maximum(argc > 2 ? str_toint(argv[2]) : 1000000, 1); // ignore_convention
+
+	IConfig *pConfig = CreateConfig();
+	pConfig->Reset();
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+
+	CBenchBan *pBan = new CBenchBan;
+	pBan->Init(pConsole, 0);
+
+	// one message per ban would dominate the measurement
+	g_Config.m_StdoutOutputLevel = -1;
+
+	int64 Start = time_get();
+	for(int i = 0; i < NumBans; i++)
+	{
+		if(i % 2)
+		{
+			CNetRange Range;
+			RandomRange(&Range);
+			if(pBan->BanRange(&Range, 0, "bench") == 0)
+				pBan->m_aRanges.push_back(Range);
+		}
+		else
+		{
+			NETADDR Addr;
+			RandomAddr(&Addr);
+			if(pBan->BanAddr(&Addr, (Random() % 60 + 1) * 60, "bench") == 0)
+				pBan->m_aAddrs.push_back(Addr);
+		}
+	}
+	int64 AddTime = time_get() - Start;
+	dbg_msg("netban", "added %d address and %d range bans in %.2f ms", (int)pBan->m_aAddrs.size(), (int)pBan->m_aRanges.size(), AddTime * 1000.0 / time_freq());
+
+	// compare with a scan over all bans
+	char aBuf[256];
+	for(int i = 0; i < 2000; i++)
+	{
+		NETADDR Addr;
+		LookupAddr(pBan, &Addr);
+		if(pBan->IsBanned(&Addr, aBuf, sizeof(aBuf)) != pBan->ScanBanned(&Addr))
+		{
+			char aAddrStr[NETADDR_MAXSTRSIZE];
+			net_addr_str(&Addr, aAddrStr, sizeof(aAddrStr), false);
+			dbg_msg("netban", "lookup mismatch for %s", aAddrStr);
+			return 1;
+		}
+	}
+
+	int NumBanned = 0;
+	Start = time_get();
+	for(int i = 0; i < NumLookups; i++)
+	{
+		NETADDR Addr;
+		LookupAddr(pBan, &Addr);
+		NumBanned += pBan->IsBanned(&Addr, aBuf, sizeof(aBuf));
+	}
+	int64 LookupTime = time_get() - Start;
+	dbg_msg("netban", "%d lookups, %d banned, %.3f us per lookup", NumLookups, NumBanned, LookupTime * 1000000.0 / time_freq() / NumLookups);
+
+	// unban every other range, the rest has to stay banned
+	Start = time_get();
+	std::vector<CNetRange> aKept;
+	for(int i = 0; i < (int)pBan->m_aRanges.size(); i++)
+	{
+		if(i % 2)
+			pBan->UnbanByRange(&pBan->m_aRanges[i]);
+		else
+			aKept.push_back(pBan->m_aRanges[i]);
+	}
+	int64 UnbanTime = time_get() - Start;
+	pBan->m_aRanges = aKept;
+	dbg_msg("netban", "removed %d range bans in %.2f ms", (int)aKept.size(), UnbanTime * 1000.0 / time_freq());
+
+	for(int i = 0; i < 2000; i++)
+	{
+		NETADDR Addr;
+		LookupAddr(pBan, &Addr);
+		if(pBan->IsBanned(&Addr, aBuf, sizeof(aBuf)) != pBan->ScanBanned(&Addr))
+		{
+			dbg_msg("netban", "lookup mismatch after unban");
+			return 1;
+		}
+	}
+
+	// timed bans leave through the expiry heap
+	std::vector<NETADDR> aShortBans;
+	for(int i = 0; i < 1000; i++)
+	{
+		NETADDR Addr;
+		RandomAddr(&Addr);
+		if(pBan->BanAddr(&Addr, 1, "bench") == 0)
+			aShortBans.push_back(Addr);
+	}
+	thread_sleep(2100);
+	Start = time_get();
+	pBan->Update();
+	int64 ExpireTime = time_get() - Start;
+	for(const auto &Addr : aShortBans)
+	{
+		if(pBan->IsBanned(&Addr, aBuf, sizeof(aBuf)) && !pBan->ScanBanned(&Addr))
+		{
+			dbg_msg("netban", "expired ban still active");
+			return 1;
+		}
+	}
+	dbg_msg("netban", "expired %d bans in %.2f ms", (int)aShortBans.size(), ExpireTime * 1000.0 / time_freq());
+
+	delete pBan;
+	delete pConsole;
+	delete pConfig;
+	return 0;
+}
@@ -0,0 +1,170 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/config.h>
+#include <engine/shared/config.h>
+#include <engine/shared/network.h>
+
+/*
+	Measures the per-connection bookkeeping of the server network code.
+	Connects a number of clients to a local CNetServer and then runs
+	network pumps like the server loop does: every client gets a vital
+	and a flushed snapshot sized chunk, then the server updates its
+	connections. Send and Update are timed separately.
+
+	Usage: netconn_bench [clients] [pumps] [port]
+*/
+
+enum
+{
+	SNAPSHOT_SIZE = 600,
+};
+
+static int NewClientCallback(int ClientID, void *pUser, bool Sixup) { return 0; }
+static int DelClientCallback(int ClientID, const char *pReason, void *pUser) { return 0; }
+
+static void PumpClients(CNetClient *pClients, int NumClients)
+{
+	for(int i = 0; i < NumClients; i++)
+	{
+		CNetChunk Chunk;
+		pClients[i].Update();
+		while(pClients[i].Recv(&Chunk))
+			;
+	}
+}
+
+static void PumpServer(CNetServer *pServer)
+{
+	CNetChunk Chunk;
+	SECURITY_TOKEN ResponseToken;
+	pServer->Update();
+	while(pServer->Recv(&Chunk, &ResponseToken))
+		;
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+	if(secure_random_init() != 0)
+	{
+		dbg_msg("secure", "could not initialize secure RNG");
+		return -1;
+	}
+	net_init();
+	CNetBase::Init();
+
+	IConfig *pConfig = CreateConfig();
+	pConfig->Reset();
+
+	int NumClients = clamp(argc > 1 ? str_toint(argv[1]) : (int)MAX_PLAYERS, 1, (int)NET_MAX_CLIENTS); // ignore_convention
+	int NumPumps = maximum(argc > 2 ? str_toint(argv[2]) : 5000, 1); // ignore_convention
+	int Port = argc > 3 ? str_toint(argv[3]) : 8399; // ignore_convention
+
+	// all clients come from localhost
+	g_Config.m_SvConnlimit = NumClients + 1;
+	g_Config.m_SvVanillaAntiSpoof = 0;
+
+	NETADDR ServerAddr;
+	mem_zero(&ServerAddr, sizeof(ServerAddr));
+	ServerAddr.type = NETTYPE_IPV4;
+	ServerAddr.ip[0] = 127;
+	ServerAddr.ip[3] = 1;
+	ServerAddr.port = Port;
+
+	CNetServer *pServer = new CNetServer;
+	if(!pServer->Open(ServerAddr, 0, NumClients, NumClients))
+	{
+		dbg_msg("netconn_bench", "could not open server socket on port %d", Port);
+		return -1;
+	}
+	pServer->SetCallbacks(NewClientCallback, DelClientCallback, 0);
+
+	CNetClient *pClients = new CNetClient[NumClients];
+	for(int i = 0; i < NumClients; i++)
+	{
+		NETADDR BindAddr;
+		mem_zero(&BindAddr, sizeof(BindAddr));
+		BindAddr.type = NETTYPE_IPV4;
+		if(!pClients[i].Open(BindAddr))
+		{
+			dbg_msg("netconn_bench", "could not open socket for client %d", i);
+			return -1;
+		}
+		pClients[i].Connect(&ServerAddr, 1);
+	}
+
+	// handshake
+	int64 Timeout = time_get() + time_freq() * 10;
+	int NumOnline = 0;
+	while(NumOnline < NumClients && time_get() < Timeout)
+	{
+		PumpClients(pClients, NumClients);
+		PumpServer(pServer);
+		thread_sleep(1);
+
+		NumOnline = 0;
+		for(int i = 0; i < NumClients; i++)
+			if(pClients[i].State() == NETSTATE_ONLINE)
+				NumOnline++;
+	}
+	if(NumOnline < NumClients)
+	{
+		dbg_msg("netconn_bench", "only %d of %d clients connected", NumOnline, NumClients);
+		return -1;
+	}
+	dbg_msg("netconn_bench", "%d clients connected, running %d pumps", NumClients, NumPumps);
+
+	static unsigned char s_aData[SNAPSHOT_SIZE];
+	for(int i = 0; i < SNAPSHOT_SIZE; i++)
+		s_aData[i] = i * 7;
+
+	int64 SendTime = 0;
+	int64 UpdateTime = 0;
+	for(int p = 0; p < NumPumps; p++)
+	{
+		int64 Start = time_get();
+		for(int i = 0; i < NumClients; i++)
+		{
+			CNetChunk Chunk;
+			Chunk.m_ClientID = i;
+			Chunk.m_pData = s_aData;
+
+			Chunk.m_Flags = NETSENDFLAG_VITAL;
+			Chunk.m_DataSize = 16;
+			pServer->Send(&Chunk);
+
+			Chunk.m_Flags = NETSENDFLAG_FLUSH;
+			Chunk.m_DataSize = SNAPSHOT_SIZE;
+			pServer->Send(&Chunk);
+		}
+		int64 Sent = time_get();
+		pServer->Update();
+		UpdateTime += time_get() - Sent;
+		SendTime += Sent - Start;
+
+		// acks and the rest of the pump are not measured
+		CNetChunk Chunk;
+		SECURITY_TOKEN ResponseToken;
+		while(pServer->Recv(&Chunk, &ResponseToken))
+			;
+		PumpClients(pClients, NumClients);
+	}
+
+	double Freq = (double)time_freq();
+	dbg_msg("netconn_bench", "send   %8.2f us per pump, %6.3f us per chunk", SendTime * 1000000.0 / Freq / NumPumps, SendTime * 1000000.0 / Freq / NumPumps / (NumClients * 2));
+	dbg_msg("netconn_bench", "update %8.2f us per pump, %6.3f us per connection", UpdateTime * 1000000.0 / Freq / NumPumps, UpdateTime * 1000000.0 / Freq / NumPumps / NumClients);
+
+	for(int i = 0; i < NumClients; i++)
+	{
+		pClients[i].Disconnect("netconn_bench done");
+		pClients[i].Close();
+	}
+	pServer->Close();
+	delete[] pClients;
+	delete pServer;
+	delete pConfig;
+	return 0;
+}
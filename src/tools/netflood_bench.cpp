@@ -0,0 +1,144 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/config.h>
+#include <engine/shared/config.h>
+#include <engine/shared/network.h>
+
+/*
+	Floods a local CNetServer with junk from one address and measures
+	how long the server receive loop spends per junk packet, once
+	without and once with the preauth flood shield.
+
+	Usage: netflood_bench [packets] [port]
+
+	The junk is a mix of random bytes, connectionless info requests
+	and vanilla connect messages, which the server answers with the
+	dummy map handshake.
+*/
+
+enum
+{
+	BATCH_SIZE = 64,
+};
+
+static int NewClientCallback(int ClientID, void *pUser, bool Sixup) { return 0; }
+static int DelClientCallback(int ClientID, const char *pReason, void *pUser) { return 0; }
+
+static unsigned s_Seed = 1;
+
+static unsigned Random()
+{
+	s_Seed = s_Seed * 1103515245 + 12345;
+	return (s_Seed >> 16) & 0x7fff;
+}
+
+static void SendJunk(NETSOCKET Socket, NETADDR *pAddr)
+{
+	unsigned char aData[NET_MAX_PACKETSIZE];
+	int Kind = Random() % 3;
+	if(Kind == 0)
+	{
+		int Size = 4 + Random() % 400;
+		for(int i = 0; i < Size; i++)
+			aData[i] = Random();
+		// plain packet header, random control or 0.7 packets could get a slot
+		aData[0] = 0;
+		net_udp_send(Socket, pAddr, aData, Size);
+	}
+	else if(Kind == 1)
+	{
+		static const unsigned char s_aGetInfo[] = {255, 255, 255, 255, 'g', 'i', 'e', '3', 0};
+		unsigned char aExtra[4] = {0};
+		CNetBase::SendPacketConnless(Socket, pAddr, s_aGetInfo, sizeof(s_aGetInfo), false, aExtra);
+	}
+	else
+		CNetBase::SendControlMsg(Socket, pAddr, 0, NET_CTRLMSG_CONNECT, 0, 0, NET_SECURITY_TOKEN_UNSUPPORTED);
+}
+
+static double Flood(CNetServer *pServer, NETSOCKET Socket, NETADDR *pAddr, int NumPackets)
+{
+	s_Seed = 1;
+	pServer->FloodShield()->ResetCounters();
+
+	int64 RecvTime = 0;
+	for(int Sent = 0; Sent < NumPackets; Sent += BATCH_SIZE)
+	{
+		for(int i = 0; i < BATCH_SIZE; i++)
+			SendJunk(Socket, pAddr);
+		thread_sleep(1);
+
+		// one network pump, only the receive loop is measured
+		pServer->Update();
+		CNetChunk Chunk;
+		SECURITY_TOKEN ResponseToken;
+		int64 Start = time_get();
+		while(pServer->Recv(&Chunk, &ResponseToken))
+			;
+		RecvTime += time_get() - Start;
+	}
+
+	const CNetFloodShield::CCounters &Counters = pServer->FloodShield()->Counters();
+	dbg_msg("netflood", "rate=%d: %d packets, %lld checked, %lld dropped by the shield",
+		g_Config.m_SvPreauthRate, NumPackets, Counters.m_NumChecked, Counters.m_NumDropped);
+	return RecvTime * 1000000.0 / time_freq() / NumPackets;
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+	if(secure_random_init() != 0)
+	{
+		dbg_msg("secure", "could not initialize secure RNG");
+		return -1;
+	}
+	net_init();
+	CNetBase::Init();
+
+	IConfig *pConfig = CreateConfig();
+	pConfig->Reset();
+
+	int NumPackets = maximum(argc > 1 ? str_toint(argv[1]) : 200000, (int)BATCH_SIZE); // ignore_convention
+	int Port = argc > 2 ? str_toint(argv[2]) : 8398; // ignore_convention
+
+	NETADDR ServerAddr;
+	mem_zero(&ServerAddr, sizeof(ServerAddr));
+	ServerAddr.type = NETTYPE_IPV4;
+	ServerAddr.ip[0] = 127;
+	ServerAddr.ip[3] = 1;
+	ServerAddr.port = Port;
+
+	CNetServer *pServer = new CNetServer;
+	if(!pServer->Open(ServerAddr, 0, 16, 16))
+	{
+		dbg_msg("netflood", "could not open server socket on port %d", Port);
+		return -1;
+	}
+	pServer->SetCallbacks(NewClientCallback, DelClientCallback, 0);
+
+	NETADDR BindAddr;
+	mem_zero(&BindAddr, sizeof(BindAddr));
+	BindAddr.type = NETTYPE_IPV4;
+	NETSOCKET Socket = net_udp_create(BindAddr, 0);
+	if(!Socket)
+	{
+		dbg_msg("netflood", "could not open flood socket");
+		return -1;
+	}
+
+	int Rate = g_Config.m_SvPreauthRate;
+	g_Config.m_SvPreauthRate = 0;
+	double Unlimited = Flood(pServer, Socket, &ServerAddr, NumPackets);
+	g_Config.m_SvPreauthRate = Rate;
+	double Limited = Flood(pServer, Socket, &ServerAddr, NumPackets);
+
+	dbg_msg("netflood", "receive loop per junk packet: %.3f us without the shield, %.3f us with the shield", Unlimited, Limited);
+
+	net_udp_close(Socket);
+	pServer->Close();
+	delete pServer;
+	delete pConfig;
+	return 0;
+}
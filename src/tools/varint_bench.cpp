@@ -0,0 +1,122 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/shared/compression.h>
+
+#include <vector>
+
+/*
+	Times CVariableInt::Compress and Decompress against the plain per
+	int Pack and Unpack loop on snapshot deltas written by the server's
+	dump_deltas command, and checks that both give the same output.
+
+	Usage: varint_bench <dump file> [rounds]
+*/
+
+static bool LoadDeltas(const char *pFilename, std::vector<int> *pInts, std::vector<int> *pSizes)
+{
+	IOHANDLE File = io_open(pFilename, IOFLAG_READ);
+	if(!File)
+	{
+		dbg_msg("varint", "failed to open '%s'", pFilename);
+		return false;
+	}
+
+	int NumInts;
+	while(io_read(File, &NumInts, sizeof(NumInts)) == sizeof(NumInts))
+	{
+		if(NumInts <= 0 || NumInts > 1024*1024)
+			break;
+		unsigned Offset = pInts->size();
+		pInts->resize(Offset + NumInts);
+		if(io_read(File, pInts->data() + Offset, NumInts*sizeof(int)) != NumInts*sizeof(int))
+		{
+			pInts->resize(Offset);
+			break;
+		}
+		pSizes->push_back(NumInts);
+	}
+	io_close(File);
+
+	if(pSizes->empty())
+	{
+		dbg_msg("varint", "no deltas in '%s'", pFilename);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+
+	if(argc < 2) // ignore_convention
+	{
+		dbg_msg("varint", "usage: varint_bench <dump file> [rounds]");
+		return 1;
+	}
+	int NumRounds = maximum(argc > 2 ? str_toint(argv[2]) : 50, 1); // ignore_convention
+
+	std::vector<int> aDeltas;
+	std::vector<int> aDeltaSizes;
+	if(!LoadDeltas(argv[1], &aDeltas, &aDeltaSizes)) // ignore_convention
+		return 1;
+
+	std::vector<unsigned char> aPacked(aDeltas.size()*CVariableInt::MAX_BYTES_PACKED + 1);
+	std::vector<int> aUnpacked(aDeltas.size() + 1);
+	long PackedSize = 0;
+	long Check = 0;
+
+	// the reference is the plain per int loop the batch coders replaced
+	int64 Start = time_get();
+	for(int r = 0; r < NumRounds; r++)
+	{
+		const int *pSrc = aDeltas.data();
+		for(unsigned d = 0; d < aDeltaSizes.size(); pSrc += aDeltaSizes[d++])
+		{
+			unsigned char *pDst = aPacked.data();
+			unsigned char *pDstEnd = pDst + aPacked.size();
+			for(int i = 0; i < aDeltaSizes[d] && pDst; i++)
+				pDst = CVariableInt::Pack(pDst, pSrc[i], pDstEnd - pDst);
+			Check += pDst - aPacked.data();
+		}
+	}
+	int64 PackReference = time_get() - Start;
+
+	Start = time_get();
+	for(int r = 0; r < NumRounds; r++)
+	{
+		const int *pSrc = aDeltas.data();
+		for(unsigned d = 0; d < aDeltaSizes.size(); pSrc += aDeltaSizes[d++])
+			Check -= CVariableInt::Compress(pSrc, aDeltaSizes[d]*sizeof(int), aPacked.data(), aPacked.size());
+	}
+	int64 PackBatch = time_get() - Start;
+
+	// pack everything once more as one stream for the decoders
+	PackedSize = CVariableInt::Compress(aDeltas.data(), aDeltas.size()*sizeof(int), aPacked.data(), aPacked.size());
+
+	Start = time_get();
+	for(int r = 0; r < NumRounds; r++)
+	{
+		const unsigned char *pSrc = aPacked.data();
+		const unsigned char *pSrcEnd = pSrc + PackedSize;
+		int *pDst = aUnpacked.data();
+		while(pSrc && pSrc < pSrcEnd)
+			pSrc = CVariableInt::Unpack(pSrc, pDst++, pSrcEnd - pSrc);
+	}
+	int64 UnpackReference = time_get() - Start;
+
+	Start = time_get();
+	for(int r = 0; r < NumRounds; r++)
+		CVariableInt::Decompress(aPacked.data(), PackedSize, aUnpacked.data(), aUnpacked.size()*sizeof(int));
+	int64 UnpackBatch = time_get() - Start;
+
+	bool Match = mem_comp(aUnpacked.data(), aDeltas.data(), aDeltas.size()*sizeof(int)) == 0;
+	dbg_msg("varint", "%d deltas, %d ints, %ld bytes packed, output %s", (int)aDeltaSizes.size(), (int)aDeltas.size(),
+		PackedSize, Match && Check == 0 ? "identical" : "DIFFERENT");
+	dbg_msg("varint", "compress reference=%lldus batch=%lldus, decompress reference=%lldus batch=%lldus (%d rounds)",
+		PackReference*1000000/time_freq(), PackBatch*1000000/time_freq(), UnpackReference*1000000/time_freq(), UnpackBatch*1000000/time_freq(), NumRounds);
+	return Match && Check == 0 ? 0 : 1;
+}